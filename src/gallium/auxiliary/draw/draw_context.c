@@ -267,6 +267,10 @@ void draw_set_rasterizer_state( struct draw_context *draw,
  * Some hardware can turn off clipping altogether - in particular any
  * hardware with a TNL unit can do its own clipping, even if it is
  * relying on the draw module for some other reason.
+ *
+ * With guard_band_xy, only primitives reaching more than twice the
+ * viewport size away from its center are clipped in x/y.  The driver
+ * must then discard the pixels outside the viewport itself.
  */
 void draw_set_driver_clipping( struct draw_context *draw,
                                boolean bypass_clip_xy,
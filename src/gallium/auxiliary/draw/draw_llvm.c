@@ -45,11 +45,15 @@
 #include "gallivm/lp_bld_init.h"
 #include "gallivm/lp_bld_type.h"
 #include "gallivm/lp_bld_pack.h"
+#include "gallivm/lp_bld_cache.h"
 #include "gallivm/lp_bld_format.h"
 
 #include "tgsi/tgsi_exec.h"
 #include "tgsi/tgsi_dump.h"
+#include "tgsi/tgsi_parse.h"
+#include "os/os_time.h"
 
+#include "util/u_inlines.h"
 #include "util/u_math.h"
 #include "util/u_pointer.h"
 #include "util/u_string.h"
@@ -496,6 +500,9 @@ draw_llvm_create(struct draw_context *draw)
    llvm->nr_gs_variants = 0;
    make_empty_list(&llvm->gs_variants_list);
 
+   draw_llvm_cache_init();
+   draw_llvm_async_init();
+
    return llvm;
 }
 
@@ -506,13 +513,188 @@ draw_llvm_create(struct draw_context *draw)
 void
 draw_llvm_destroy(struct draw_llvm *llvm)
 {
+   draw_llvm_async_fini();
+   draw_llvm_cache_fini();
+
    /* XXX free other draw_llvm data? */
    FREE(llvm);
 }
 
 
+/**
+ * Build the key of the shared code cache: the variant key plus all the
+ * other state the generated code depends on.  The disk cache key starts
+ * out with the build, LLVM version and CPU features, which also keeps
+ * code of different processes apart.
+ */
+static void
+make_code_key(struct draw_llvm *llvm,
+              unsigned num_inputs,
+              const struct draw_llvm_variant_key *key,
+              struct gallivm_cache_key *code_key)
+{
+   struct draw_context *draw = llvm->draw;
+   struct llvm_vertex_shader *shader =
+      llvm_vertex_shader(draw->vs.vertex_shader);
+   const struct tgsi_token *tokens = shader->base.state.tokens;
+   unsigned outputs[4];
+
+   gallivm_cache_key_init(code_key);
+
+   gallivm_cache_key_append(code_key, tokens,
+                            tgsi_num_tokens(tokens) *
+                            sizeof(struct tgsi_token));
+   gallivm_cache_key_append(code_key, key, shader->variant_key_size);
+   gallivm_cache_key_append(code_key, &num_inputs, sizeof num_inputs);
+
+   /* The fetch code covers all vertex elements, not only the ones in the
+    * variant key.
+    */
+   gallivm_cache_key_append(code_key, &draw->pt.nr_vertex_elements,
+                            sizeof draw->pt.nr_vertex_elements);
+   gallivm_cache_key_append(code_key, draw->pt.vertex_element,
+                            draw->pt.nr_vertex_elements *
+                            sizeof draw->pt.vertex_element[0]);
+
+   outputs[0] = draw_current_shader_position_output(draw);
+   outputs[1] = draw_current_shader_clipvertex_output(draw);
+   outputs[2] = draw_current_shader_clipdistance_output(draw, 0);
+   outputs[3] = draw_current_shader_clipdistance_output(draw, 1);
+   gallivm_cache_key_append(code_key, outputs, sizeof outputs);
+}
+
+
+/**
+ * Optimize and compile generated code, writing its IR to the disk cache
+ * first if asked to.  Called on the background thread for code compiled
+ * asynchronously.
+ */
+void
+draw_llvm_code_compile(struct draw_llvm_code *code)
+{
+   if (code->store) {
+      /* The disk cache is keyed on the same blob */
+      struct gallivm_cache_key key;
+
+      key.data.data = code->key;
+      key.data.size = code->key_size;
+      key.data.capacity = code->key_size;
+      gallivm_cache_store(&key, code->gallivm);
+   }
+
+   gallivm_compile_module(code->gallivm);
+
+   code->jit_func = (draw_jit_vert_func)
+         gallivm_jit_function(code->gallivm, code->function);
+
+   code->jit_func_elts = (draw_jit_vert_func_elts)
+         gallivm_jit_function(code->gallivm, code->function_elts);
+}
+
+
+/**
+ * Generate and compile the code of a variant, or load its IR from the
+ * disk cache.
+ * \param async  only generate the code and leave compiling it to the
+ *               background thread, unless it comes from the disk cache
+ * \param tier   optimization tier.  Peak tier code is never loaded from
+ *               the disk cache, as that doesn't tell the tiers apart.
+ */
+static struct draw_llvm_code *
+compile_variant(struct draw_llvm *llvm,
+                struct draw_llvm_variant *variant,
+                unsigned num_inputs,
+                const struct gallivm_cache_key *code_key,
+                boolean async,
+                enum gallivm_tier tier)
+{
+   struct draw_llvm_code *code;
+   int64_t t0 = os_time_get();
+   boolean use_cache = gallivm_cache_enabled();
+   boolean cached = FALSE;
+
+   code = CALLOC_STRUCT(draw_llvm_code);
+   if (!code)
+      return NULL;
+
+   code->key = MALLOC(code_key->data.size);
+   if (!code->key) {
+      FREE(code);
+      return NULL;
+   }
+   memcpy(code->key, code_key->data.data, code_key->data.size);
+   code->key_size = code_key->data.size;
+   pipe_reference_init(&code->reference, 1);
+
+   if (use_cache && tier != GALLIVM_TIER_PEAK) {
+      variant->gallivm = gallivm_cache_load(code_key);
+      if (variant->gallivm) {
+         variant->function =
+            LLVMGetNamedFunction(variant->gallivm->module, "draw_llvm_shader");
+         variant->function_elts =
+            LLVMGetNamedFunction(variant->gallivm->module, "draw_llvm_shader_elts");
+         cached = variant->function && variant->function_elts;
+         if (!cached) {
+            /* Stale or foreign entry */
+            gallivm_destroy(variant->gallivm);
+            variant->gallivm = NULL;
+         }
+      }
+   }
+
+   if (cached) {
+      tier = GALLIVM_TIER_DEFAULT;
+      async = FALSE;
+   }
+   else {
+      LLVMTypeRef vertex_header;
+
+      if (async || tier != GALLIVM_TIER_DEFAULT)
+         variant->gallivm = gallivm_create_private(tier);
+      else
+         variant->gallivm = gallivm_create();
+      if (!variant->gallivm) {
+         FREE(code->key);
+         FREE(code);
+         return NULL;
+      }
+
+      create_jit_types(variant);
+
+      vertex_header = create_jit_vertex_header(variant->gallivm, num_inputs);
+
+      variant->vertex_header_ptr_type = LLVMPointerType(vertex_header, 0);
+
+      draw_llvm_generate(llvm, variant, FALSE);  /* linear */
+      draw_llvm_generate(llvm, variant, TRUE);   /* elts */
+
+      /* Don't let fast tier code stand in for better code in later runs */
+      code->store = use_cache && tier != GALLIVM_TIER_FAST;
+   }
+
+   code->tier = tier;
+   code->gallivm = variant->gallivm;
+   code->function = variant->function;
+   code->function_elts = variant->function_elts;
+
+   if (async) {
+      draw_llvm_async_compile(code);
+   }
+   else {
+      draw_llvm_code_compile(code);
+      code->ready = TRUE;
+   }
+
+   /* Only the time spent on this thread */
+   code->compile_time = os_time_get() - t0;
+
+   return code;
+}
+
+
 /**
  * Create LLVM-generated code for a vertex shader.
+ * The code is shared with identical variants of any other draw context.
  */
 struct draw_llvm_variant *
 draw_llvm_create_variant(struct draw_llvm *llvm,
@@ -522,36 +704,61 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
    struct draw_llvm_variant *variant;
    struct llvm_vertex_shader *shader =
       llvm_vertex_shader(llvm->draw->vs.vertex_shader);
-   LLVMTypeRef vertex_header;
+   struct gallivm_cache_key code_key;
+   struct draw_llvm_code *code;
 
-   variant = MALLOC(sizeof *variant +
-                    shader->variant_key_size -
-                    sizeof variant->key);
+   variant = CALLOC(1, sizeof *variant +
+                       shader->variant_key_size -
+                       sizeof variant->key);
    if (variant == NULL)
       return NULL;
 
    variant->llvm = llvm;
 
-   variant->gallivm = gallivm_create();
-
-   create_jit_types(variant);
-
    memcpy(&variant->key, key, shader->variant_key_size);
 
-   vertex_header = create_jit_vertex_header(variant->gallivm, num_inputs);
+   make_code_key(llvm, num_inputs, key, &code_key);
 
-   variant->vertex_header_ptr_type = LLVMPointerType(vertex_header, 0);
+   code = draw_llvm_cache_find(code_key.data.data, code_key.data.size);
+   if (!code) {
+      /* The interpreter can't sample textures through the llvm samplers */
+      boolean async = draw_llvm_async_enabled() &&
+         shader->base.info.file_max[TGSI_FILE_SAMPLER] == -1 &&
+         shader->base.info.file_max[TGSI_FILE_SAMPLER_VIEW] == -1;
 
-   draw_llvm_generate(llvm, variant, FALSE);  /* linear */
-   draw_llvm_generate(llvm, variant, TRUE);   /* elts */
+      code = compile_variant(llvm, variant, num_inputs, &code_key, async,
+                             draw_llvm_tier_up_vertices() ?
+                             GALLIVM_TIER_FAST : GALLIVM_TIER_DEFAULT);
+      if (code)
+         code = draw_llvm_cache_add(code);
+   }
 
-   gallivm_compile_module(variant->gallivm);
+   gallivm_cache_key_fini(&code_key);
 
-   variant->jit_func = (draw_jit_vert_func)
-         gallivm_jit_function(variant->gallivm, variant->function);
+   if (!code) {
+      if (variant->gallivm)
+         gallivm_destroy(variant->gallivm);
+      FREE(variant);
+      return NULL;
+   }
 
-   variant->jit_func_elts = (draw_jit_vert_func_elts)
-         gallivm_jit_function(variant->gallivm, variant->function_elts);
+   variant->code = code;
+   variant->gallivm = code->gallivm;
+   variant->function = code->function;
+   variant->function_elts = code->function_elts;
+   variant->jit_func = NULL;
+   variant->jit_func_elts = NULL;
+   variant->num_inputs = num_inputs;
+
+   /* Draws use the interpreter until the code is compiled */
+   if (!draw_llvm_variant_ready(variant) && !shader->exec_shader) {
+      shader->exec_shader = draw_create_vs_exec(llvm->draw,
+                                                &shader->base.state);
+      if (!shader->exec_shader) {
+         draw_llvm_code_wait(code);
+         draw_llvm_variant_ready(variant);
+      }
+   }
 
    variant->shader = shader;
    variant->list_item_global.base = variant;
@@ -563,6 +770,58 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
 }
 
 
+/**
+ * Called as the code of the current variant gets hot: recompile it at the
+ * peak tier in the background, and switch over once that's ready.
+ */
+void
+draw_llvm_variant_tier_up(struct draw_llvm_variant *variant)
+{
+   struct draw_llvm *llvm = variant->llvm;
+   struct draw_llvm_code *code = variant->code;
+   struct draw_llvm_code *upgrade;
+
+   assert(llvm->draw->vs.vertex_shader == &variant->shader->base);
+
+   upgrade = draw_llvm_code_get_upgrade(code);
+   if (!upgrade) {
+      struct gallivm_cache_key code_key;
+
+      /* The draw state still is what the variant was made for */
+      make_code_key(llvm, variant->num_inputs, &variant->key, &code_key);
+      upgrade = compile_variant(llvm, variant, variant->num_inputs,
+                                &code_key, TRUE, GALLIVM_TIER_PEAK);
+      gallivm_cache_key_fini(&code_key);
+
+      /* compile_variant() left its state in the variant, restore ours */
+      variant->gallivm = code->gallivm;
+      variant->function = code->function;
+      variant->function_elts = code->function_elts;
+
+      if (!upgrade) {
+         /* Try again later */
+         variant->vertices = 0;
+         return;
+      }
+
+      upgrade = draw_llvm_code_set_upgrade(code, upgrade);
+   }
+
+   if (draw_llvm_code_ready(upgrade)) {
+      draw_llvm_cache_replace(upgrade);
+
+      draw_llvm_code_reference(&variant->code, upgrade);
+      variant->gallivm = upgrade->gallivm;
+      variant->function = upgrade->function;
+      variant->function_elts = upgrade->function_elts;
+      variant->jit_func = upgrade->jit_func;
+      variant->jit_func_elts = upgrade->jit_func_elts;
+   }
+
+   draw_llvm_code_reference(&upgrade, NULL);
+}
+
+
 static void
 generate_vs(struct draw_llvm_variant *variant,
             LLVMBuilderRef builder,
@@ -1052,6 +1311,7 @@ generate_clipmask(struct draw_llvm *llvm,
                   boolean clip_z,
                   boolean clip_user,
                   boolean clip_halfz,
+                  boolean guard_band_xy,
                   unsigned ucp_enable,
                   LLVMValueRef context_ptr,
                   boolean *have_clipdist)
@@ -1105,6 +1365,15 @@ generate_clipmask(struct draw_llvm *llvm,
 
    /* Cliptest, for hardwired planes */
    if (clip_xy) {
+      if (guard_band_xy) {
+         /* The guard band planes are twice as far out as the viewport
+          * ones, see draw_pt_post_vs_prepare().
+          */
+         LLVMValueRef half = lp_build_const_vec(gallivm, f32_type, 0.5);
+         pos_x = LLVMBuildFMul(builder, pos_x, half, "");
+         pos_y = LLVMBuildFMul(builder, pos_y, half, "");
+      }
+
       /* plane 1 */
       test = lp_build_compare(gallivm, f32_type, PIPE_FUNC_GREATER, pos_x , pos_w);
       temp = shift;
@@ -1605,6 +1874,7 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant,
                                          key->clip_z,
                                          key->clip_user,
                                          key->clip_halfz,
+                                         key->guard_band_xy,
                                          key->ucp_enable,
                                          context_ptr, &have_clipdist);
             temp = LLVMBuildOr(builder, clipmask, temp, "");
@@ -1672,6 +1942,7 @@ draw_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
    key->clip_user = llvm->draw->clip_user;
    key->bypass_viewport = llvm->draw->identity_viewport;
    key->clip_halfz = llvm->draw->rasterizer->clip_halfz;
+   key->guard_band_xy = llvm->draw->guard_band_xy;
    key->need_edgeflags = (llvm->draw->vs.edgeflag_output ? TRUE : FALSE);
    key->ucp_enable = llvm->draw->rasterizer->clip_plane_enable;
    key->has_gs = llvm->draw->gs.geometry_shader != NULL;
@@ -1723,6 +1994,7 @@ draw_llvm_dump_variant_key(struct draw_llvm_variant_key *key)
    debug_printf("clip_user = %u\n", key->clip_user);
    debug_printf("bypass_viewport = %u\n", key->bypass_viewport);
    debug_printf("clip_halfz = %u\n", key->clip_halfz);
+   debug_printf("guard_band_xy = %u\n", key->guard_band_xy);
    debug_printf("need_edgeflags = %u\n", key->need_edgeflags);
    debug_printf("has_gs = %u\n", key->has_gs);
    debug_printf("ucp_enable = %u\n", key->ucp_enable);
@@ -1826,17 +2098,7 @@ draw_llvm_destroy_variant(struct draw_llvm_variant *variant)
 {
    struct draw_llvm *llvm = variant->llvm;
 
-   if (variant->function_elts) {
-      gallivm_free_function(variant->gallivm,
-                            variant->function_elts, variant->jit_func_elts);
-   }
-
-   if (variant->function) {
-      gallivm_free_function(variant->gallivm,
-                            variant->function, variant->jit_func);
-   }
-
-   gallivm_destroy(variant->gallivm);
+   draw_llvm_code_reference(&variant->code, NULL);
 
    remove_from_list(&variant->list_item_local);
    variant->shader->variants_cached--;
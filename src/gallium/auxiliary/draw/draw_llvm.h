@@ -35,6 +35,7 @@
 
 #include "gallivm/lp_bld_sample.h"
 #include "gallivm/lp_bld_limits.h"
+#include "gallivm/lp_bld_init.h"
 
 #include "pipe/p_context.h"
 #include "util/u_simple_list.h"
@@ -290,8 +291,9 @@ struct draw_llvm_variant_key
     * it is important there are no holes in this struct
     * (and all padding gets zeroed).
     */
+   unsigned guard_band_xy:1;
    unsigned ucp_enable:PIPE_MAX_CLIP_PLANES;
-   unsigned pad1:32-PIPE_MAX_CLIP_PLANES;
+   unsigned pad1:32-PIPE_MAX_CLIP_PLANES-1;
 
    /* Variable number of vertex elements:
     */
@@ -359,9 +361,74 @@ struct draw_gs_llvm_variant_list_item
 };
 
 
+/**
+ * The compiled code of a vertex shader variant.
+ *
+ * Kept in a cache shared by all draw contexts of the process (see
+ * draw_llvm_cache.c), so contexts running the same vertex pipeline only
+ * compile it once.  Reference counted: the cache and every variant using
+ * it hold a reference.
+ */
+struct draw_llvm_code
+{
+   struct pipe_reference reference;
+
+   struct gallivm_state *gallivm;
+   LLVMValueRef function;
+   LLVMValueRef function_elts;
+   draw_jit_vert_func jit_func;
+   draw_jit_vert_func_elts jit_func_elts;
+
+   /**
+    * Whether the jit functions can be called.  Code compiled in the
+    * background is shared before it is ready, see draw_llvm_async.c.
+    */
+   boolean ready;
+
+   /** Optimization tier, see DRAW_TIER_UP_VERTICES */
+   enum gallivm_tier tier;
+
+   /** Write the IR to the disk cache once optimized */
+   boolean store;
+
+   /**
+    * The same code recompiled at a higher tier once it got hot.  Replaces
+    * this in the cache and in the variants once it's ready.
+    */
+   struct draw_llvm_code *upgrade;
+
+   /** Time it took to generate and compile, in usecs */
+   int64_t compile_time;
+
+   /** Everything the generated code depends on, see make_code_key() */
+   void *key;
+   unsigned key_size;
+   unsigned hash;
+
+   /** LRU list of the cache */
+   struct draw_llvm_code *next, *prev;
+
+   /** Background compile queue */
+   struct draw_llvm_code *next_job;
+};
+
+
+struct draw_llvm_cache_stats
+{
+   unsigned hits;
+   unsigned misses;
+   unsigned evictions;
+   unsigned entries;
+   int64_t compile_time;   /**< usecs spent compiling cached code */
+   int64_t time_saved;     /**< usecs of compiling avoided by hits */
+};
+
+
 struct draw_llvm_variant
 {
+   /** The gallivm state of code, only owned while generating it */
    struct gallivm_state *gallivm;
+   struct draw_llvm_code *code;
 
    /* LLVM JIT builder types */
    LLVMTypeRef context_ptr_type;
@@ -374,6 +441,11 @@ struct draw_llvm_variant
    draw_jit_vert_func jit_func;
    draw_jit_vert_func_elts jit_func_elts;
 
+   unsigned num_inputs;
+
+   /** Vertices shaded with code below the peak tier */
+   unsigned vertices;
+
    struct llvm_vertex_shader *shader;
 
    struct draw_llvm *llvm;
@@ -417,6 +489,9 @@ struct llvm_vertex_shader {
    struct draw_llvm_variant_list_item variants;
    unsigned variants_created;
    unsigned variants_cached;
+
+   /** Interpreted copy, used while variants compile in the background */
+   struct draw_vertex_shader *exec_shader;
 };
 
 struct llvm_geometry_shader {
@@ -479,6 +554,82 @@ void
 draw_llvm_dump_variant_key(struct draw_llvm_variant_key *key);
 
 
+void
+draw_llvm_cache_init(void);
+
+void
+draw_llvm_cache_fini(void);
+
+struct draw_llvm_code *
+draw_llvm_cache_find(const void *key, unsigned key_size);
+
+struct draw_llvm_code *
+draw_llvm_cache_add(struct draw_llvm_code *code);
+
+void
+draw_llvm_code_reference(struct draw_llvm_code **ptr,
+                         struct draw_llvm_code *code);
+
+void
+draw_llvm_cache_replace(struct draw_llvm_code *code);
+
+void
+draw_llvm_cache_get_stats(struct draw_llvm_cache_stats *stats);
+
+
+void
+draw_llvm_async_init(void);
+
+void
+draw_llvm_async_fini(void);
+
+boolean
+draw_llvm_async_enabled(void);
+
+unsigned
+draw_llvm_tier_up_vertices(void);
+
+void
+draw_llvm_async_compile(struct draw_llvm_code *code);
+
+boolean
+draw_llvm_code_ready(struct draw_llvm_code *code);
+
+void
+draw_llvm_code_wait(struct draw_llvm_code *code);
+
+void
+draw_llvm_code_compile(struct draw_llvm_code *code);
+
+struct draw_llvm_code *
+draw_llvm_code_get_upgrade(struct draw_llvm_code *code);
+
+struct draw_llvm_code *
+draw_llvm_code_set_upgrade(struct draw_llvm_code *code,
+                           struct draw_llvm_code *upgrade);
+
+void
+draw_llvm_variant_tier_up(struct draw_llvm_variant *variant);
+
+
+/**
+ * Check whether the code of a vertex shader variant has been compiled, and
+ * pick up the jit functions once it has.
+ */
+static INLINE boolean
+draw_llvm_variant_ready(struct draw_llvm_variant *variant)
+{
+   if (!variant->jit_func) {
+      if (!draw_llvm_code_ready(variant->code))
+         return FALSE;
+
+      variant->jit_func = variant->code->jit_func;
+      variant->jit_func_elts = variant->code->jit_func_elts;
+   }
+   return TRUE;
+}
+
+
 struct draw_gs_llvm_variant *
 draw_gs_llvm_create_variant(struct draw_llvm *llvm,
                             unsigned num_vertex_header_attribs,
@@ -0,0 +1,302 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Background compilation of vertex shader variants.
+ *
+ * With DRAW_ASYNC_COMPILE set, a new variant's IR is still generated on the
+ * calling thread, since that depends on lots of draw state, but in an LLVM
+ * context of its own.  The optimization and code generation, which take
+ * most of the time, are then left to a worker thread, and the draws shade
+ * with the variant's interpreted copy of the shader.  Once the code is
+ * ready, it's picked up by draw_llvm_variant_ready().
+ *
+ * With DRAW_TIER_UP_VERTICES set, new variants are compiled at the fast
+ * tier instead, and counted the vertices they shade.  Once that reaches
+ * the threshold, the variant is regenerated at the peak tier and handed to
+ * the worker, while the draws go on with the fast code.  When the peak
+ * tier code is ready, it's attached as the upgrade of the fast code, which
+ * every variant using that picks up in draw_llvm_variant_tier_up().
+ *
+ * The queue holds a reference to each pending code object, so it can't go
+ * away while it's being compiled.  There is one worker for the process,
+ * running while at least one draw_llvm object is alive.
+ */
+
+#include "os/os_thread.h"
+#include "util/u_debug.h"
+#include "util/u_inlines.h"
+
+#include "gallivm/lp_bld_init.h"
+
+#include "draw_llvm.h"
+
+
+DEBUG_GET_ONCE_BOOL_OPTION(draw_async_compile, "DRAW_ASYNC_COMPILE", FALSE)
+DEBUG_GET_ONCE_NUM_OPTION(draw_tier_up_vertices, "DRAW_TIER_UP_VERTICES", 0)
+
+
+static struct {
+   /** Number of draw_llvm objects alive */
+   unsigned users;
+
+   /** Whether the worker is running */
+   boolean running;
+   boolean async_compile;
+   unsigned tier_up_vertices;
+
+   boolean exit_flag;
+   pipe_thread thread;
+
+   /** Pending jobs, oldest first */
+   struct draw_llvm_code *head, *tail;
+
+   /** Signalled when a job is queued or some code becomes ready */
+   pipe_condvar cond;
+} async;
+
+pipe_static_mutex(async_mutex);
+
+
+static PIPE_THREAD_ROUTINE( compile_thread, init_data )
+{
+   pipe_mutex_lock(async_mutex);
+
+   while (1) {
+      struct draw_llvm_code *code;
+
+      while (!async.head && !async.exit_flag)
+         pipe_condvar_wait(async.cond, async_mutex);
+
+      if (async.exit_flag)
+         break;
+
+      code = async.head;
+      async.head = code->next_job;
+      if (!async.head)
+         async.tail = NULL;
+
+      pipe_mutex_unlock(async_mutex);
+      draw_llvm_code_compile(code);
+      pipe_mutex_lock(async_mutex);
+
+      code->ready = TRUE;
+      pipe_condvar_broadcast(async.cond);
+
+      pipe_mutex_unlock(async_mutex);
+      draw_llvm_code_reference(&code, NULL);
+      pipe_mutex_lock(async_mutex);
+   }
+
+   pipe_mutex_unlock(async_mutex);
+
+   return 0;
+}
+
+
+void
+draw_llvm_async_init(void)
+{
+   pipe_mutex_lock(async_mutex);
+
+   if (async.users++ == 0) {
+      async.async_compile = debug_get_option_draw_async_compile();
+      async.tier_up_vertices = debug_get_option_draw_tier_up_vertices();
+
+      if (async.async_compile || async.tier_up_vertices) {
+         async.exit_flag = FALSE;
+         pipe_condvar_init(async.cond);
+         async.thread = pipe_thread_create(compile_thread, NULL);
+         async.running = async.thread != 0;
+         if (!async.running)
+            pipe_condvar_destroy(async.cond);
+      }
+   }
+
+   pipe_mutex_unlock(async_mutex);
+}
+
+
+/**
+ * Stop the worker once the last draw_llvm object goes away.  Jobs that
+ * haven't been started are dropped; their code is never used again.
+ */
+void
+draw_llvm_async_fini(void)
+{
+   struct draw_llvm_code *jobs = NULL;
+
+   pipe_mutex_lock(async_mutex);
+
+   assert(async.users);
+   if (--async.users == 0 && async.running) {
+      async.exit_flag = TRUE;
+      pipe_condvar_broadcast(async.cond);
+      pipe_mutex_unlock(async_mutex);
+
+      pipe_thread_wait(async.thread);
+
+      pipe_mutex_lock(async_mutex);
+      jobs = async.head;
+      async.head = async.tail = NULL;
+      async.running = FALSE;
+      pipe_condvar_destroy(async.cond);
+   }
+
+   pipe_mutex_unlock(async_mutex);
+
+   while (jobs) {
+      struct draw_llvm_code *code = jobs;
+      jobs = code->next_job;
+      draw_llvm_code_reference(&code, NULL);
+   }
+}
+
+
+/** Whether new variants should be compiled in the background */
+boolean
+draw_llvm_async_enabled(void)
+{
+   return async.running && async.async_compile;
+}
+
+
+/**
+ * Number of vertices after which a variant is recompiled at the peak
+ * tier, or zero if new variants should be compiled at the default tier
+ * and left at that.
+ */
+unsigned
+draw_llvm_tier_up_vertices(void)
+{
+   return async.running ? async.tier_up_vertices : 0;
+}
+
+
+/**
+ * Queue generated but not yet compiled code for the worker.
+ */
+void
+draw_llvm_async_compile(struct draw_llvm_code *code)
+{
+   assert(async.running);
+   assert(!code->ready);
+   assert(code->gallivm->private_context);
+
+   /* The queue's own reference */
+   p_atomic_inc(&code->reference.count);
+   code->next_job = NULL;
+
+   pipe_mutex_lock(async_mutex);
+
+   if (async.tail)
+      async.tail->next_job = code;
+   else
+      async.head = code;
+   async.tail = code;
+
+   pipe_condvar_broadcast(async.cond);
+
+   pipe_mutex_unlock(async_mutex);
+}
+
+
+boolean
+draw_llvm_code_ready(struct draw_llvm_code *code)
+{
+   boolean ready;
+
+   pipe_mutex_lock(async_mutex);
+   ready = code->ready;
+   pipe_mutex_unlock(async_mutex);
+
+   return ready;
+}
+
+
+/**
+ * Block until the code has been compiled.
+ */
+void
+draw_llvm_code_wait(struct draw_llvm_code *code)
+{
+   pipe_mutex_lock(async_mutex);
+
+   while (!code->ready) {
+      assert(async.running);
+      pipe_condvar_wait(async.cond, async_mutex);
+   }
+
+   pipe_mutex_unlock(async_mutex);
+}
+
+
+/**
+ * Get the upgrade of code, if it's been recompiled at a higher tier.
+ * \return a new reference to the upgrade, or NULL
+ */
+struct draw_llvm_code *
+draw_llvm_code_get_upgrade(struct draw_llvm_code *code)
+{
+   struct draw_llvm_code *upgrade = NULL;
+
+   pipe_mutex_lock(async_mutex);
+   draw_llvm_code_reference(&upgrade, code->upgrade);
+   pipe_mutex_unlock(async_mutex);
+
+   return upgrade;
+}
+
+
+/**
+ * Make code queued for the worker the upgrade of code, unless another
+ * context did the same in the meantime.
+ * \return a reference to the upgrade in place, which replaces the one passed
+ *         in
+ */
+struct draw_llvm_code *
+draw_llvm_code_set_upgrade(struct draw_llvm_code *code,
+                           struct draw_llvm_code *upgrade)
+{
+   struct draw_llvm_code *old = NULL;
+
+   pipe_mutex_lock(async_mutex);
+   if (code->upgrade) {
+      draw_llvm_code_reference(&old, code->upgrade);
+   }
+   else {
+      draw_llvm_code_reference(&code->upgrade, upgrade);
+   }
+   pipe_mutex_unlock(async_mutex);
+
+   if (old) {
+      draw_llvm_code_reference(&upgrade, NULL);
+      return old;
+   }
+
+   return upgrade;
+}
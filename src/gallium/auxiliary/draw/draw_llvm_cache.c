@@ -0,0 +1,314 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Process-wide cache of compiled vertex shader variants.
+ *
+ * The variants themselves stay per shader and per draw context, since
+ * that's where the shaders live, but their code is looked up here first,
+ * in a hash table keyed on everything code generation depends on.  So
+ * contexts binding the same vertex pipeline share one compiled copy.
+ *
+ * The cache holds a reference to each entry, and drops the least recently
+ * used ones once it holds more than DRAW_LLVM_CACHE_SIZE entries.  Code
+ * still in use by a variant lives on until that variant is destroyed.
+ * It lives as long as at least one draw_llvm object does.
+ */
+
+#include "os/os_thread.h"
+#include "util/u_debug.h"
+#include "util/u_hash.h"
+#include "util/u_hash_table.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/u_simple_list.h"
+
+#include "gallivm/lp_bld_init.h"
+
+#include "draw_llvm.h"
+
+
+DEBUG_GET_ONCE_NUM_OPTION(draw_llvm_cache_size, "DRAW_LLVM_CACHE_SIZE", 512)
+DEBUG_GET_ONCE_BOOL_OPTION(draw_llvm_cache_stats, "DRAW_LLVM_CACHE_STATS", FALSE)
+
+
+static struct {
+   /** Number of draw_llvm objects alive */
+   unsigned users;
+
+   /** Max number of entries, zero if the cache is disabled */
+   unsigned size;
+
+   struct util_hash_table *table;
+   struct draw_llvm_code lru;
+
+   struct draw_llvm_cache_stats stats;
+} cache;
+
+pipe_static_mutex(cache_mutex);
+
+
+static unsigned
+code_hash(void *key)
+{
+   return ((const struct draw_llvm_code *) key)->hash;
+}
+
+
+static int
+code_compare(void *key1, void *key2)
+{
+   const struct draw_llvm_code *a = key1;
+   const struct draw_llvm_code *b = key2;
+
+   if (a->key_size != b->key_size)
+      return 1;
+   return memcmp(a->key, b->key, a->key_size);
+}
+
+
+static void
+code_destroy(struct draw_llvm_code *code)
+{
+   draw_llvm_code_reference(&code->upgrade, NULL);
+
+   if (code->function_elts) {
+      gallivm_free_function(code->gallivm,
+                            code->function_elts, code->jit_func_elts);
+   }
+
+   if (code->function) {
+      gallivm_free_function(code->gallivm,
+                            code->function, code->jit_func);
+   }
+
+   gallivm_destroy(code->gallivm);
+   FREE(code->key);
+   FREE(code);
+}
+
+
+void
+draw_llvm_code_reference(struct draw_llvm_code **ptr,
+                         struct draw_llvm_code *code)
+{
+   struct draw_llvm_code *old = *ptr;
+
+   if (pipe_reference(old ? &old->reference : NULL,
+                      code ? &code->reference : NULL)) {
+      code_destroy(old);
+   }
+   *ptr = code;
+}
+
+
+/** Drop the cache's reference to an entry.  Called with the mutex held. */
+static void
+cache_remove(struct draw_llvm_code *code)
+{
+   util_hash_table_remove(cache.table, code);
+   remove_from_list(code);
+   cache.stats.entries--;
+   draw_llvm_code_reference(&code, NULL);
+}
+
+
+void
+draw_llvm_cache_init(void)
+{
+   pipe_mutex_lock(cache_mutex);
+
+   if (cache.users++ == 0) {
+      cache.size = debug_get_option_draw_llvm_cache_size();
+      if (cache.size)
+         cache.table = util_hash_table_create(code_hash, code_compare);
+      if (!cache.table)
+         cache.size = 0;
+      make_empty_list(&cache.lru);
+      memset(&cache.stats, 0, sizeof cache.stats);
+   }
+
+   pipe_mutex_unlock(cache_mutex);
+}
+
+
+void
+draw_llvm_cache_fini(void)
+{
+   pipe_mutex_lock(cache_mutex);
+
+   assert(cache.users);
+   if (--cache.users == 0) {
+      const struct draw_llvm_cache_stats *stats = &cache.stats;
+
+      if (debug_get_option_draw_llvm_cache_stats() &&
+          stats->hits + stats->misses) {
+         debug_printf("draw: llvm variant cache: %u hits, %u misses, "
+                      "%u evictions, %.3f sec compiling, %.3f sec saved\n",
+                      stats->hits, stats->misses, stats->evictions,
+                      stats->compile_time / 1000000.0,
+                      stats->time_saved / 1000000.0);
+      }
+
+      while (!is_empty_list(&cache.lru))
+         cache_remove(last_elem(&cache.lru));
+
+      if (cache.table) {
+         util_hash_table_destroy(cache.table);
+         cache.table = NULL;
+      }
+   }
+
+   pipe_mutex_unlock(cache_mutex);
+}
+
+
+/**
+ * Look up the code for a key built by make_code_key().
+ * \return a new reference to the code, or NULL on a miss
+ */
+struct draw_llvm_code *
+draw_llvm_cache_find(const void *key, unsigned key_size)
+{
+   struct draw_llvm_code tmp, *code = NULL;
+
+   if (!cache.size)
+      return NULL;
+
+   tmp.key = (void *) key;
+   tmp.key_size = key_size;
+   tmp.hash = util_hash_crc32(key, key_size);
+
+   pipe_mutex_lock(cache_mutex);
+
+   code = util_hash_table_get(cache.table, &tmp);
+   if (code) {
+      move_to_head(&cache.lru, code);
+      p_atomic_inc(&code->reference.count);
+      cache.stats.hits++;
+      cache.stats.time_saved += code->compile_time;
+   }
+   else {
+      cache.stats.misses++;
+   }
+
+   pipe_mutex_unlock(cache_mutex);
+
+   return code;
+}
+
+
+/**
+ * Insert freshly compiled code.  If another context added the same code in
+ * the meantime, the new copy is released and the cached one returned
+ * instead.
+ * \return a reference to the cached code, which replaces the one passed in
+ */
+struct draw_llvm_code *
+draw_llvm_cache_add(struct draw_llvm_code *code)
+{
+   struct draw_llvm_code *old;
+
+   if (!cache.size)
+      return code;
+
+   code->hash = util_hash_crc32(code->key, code->key_size);
+
+   pipe_mutex_lock(cache_mutex);
+
+   old = util_hash_table_get(cache.table, code);
+   if (old) {
+      move_to_head(&cache.lru, old);
+      p_atomic_inc(&old->reference.count);
+      pipe_mutex_unlock(cache_mutex);
+
+      draw_llvm_code_reference(&code, NULL);
+      return old;
+   }
+
+   if (util_hash_table_set(cache.table, code, code) != PIPE_OK) {
+      pipe_mutex_unlock(cache_mutex);
+      return code;
+   }
+
+   /* The cache's own reference */
+   p_atomic_inc(&code->reference.count);
+   insert_at_head(&cache.lru, code);
+   cache.stats.entries++;
+   cache.stats.compile_time += code->compile_time;
+
+   while (cache.stats.entries > cache.size) {
+      cache_remove(last_elem(&cache.lru));
+      cache.stats.evictions++;
+   }
+
+   pipe_mutex_unlock(cache_mutex);
+
+   return code;
+}
+
+
+/**
+ * Put recompiled code in the place of the cached code with the same key,
+ * if it isn't there already.
+ */
+void
+draw_llvm_cache_replace(struct draw_llvm_code *code)
+{
+   struct draw_llvm_code *old;
+
+   if (!cache.size)
+      return;
+
+   code->hash = util_hash_crc32(code->key, code->key_size);
+
+   pipe_mutex_lock(cache_mutex);
+
+   old = util_hash_table_get(cache.table, code);
+   if (old != code) {
+      if (old)
+         cache_remove(old);
+
+      if (util_hash_table_set(cache.table, code, code) == PIPE_OK) {
+         p_atomic_inc(&code->reference.count);
+         insert_at_head(&cache.lru, code);
+         cache.stats.entries++;
+         cache.stats.compile_time += code->compile_time;
+      }
+   }
+
+   pipe_mutex_unlock(cache_mutex);
+}
+
+
+void
+draw_llvm_cache_get_stats(struct draw_llvm_cache_stats *stats)
+{
+   pipe_mutex_lock(cache_mutex);
+   *stats = cache.stats;
+   pipe_mutex_unlock(cache_mutex);
+}
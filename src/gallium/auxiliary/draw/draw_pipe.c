@@ -268,6 +268,9 @@ void draw_pipeline_run( struct draw_context *draw,
                     vert_info->count - 1);
    }
 
+   /* the clipper may still hold primitives referencing these vertices */
+   draw_clip_end_run(draw->pipeline.clip);
+
    draw->pipeline.verts = NULL;
    draw->pipeline.vertex_count = 0;
 }
@@ -338,6 +341,9 @@ void draw_pipeline_run_linear( struct draw_context *draw,
                       count);
    }
 
+   /* the clipper may still hold primitives referencing these vertices */
+   draw_clip_end_run(draw->pipeline.clip);
+
    draw->pipeline.verts = NULL;
    draw->pipeline.vertex_count = 0;
 }
@@ -34,6 +34,7 @@
 
 #include "util/u_memory.h"
 #include "util/u_math.h"
+#include "util/u_sse.h"
 
 #include "pipe/p_shader_tokens.h"
 
@@ -57,6 +58,13 @@
 
 #define MAX_CLIPPED_VERTICES ((2 * (6 + PIPE_MAX_CLIP_PLANES))+1)
 
+/**
+ * Max number of consecutive triangles clipped together.  Their plane
+ * distances are computed in one go, four vertices at a time.
+ */
+#define CLIP_BATCH_SIZE 16
+#define CLIP_BATCH_VERTS (CLIP_BATCH_SIZE * 3)
+
 
 
 struct clip_stage {
@@ -70,6 +78,17 @@ struct clip_stage {
    boolean noperspective_attribs[PIPE_MAX_SHADER_OUTPUTS];
 
    float (*plane)[4];
+
+   /* Triangles waiting to be clipped.  Only consecutive triangles which
+    * all need clipping are batched, so the order of the primitives
+    * reaching the next stage doesn't change.
+    */
+   unsigned num_batched;
+   struct prim_header batch[CLIP_BATCH_SIZE];
+   unsigned batch_clipmask[CLIP_BATCH_SIZE];
+
+   /** Plane distances of the batched vertices, [plane][vertex] */
+   float batch_dist[DRAW_TOTAL_CLIP_PLANES][CLIP_BATCH_VERTS];
 };
 
 
@@ -90,10 +109,18 @@ static void interp_attr( float dst[4],
 			 const float in[4],
 			 const float out[4] )
 {  
+#if defined(PIPE_ARCH_SSE)
+   /* Same operations as LINTERP, so the results are identical */
+   const __m128 vout = _mm_loadu_ps(out);
+   const __m128 vin = _mm_loadu_ps(in);
+   _mm_storeu_ps(dst, _mm_add_ps(vout, _mm_mul_ps(_mm_set1_ps(t),
+                                                  _mm_sub_ps(vin, vout))));
+#else
    dst[0] = LINTERP( t, out[0], in[0] );
    dst[1] = LINTERP( t, out[1], in[1] );
    dst[2] = LINTERP( t, out[2], in[2] );
    dst[3] = LINTERP( t, out[3], in[3] );
+#endif
 }
 
 
@@ -306,12 +333,118 @@ static INLINE float getclipdist(const struct clip_stage *clipper,
    return dp;
 }
 
+
+/**
+ * Compute the distances of all the batched triangles' vertices to all the
+ * planes any of them needs clipping against.  The positions are packed
+ * SoA so that four vertices are handled per plane and instruction.
+ * The arithmetic matches dot4(), so the results are the same as
+ * getclipdist() would return.
+ */
+static void
+clip_batch_distances( struct clip_stage *clipper )
+{
+   const unsigned num_verts = clipper->num_batched * 3;
+   unsigned planes = 0;
+   unsigned i, j;
+
+   for (i = 0; i < clipper->num_batched; i++)
+      planes |= clipper->batch_clipmask[i];
+
+   for (i = 0; i < num_verts; i += 4) {
+      const float *pos[4];
+      unsigned mask = planes;
+
+      for (j = 0; j < 4; j++) {
+         /* pad the last group with the first vertex */
+         const unsigned v = i + j < num_verts ? i + j : 0;
+         pos[j] = clipper->batch[v / 3].v[v % 3]->clip;
+      }
+
+#if defined(PIPE_ARCH_SSE)
+      {
+         __m128 x = _mm_loadu_ps(pos[0]);
+         __m128 y = _mm_loadu_ps(pos[1]);
+         __m128 z = _mm_loadu_ps(pos[2]);
+         __m128 w = _mm_loadu_ps(pos[3]);
+
+         _MM_TRANSPOSE4_PS(x, y, z, w);
+
+         while (mask) {
+            const unsigned plane_idx = ffs(mask) - 1;
+            const float *plane = clipper->plane[plane_idx];
+            __m128 dp;
+
+            dp = _mm_mul_ps(x, _mm_set1_ps(plane[0]));
+            dp = _mm_add_ps(dp, _mm_mul_ps(y, _mm_set1_ps(plane[1])));
+            dp = _mm_add_ps(dp, _mm_mul_ps(z, _mm_set1_ps(plane[2])));
+            dp = _mm_add_ps(dp, _mm_mul_ps(w, _mm_set1_ps(plane[3])));
+            _mm_storeu_ps(&clipper->batch_dist[plane_idx][i], dp);
+
+            mask &= ~(1 << plane_idx);
+         }
+      }
+#else
+      while (mask) {
+         const unsigned plane_idx = ffs(mask) - 1;
+
+         for (j = 0; j < 4; j++) {
+            clipper->batch_dist[plane_idx][i + j] =
+               dot4(pos[j], clipper->plane[plane_idx]);
+         }
+
+         mask &= ~(1 << plane_idx);
+      }
+#endif
+   }
+
+   /* Shader-written clip distances replace the user planes */
+   if (planes & ~0x3f) {
+      for (i = 0; i < num_verts; i++) {
+         struct vertex_header *vert = clipper->batch[i / 3].v[i % 3];
+
+         if (vert->have_clipdist) {
+            unsigned mask = planes & ~0x3f;
+
+            while (mask) {
+               const unsigned plane_idx = ffs(mask) - 1;
+               clipper->batch_dist[plane_idx][i] =
+                  getclipdist(clipper, vert, plane_idx);
+               mask &= ~(1 << plane_idx);
+            }
+         }
+      }
+   }
+}
+
+
+/**
+ * Plane distance of a polygon vertex.  orig is the index of the vertex in
+ * the original triangle, or -1 for vertices created by the clipper.
+ */
+static INLINE float
+poly_clipdist( const struct clip_stage *clipper,
+               const float *dist,
+               int orig,
+               struct vertex_header *vert,
+               int plane_idx )
+{
+   if (dist && orig >= 0)
+      return dist[plane_idx * CLIP_BATCH_VERTS + orig];
+
+   return getclipdist(clipper, vert, plane_idx);
+}
+
+
 /* Clip a triangle against the viewport and user clip planes.
+ * dist, if not NULL, holds the precomputed plane distances of the
+ * triangle's vertices, as laid out in clip_stage::batch_dist.
  */
 static void
 do_clip_tri( struct draw_stage *stage, 
 	     struct prim_header *header,
-	     unsigned clipmask )
+	     unsigned clipmask,
+             const float *dist )
 {
    struct clip_stage *clipper = clip_stage( stage );
    struct vertex_header *a[MAX_CLIPPED_VERTICES];
@@ -325,11 +458,19 @@ do_clip_tri( struct draw_stage *stage,
    boolean bEdges[MAX_CLIPPED_VERTICES];
    boolean *inEdges = aEdges;
    boolean *outEdges = bEdges;
+   int aOrig[MAX_CLIPPED_VERTICES];
+   int bOrig[MAX_CLIPPED_VERTICES];
+   int *inOrig = aOrig;
+   int *outOrig = bOrig;
 
    inlist[0] = header->v[0];
    inlist[1] = header->v[1];
    inlist[2] = header->v[2];
 
+   inOrig[0] = 0;
+   inOrig[1] = 1;
+   inOrig[2] = 2;
+
    if (DEBUG_CLIP) {
       const float *v0 = header->v[0]->clip;
       const float *v1 = header->v[1]->clip;
@@ -357,10 +498,11 @@ do_clip_tri( struct draw_stage *stage,
       const boolean is_user_clip_plane = plane_idx >= 6;
       struct vertex_header *vert_prev = inlist[0];
       boolean *edge_prev = &inEdges[0];
+      int orig_prev = inOrig[0];
       float dp_prev;
       unsigned outcount = 0;
 
-      dp_prev = getclipdist(clipper, vert_prev, plane_idx);
+      dp_prev = poly_clipdist(clipper, dist, orig_prev, vert_prev, plane_idx);
       clipmask &= ~(1<<plane_idx);
 
       assert(n < MAX_CLIPPED_VERTICES);
@@ -368,18 +510,21 @@ do_clip_tri( struct draw_stage *stage,
          return;
       inlist[n] = inlist[0]; /* prevent rotation of vertices */
       inEdges[n] = inEdges[0];
+      inOrig[n] = inOrig[0];
 
       for (i = 1; i <= n; i++) {
 	 struct vertex_header *vert = inlist[i];
          boolean *edge = &inEdges[i];
+         int orig = inOrig[i];
 
-         float dp = getclipdist(clipper, vert, plane_idx);
+         float dp = poly_clipdist(clipper, dist, orig, vert, plane_idx);
 
 	 if (!IS_NEGATIVE(dp_prev)) {
             assert(outcount < MAX_CLIPPED_VERTICES);
             if (outcount >= MAX_CLIPPED_VERTICES)
                return;
             outEdges[outcount] = *edge_prev;
+            outOrig[outcount] = orig_prev;
 	    outlist[outcount++] = vert_prev;
 	 }
 
@@ -397,6 +542,7 @@ do_clip_tri( struct draw_stage *stage,
                return;
 
             new_edge = &outEdges[outcount];
+            outOrig[outcount] = -1;
 	    outlist[outcount++] = new_vert;
 
 	    if (IS_NEGATIVE(dp)) {
@@ -436,6 +582,7 @@ do_clip_tri( struct draw_stage *stage,
 
 	 vert_prev = vert;
          edge_prev = edge;
+         orig_prev = orig;
 	 dp_prev = dp;
       }
 
@@ -451,6 +598,11 @@ do_clip_tri( struct draw_stage *stage,
          inEdges = outEdges;
          outEdges = tmp;
       }
+      {
+         int *tmp = inOrig;
+         inOrig = outOrig;
+         outOrig = tmp;
+      }
 
    }
 
@@ -541,10 +693,37 @@ do_clip_line( struct draw_stage *stage,
 }
 
 
+/**
+ * Clip the batched triangles, in order.
+ */
+static void
+clip_flush_batch( struct draw_stage *stage )
+{
+   struct clip_stage *clipper = clip_stage( stage );
+   unsigned i;
+
+   if (clipper->num_batched == 1) {
+      do_clip_tri(stage, &clipper->batch[0], clipper->batch_clipmask[0], NULL);
+   }
+   else if (clipper->num_batched) {
+      clip_batch_distances(clipper);
+
+      for (i = 0; i < clipper->num_batched; i++) {
+         do_clip_tri(stage, &clipper->batch[i], clipper->batch_clipmask[i],
+                     &clipper->batch_dist[0][i * 3]);
+      }
+   }
+
+   clipper->num_batched = 0;
+}
+
+
 static void
 clip_point( struct draw_stage *stage, 
 	    struct prim_header *header )
 {
+   clip_flush_batch( stage );
+
    if (header->v[0]->clipmask == 0) 
       stage->next->point( stage->next, header );
 }
@@ -556,6 +735,8 @@ clip_line( struct draw_stage *stage,
 {
    unsigned clipmask = (header->v[0]->clipmask | 
                         header->v[1]->clipmask);
+
+   clip_flush_batch( stage );
    
    if (clipmask == 0) {
       /* no clipping needed */
@@ -579,12 +760,18 @@ clip_tri( struct draw_stage *stage,
    
    if (clipmask == 0) {
       /* no clipping needed */
+      clip_flush_batch( stage );
       stage->next->tri( stage->next, header );
    }
    else if ((header->v[0]->clipmask & 
              header->v[1]->clipmask & 
              header->v[2]->clipmask) == 0) {
-      do_clip_tri(stage, header, clipmask);
+      struct clip_stage *clipper = clip_stage( stage );
+
+      clipper->batch[clipper->num_batched] = *header;
+      clipper->batch_clipmask[clipper->num_batched] = clipmask;
+      if (++clipper->num_batched == CLIP_BATCH_SIZE)
+         clip_flush_batch( stage );
    }
 }
 
@@ -704,6 +891,8 @@ static void clip_first_line( struct draw_stage *stage,
 static void clip_flush( struct draw_stage *stage, 
 			     unsigned flags )
 {
+   clip_flush_batch( stage );
+
    stage->tri = clip_first_tri;
    stage->line = clip_first_line;
    stage->next->flush( stage->next, flags );
@@ -712,6 +901,7 @@ static void clip_flush( struct draw_stage *stage,
 
 static void clip_reset_stipple_counter( struct draw_stage *stage )
 {
+   clip_flush_batch( stage );
    stage->next->reset_stipple_counter( stage->next );
 }
 
@@ -723,6 +913,16 @@ static void clip_destroy( struct draw_stage *stage )
 }
 
 
+/**
+ * Clip any triangles still batched.  Must be called before the vertices
+ * of a pipeline run go away.
+ */
+void draw_clip_end_run( struct draw_stage *stage )
+{
+   clip_flush_batch( stage );
+}
+
+
 /**
  * Allocate a new clipper stage.
  * \return pointer to new stage object
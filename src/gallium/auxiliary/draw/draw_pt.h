@@ -241,6 +241,57 @@ struct pt_post_vs *draw_pt_post_vs_create( struct draw_context *draw );
 void draw_pt_post_vs_destroy( struct pt_post_vs *pvs );
 
 
+/*******************************************************************************
+ * Post-transform vertex cache:
+ */
+struct pt_vcache;
+
+typedef int (*draw_pt_vcache_shade_func)( void *data,
+                                          const unsigned *elts,
+                                          unsigned count,
+                                          struct vertex_header *verts );
+
+void draw_pt_vcache_prepare( struct pt_vcache *vc,
+                             unsigned vertex_size,
+                             unsigned pad );
+
+void draw_pt_vcache_invalidate( struct pt_vcache *vc );
+
+int draw_pt_vcache_run( struct pt_vcache *vc,
+                        const unsigned *elts,
+                        unsigned count,
+                        unsigned num_prims,
+                        struct vertex_header *verts,
+                        draw_pt_vcache_shade_func shade,
+                        void *data );
+
+struct pt_vcache *draw_pt_vcache_create( struct draw_context *draw,
+                                         unsigned size );
+
+void draw_pt_vcache_destroy( struct pt_vcache *vc );
+
+
+/*******************************************************************************
+ * Worker threads for splitting vertex shading of a run across cores:
+ */
+#define DRAW_MAX_THREADS 8
+
+struct draw_pt_threads;
+
+typedef void (*draw_pt_thread_func)( void *data, unsigned slice );
+
+struct draw_pt_threads *draw_pt_threads_create( unsigned num_threads );
+
+unsigned draw_pt_threads_count( const struct draw_pt_threads *pool );
+
+void draw_pt_threads_run( struct draw_pt_threads *pool,
+                          draw_pt_thread_func func,
+                          void *data,
+                          unsigned num_slices );
+
+void draw_pt_threads_destroy( struct draw_pt_threads *pool );
+
+
 /*******************************************************************************
  * Utils: 
  */
@@ -25,6 +25,8 @@
  *
  **************************************************************************/
 
+#include "util/u_cpu_detect.h"
+#include "util/u_debug.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
@@ -39,6 +41,16 @@
 #include "gallivm/lp_bld_init.h"
 
 
+/**
+ * Don't bother handing vertex shading to the worker threads unless each
+ * of them gets at least this many vertices; waking them up isn't free.
+ */
+#define MIN_VERTICES_PER_THREAD 512
+
+/** Default number of vertices kept by the post-transform vertex cache */
+#define DEFAULT_VCACHE_SIZE 2048
+
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -56,6 +68,26 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   /** Worker threads for vertex shading, or NULL */
+   struct draw_pt_threads *threads;
+
+   /** Post-transform vertex cache for indexed draws, or NULL */
+   struct pt_vcache *vcache;
+};
+
+
+/**
+ * A vertex shader run split into slices for the worker threads.
+ * Every slice but the last is a multiple of the SIMD vector length, as the
+ * jit code always stores whole vectors of vertices.
+ */
+struct llvm_vs_job {
+   struct llvm_middle_end *fpme;
+   const struct draw_fetch_info *fetch_info;
+   struct vertex_header *verts;
+   unsigned slice_size;
+   int clipped[DRAW_MAX_THREADS + 1];
 };
 
 
@@ -184,6 +216,9 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
    /* return even number */
    *max_vertices = *max_vertices & ~1;
 
+   draw_pt_vcache_prepare( fpme->vcache, fpme->vertex_size,
+                           lp_native_vector_width / 32 );
+
    /* Find/create the vertex shader variant */
    {
       struct draw_llvm_variant_key *key;
@@ -246,6 +281,27 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
       fpme->current_variant = variant;
    }
 
+   /* Until the variant is compiled, vertices are fetched and shaded the
+    * same way as in the non-LLVM middle end.
+    */
+   if (fpme->current_variant &&
+       !draw_llvm_variant_ready(fpme->current_variant)) {
+      unsigned instance_id_index = ~0;
+      unsigned i;
+
+      for (i = 0; i < vs->info.num_inputs; i++) {
+         if (vs->info.input_semantic_name[i] == TGSI_SEMANTIC_INSTANCEID) {
+            instance_id_index = i;
+            break;
+         }
+      }
+
+      draw_pt_fetch_prepare( fpme->fetch,
+                             vs->info.num_inputs,
+                             fpme->vertex_size,
+                             instance_id_index );
+   }
+
    if (gs) {
       llvm_middle_end_prepare_gs(fpme);
    }
@@ -308,6 +364,179 @@ static void emit(struct pt_emit *emit,
    }
 }
 
+/**
+ * Fetch and shade count vertices starting at the first'th fetch element,
+ * storing them at the same position in verts.
+ * \return the jit function's clipped flag
+ */
+static int
+llvm_run_vs( struct llvm_middle_end *fpme,
+             const struct draw_fetch_info *fetch_info,
+             struct vertex_header *verts,
+             unsigned first,
+             unsigned count )
+{
+   struct draw_context *draw = fpme->draw;
+   struct vertex_header *out =
+      (struct vertex_header *)((char *)verts + first * fpme->vertex_size);
+
+   if (fetch_info->linear)
+      return fpme->current_variant->jit_func( &fpme->llvm->jit_context,
+                                              out,
+                                              (const char **)draw->pt.user.vbuffer,
+                                              fetch_info->start + first,
+                                              count,
+                                              fpme->vertex_size,
+                                              draw->pt.vertex_buffer,
+                                              draw->instance_id);
+   else
+      return fpme->current_variant->jit_func_elts( &fpme->llvm->jit_context,
+                                                   out,
+                                                   (const char **)draw->pt.user.vbuffer,
+                                                   fetch_info->elts + first,
+                                                   count,
+                                                   fpme->vertex_size,
+                                                   draw->pt.vertex_buffer,
+                                                   draw->instance_id);
+}
+
+
+/**
+ * Fetch and shade the vertices with the interpreter, while the variant is
+ * being compiled in the background.  This also does the clip test and
+ * viewport transform the jit code would have done.
+ * \return the clipped flag, like the jit function
+ */
+static int
+exec_run_vs( struct llvm_middle_end *fpme,
+             const struct draw_fetch_info *fetch_info,
+             struct vertex_header *verts )
+{
+   struct draw_context *draw = fpme->draw;
+   struct draw_vertex_shader *evs = fpme->current_variant->shader->exec_shader;
+   struct draw_vertex_info vert_info;
+
+   if (fetch_info->linear)
+      draw_pt_fetch_run_linear( fpme->fetch,
+                                fetch_info->start,
+                                fetch_info->count,
+                                (char *)verts );
+   else
+      draw_pt_fetch_run( fpme->fetch,
+                         fetch_info->elts,
+                         fetch_info->count,
+                         (char *)verts );
+
+   /* The shader reads all the inputs of a vertex before writing any of
+    * its outputs, so it can run in place.
+    */
+   evs->prepare( evs, draw );
+   evs->run_linear( evs,
+                    (const float (*)[4])verts->data,
+                    (      float (*)[4])verts->data,
+                    draw->pt.user.vs_constants,
+                    draw->pt.user.vs_constants_size,
+                    fetch_info->count,
+                    fpme->vertex_size,
+                    fpme->vertex_size );
+
+   /* With a geometry shader that's done on its output instead */
+   if (draw->gs.geometry_shader)
+      return 0;
+
+   vert_info.verts = verts;
+   vert_info.vertex_size = fpme->vertex_size;
+   vert_info.stride = fpme->vertex_size;
+   vert_info.count = fetch_info->count;
+
+   return draw_pt_post_vs_run( fpme->post_vs, &vert_info );
+}
+
+
+static void
+llvm_vs_job_slice( void *data, unsigned slice )
+{
+   struct llvm_vs_job *job = (struct llvm_vs_job *)data;
+   unsigned first = slice * job->slice_size;
+   unsigned count = MIN2(job->slice_size, job->fetch_info->count - first);
+
+   job->clipped[slice] = llvm_run_vs( job->fpme, job->fetch_info,
+                                      job->verts, first, count );
+}
+
+
+/**
+ * Run the vertex shader over all the fetched vertices, splitting the work
+ * across the worker threads when there are enough vertices to make it
+ * worthwhile.  The vertices end up in verts in fetch order either way.
+ */
+static int
+llvm_shade_vertices( struct llvm_middle_end *fpme,
+                     const struct draw_fetch_info *fetch_info,
+                     struct vertex_header *verts )
+{
+   const unsigned vector_length = lp_native_vector_width / 32;
+   struct llvm_vs_job job;
+   unsigned num_slices, i;
+   int clipped = 0;
+
+   if (fpme->draw->collect_statistics)
+      fpme->draw->statistics.vs_invocations += fetch_info->count;
+
+   if (!draw_llvm_variant_ready(fpme->current_variant))
+      return exec_run_vs( fpme, fetch_info, verts );
+
+   if (fpme->current_variant->code->tier != GALLIVM_TIER_PEAK) {
+      struct draw_llvm_variant *variant = fpme->current_variant;
+      const unsigned tier_up_vertices = draw_llvm_tier_up_vertices();
+
+      variant->vertices += fetch_info->count;
+      if (tier_up_vertices && variant->vertices >= tier_up_vertices)
+         draw_llvm_variant_tier_up( variant );
+   }
+
+   num_slices = MIN2(draw_pt_threads_count(fpme->threads) + 1,
+                     fetch_info->count / MIN_VERTICES_PER_THREAD);
+   if (num_slices <= 1)
+      return llvm_run_vs( fpme, fetch_info, verts, 0, fetch_info->count );
+
+   job.fpme = fpme;
+   job.fetch_info = fetch_info;
+   job.verts = verts;
+   job.slice_size = align((fetch_info->count + num_slices - 1) / num_slices,
+                          vector_length);
+   num_slices = (fetch_info->count + job.slice_size - 1) / job.slice_size;
+
+   draw_pt_threads_run( fpme->threads, llvm_vs_job_slice, &job, num_slices );
+
+   for (i = 0; i < num_slices; i++)
+      clipped |= job.clipped[i];
+
+   return clipped;
+}
+
+
+/**
+ * Shade callback for the vertex cache: shade the listed fetch elements.
+ */
+static int
+llvm_shade_elts( void *data,
+                 const unsigned *elts,
+                 unsigned count,
+                 struct vertex_header *verts )
+{
+   struct draw_fetch_info fetch_info;
+
+   fetch_info.linear = FALSE;
+   fetch_info.start = 0;
+   fetch_info.elts = elts;
+   fetch_info.count = count;
+
+   return llvm_shade_vertices( (struct llvm_middle_end *)data,
+                               &fetch_info, verts );
+}
+
+
 static void
 llvm_pipeline_generic( struct draw_pt_middle_end *middle,
                        const struct draw_fetch_info *fetch_info,
@@ -342,27 +571,21 @@ llvm_pipeline_generic( struct draw_pt_middle_end *middle,
       draw->statistics.ia_vertices += fetch_info->count;
       draw->statistics.ia_primitives +=
          u_decomposed_prims_for_vertices(prim_info->prim, prim_info->count);
-      draw->statistics.vs_invocations += fetch_info->count;
    }
 
-   if (fetch_info->linear)
-      clipped = fpme->current_variant->jit_func( &fpme->llvm->jit_context,
-                                       llvm_vert_info.verts,
-                                       (const char **)draw->pt.user.vbuffer,
-                                       fetch_info->start,
-                                       fetch_info->count,
-                                       fpme->vertex_size,
-                                       draw->pt.vertex_buffer,
-                                       draw->instance_id);
-   else
-      clipped = fpme->current_variant->jit_func_elts( &fpme->llvm->jit_context,
-                                            llvm_vert_info.verts,
-                                            (const char **)draw->pt.user.vbuffer,
-                                            fetch_info->elts,
-                                            fetch_info->count,
-                                            fpme->vertex_size,
-                                            draw->pt.vertex_buffer,
-                                            draw->instance_id);
+   if (fetch_info->linear || !fpme->vcache) {
+      clipped = llvm_shade_vertices( fpme, fetch_info, llvm_vert_info.verts );
+   }
+   else {
+      clipped = draw_pt_vcache_run( fpme->vcache,
+                                    fetch_info->elts,
+                                    fetch_info->count,
+                                    u_decomposed_prims_for_vertices(prim_info->prim,
+                                                                    prim_info->count),
+                                    llvm_vert_info.verts,
+                                    llvm_shade_elts,
+                                    fpme );
+   }
 
    /* Finished with fetch and vs:
     */
@@ -449,6 +672,12 @@ static void llvm_middle_end_run( struct draw_pt_middle_end *middle,
    struct draw_fetch_info fetch_info;
    struct draw_prim_info prim_info;
 
+   /* Cached vertices can only be reused by the following segments of the
+    * same primitive; anything else may have different vertex inputs.
+    */
+   if (!(prim_flags & DRAW_SPLIT_BEFORE))
+      draw_pt_vcache_invalidate( fpme->vcache );
+
    fetch_info.linear = FALSE;
    fetch_info.start = 0;
    fetch_info.elts = fetch_elts;
@@ -549,6 +778,10 @@ static void llvm_middle_end_destroy( struct draw_pt_middle_end *middle )
    if (fpme->post_vs)
       draw_pt_post_vs_destroy( fpme->post_vs );
 
+   draw_pt_threads_destroy( fpme->threads );
+
+   draw_pt_vcache_destroy( fpme->vcache );
+
    FREE(middle);
 }
 
@@ -597,6 +830,17 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 
    fpme->current_variant = NULL;
 
+   /* By default use one worker per extra core; the application thread
+    * shades a slice too.  The jit code only reads the shared state, so
+    * the workers can run it concurrently.
+    */
+   fpme->threads = draw_pt_threads_create(
+      debug_get_num_option("DRAW_NUM_THREADS",
+                           MAX2(util_cpu_caps.nr_cpus, 1) - 1));
+
+   fpme->vcache = draw_pt_vcache_create( draw,
+      debug_get_num_option("DRAW_VCACHE_SIZE", DEFAULT_VCACHE_SIZE));
+
    return &fpme->base;
 
  fail:
@@ -0,0 +1,203 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * A small pool of worker threads for the middle ends.
+ *
+ * The caller splits a vertex run into slices, which are then processed
+ * concurrently: slice 0 on the calling thread, the others on the workers.
+ * Each slice writes its own range of the output vertex buffer, so the
+ * results are already in order for the clip and emit stages when
+ * draw_pt_threads_run() returns.
+ */
+
+#include "os/os_thread.h"
+#include "util/u_debug.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+
+#include "draw/draw_pt.h"
+
+
+struct draw_pt_thread
+{
+   struct draw_pt_threads *pool;
+   unsigned index;
+
+   pipe_thread handle;
+   pipe_semaphore work_ready;
+};
+
+
+struct draw_pt_threads
+{
+   unsigned num_threads;
+   boolean exit_flag;
+
+   /** The job being run, only valid between work_ready and work_done */
+   draw_pt_thread_func func;
+   void *data;
+
+   /** Signalled once by each worker when it's done with its slice */
+   pipe_semaphore work_done;
+
+   struct draw_pt_thread threads[DRAW_MAX_THREADS];
+};
+
+
+/**
+ * Worker thread entrypoint.  Wait for work, process slice index + 1 and
+ * report back, until told to exit.
+ */
+static PIPE_THREAD_ROUTINE( thread_function, init_data )
+{
+   struct draw_pt_thread *thread = (struct draw_pt_thread *) init_data;
+   struct draw_pt_threads *pool = thread->pool;
+
+   while (1) {
+      pipe_semaphore_wait(&thread->work_ready);
+
+      if (pool->exit_flag)
+         break;
+
+      pool->func(pool->data, thread->index + 1);
+
+      pipe_semaphore_signal(&pool->work_done);
+   }
+
+   return 0;
+}
+
+
+/**
+ * Create a pool of num_threads worker threads.
+ * Returns NULL if num_threads is zero or no thread could be started, in
+ * which case the caller should just do the work itself.
+ */
+struct draw_pt_threads *
+draw_pt_threads_create(unsigned num_threads)
+{
+   struct draw_pt_threads *pool;
+   unsigned i;
+
+   num_threads = MIN2(num_threads, DRAW_MAX_THREADS);
+   if (!num_threads)
+      return NULL;
+
+   pool = CALLOC_STRUCT(draw_pt_threads);
+   if (!pool)
+      return NULL;
+
+   pipe_semaphore_init(&pool->work_done, 0);
+
+   for (i = 0; i < num_threads; i++) {
+      struct draw_pt_thread *thread = &pool->threads[i];
+
+      thread->pool = pool;
+      thread->index = i;
+      pipe_semaphore_init(&thread->work_ready, 0);
+      thread->handle = pipe_thread_create(thread_function, (void *) thread);
+      if (!thread->handle) {
+         pipe_semaphore_destroy(&thread->work_ready);
+         break;
+      }
+      pool->num_threads++;
+   }
+
+   if (!pool->num_threads) {
+      draw_pt_threads_destroy(pool);
+      return NULL;
+   }
+
+   return pool;
+}
+
+
+/** Return the number of worker threads (not counting the caller) */
+unsigned
+draw_pt_threads_count(const struct draw_pt_threads *pool)
+{
+   return pool ? pool->num_threads : 0;
+}
+
+
+/**
+ * Call func(data, slice) for every slice in [0, num_slices) and wait for
+ * all of them to complete.  num_slices may not exceed the number of
+ * worker threads plus one.
+ */
+void
+draw_pt_threads_run(struct draw_pt_threads *pool,
+                    draw_pt_thread_func func,
+                    void *data,
+                    unsigned num_slices)
+{
+   unsigned i;
+
+   assert(num_slices <= draw_pt_threads_count(pool) + 1);
+
+   if (num_slices > 1) {
+      pool->func = func;
+      pool->data = data;
+
+      for (i = 0; i < num_slices - 1; i++) {
+         pipe_semaphore_signal(&pool->threads[i].work_ready);
+      }
+   }
+
+   if (num_slices)
+      func(data, 0);
+
+   for (i = 1; i < num_slices; i++) {
+      pipe_semaphore_wait(&pool->work_done);
+   }
+}
+
+
+void
+draw_pt_threads_destroy(struct draw_pt_threads *pool)
+{
+   unsigned i;
+
+   if (!pool)
+      return;
+
+   pool->exit_flag = TRUE;
+
+   for (i = 0; i < pool->num_threads; i++) {
+      pipe_semaphore_signal(&pool->threads[i].work_ready);
+   }
+
+   for (i = 0; i < pool->num_threads; i++) {
+      pipe_thread_wait(pool->threads[i].handle);
+      pipe_semaphore_destroy(&pool->threads[i].work_ready);
+   }
+
+   pipe_semaphore_destroy(&pool->work_done);
+
+   FREE(pool);
+}
@@ -0,0 +1,343 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Post-transform vertex cache.
+ *
+ * vsplit only removes duplicate indices within one segment, with a small
+ * direct-mapped table, so indexed meshes re-shade every vertex shared
+ * across a segment boundary.  This cache keeps the shaded vertices of the
+ * last few segments of a primitive in a FIFO.  The middle end passes the
+ * fetch elements of each segment through it, and only the ones not
+ * found are handed to the vertex shader.
+ *
+ * Slots are allocated in FIFO order, so the misses of one run occupy a
+ * contiguous range of the store and are shaded straight into it.  The
+ * shaded vertices are then copied into the run's vertex buffer, where the
+ * later stages may modify them freely.
+ */
+
+#include "util/u_debug.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+
+#include "draw/draw_private.h"
+#include "draw/draw_pt.h"
+
+
+DEBUG_GET_ONCE_BOOL_OPTION(draw_vcache_stats, "DRAW_VCACHE_STATS", FALSE)
+
+
+struct pt_vcache {
+   struct draw_context *draw;
+
+   /** Number of slots, zero if the cache is disabled */
+   unsigned size;
+   /** Slots the shader may write past the end of a run */
+   unsigned pad;
+
+   unsigned vertex_size;
+   char *store;
+
+   /** Fetch element held by each slot */
+   unsigned *tags;
+   /** Generation each slot was filled in, zero if it holds garbage */
+   unsigned *gens;
+   unsigned generation;
+
+   /** Maps hashed fetch elements to slots.  Lossy, checked against tags */
+   unsigned *index;
+   unsigned index_shift;
+
+   /** Next slot to fill */
+   unsigned head;
+
+   /* Per-run scratch space */
+   unsigned max_count;
+   unsigned *miss_elts;
+   unsigned *pending_pos;
+   unsigned *pending_slot;
+
+   boolean print_stats;
+   uint64_t hits;
+   uint64_t misses;
+   uint64_t prims;
+};
+
+
+static INLINE unsigned
+vcache_hash(const struct pt_vcache *vc, unsigned elt)
+{
+   return (elt * 0x9e3779b1) >> vc->index_shift;
+}
+
+
+static void
+vcache_free_store(struct pt_vcache *vc)
+{
+   align_free(vc->store);
+   FREE(vc->tags);
+   FREE(vc->gens);
+   vc->store = NULL;
+   vc->tags = NULL;
+   vc->gens = NULL;
+   vc->vertex_size = 0;
+}
+
+
+/**
+ * Forget all cached vertices.  Called whenever the inputs of the vertex
+ * shader may have changed, ie. at the start of every primitive.
+ */
+void
+draw_pt_vcache_invalidate(struct pt_vcache *vc)
+{
+   if (!vc || !vc->gens)
+      return;
+
+   if (++vc->generation == 0) {
+      memset(vc->gens, 0, (vc->size + vc->pad) * sizeof vc->gens[0]);
+      vc->generation = 1;
+   }
+   vc->head = 0;
+}
+
+
+/**
+ * (Re)allocate the store for vertices of the given size.
+ * \param pad  number of vertices the shader may write past the end of the
+ *             range it's asked for
+ */
+void
+draw_pt_vcache_prepare(struct pt_vcache *vc,
+                       unsigned vertex_size,
+                       unsigned pad)
+{
+   unsigned slots;
+
+   if (!vc || !vc->size)
+      return;
+
+   if (vc->vertex_size == vertex_size && vc->pad == pad) {
+      draw_pt_vcache_invalidate(vc);
+      return;
+   }
+
+   vcache_free_store(vc);
+
+   slots = vc->size + pad;
+   vc->store = align_malloc(slots * vertex_size, 16);
+   vc->tags = MALLOC(slots * sizeof vc->tags[0]);
+   vc->gens = CALLOC(slots, sizeof vc->gens[0]);
+   if (!vc->store || !vc->tags || !vc->gens) {
+      vcache_free_store(vc);
+      return;
+   }
+
+   vc->vertex_size = vertex_size;
+   vc->pad = pad;
+   vc->generation = 1;
+   vc->head = 0;
+}
+
+
+static boolean
+vcache_reserve_scratch(struct pt_vcache *vc, unsigned count)
+{
+   if (count <= vc->max_count)
+      return TRUE;
+
+   FREE(vc->miss_elts);
+   FREE(vc->pending_pos);
+   FREE(vc->pending_slot);
+   vc->miss_elts = MALLOC(count * sizeof vc->miss_elts[0]);
+   vc->pending_pos = MALLOC(count * sizeof vc->pending_pos[0]);
+   vc->pending_slot = MALLOC(count * sizeof vc->pending_slot[0]);
+   if (!vc->miss_elts || !vc->pending_pos || !vc->pending_slot) {
+      FREE(vc->miss_elts);
+      FREE(vc->pending_pos);
+      FREE(vc->pending_slot);
+      vc->miss_elts = NULL;
+      vc->pending_pos = NULL;
+      vc->pending_slot = NULL;
+      vc->max_count = 0;
+      return FALSE;
+   }
+
+   vc->max_count = count;
+   return TRUE;
+}
+
+
+/**
+ * Produce the shaded vertices for the count fetch elements in verts,
+ * calling shade() only for those not in the cache.
+ * \param num_prims  primitives drawn with these vertices, for statistics
+ * \return the OR of the clipped flags of all the vertices
+ */
+int
+draw_pt_vcache_run(struct pt_vcache *vc,
+                   const unsigned *elts,
+                   unsigned count,
+                   unsigned num_prims,
+                   struct vertex_header *verts,
+                   draw_pt_vcache_shade_func shade,
+                   void *data)
+{
+   const unsigned vertex_size = vc ? vc->vertex_size : 0;
+   unsigned num_misses = 0, num_pending = 0;
+   unsigned base, i;
+   int clipped = 0;
+
+   if (!vc || !vc->store || count > vc->size ||
+       !vcache_reserve_scratch(vc, count)) {
+      return shade(data, elts, count, verts);
+   }
+
+   /* Keep the misses of this run contiguous */
+   if (vc->head + count > vc->size)
+      vc->head = 0;
+   base = vc->head;
+
+   for (i = 0; i < count; i++) {
+      const unsigned elt = elts[i];
+      const unsigned h = vcache_hash(vc, elt);
+      unsigned slot = vc->index[h];
+
+      if (slot < vc->size &&
+          vc->tags[slot] == elt &&
+          vc->gens[slot] == vc->generation) {
+         if (slot >= base && slot < base + num_misses) {
+            /* repeated within this run, not shaded yet */
+            vc->pending_pos[num_pending] = i;
+            vc->pending_slot[num_pending] = slot;
+            num_pending++;
+         }
+         else {
+            const struct vertex_header *src = (const struct vertex_header *)
+               (vc->store + slot * vertex_size);
+
+            memcpy((char *)verts + i * vertex_size, src, vertex_size);
+            clipped |= src->clipmask;
+         }
+         vc->hits++;
+      }
+      else {
+         slot = base + num_misses;
+         vc->miss_elts[num_misses++] = elt;
+         vc->tags[slot] = elt;
+         vc->gens[slot] = vc->generation;
+         vc->index[h] = slot;
+
+         vc->pending_pos[num_pending] = i;
+         vc->pending_slot[num_pending] = slot;
+         num_pending++;
+      }
+   }
+
+   if (num_misses) {
+      /* The shader may overwrite the slots after the last miss */
+      for (i = base + num_misses; i < base + num_misses + vc->pad; i++)
+         vc->gens[i] = 0;
+
+      clipped |= shade(data, vc->miss_elts, num_misses,
+                       (struct vertex_header *)(vc->store + base * vertex_size));
+
+      for (i = 0; i < num_pending; i++) {
+         memcpy((char *)verts + vc->pending_pos[i] * vertex_size,
+                vc->store + vc->pending_slot[i] * vertex_size,
+                vertex_size);
+      }
+
+      vc->head = base + num_misses;
+      vc->misses += num_misses;
+   }
+
+   vc->prims += num_prims;
+
+   return clipped;
+}
+
+
+/**
+ * Create a cache with room for size vertices.  Returns NULL if size is
+ * zero, ie. caching is disabled.
+ */
+struct pt_vcache *
+draw_pt_vcache_create(struct draw_context *draw, unsigned size)
+{
+   struct pt_vcache *vc;
+   unsigned index_size;
+
+   if (!size)
+      return NULL;
+
+   vc = CALLOC_STRUCT(pt_vcache);
+   if (!vc)
+      return NULL;
+
+   /* Twice as many index entries as slots keeps collisions rare */
+   index_size = util_next_power_of_two(MAX2(size * 2, 2));
+   vc->index = MALLOC(index_size * sizeof vc->index[0]);
+   if (!vc->index) {
+      FREE(vc);
+      return NULL;
+   }
+   memset(vc->index, 0xff, index_size * sizeof vc->index[0]);
+
+   vc->draw = draw;
+   vc->size = size;
+   vc->index_shift = 32 - util_logbase2(index_size);
+   vc->print_stats = debug_get_option_draw_vcache_stats();
+
+   return vc;
+}
+
+
+void
+draw_pt_vcache_destroy(struct pt_vcache *vc)
+{
+   if (!vc)
+      return;
+
+   if (vc->print_stats && vc->prims) {
+      debug_printf("draw: vertex cache %u slots: %llu hits, %llu misses "
+                   "(%.1f%% hit rate), %.3f vertices shaded per primitive\n",
+                   vc->size,
+                   (unsigned long long) vc->hits,
+                   (unsigned long long) vc->misses,
+                   100.0 * vc->hits / MAX2(vc->hits + vc->misses, 1),
+                   (double) vc->misses / vc->prims);
+   }
+
+   vcache_free_store(vc);
+   FREE(vc->miss_elts);
+   FREE(vc->pending_pos);
+   FREE(vc->pending_slot);
+   FREE(vc->index);
+   FREE(vc);
+}
@@ -35,6 +35,7 @@
 #include "draw_vs.h"
 #include "draw_llvm.h"
 
+#include "tgsi/tgsi_exec.h"
 #include "tgsi/tgsi_parse.h"
 #include "tgsi/tgsi_scan.h"
 
@@ -75,6 +76,17 @@ vs_llvm_delete( struct draw_vertex_shader *dvs )
    }
 
    assert(shader->variants_cached == 0);
+
+   if (shader->exec_shader) {
+      struct tgsi_exec_machine *machine = dvs->draw->vs.tgsi.machine;
+
+      /* Don't leave the machine bound to the freed tokens */
+      if (machine->Tokens == shader->exec_shader->state.tokens)
+         tgsi_exec_machine_bind_shader(machine, NULL, NULL);
+
+      shader->exec_shader->delete(shader->exec_shader);
+   }
+
    FREE((void*) dvs->state.tokens);
    FREE( dvs );
 }
@@ -857,6 +857,53 @@ lp_build_mul(struct lp_build_context *bld,
 }
 
 
+/**
+ * Generate a * b + c
+ *
+ * Emits a fused multiply-add when the CPU supports FMA, which is both
+ * faster and more precise (a single rounding step), otherwise a separate
+ * multiply and add.
+ */
+LLVMValueRef
+lp_build_mad(struct lp_build_context *bld,
+             LLVMValueRef a,
+             LLVMValueRef b,
+             LLVMValueRef c)
+{
+   const struct lp_type type = bld->type;
+
+   assert(lp_check_value(type, a));
+   assert(lp_check_value(type, b));
+   assert(lp_check_value(type, c));
+
+   if (util_cpu_caps.has_fma &&
+       type.floating &&
+       (type.width == 32 || type.width == 64) &&
+       !(LLVMIsConstant(a) && LLVMIsConstant(b)) &&
+       a != bld->zero && a != bld->one &&
+       b != bld->zero && b != bld->one) {
+      LLVMBuilderRef builder = bld->gallivm->builder;
+      LLVMTypeRef vec_type = lp_build_vec_type(bld->gallivm, type);
+      LLVMValueRef args[3];
+      char intrinsic[32];
+
+      if (type.length == 1) {
+         util_snprintf(intrinsic, sizeof intrinsic, "llvm.fma.f%u", type.width);
+      }
+      else {
+         util_snprintf(intrinsic, sizeof intrinsic, "llvm.fma.v%uf%u", type.length, type.width);
+      }
+
+      args[0] = a;
+      args[1] = b;
+      args[2] = c;
+      return lp_build_intrinsic(builder, intrinsic, vec_type, args, 3);
+   }
+
+   return lp_build_add(bld, lp_build_mul(bld, a, b), c);
+}
+
+
 /**
  * Small vector x scale multiplication optimization.
  */
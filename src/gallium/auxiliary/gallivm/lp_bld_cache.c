@@ -0,0 +1,384 @@
+/**************************************************************************
+ *
+ * Copyright 2013 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Persistent on-disk cache of optimized LLVM modules.
+ *
+ * Each entry is a single file named after the CRC32 of the key, holding a
+ * small header, the full key (to rule out hash collisions), and the module
+ * bitcode up to the end of the file.  Entries are written to a temporary
+ * file and renamed into place, so concurrent processes sharing the same
+ * directory never observe partially written entries.
+ *
+ * Only the IR is persisted -- machine code emission still happens when the
+ * functions are first JIT'ed -- but a hit skips TGSI translation and the IR
+ * optimization passes, which dominate the compile time of large shaders.
+ */
+
+
+#include "pipe/p_config.h"
+#include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_debug.h"
+#include "util/u_hash.h"
+#include "util/u_memory.h"
+#include "util/u_string.h"
+
+#include "lp_bld_cache.h"
+#include "lp_bld_debug.h"
+#include "lp_bld_misc.h"
+#include "lp_bld_type.h"
+
+#include <stdio.h>
+
+#if defined(PIPE_OS_UNIX) && HAVE_LLVM >= 0x0301
+#define HAVE_GALLIVM_CACHE 1
+#include <dlfcn.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <llvm-c/BitWriter.h>
+#else
+#define HAVE_GALLIVM_CACHE 0
+#endif
+
+
+#define GALLIVM_CACHE_MAGIC "GLVMBC01"
+
+
+struct gallivm_cache_header
+{
+   char magic[8];
+   uint32_t key_size;
+   uint32_t key_crc;
+};
+
+
+static struct {
+   int32_t hits;
+   int32_t misses;
+   int32_t stores;
+   int32_t uncacheable;
+} gallivm_cache_counters;
+
+
+static const char *
+gallivm_cache_dir(void)
+{
+   static boolean first = TRUE;
+   static const char *dir = NULL;
+
+   if (first) {
+      first = FALSE;
+      dir = debug_get_option("GALLIVM_CACHE_DIR", NULL);
+      if (dir && !*dir) {
+         dir = NULL;
+      }
+   }
+
+   return dir;
+}
+
+
+/**
+ * Identify the build of the binary we're part of, so that entries written by
+ * a different build (with possibly different JIT structure layouts, etc.)
+ * are never picked up.  We use the modification time of the shared object
+ * (or executable) containing this code.
+ *
+ * \return FALSE if the build can't be identified
+ */
+static boolean
+gallivm_cache_build_id(int64_t *id)
+{
+#if HAVE_GALLIVM_CACHE
+   static boolean first = TRUE;
+   static boolean found = FALSE;
+   static int64_t build_id = 0;
+
+   if (first) {
+      Dl_info info;
+      struct stat st;
+
+      first = FALSE;
+      if (dladdr((void *) gallivm_cache_build_id, &info) &&
+          info.dli_fname &&
+          stat(info.dli_fname, &st) == 0) {
+         build_id = (int64_t) st.st_mtime;
+         found = TRUE;
+      }
+   }
+
+   *id = build_id;
+   return found;
+#else
+   *id = 0;
+   return FALSE;
+#endif
+}
+
+
+boolean
+gallivm_cache_enabled(void)
+{
+   int64_t build_id;
+
+   return gallivm_cache_dir() != NULL &&
+          gallivm_cache_build_id(&build_id);
+}
+
+
+/**
+ * Start a new key.  Everything besides the caller supplied data which
+ * influences code generation is added here.
+ */
+void
+gallivm_cache_key_init(struct gallivm_cache_key *key)
+{
+   unsigned features = 0;
+   int64_t build_id;
+
+   util_dynarray_init(&key->data);
+
+   lp_build_init();
+
+   features |= util_cpu_caps.has_sse      << 0;
+   features |= util_cpu_caps.has_sse2     << 1;
+   features |= util_cpu_caps.has_sse3     << 2;
+   features |= util_cpu_caps.has_ssse3    << 3;
+   features |= util_cpu_caps.has_sse4_1   << 4;
+   features |= util_cpu_caps.has_sse4_2   << 5;
+   features |= util_cpu_caps.has_avx      << 6;
+   features |= util_cpu_caps.has_f16c     << 7;
+   features |= util_cpu_caps.has_altivec  << 8;
+   features |= util_cpu_caps.has_intel    << 9;
+   features |= util_cpu_caps.has_avx2     << 10;
+   features |= util_cpu_caps.has_fma      << 11;
+   features |= util_cpu_caps.has_avx512f  << 12;
+   features |= lp_wide_vectors            << 13;
+
+   gallivm_cache_build_id(&build_id);
+
+   util_dynarray_append(&key->data, int64_t, build_id);
+   util_dynarray_append(&key->data, unsigned, HAVE_LLVM);
+   util_dynarray_append(&key->data, unsigned, sizeof(void *));
+   util_dynarray_append(&key->data, unsigned, lp_native_vector_width);
+   util_dynarray_append(&key->data, unsigned, gallivm_debug);
+   util_dynarray_append(&key->data, unsigned, features);
+}
+
+
+void
+gallivm_cache_key_append(struct gallivm_cache_key *key,
+                         const void *data, unsigned size)
+{
+   memcpy(util_dynarray_grow(&key->data, size), data, size);
+}
+
+
+void
+gallivm_cache_key_fini(struct gallivm_cache_key *key)
+{
+   util_dynarray_fini(&key->data);
+}
+
+
+#if HAVE_GALLIVM_CACHE
+
+static void
+gallivm_cache_path(char *path, size_t size, uint32_t crc)
+{
+   util_snprintf(path, size, "%s/%08x.bc", gallivm_cache_dir(), crc);
+}
+
+
+/**
+ * Read the whole file into a malloc'ed buffer.
+ */
+static void *
+read_file(const char *path, size_t *size)
+{
+   FILE *fp;
+   char *data;
+   long length;
+
+   fp = fopen(path, "rb");
+   if (!fp)
+      return NULL;
+
+   if (fseek(fp, 0, SEEK_END) != 0 ||
+       (length = ftell(fp)) <= 0 ||
+       fseek(fp, 0, SEEK_SET) != 0) {
+      fclose(fp);
+      return NULL;
+   }
+
+   data = MALLOC(length);
+   if (data && fread(data, 1, length, fp) != (size_t) length) {
+      FREE(data);
+      data = NULL;
+   }
+
+   fclose(fp);
+   *size = length;
+   return data;
+}
+
+#endif /* HAVE_GALLIVM_CACHE */
+
+
+/**
+ * Look up a module in the cache.
+ *
+ * \return a new gallivm_state holding the cached module, or NULL on a miss.
+ */
+struct gallivm_state *
+gallivm_cache_load(const struct gallivm_cache_key *key)
+{
+#if HAVE_GALLIVM_CACHE
+   struct gallivm_state *gallivm = NULL;
+   const struct gallivm_cache_header *header;
+   char path[1024];
+   uint32_t crc;
+   size_t size;
+   size_t offset;
+   char *data;
+
+   if (!gallivm_cache_enabled())
+      return NULL;
+
+   crc = util_hash_crc32(key->data.data, key->data.size);
+   gallivm_cache_path(path, sizeof path, crc);
+
+   data = read_file(path, &size);
+   if (data) {
+      header = (const struct gallivm_cache_header *) data;
+      offset = sizeof *header + key->data.size;
+      if (size > offset &&
+          memcmp(header->magic, GALLIVM_CACHE_MAGIC, sizeof header->magic) == 0 &&
+          header->key_size == key->data.size &&
+          header->key_crc == crc &&
+          memcmp(header + 1, key->data.data, key->data.size) == 0) {
+         gallivm = gallivm_create_from_bitcode(data + offset, size - offset);
+      }
+      FREE(data);
+   }
+
+   if (gallivm) {
+      p_atomic_inc(&gallivm_cache_counters.hits);
+   }
+   else {
+      p_atomic_inc(&gallivm_cache_counters.misses);
+   }
+
+   if (gallivm_debug & GALLIVM_DEBUG_CACHE) {
+      debug_printf("gallivm: cache %s %s\n", gallivm ? "hit" : "miss", path);
+   }
+
+   return gallivm;
+#else
+   (void) key;
+   return NULL;
+#endif
+}
+
+
+/**
+ * Write the (verified, but not yet compiled) module of the given gallivm
+ * state to the cache.  Deferred optimizations are run first.
+ *
+ * This must be called before gallivm_compile_module(), as code generation
+ * and gallivm_jit_function() both modify the IR.
+ */
+void
+gallivm_cache_store(const struct gallivm_cache_key *key,
+                    struct gallivm_state *gallivm)
+{
+#if HAVE_GALLIVM_CACHE
+   struct gallivm_cache_header header;
+   char path[1024];
+   char tmp_path[1024];
+   int fd;
+
+   if (!gallivm_cache_enabled())
+      return;
+
+   assert(!gallivm->compiled);
+
+   if (gallivm->has_absolute_addresses) {
+      p_atomic_inc(&gallivm_cache_counters.uncacheable);
+      return;
+   }
+
+   gallivm_optimize_module(gallivm);
+
+   memset(&header, 0, sizeof header);
+   memcpy(header.magic, GALLIVM_CACHE_MAGIC, sizeof header.magic);
+   header.key_size = key->data.size;
+   header.key_crc = util_hash_crc32(key->data.data, key->data.size);
+
+   gallivm_cache_path(path, sizeof path, header.key_crc);
+   util_snprintf(tmp_path, sizeof tmp_path, "%s.XXXXXX", path);
+
+   fd = mkstemp(tmp_path);
+   if (fd < 0)
+      return;
+
+   if (write(fd, &header, sizeof header) != (ssize_t) sizeof header ||
+       write(fd, key->data.data, key->data.size) != (ssize_t) key->data.size) {
+      close(fd);
+      unlink(tmp_path);
+      return;
+   }
+
+   /* This closes the file descriptor */
+   if (LLVMWriteBitcodeToFD(gallivm->module, fd, 1, 0) != 0 ||
+       rename(tmp_path, path) != 0) {
+      unlink(tmp_path);
+      return;
+   }
+
+   p_atomic_inc(&gallivm_cache_counters.stores);
+
+   if (gallivm_debug & GALLIVM_DEBUG_CACHE) {
+      debug_printf("gallivm: cache store %s\n", path);
+   }
+#else
+   (void) key;
+   (void) gallivm;
+#endif
+}
+
+
+void
+gallivm_cache_get_stats(struct gallivm_cache_stats *stats)
+{
+   stats->hits = gallivm_cache_counters.hits;
+   stats->misses = gallivm_cache_counters.misses;
+   stats->stores = gallivm_cache_counters.stores;
+   stats->uncacheable = gallivm_cache_counters.uncacheable;
+}
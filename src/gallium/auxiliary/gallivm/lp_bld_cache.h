@@ -0,0 +1,89 @@
+/**************************************************************************
+ *
+ * Copyright 2013 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Persistent on-disk cache of optimized LLVM modules.
+ *
+ * Modules are stored as LLVM bitcode, keyed on an arbitrary blob supplied by
+ * the caller (shader tokens, variant key, etc.), to which the Mesa build, the
+ * LLVM version and the relevant host CPU features are implicitly added.
+ *
+ * The cache is disabled unless the GALLIVM_CACHE_DIR environment variable
+ * names a writable directory.
+ */
+
+#ifndef LP_BLD_CACHE_H
+#define LP_BLD_CACHE_H
+
+
+#include "pipe/p_compiler.h"
+#include "util/u_dynarray.h"
+#include "lp_bld.h"
+#include "lp_bld_init.h"
+
+
+struct gallivm_cache_key
+{
+   struct util_dynarray data;
+};
+
+
+struct gallivm_cache_stats
+{
+   unsigned hits;
+   unsigned misses;
+   unsigned stores;
+   unsigned uncacheable;  /**< modules which embed host addresses */
+};
+
+
+boolean
+gallivm_cache_enabled(void);
+
+void
+gallivm_cache_key_init(struct gallivm_cache_key *key);
+
+void
+gallivm_cache_key_append(struct gallivm_cache_key *key,
+                         const void *data, unsigned size);
+
+void
+gallivm_cache_key_fini(struct gallivm_cache_key *key);
+
+struct gallivm_state *
+gallivm_cache_load(const struct gallivm_cache_key *key);
+
+void
+gallivm_cache_store(const struct gallivm_cache_key *key,
+                    struct gallivm_state *gallivm);
+
+void
+gallivm_cache_get_stats(struct gallivm_cache_stats *stats);
+
+
+#endif /* !LP_BLD_CACHE_H */
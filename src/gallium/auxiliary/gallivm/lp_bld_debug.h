@@ -44,6 +44,7 @@
 #define GALLIVM_DEBUG_NO_BRILINEAR  (1 << 5)
 #define GALLIVM_DEBUG_NO_RHO_APPROX (1 << 6)
 #define GALLIVM_DEBUG_GC            (1 << 7)
+#define GALLIVM_DEBUG_CACHE         (1 << 8)
 
 
 #ifdef __cplusplus
@@ -28,8 +28,10 @@
 
 #include "pipe/p_config.h"
 #include "pipe/p_compiler.h"
+#include "os/os_thread.h"
 #include "util/u_cpu_detect.h"
 #include "util/u_debug.h"
+#include "util/u_dynarray.h"
 #include "util/u_memory.h"
 #include "util/u_simple_list.h"
 #include "lp_bld.h"
@@ -40,6 +42,7 @@
 #include <llvm-c/Analysis.h>
 #include <llvm-c/Transforms/Scalar.h>
 #include <llvm-c/BitWriter.h>
+#include <llvm-c/BitReader.h>
 
 
 /**
@@ -64,6 +67,17 @@
 #endif
 
 
+/**
+ * AVX-512 needs EVEX encoding, which only MC-JIT from LLVM 3.5 onwards
+ * can emit.
+ */
+#if USE_MCJIT && HAVE_LLVM >= 0x0305
+#  define HAVE_AVX512 1
+#else
+#  define HAVE_AVX512 0
+#endif
+
+
 #if USE_MCJIT
 void LLVMLinkInMCJIT();
 #endif
@@ -81,6 +95,7 @@ static const struct debug_named_value lp_bld_debug_flags[] = {
    { "no_brilinear", GALLIVM_DEBUG_NO_BRILINEAR, NULL },
    { "no_rho_approx", GALLIVM_DEBUG_NO_RHO_APPROX, NULL },
    { "gc",     GALLIVM_DEBUG_GC, NULL },
+   { "cache",  GALLIVM_DEBUG_CACHE, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -92,6 +107,8 @@ static boolean gallivm_initialized = FALSE;
 
 unsigned lp_native_vector_width;
 
+boolean lp_wide_vectors = FALSE;
+
 
 /*
  * Optimization values are:
@@ -142,7 +159,15 @@ create_pass_manager(struct gallivm_state *gallivm)
 
    LLVMAddTargetData(gallivm->target, gallivm->passmgr);
 
-   if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) == 0) {
+   if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) == 0 &&
+       gallivm->tier != GALLIVM_TIER_FAST) {
+#if HAVE_LLVM >= 0x0301
+      if (gallivm->tier == GALLIVM_TIER_PEAK) {
+         LLVMAddBasicAliasAnalysisPass(gallivm->passmgr);
+         LLVMAddTypeBasedAliasAnalysisPass(gallivm->passmgr);
+      }
+#endif
+
       /* These are the passes currently listed in llvm-c/Transforms/Scalar.h,
        * but there are more on SVN.
        * TODO: Add more passes.
@@ -170,6 +195,17 @@ create_pass_manager(struct gallivm_state *gallivm)
          LLVMAddInstructionCombiningPass(gallivm->passmgr);
       }
       LLVMAddGVNPass(gallivm->passmgr);
+
+      if (gallivm->tier == GALLIVM_TIER_PEAK) {
+         /* Hot code: clean up after GVN, and hoist the invariant parts of
+          * the loops (texture sampling, shader loops) out of them.
+          */
+         LLVMAddReassociatePass(gallivm->passmgr);
+         LLVMAddLICMPass(gallivm->passmgr);
+         LLVMAddDeadStoreEliminationPass(gallivm->passmgr);
+         LLVMAddAggressiveDCEPass(gallivm->passmgr);
+         LLVMAddCFGSimplificationPass(gallivm->passmgr);
+      }
    }
    else {
       /* We need at least this pass to prevent the backends to fail in
@@ -182,6 +218,41 @@ create_pass_manager(struct gallivm_state *gallivm)
 }
 
 
+/**
+ * Contexts of destroyed gallivm_create_private() objects, for reuse, since
+ * LLVM contexts are never freed (see gallivm_context below).
+ */
+static struct util_dynarray free_contexts;
+
+pipe_static_mutex(free_contexts_mutex);
+
+
+static LLVMContextRef
+get_private_context(void)
+{
+   LLVMContextRef context = NULL;
+
+   pipe_mutex_lock(free_contexts_mutex);
+   if (util_dynarray_contains(&free_contexts, LLVMContextRef))
+      context = util_dynarray_pop(&free_contexts, LLVMContextRef);
+   pipe_mutex_unlock(free_contexts_mutex);
+
+   if (!context)
+      context = LLVMContextCreate();
+
+   return context;
+}
+
+
+static void
+put_private_context(LLVMContextRef context)
+{
+   pipe_mutex_lock(free_contexts_mutex);
+   util_dynarray_append(&free_contexts, LLVMContextRef, context);
+   pipe_mutex_unlock(free_contexts_mutex);
+}
+
+
 /**
  * Free gallivm object's LLVM allocations, but not the gallivm object itself.
  */
@@ -233,6 +304,9 @@ free_gallivm_state(struct gallivm_state *gallivm)
    if (gallivm->builder)
       LLVMDisposeBuilder(gallivm->builder);
 
+   if (gallivm->private_context && gallivm->context)
+      put_private_context(gallivm->context);
+
    gallivm->engine = NULL;
    gallivm->target = NULL;
    gallivm->module = NULL;
@@ -252,9 +326,13 @@ init_gallivm_engine(struct gallivm_state *gallivm)
       char *error = NULL;
       int ret;
 
-      if (gallivm_debug & GALLIVM_DEBUG_NO_OPT) {
+      if (gallivm_debug & GALLIVM_DEBUG_NO_OPT ||
+          gallivm->tier == GALLIVM_TIER_FAST) {
          optlevel = None;
       }
+      else if (gallivm->tier == GALLIVM_TIER_PEAK) {
+         optlevel = Aggressive;
+      }
       else {
          optlevel = Default;
       }
@@ -264,6 +342,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
                                                     gallivm->module,
                                                     (unsigned) optlevel,
                                                     USE_MCJIT,
+                                                    gallivm->tier == GALLIVM_TIER_PEAK,
                                                     &error);
 #else
       ret = LLVMCreateJITCompiler(&gallivm->engine, gallivm->provider,
@@ -327,10 +406,15 @@ static LLVMContextRef gallivm_context = NULL;
 
 /**
  * Allocate gallivm LLVM objects.
+ *
+ * If bitcode is given, the module is parsed from it instead of starting out
+ * empty.
+ *
  * \return  TRUE for success, FALSE for failure
  */
 static boolean
-init_gallivm_state(struct gallivm_state *gallivm)
+init_gallivm_state(struct gallivm_state *gallivm,
+                   const void *bitcode, size_t bitcode_size)
 {
    assert(!gallivm->context);
    assert(!gallivm->module);
@@ -338,15 +422,44 @@ init_gallivm_state(struct gallivm_state *gallivm)
 
    lp_build_init();
 
-   if (!gallivm_context) {
-      gallivm_context = LLVMContextCreate();
+   if (gallivm->private_context) {
+      gallivm->context = get_private_context();
+   }
+   else {
+      if (!gallivm_context) {
+         gallivm_context = LLVMContextCreate();
+      }
+      gallivm->context = gallivm_context;
    }
-   gallivm->context = gallivm_context;
    if (!gallivm->context)
       goto fail;
 
-   gallivm->module = LLVMModuleCreateWithNameInContext("gallivm",
-                                                       gallivm->context);
+   if (bitcode) {
+#if HAVE_LLVM >= 0x0301
+      LLVMMemoryBufferRef buffer;
+      char *error = NULL;
+
+      buffer = LLVMCreateMemoryBufferWithMemoryRangeCopy(bitcode,
+                                                         bitcode_size,
+                                                         "gallivm");
+      if (!buffer)
+         goto fail;
+
+      if (LLVMParseBitcodeInContext(gallivm->context, buffer,
+                                    &gallivm->module, &error)) {
+         if (error) {
+            _debug_printf("%s\n", error);
+            LLVMDisposeMessage(error);
+         }
+         gallivm->module = NULL;
+      }
+      LLVMDisposeMemoryBuffer(buffer);
+#endif
+   }
+   else {
+      gallivm->module = LLVMModuleCreateWithNameInContext("gallivm",
+                                                          gallivm->context);
+   }
    if (!gallivm->module)
       goto fail;
 
@@ -453,9 +566,35 @@ lp_build_init(void)
       lp_native_vector_width = 128;
    }
  
+   /* Opt-in wide vector mode: use the widest vectors the CPU and the JIT
+    * can handle, i.e., 16 floats with AVX-512 or 8 floats with AVX2 (on
+    * any vendor, as AVX2 parts no longer split 256-bit ops).  This also
+    * enables FMA code generation.  Note llvmpipe's fragment shaders are
+    * limited to 256-bit vectors regardless.
+    */
+   lp_wide_vectors = debug_get_bool_option("LP_WIDE_VECTORS", FALSE);
+   if (lp_wide_vectors) {
+      if (HAVE_AVX512 && util_cpu_caps.has_avx512f) {
+         lp_native_vector_width = 512;
+      } else if (HAVE_AVX && util_cpu_caps.has_avx2) {
+         lp_native_vector_width = 256;
+      }
+   } else {
+      util_cpu_caps.has_fma = 0;
+   }
+
    lp_native_vector_width = debug_get_num_option("LP_NATIVE_VECTOR_WIDTH",
                                                  lp_native_vector_width);
 
+   if (lp_native_vector_width > 256 &&
+       !(HAVE_AVX512 && util_cpu_caps.has_avx512f)) {
+      lp_native_vector_width = 256;
+   }
+
+   if (lp_native_vector_width <= 256) {
+      util_cpu_caps.has_avx512f = 0;
+   }
+
    if (lp_native_vector_width <= 128) {
       /* Hide AVX support, as often LLVM AVX instrinsics are only guarded by
        * "util_cpu_caps.has_avx" predicate, and lack the
@@ -463,6 +602,8 @@ lp_build_init(void)
        * consistent behavior, allowing one to test SSE2 on AVX machines.
        */
       util_cpu_caps.has_avx = 0;
+      util_cpu_caps.has_avx2 = 0;
+      util_cpu_caps.has_fma = 0;
    }
 
    if (!HAVE_AVX) {
@@ -472,6 +613,12 @@ lp_build_init(void)
        * omit it unnecessarily on amd cpus, see above).
        */
       util_cpu_caps.has_f16c = 0;
+      util_cpu_caps.has_avx2 = 0;
+      util_cpu_caps.has_fma = 0;
+   }
+
+   if (!HAVE_AVX512) {
+      util_cpu_caps.has_avx512f = 0;
    }
 
 #ifdef PIPE_ARCH_PPC_64
@@ -501,6 +648,9 @@ lp_build_init(void)
    util_cpu_caps.has_ssse3 = 0;
    util_cpu_caps.has_sse4_1 = 0;
    util_cpu_caps.has_avx = 0;
+   util_cpu_caps.has_avx2 = 0;
+   util_cpu_caps.has_fma = 0;
+   util_cpu_caps.has_avx512f = 0;
    util_cpu_caps.has_f16c = 0;
 #endif
 }
@@ -524,7 +674,8 @@ gallivm_create(void)
 
    gallivm = CALLOC_STRUCT(gallivm_state);
    if (gallivm) {
-      if (!init_gallivm_state(gallivm)) {
+      gallivm->tier = GALLIVM_TIER_DEFAULT;
+      if (!init_gallivm_state(gallivm, NULL, 0)) {
          FREE(gallivm);
          gallivm = NULL;
       }
@@ -538,6 +689,73 @@ gallivm_create(void)
 }
 
 
+/**
+ * Create a new gallivm_state object with an LLVM context of its own, which
+ * optimizes and compiles its code at the given tier.
+ *
+ * Unlike with gallivm_create(), the module can be optimized and compiled on
+ * another thread while the creating thread goes on building other modules.
+ * Only one thread may use the object at a time, though.  So that the
+ * creating thread doesn't pay for it, optimization is deferred from
+ * gallivm_verify_function() to gallivm_optimize_module().
+ */
+struct gallivm_state *
+gallivm_create_private(enum gallivm_tier tier)
+{
+   struct gallivm_state *gallivm;
+
+#if HAVE_LLVM <= 0x206
+   /* Only one execution engine */
+   gallivm = NULL;
+#else
+   gallivm = CALLOC_STRUCT(gallivm_state);
+   if (gallivm) {
+      gallivm->private_context = TRUE;
+      gallivm->tier = tier;
+      if (!init_gallivm_state(gallivm, NULL, 0)) {
+         FREE(gallivm);
+         gallivm = NULL;
+      }
+   }
+#endif
+
+   return gallivm;
+}
+
+
+/**
+ * Create a new gallivm_state object whose module is deserialized from
+ * previously written LLVM bitcode (see gallivm_cache_store()).
+ *
+ * The functions in the module are already optimized, so they can be handed
+ * to gallivm_compile_module()/gallivm_jit_function() directly.
+ */
+struct gallivm_state *
+gallivm_create_from_bitcode(const void *data, size_t size)
+{
+   struct gallivm_state *gallivm;
+
+   assert(data);
+
+#if HAVE_LLVM <= 0x0300
+   /* No in-memory bitcode parsing through the C API */
+   (void) size;
+   gallivm = NULL;
+#else
+   gallivm = CALLOC_STRUCT(gallivm_state);
+   if (gallivm) {
+      gallivm->tier = GALLIVM_TIER_DEFAULT;
+      if (!init_gallivm_state(gallivm, data, size)) {
+         FREE(gallivm);
+         gallivm = NULL;
+      }
+   }
+#endif
+
+   return gallivm;
+}
+
+
 /**
  * Destroy a gallivm_state object.
  */
@@ -596,7 +814,10 @@ gallivm_verify_function(struct gallivm_state *gallivm,
    }
 #endif
 
-   gallivm_optimize_function(gallivm, func);
+   if (gallivm->private_context)
+      gallivm->optimize_pending = TRUE;
+   else
+      gallivm_optimize_function(gallivm, func);
 
    if (gallivm_debug & GALLIVM_DEBUG_IR) {
       /* Print the LLVM IR to stderr */
@@ -606,6 +827,29 @@ gallivm_verify_function(struct gallivm_state *gallivm,
 }
 
 
+/**
+ * Run the optimization passes deferred by gallivm_verify_function() over
+ * all the functions of the module.
+ */
+void
+gallivm_optimize_module(struct gallivm_state *gallivm)
+{
+   LLVMValueRef func;
+
+   if (!gallivm->optimize_pending)
+      return;
+
+   for (func = LLVMGetFirstFunction(gallivm->module);
+        func;
+        func = LLVMGetNextFunction(func)) {
+      if (!LLVMIsDeclaration(func))
+         gallivm_optimize_function(gallivm, func);
+   }
+
+   gallivm->optimize_pending = FALSE;
+}
+
+
 void
 gallivm_compile_module(struct gallivm_state *gallivm)
 {
@@ -613,6 +857,8 @@ gallivm_compile_module(struct gallivm_state *gallivm)
    assert(!gallivm->compiled);
 #endif
 
+   gallivm_optimize_module(gallivm);
+
    /* Dump byte code to a file */
    if (0) {
       LLVMWriteBitcodeToFile(gallivm->module, "llvmpipe.bc");
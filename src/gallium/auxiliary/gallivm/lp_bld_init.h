@@ -36,6 +36,18 @@
 #include <llvm-c/ExecutionEngine.h>
 
 
+/**
+ * Optimization tiers.  Code that only runs a few times is best compiled
+ * quickly, while hot code is worth optimizing harder.
+ */
+enum gallivm_tier
+{
+   GALLIVM_TIER_FAST = 0,     /**< minimal passes, fast code generation */
+   GALLIVM_TIER_DEFAULT = 1,  /**< what gallivm_create() uses */
+   GALLIVM_TIER_PEAK = 2      /**< more passes, aggressive, host tuned */
+};
+
+
 struct gallivm_state
 {
    LLVMModuleRef module;
@@ -46,6 +58,20 @@ struct gallivm_state
    LLVMContextRef context;
    LLVMBuilderRef builder;
    unsigned compiled;
+
+   /**
+    * Set when the generated code embeds host addresses (e.g., C helper
+    * functions), which makes the module unsuitable for persistent caching.
+    */
+   boolean has_absolute_addresses;
+
+   /** Set when the LLVM context isn't shared with other objects */
+   boolean private_context;
+
+   enum gallivm_tier tier;
+
+   /** Function optimization left to gallivm_optimize_module() */
+   boolean optimize_pending;
 };
 
 
@@ -56,6 +82,12 @@ lp_build_init(void);
 struct gallivm_state *
 gallivm_create(void);
 
+struct gallivm_state *
+gallivm_create_private(enum gallivm_tier tier);
+
+struct gallivm_state *
+gallivm_create_from_bitcode(const void *data, size_t size);
+
 void
 gallivm_destroy(struct gallivm_state *gallivm);
 
@@ -64,6 +96,9 @@ void
 gallivm_verify_function(struct gallivm_state *gallivm,
                         LLVMValueRef func);
 
+void
+gallivm_optimize_module(struct gallivm_state *gallivm);
+
 void
 gallivm_compile_module(struct gallivm_state *gallivm);
 
@@ -59,6 +59,7 @@
 #include <llvm/ExecutionEngine/JITMemoryManager.h>
 #endif
 #include <llvm/Support/CommandLine.h>
+#include <llvm/Support/Host.h>
 #include <llvm/Support/PrettyStackTrace.h>
 
 #if HAVE_LLVM >= 0x0300
@@ -259,6 +260,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
                                         LLVMModuleRef M,
                                         unsigned OptLevel,
                                         int useMCJIT,
+                                        int tuneForHost,
                                         char **OutError)
 {
    using namespace llvm;
@@ -294,7 +296,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
        builder.setUseMCJIT(true);
    }
 
-   llvm::SmallVector<std::string, 1> MAttrs;
+   llvm::SmallVector<std::string, 4> MAttrs;
    if (util_cpu_caps.has_avx) {
       /*
        * AVX feature is not automatically detected from CPUID by the X86 target
@@ -306,6 +308,19 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
       if (util_cpu_caps.has_f16c) {
          MAttrs.push_back("+f16c");
       }
+      /* Like FMA, AVX2 code generation is part of the opt-in wide vector
+       * mode.  has_avx2 stays set regardless, for the other users of
+       * util_cpu_caps.
+       */
+      if (lp_wide_vectors && util_cpu_caps.has_avx2) {
+         MAttrs.push_back("+avx2");
+      }
+      if (util_cpu_caps.has_fma) {
+         MAttrs.push_back("+fma");
+      }
+      if (util_cpu_caps.has_avx512f) {
+         MAttrs.push_back("+avx512f");
+      }
       builder.setMAttrs(MAttrs);
    }
    builder.setJITMemoryManager(JITMemoryManager::CreateDefaultMemManager());
@@ -319,6 +334,16 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
     */
    StringRef MArch = "";
    StringRef MCPU = "";
+   /*
+    * Schedule for the host CPU.  Naming the CPU also turns on all its
+    * features though, so don't with the old JIT on AVX capable hosts, see
+    * above.
+    */
+   std::string HostCPU;
+   if (tuneForHost && (useMCJIT || !util_cpu_caps.has_avx)) {
+      HostCPU = sys::getHostCPUName();
+      MCPU = HostCPU;
+   }
    Triple TT(unwrap(M)->getTargetTriple());
    JIT = builder.create(builder.selectTarget(TT, MArch, MCPU, MAttrs));
 #endif
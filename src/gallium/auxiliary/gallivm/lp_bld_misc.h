@@ -39,6 +39,9 @@ extern "C" {
 #endif
 
 
+/** Whether the opt-in LP_WIDE_VECTORS mode is on, set by lp_build_init() */
+extern boolean lp_wide_vectors;
+
 
 extern void
 lp_set_target_options(void);
@@ -57,6 +60,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
                                         LLVMModuleRef M,
                                         unsigned OptLevel,
                                         int useMCJIT,
+                                        int tuneForHost,
                                         char **OutError);
 
 
@@ -80,6 +80,27 @@ static INLINE int pipe_thread_destroy( pipe_thread thread )
    return pthread_detach( thread );
 }
 
+/**
+ * Bind the calling thread to the given CPU.
+ * \return  TRUE for success, FALSE if not supported or failed
+ */
+static INLINE boolean pipe_thread_pin_self( unsigned cpu )
+{
+#if defined(PIPE_OS_LINUX) && defined(_GNU_SOURCE)
+   cpu_set_t set;
+
+   if (cpu >= CPU_SETSIZE)
+      return FALSE;
+
+   CPU_ZERO(&set);
+   CPU_SET(cpu, &set);
+   return pthread_setaffinity_np(pthread_self(), sizeof set, &set) == 0;
+#else
+   (void) cpu;
+   return FALSE;
+#endif
+}
+
 
 /* pipe_mutex
  */
@@ -156,6 +177,13 @@ static INLINE int pipe_thread_destroy( pipe_thread thread )
    return -1;
 }
 
+static INLINE boolean pipe_thread_pin_self( unsigned cpu )
+{
+   if (cpu >= 8 * sizeof(DWORD_PTR))
+      return FALSE;
+   return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR) 1 << cpu) != 0;
+}
+
 
 /* pipe_mutex
  */
@@ -265,6 +293,11 @@ static INLINE int pipe_thread_destroy( pipe_thread thread )
    return -1;
 }
 
+static INLINE boolean pipe_thread_pin_self( unsigned cpu )
+{
+   return FALSE;
+}
+
 typedef unsigned pipe_mutex;
 
 #define pipe_static_mutex(mutex) \
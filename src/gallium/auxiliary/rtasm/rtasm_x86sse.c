@@ -123,6 +123,15 @@ void x86_print_reg( struct x86_reg reg )
    debug_printf( ", %u", I );                   \
 } while( 0 )
 
+#define DUMP_RRR( R0, R1, R2 ) do {             \
+   DUMP();                                      \
+   x86_print_reg( R0 );                            \
+   debug_printf( ", " );                        \
+   x86_print_reg( R1 );                            \
+   debug_printf( ", " );                        \
+   x86_print_reg( R2 );                            \
+} while( 0 )
+
 #else
 
 #define DUMP_START()
@@ -133,6 +142,7 @@ void x86_print_reg( struct x86_reg reg )
 #define DUMP_RR( R0, R1 )
 #define DUMP_RI( R0, I )
 #define DUMP_RRI( R0, R1, I )
+#define DUMP_RRR( R0, R1, R2 )
 
 #endif
 
@@ -1508,6 +1518,84 @@ void sse2_rcpss( struct x86_function *p,
    emit_modrm( p, dst, src );
 }
 
+/***********************************************************************
+ * AVX (VEX encoded) instructions
+ */
+
+#define VEX_PP_66   1
+#define VEX_MAP_0F38 2
+
+/* Emit a three byte VEX prefix for a 128-bit operation.  vvvv is the
+ * index of the extra source register, or 0 if the instruction doesn't
+ * have one.  Like emit_modrm, this only supports the first eight
+ * registers, so the inverted REX-like R, X and B bits are always set.
+ */
+static void emit_vex( struct x86_function *p,
+                      unsigned map,
+                      unsigned pp,
+                      unsigned vvvv )
+{
+   assert(vvvv < 16);
+   emit_3ub(p, 0xc4, 0xe0 | map, ((~vvvv & 0xf) << 3) | pp);
+}
+
+/* Convert the four half floats in the low 64 bits of src to floats.
+ * Requires F16C.
+ */
+void f16c_vcvtph2ps( struct x86_function *p,
+                     struct x86_reg dst,
+                     struct x86_reg src )
+{
+   DUMP_RR( dst, src );
+   assert(p->caps & X86_F16C);
+   emit_vex(p, VEX_MAP_0F38, VEX_PP_66, 0);
+   emit_1ub(p, 0x13);
+   emit_modrm( p, dst, src );
+}
+
+static void avx2_shift_var( struct x86_function *p,
+                            unsigned char op,
+                            struct x86_reg dst,
+                            struct x86_reg src0,
+                            struct x86_reg src1 )
+{
+   assert(p->caps & X86_AVX2);
+   assert(src0.file == file_XMM && src0.mod == mod_REG);
+   emit_vex(p, VEX_MAP_0F38, VEX_PP_66, src0.idx);
+   emit_1ub(p, op);
+   emit_modrm( p, dst, src1 );
+}
+
+/* dst = src0 << src1, with a separate shift count in each dword of src1 */
+void avx2_vpsllvd( struct x86_function *p,
+                   struct x86_reg dst,
+                   struct x86_reg src0,
+                   struct x86_reg src1 )
+{
+   DUMP_RRR( dst, src0, src1 );
+   avx2_shift_var(p, 0x47, dst, src0, src1);
+}
+
+/* dst = src0 >> src1, logical, with per dword shift counts */
+void avx2_vpsrlvd( struct x86_function *p,
+                   struct x86_reg dst,
+                   struct x86_reg src0,
+                   struct x86_reg src1 )
+{
+   DUMP_RRR( dst, src0, src1 );
+   avx2_shift_var(p, 0x45, dst, src0, src1);
+}
+
+/* dst = src0 >> src1, arithmetic, with per dword shift counts */
+void avx2_vpsravd( struct x86_function *p,
+                   struct x86_reg dst,
+                   struct x86_reg src0,
+                   struct x86_reg src1 )
+{
+   DUMP_RRR( dst, src0, src1 );
+   avx2_shift_var(p, 0x46, dst, src0, src1);
+}
+
 /***********************************************************************
  * x87 instructions
  */
@@ -2164,6 +2252,12 @@ static void x86_init_func_common( struct x86_function *p )
       p->caps |= X86_SSE3;
    if(util_cpu_caps.has_sse4_1)
       p->caps |= X86_SSE4_1;
+   if(util_cpu_caps.has_avx)
+      p->caps |= X86_AVX;
+   if(util_cpu_caps.has_avx2)
+      p->caps |= X86_AVX2;
+   if(util_cpu_caps.has_f16c)
+      p->caps |= X86_F16C;
    p->csr = p->store;
    DUMP_START();
 }
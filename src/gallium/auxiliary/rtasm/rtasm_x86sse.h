@@ -47,6 +47,9 @@ struct x86_reg {
 #define X86_SSE2 8
 #define X86_SSE3 0x10
 #define X86_SSE4_1 0x20
+#define X86_AVX 0x40
+#define X86_AVX2 0x80
+#define X86_F16C 0x100
 
 struct x86_function {
    unsigned caps;
@@ -266,6 +269,11 @@ void sse2_psrad_imm( struct x86_function *p, struct x86_reg dst, unsigned imm );
 
 void sse2_por( struct x86_function *p, struct x86_reg dst, struct x86_reg src );
 
+void f16c_vcvtph2ps( struct x86_function *p, struct x86_reg dst, struct x86_reg src );
+void avx2_vpsllvd( struct x86_function *p, struct x86_reg dst, struct x86_reg src0, struct x86_reg src1 );
+void avx2_vpsrlvd( struct x86_function *p, struct x86_reg dst, struct x86_reg src0, struct x86_reg src1 );
+void avx2_vpsravd( struct x86_function *p, struct x86_reg dst, struct x86_reg src0, struct x86_reg src1 );
+
 void sse2_pshuflw( struct x86_function *p, struct x86_reg dst, struct x86_reg src, uint8_t imm );
 void sse2_pshufhw( struct x86_function *p, struct x86_reg dst, struct x86_reg src, uint8_t imm );
 void sse2_pshufd( struct x86_function *p, struct x86_reg dst, struct x86_reg src, uint8_t imm );
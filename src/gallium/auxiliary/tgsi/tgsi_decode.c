@@ -0,0 +1,164 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * One-time decoding of TGSI shaders.
+ *
+ * tgsi_parse expands the bit-packed tokens one at a time, every time a
+ * shader is walked.  Here the shader is expanded once into flat arrays of
+ * declarations, immediates, instructions and properties, plus an array of
+ * token types recording their interleaving.
+ * Consumers which need the tokens more than once, such as tgsi_exec and
+ * tgsi_scan, can share the result.
+ */
+
+#include "util/u_debug.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "tgsi/tgsi_decode.h"
+
+
+/**
+ * Make room for one more element in an array of *max elements, growing it
+ * geometrically.
+ * \return FALSE if out of memory
+ */
+static boolean
+grow_array(void **array, uint count, uint *max, size_t elem_size)
+{
+   uint new_max;
+   void *new_array;
+
+   if (count < *max)
+      return TRUE;
+
+   new_max = MAX2(*max * 2, 16);
+   new_array = REALLOC(*array, *max * elem_size, new_max * elem_size);
+   if (!new_array)
+      return FALSE;
+
+   *array = new_array;
+   *max = new_max;
+   return TRUE;
+}
+
+
+#define GROW(shader, array, count, max) \
+   grow_array((void **) &(shader)->array, (shader)->count, &max, \
+              sizeof (shader)->array[0])
+
+
+/**
+ * Decode a shader.
+ * \return the decoded shader, or NULL if out of memory or the tokens are
+ *         malformed
+ */
+struct tgsi_decoded_shader *
+tgsi_decode_shader(const struct tgsi_token *tokens)
+{
+   struct tgsi_decoded_shader *shader;
+   struct tgsi_parse_context parse;
+   uint max_tokens = 0, max_declarations = 0, max_immediates = 0;
+   uint max_instructions = 0, max_properties = 0;
+   boolean ok = TRUE;
+
+   if (tgsi_parse_init(&parse, tokens) != TGSI_PARSE_OK)
+      return NULL;
+
+   shader = CALLOC_STRUCT(tgsi_decoded_shader);
+   if (!shader) {
+      tgsi_parse_free(&parse);
+      return NULL;
+   }
+
+   shader->Tokens = tokens;
+   shader->FullHeader = parse.FullHeader;
+
+   while (ok && !tgsi_parse_end_of_tokens(&parse)) {
+      tgsi_parse_token(&parse);
+
+      ok = GROW(shader, TokenTypes, NumTokens, max_tokens);
+      if (!ok)
+         break;
+      shader->TokenTypes[shader->NumTokens++] = parse.FullToken.Token.Type;
+
+      switch (parse.FullToken.Token.Type) {
+      case TGSI_TOKEN_TYPE_DECLARATION:
+         ok = GROW(shader, Declarations, NumDeclarations, max_declarations);
+         if (ok)
+            shader->Declarations[shader->NumDeclarations++] =
+               parse.FullToken.FullDeclaration;
+         break;
+      case TGSI_TOKEN_TYPE_IMMEDIATE:
+         ok = GROW(shader, Immediates, NumImmediates, max_immediates);
+         if (ok)
+            shader->Immediates[shader->NumImmediates++] =
+               parse.FullToken.FullImmediate;
+         break;
+      case TGSI_TOKEN_TYPE_INSTRUCTION:
+         ok = GROW(shader, Instructions, NumInstructions, max_instructions);
+         if (ok)
+            shader->Instructions[shader->NumInstructions++] =
+               parse.FullToken.FullInstruction;
+         break;
+      case TGSI_TOKEN_TYPE_PROPERTY:
+         ok = GROW(shader, Properties, NumProperties, max_properties);
+         if (ok)
+            shader->Properties[shader->NumProperties++] =
+               parse.FullToken.FullProperty;
+         break;
+      default:
+         assert(0);
+         ok = FALSE;
+      }
+   }
+
+   tgsi_parse_free(&parse);
+
+   if (!ok) {
+      tgsi_decoded_shader_destroy(shader);
+      return NULL;
+   }
+
+   return shader;
+}
+
+
+void
+tgsi_decoded_shader_destroy(struct tgsi_decoded_shader *shader)
+{
+   if (!shader)
+      return;
+
+   FREE(shader->TokenTypes);
+   FREE(shader->Declarations);
+   FREE(shader->Immediates);
+   FREE(shader->Instructions);
+   FREE(shader->Properties);
+   FREE(shader);
+}
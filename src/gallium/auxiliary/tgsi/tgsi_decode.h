@@ -0,0 +1,152 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * A shader decoded once into arrays of full tokens, so that the
+ * consumers which walk it repeatedly don't each re-run tgsi_parse.
+ */
+
+#ifndef TGSI_DECODE_H
+#define TGSI_DECODE_H
+
+#include "pipe/p_compiler.h"
+#include "pipe/p_shader_tokens.h"
+#include "util/u_debug.h"
+#include "tgsi/tgsi_parse.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+struct tgsi_decoded_shader
+{
+   const struct tgsi_token *Tokens;
+   struct tgsi_full_header FullHeader;
+
+   /** TGSI_TOKEN_TYPE_x of every token, in program order */
+   ubyte *TokenTypes;
+   uint NumTokens;
+
+   struct tgsi_full_declaration *Declarations;
+   uint NumDeclarations;
+
+   struct tgsi_full_immediate *Immediates;
+   uint NumImmediates;
+
+   struct tgsi_full_instruction *Instructions;
+   uint NumInstructions;
+
+   struct tgsi_full_property *Properties;
+   uint NumProperties;
+};
+
+/**
+ * Walks the tokens of a decoded shader in program order.  After each
+ * successful tgsi_decoded_next(), Type says which one of the pointers is
+ * valid.
+ */
+struct tgsi_decoded_iterator
+{
+   const struct tgsi_decoded_shader *Shader;
+   uint Position;
+   uint Type;
+
+   /** Number of tokens of each kind walked so far */
+   uint Declaration;
+   uint Immediate;
+   uint Instruction;
+   uint Property;
+
+   const struct tgsi_full_declaration *FullDeclaration;
+   const struct tgsi_full_immediate *FullImmediate;
+   const struct tgsi_full_instruction *FullInstruction;
+   const struct tgsi_full_property *FullProperty;
+};
+
+struct tgsi_decoded_shader *
+tgsi_decode_shader(const struct tgsi_token *tokens);
+
+void
+tgsi_decoded_shader_destroy(struct tgsi_decoded_shader *shader);
+
+
+static INLINE void
+tgsi_decoded_iterator_init(struct tgsi_decoded_iterator *it,
+                           const struct tgsi_decoded_shader *shader)
+{
+   it->Shader = shader;
+   it->Position = 0;
+   it->Type = TGSI_TOKEN_TYPE_DECLARATION;
+   it->Declaration = 0;
+   it->Immediate = 0;
+   it->Instruction = 0;
+   it->Property = 0;
+   it->FullDeclaration = NULL;
+   it->FullImmediate = NULL;
+   it->FullInstruction = NULL;
+   it->FullProperty = NULL;
+}
+
+/**
+ * Advance to the next token.
+ * \return FALSE at the end of the shader
+ */
+static INLINE boolean
+tgsi_decoded_next(struct tgsi_decoded_iterator *it)
+{
+   if (it->Position >= it->Shader->NumTokens)
+      return FALSE;
+
+   it->Type = it->Shader->TokenTypes[it->Position++];
+
+   switch (it->Type) {
+   case TGSI_TOKEN_TYPE_DECLARATION:
+      it->FullDeclaration = &it->Shader->Declarations[it->Declaration++];
+      break;
+   case TGSI_TOKEN_TYPE_IMMEDIATE:
+      it->FullImmediate = &it->Shader->Immediates[it->Immediate++];
+      break;
+   case TGSI_TOKEN_TYPE_INSTRUCTION:
+      it->FullInstruction = &it->Shader->Instructions[it->Instruction++];
+      break;
+   case TGSI_TOKEN_TYPE_PROPERTY:
+      it->FullProperty = &it->Shader->Properties[it->Property++];
+      break;
+   default:
+      assert(0);
+   }
+
+   return TRUE;
+}
+
+
+#if defined __cplusplus
+}
+#endif
+
+#endif /* TGSI_DECODE_H */
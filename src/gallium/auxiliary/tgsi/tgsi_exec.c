@@ -54,12 +54,14 @@
 #include "pipe/p_compiler.h"
 #include "pipe/p_state.h"
 #include "pipe/p_shader_tokens.h"
+#include "tgsi/tgsi_decode.h"
 #include "tgsi/tgsi_dump.h"
 #include "tgsi/tgsi_parse.h"
 #include "tgsi/tgsi_util.h"
 #include "tgsi_exec.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
+#include "util/u_sse.h"
 
 
 #define DEBUG_EXECUTION 0
@@ -76,10 +78,15 @@ static void
 micro_abs(union tgsi_exec_channel *dst,
           const union tgsi_exec_channel *src)
 {
+#if defined(PIPE_ARCH_SSE)
+   const __m128 a = _mm_loadu_ps(src->f);
+   _mm_storeu_ps(dst->f, _mm_andnot_ps(_mm_set1_ps(-0.0f), a));
+#else
    dst->f[0] = fabsf(src->f[0]);
    dst->f[1] = fabsf(src->f[1]);
    dst->f[2] = fabsf(src->f[2]);
    dst->f[3] = fabsf(src->f[3]);
+#endif
 }
 
 static void
@@ -275,10 +282,17 @@ micro_lrp(union tgsi_exec_channel *dst,
           const union tgsi_exec_channel *src1,
           const union tgsi_exec_channel *src2)
 {
+#if defined(PIPE_ARCH_SSE)
+   const __m128 a = _mm_loadu_ps(src0->f);
+   const __m128 b = _mm_loadu_ps(src1->f);
+   const __m128 c = _mm_loadu_ps(src2->f);
+   _mm_storeu_ps(dst->f, _mm_add_ps(_mm_mul_ps(a, _mm_sub_ps(b, c)), c));
+#else
    dst->f[0] = src0->f[0] * (src1->f[0] - src2->f[0]) + src2->f[0];
    dst->f[1] = src0->f[1] * (src1->f[1] - src2->f[1]) + src2->f[1];
    dst->f[2] = src0->f[2] * (src1->f[2] - src2->f[2]) + src2->f[2];
    dst->f[3] = src0->f[3] * (src1->f[3] - src2->f[3]) + src2->f[3];
+#endif
 }
 
 static void
@@ -287,10 +301,17 @@ micro_mad(union tgsi_exec_channel *dst,
           const union tgsi_exec_channel *src1,
           const union tgsi_exec_channel *src2)
 {
+#if defined(PIPE_ARCH_SSE)
+   const __m128 a = _mm_loadu_ps(src0->f);
+   const __m128 b = _mm_loadu_ps(src1->f);
+   const __m128 c = _mm_loadu_ps(src2->f);
+   _mm_storeu_ps(dst->f, _mm_add_ps(_mm_mul_ps(a, b), c));
+#else
    dst->f[0] = src0->f[0] * src1->f[0] + src2->f[0];
    dst->f[1] = src0->f[1] * src1->f[1] + src2->f[1];
    dst->f[2] = src0->f[2] * src1->f[2] + src2->f[2];
    dst->f[3] = src0->f[3] * src1->f[3] + src2->f[3];
+#endif
 }
 
 static void
@@ -313,10 +334,15 @@ micro_rcp(union tgsi_exec_channel *dst,
    assert(src->f[2] != 0.0f);
    assert(src->f[3] != 0.0f);
 #endif
+#if defined(PIPE_ARCH_SSE)
+   const __m128 a = _mm_loadu_ps(src->f);
+   _mm_storeu_ps(dst->f, _mm_div_ps(_mm_set1_ps(1.0f), a));
+#else
    dst->f[0] = 1.0f / src->f[0];
    dst->f[1] = 1.0f / src->f[1];
    dst->f[2] = 1.0f / src->f[2];
    dst->f[3] = 1.0f / src->f[3];
+#endif
 }
 
 static void
@@ -360,10 +386,16 @@ micro_seq(union tgsi_exec_channel *dst,
           const union tgsi_exec_channel *src0,
           const union tgsi_exec_channel *src1)
 {
+#if defined(PIPE_ARCH_SSE)
+   const __m128 a = _mm_loadu_ps(src0->f);
+   const __m128 b = _mm_loadu_ps(src1->f);
+   _mm_storeu_ps(dst->f, _mm_and_ps(_mm_cmpeq_ps(a, b), _mm_set1_ps(1.0f)));
+#else
    dst->f[0] = src0->f[0] == src1->f[0] ? 1.0f : 0.0f;
    dst->f[1] = src0->f[1] == src1->f[1] ? 1.0f : 0.0f;
    dst->f[2] = src0->f[2] == src1->f[2] ? 1.0f : 0.0f;
    dst->f[3] = src0->f[3] == src1->f[3] ? 1.0f : 0.0f;
+#endif
 }
 
 static void
@@ -371,10 +403,16 @@ micro_sge(union tgsi_exec_channel *dst,
           const union tgsi_exec_channel *src0,
           const union tgsi_exec_channel *src1)
 {
+#if defined(PIPE_ARCH_SSE)
+   const __m128 a = _mm_loadu_ps(src0->f);
+   const __m128 b = _mm_loadu_ps(src1->f);
+   _mm_storeu_ps(dst->f, _mm_and_ps(_mm_cmpge_ps(a, b), _mm_set1_ps(1.0f)));
+#else
    dst->f[0] = src0->f[0] >= src1->f[0] ? 1.0f : 0.0f;
    dst->f[1] = src0->f[1] >= src1->f[1] ? 1.0f : 0.0f;
    dst->f[2] = src0->f[2] >= src1->f[2] ? 1.0f : 0.0f;
    dst->f[3] = src0->f[3] >= src1->f[3] ? 1.0f : 0.0f;
+#endif
 }
 
 static void
@@ -402,10 +440,16 @@ micro_sgt(union tgsi_exec_channel *dst,
           const union tgsi_exec_channel *src0,
           const union tgsi_exec_channel *src1)
 {
+#if defined(PIPE_ARCH_SSE)
+   const __m128 a = _mm_loadu_ps(src0->f);
+   const __m128 b = _mm_loadu_ps(src1->f);
+   _mm_storeu_ps(dst->f, _mm_and_ps(_mm_cmpgt_ps(a, b), _mm_set1_ps(1.0f)));
+#else
    dst->f[0] = src0->f[0] > src1->f[0] ? 1.0f : 0.0f;
    dst->f[1] = src0->f[1] > src1->f[1] ? 1.0f : 0.0f;
    dst->f[2] = src0->f[2] > src1->f[2] ? 1.0f : 0.0f;
    dst->f[3] = src0->f[3] > src1->f[3] ? 1.0f : 0.0f;
+#endif
 }
 
 static void
@@ -423,10 +467,16 @@ micro_sle(union tgsi_exec_channel *dst,
           const union tgsi_exec_channel *src0,
           const union tgsi_exec_channel *src1)
 {
+#if defined(PIPE_ARCH_SSE)
+   const __m128 a = _mm_loadu_ps(src0->f);
+   const __m128 b = _mm_loadu_ps(src1->f);
+   _mm_storeu_ps(dst->f, _mm_and_ps(_mm_cmple_ps(a, b), _mm_set1_ps(1.0f)));
+#else
    dst->f[0] = src0->f[0] <= src1->f[0] ? 1.0f : 0.0f;
    dst->f[1] = src0->f[1] <= src1->f[1] ? 1.0f : 0.0f;
    dst->f[2] = src0->f[2] <= src1->f[2] ? 1.0f : 0.0f;
    dst->f[3] = src0->f[3] <= src1->f[3] ? 1.0f : 0.0f;
+#endif
 }
 
 static void
@@ -434,10 +484,16 @@ micro_slt(union tgsi_exec_channel *dst,
           const union tgsi_exec_channel *src0,
           const union tgsi_exec_channel *src1)
 {
+#if defined(PIPE_ARCH_SSE)
+   const __m128 a = _mm_loadu_ps(src0->f);
+   const __m128 b = _mm_loadu_ps(src1->f);
+   _mm_storeu_ps(dst->f, _mm_and_ps(_mm_cmplt_ps(a, b), _mm_set1_ps(1.0f)));
+#else
    dst->f[0] = src0->f[0] < src1->f[0] ? 1.0f : 0.0f;
    dst->f[1] = src0->f[1] < src1->f[1] ? 1.0f : 0.0f;
    dst->f[2] = src0->f[2] < src1->f[2] ? 1.0f : 0.0f;
    dst->f[3] = src0->f[3] < src1->f[3] ? 1.0f : 0.0f;
+#endif
 }
 
 static void
@@ -445,10 +501,16 @@ micro_sne(union tgsi_exec_channel *dst,
           const union tgsi_exec_channel *src0,
           const union tgsi_exec_channel *src1)
 {
+#if defined(PIPE_ARCH_SSE)
+   const __m128 a = _mm_loadu_ps(src0->f);
+   const __m128 b = _mm_loadu_ps(src1->f);
+   _mm_storeu_ps(dst->f, _mm_and_ps(_mm_cmpneq_ps(a, b), _mm_set1_ps(1.0f)));
+#else
    dst->f[0] = src0->f[0] != src1->f[0] ? 1.0f : 0.0f;
    dst->f[1] = src0->f[1] != src1->f[1] ? 1.0f : 0.0f;
    dst->f[2] = src0->f[2] != src1->f[2] ? 1.0f : 0.0f;
    dst->f[3] = src0->f[3] != src1->f[3] ? 1.0f : 0.0f;
+#endif
 }
 
 static void
@@ -633,57 +695,31 @@ tgsi_check_soa_dependencies(const struct tgsi_full_instruction *inst)
 
 
 /**
- * Initialize machine state by expanding tokens to full instructions,
+ * Initialize machine state from a shader decoded with tgsi_decode_shader(),
  * allocating temporary storage, setting up constants, etc.
+ * The decoded shader must stay alive for as long as it's bound.
  * After this, we can call tgsi_exec_machine_run() many times.
  */
-void 
-tgsi_exec_machine_bind_shader(
+void
+tgsi_exec_machine_bind_decoded_shader(
    struct tgsi_exec_machine *mach,
-   const struct tgsi_token *tokens,
+   const struct tgsi_decoded_shader *shader,
    struct tgsi_sampler *sampler)
 {
-   uint k;
-   struct tgsi_parse_context parse;
-   struct tgsi_full_instruction *instructions;
-   struct tgsi_full_declaration *declarations;
-   uint maxInstructions = 10, numInstructions = 0;
-   uint maxDeclarations = 10, numDeclarations = 0;
-
-#if 0
-   tgsi_dump(tokens, 0);
-#endif
+   uint i, j;
 
    util_init_math();
 
-
-   mach->Tokens = tokens;
    mach->Sampler = sampler;
 
-   if (!tokens) {
-      /* unbind and free all */
-      FREE(mach->Declarations);
-      mach->Declarations = NULL;
-      mach->NumDeclarations = 0;
-
-      FREE(mach->Instructions);
-      mach->Instructions = NULL;
-      mach->NumInstructions = 0;
-
-      return;
-   }
-
-   k = tgsi_parse_init (&parse, mach->Tokens);
-   if (k != TGSI_PARSE_OK) {
-      debug_printf( "Problem parsing!\n" );
-      return;
+   /* drop the copy bind_shader decoded for the previous shader */
+   if (mach->OwnShader && mach->OwnShader != shader) {
+      tgsi_decoded_shader_destroy(mach->OwnShader);
+      mach->OwnShader = NULL;
    }
 
-   mach->Processor = parse.FullHeader.Processor.Processor;
-   mach->ImmLimit = 0;
-   mach->NumOutputs = 0;
-
-   if (mach->Processor == TGSI_PROCESSOR_GEOMETRY &&
+   if (shader &&
+       shader->FullHeader.Processor.Processor == TGSI_PROCESSOR_GEOMETRY &&
        !mach->UsedGeometryShader) {
       struct tgsi_exec_vector *inputs;
       struct tgsi_exec_vector *outputs;
@@ -691,119 +727,102 @@ tgsi_exec_machine_bind_shader(
       inputs = align_malloc(sizeof(struct tgsi_exec_vector) *
                             TGSI_MAX_PRIM_VERTICES * PIPE_MAX_ATTRIBS,
                             16);
-
-      if (!inputs)
-         return;
-
       outputs = align_malloc(sizeof(struct tgsi_exec_vector) *
                              TGSI_MAX_TOTAL_VERTICES, 16);
 
-      if (!outputs) {
+      if (inputs && outputs) {
+         align_free(mach->Inputs);
+         align_free(mach->Outputs);
+
+         mach->Inputs = inputs;
+         mach->Outputs = outputs;
+         mach->UsedGeometryShader = TRUE;
+      }
+      else {
          align_free(inputs);
-         return;
+         align_free(outputs);
+         shader = NULL;
       }
-
-      align_free(mach->Inputs);
-      align_free(mach->Outputs);
-
-      mach->Inputs = inputs;
-      mach->Outputs = outputs;
-      mach->UsedGeometryShader = TRUE;
    }
 
-   declarations = (struct tgsi_full_declaration *)
-      MALLOC( maxDeclarations * sizeof(struct tgsi_full_declaration) );
-
-   if (!declarations) {
+   if (!shader) {
+      /* unbind */
+      mach->Tokens = NULL;
+      mach->Shader = NULL;
+      mach->Declarations = NULL;
+      mach->NumDeclarations = 0;
+      mach->Instructions = NULL;
+      mach->NumInstructions = 0;
       return;
    }
 
-   instructions = (struct tgsi_full_instruction *)
-      MALLOC( maxInstructions * sizeof(struct tgsi_full_instruction) );
-
-   if (!instructions) {
-      FREE( declarations );
-      return;
-   }
+#if 0
+   tgsi_dump(shader->Tokens, 0);
+#endif
 
-   while( !tgsi_parse_end_of_tokens( &parse ) ) {
-      uint i;
+   mach->Tokens = shader->Tokens;
+   mach->Shader = shader;
+   mach->Processor = shader->FullHeader.Processor.Processor;
+   mach->ImmLimit = 0;
+   mach->NumOutputs = 0;
 
-      tgsi_parse_token( &parse );
-      switch( parse.FullToken.Token.Type ) {
-      case TGSI_TOKEN_TYPE_DECLARATION:
-         /* save expanded declaration */
-         if (numDeclarations == maxDeclarations) {
-            declarations = REALLOC(declarations,
-                                   maxDeclarations
-                                   * sizeof(struct tgsi_full_declaration),
-                                   (maxDeclarations + 10)
-                                   * sizeof(struct tgsi_full_declaration));
-            maxDeclarations += 10;
-         }
-         if (parse.FullToken.FullDeclaration.Declaration.File == TGSI_FILE_OUTPUT) {
-            unsigned reg;
-            for (reg = parse.FullToken.FullDeclaration.Range.First;
-                 reg <= parse.FullToken.FullDeclaration.Range.Last;
-                 ++reg) {
-               ++mach->NumOutputs;
-            }
-         }
-         memcpy(declarations + numDeclarations,
-                &parse.FullToken.FullDeclaration,
-                sizeof(declarations[0]));
-         numDeclarations++;
-         break;
+   for (i = 0; i < shader->NumDeclarations; i++) {
+      const struct tgsi_full_declaration *decl = &shader->Declarations[i];
 
-      case TGSI_TOKEN_TYPE_IMMEDIATE:
-         {
-            uint size = parse.FullToken.FullImmediate.Immediate.NrTokens - 1;
-            assert( size <= 4 );
-            assert( mach->ImmLimit + 1 <= TGSI_EXEC_NUM_IMMEDIATES );
+      if (decl->Declaration.File == TGSI_FILE_OUTPUT) {
+         mach->NumOutputs += decl->Range.Last - decl->Range.First + 1;
+      }
+   }
 
-            for( i = 0; i < size; i++ ) {
-               mach->Imms[mach->ImmLimit][i] = 
-		  parse.FullToken.FullImmediate.u[i].Float;
-            }
-            mach->ImmLimit += 1;
-         }
-         break;
+   for (i = 0; i < shader->NumImmediates; i++) {
+      const struct tgsi_full_immediate *imm = &shader->Immediates[i];
+      uint size = imm->Immediate.NrTokens - 1;
+      assert( size <= 4 );
+      assert( mach->ImmLimit + 1 <= TGSI_EXEC_NUM_IMMEDIATES );
 
-      case TGSI_TOKEN_TYPE_INSTRUCTION:
+      for (j = 0; j < size; j++) {
+         mach->Imms[mach->ImmLimit][j] = imm->u[j].Float;
+      }
+      mach->ImmLimit += 1;
+   }
 
-         /* save expanded instruction */
-         if (numInstructions == maxInstructions) {
-            instructions = REALLOC(instructions,
-                                   maxInstructions
-                                   * sizeof(struct tgsi_full_instruction),
-                                   (maxInstructions + 10)
-                                   * sizeof(struct tgsi_full_instruction));
-            maxInstructions += 10;
-         }
+   mach->Declarations = shader->Declarations;
+   mach->NumDeclarations = shader->NumDeclarations;
 
-         memcpy(instructions + numInstructions,
-                &parse.FullToken.FullInstruction,
-                sizeof(instructions[0]));
+   mach->Instructions = shader->Instructions;
+   mach->NumInstructions = shader->NumInstructions;
+}
 
-         numInstructions++;
-         break;
 
-      case TGSI_TOKEN_TYPE_PROPERTY:
-         break;
+/**
+ * Initialize machine state by expanding tokens to full instructions,
+ * allocating temporary storage, setting up constants, etc.
+ * After this, we can call tgsi_exec_machine_run() many times.
+ */
+void 
+tgsi_exec_machine_bind_shader(
+   struct tgsi_exec_machine *mach,
+   const struct tgsi_token *tokens,
+   struct tgsi_sampler *sampler)
+{
+   struct tgsi_decoded_shader *shader = NULL;
 
-      default:
-         assert( 0 );
+   if (tokens) {
+      shader = tgsi_decode_shader(tokens);
+      if (!shader) {
+         debug_printf( "Problem parsing!\n" );
+         return;
       }
    }
-   tgsi_parse_free (&parse);
 
-   FREE(mach->Declarations);
-   mach->Declarations = declarations;
-   mach->NumDeclarations = numDeclarations;
+   tgsi_exec_machine_bind_decoded_shader(mach, shader, sampler);
 
-   FREE(mach->Instructions);
-   mach->Instructions = instructions;
-   mach->NumInstructions = numInstructions;
+   if (shader) {
+      if (mach->Shader == shader)
+         mach->OwnShader = shader;
+      else
+         tgsi_decoded_shader_destroy(shader);
+   }
 }
 
 
@@ -864,8 +883,8 @@ void
 tgsi_exec_machine_destroy(struct tgsi_exec_machine *mach)
 {
    if (mach) {
-      FREE(mach->Instructions);
-      FREE(mach->Declarations);
+      if (mach->OwnShader)
+         tgsi_decoded_shader_destroy(mach->OwnShader);
 
       align_free(mach->Inputs);
       align_free(mach->Outputs);
@@ -879,10 +898,16 @@ micro_add(union tgsi_exec_channel *dst,
           const union tgsi_exec_channel *src0,
           const union tgsi_exec_channel *src1)
 {
+#if defined(PIPE_ARCH_SSE)
+   const __m128 a = _mm_loadu_ps(src0->f);
+   const __m128 b = _mm_loadu_ps(src1->f);
+   _mm_storeu_ps(dst->f, _mm_add_ps(a, b));
+#else
    dst->f[0] = src0->f[0] + src1->f[0];
    dst->f[1] = src0->f[1] + src1->f[1];
    dst->f[2] = src0->f[2] + src1->f[2];
    dst->f[3] = src0->f[3] + src1->f[3];
+#endif
 }
 
 static void
@@ -958,10 +983,16 @@ micro_max(union tgsi_exec_channel *dst,
           const union tgsi_exec_channel *src0,
           const union tgsi_exec_channel *src1)
 {
+#if defined(PIPE_ARCH_SSE)
+   const __m128 a = _mm_loadu_ps(src0->f);
+   const __m128 b = _mm_loadu_ps(src1->f);
+   _mm_storeu_ps(dst->f, _mm_max_ps(a, b));
+#else
    dst->f[0] = src0->f[0] > src1->f[0] ? src0->f[0] : src1->f[0];
    dst->f[1] = src0->f[1] > src1->f[1] ? src0->f[1] : src1->f[1];
    dst->f[2] = src0->f[2] > src1->f[2] ? src0->f[2] : src1->f[2];
    dst->f[3] = src0->f[3] > src1->f[3] ? src0->f[3] : src1->f[3];
+#endif
 }
 
 static void
@@ -969,10 +1000,16 @@ micro_min(union tgsi_exec_channel *dst,
           const union tgsi_exec_channel *src0,
           const union tgsi_exec_channel *src1)
 {
+#if defined(PIPE_ARCH_SSE)
+   const __m128 a = _mm_loadu_ps(src0->f);
+   const __m128 b = _mm_loadu_ps(src1->f);
+   _mm_storeu_ps(dst->f, _mm_min_ps(a, b));
+#else
    dst->f[0] = src0->f[0] < src1->f[0] ? src0->f[0] : src1->f[0];
    dst->f[1] = src0->f[1] < src1->f[1] ? src0->f[1] : src1->f[1];
    dst->f[2] = src0->f[2] < src1->f[2] ? src0->f[2] : src1->f[2];
    dst->f[3] = src0->f[3] < src1->f[3] ? src0->f[3] : src1->f[3];
+#endif
 }
 
 static void
@@ -980,10 +1017,16 @@ micro_mul(union tgsi_exec_channel *dst,
           const union tgsi_exec_channel *src0,
           const union tgsi_exec_channel *src1)
 {
+#if defined(PIPE_ARCH_SSE)
+   const __m128 a = _mm_loadu_ps(src0->f);
+   const __m128 b = _mm_loadu_ps(src1->f);
+   _mm_storeu_ps(dst->f, _mm_mul_ps(a, b));
+#else
    dst->f[0] = src0->f[0] * src1->f[0];
    dst->f[1] = src0->f[1] * src1->f[1];
    dst->f[2] = src0->f[2] * src1->f[2];
    dst->f[3] = src0->f[3] * src1->f[3];
+#endif
 }
 
 static void
@@ -991,10 +1034,15 @@ micro_neg(
    union tgsi_exec_channel *dst,
    const union tgsi_exec_channel *src )
 {
+#if defined(PIPE_ARCH_SSE)
+   const __m128 a = _mm_loadu_ps(src->f);
+   _mm_storeu_ps(dst->f, _mm_xor_ps(a, _mm_set1_ps(-0.0f)));
+#else
    dst->f[0] = -src->f[0];
    dst->f[1] = -src->f[1];
    dst->f[2] = -src->f[2];
    dst->f[3] = -src->f[3];
+#endif
 }
 
 static void
@@ -1021,10 +1069,16 @@ micro_sub(union tgsi_exec_channel *dst,
           const union tgsi_exec_channel *src0,
           const union tgsi_exec_channel *src1)
 {
+#if defined(PIPE_ARCH_SSE)
+   const __m128 a = _mm_loadu_ps(src0->f);
+   const __m128 b = _mm_loadu_ps(src1->f);
+   _mm_storeu_ps(dst->f, _mm_sub_ps(a, b));
+#else
    dst->f[0] = src0->f[0] - src1->f[0];
    dst->f[1] = src0->f[1] - src1->f[1];
    dst->f[2] = src0->f[2] - src1->f[2];
    dst->f[3] = src0->f[3] - src1->f[3];
+#endif
 }
 
 static void
@@ -1148,12 +1202,77 @@ fetch_src_file_channel(const struct tgsi_exec_machine *mach,
    }
 }
 
+/**
+ * Fetch a channel of a directly addressed, one-dimensional register.
+ * All four lanes read the same register here, so there is no need to
+ * build per-lane index vectors as fetch_src_file_channel() does.
+ * \return FALSE if the register file isn't handled here
+ */
+static INLINE boolean
+fetch_src_direct(const struct tgsi_exec_machine *mach,
+                 const struct tgsi_full_src_register *reg,
+                 const uint chan_index,
+                 union tgsi_exec_channel *chan)
+{
+   const int index = reg->Register.Index;
+   const uint swizzle = tgsi_util_get_full_src_register_swizzle(reg,
+                                                                chan_index);
+
+   assert(swizzle < 4);
+
+   switch (reg->Register.File) {
+   case TGSI_FILE_TEMPORARY:
+      assert(index < TGSI_EXEC_NUM_TEMPS);
+      *chan = mach->Temps[index].xyzw[swizzle];
+      return TRUE;
+
+   case TGSI_FILE_INPUT:
+      assert(index >= 0);
+      *chan = mach->Inputs[index].xyzw[swizzle];
+      return TRUE;
+
+   case TGSI_FILE_OUTPUT:
+      assert(index >= 0);
+      *chan = mach->Outputs[index].xyzw[swizzle];
+      return TRUE;
+
+   case TGSI_FILE_IMMEDIATE:
+      assert(index >= 0 && index < (int)mach->ImmLimit);
+      chan->f[0] =
+      chan->f[1] =
+      chan->f[2] =
+      chan->f[3] = mach->Imms[index][swizzle];
+      return TRUE;
+
+   case TGSI_FILE_CONSTANT:
+      {
+         /* NOTE: copying the const value as a uint instead of float */
+         const uint *buf = (const uint *)mach->Consts[0];
+         const int pos = index * 4 + swizzle;
+
+         assert(buf);
+         chan->u[0] =
+         chan->u[1] =
+         chan->u[2] =
+         chan->u[3] = (index >= 0 && pos < (int) mach->ConstsSize[0]) ?
+                      buf[pos] : 0;
+      }
+      return TRUE;
+
+   default:
+      return FALSE;
+   }
+}
+
+/**
+ * Fetch a channel of any register, in the general case where the index
+ * may differ per lane.
+ */
 static void
-fetch_source(const struct tgsi_exec_machine *mach,
-             union tgsi_exec_channel *chan,
-             const struct tgsi_full_src_register *reg,
-             const uint chan_index,
-             enum tgsi_exec_datatype src_datatype)
+fetch_src_register(const struct tgsi_exec_machine *mach,
+                   union tgsi_exec_channel *chan,
+                   const struct tgsi_full_src_register *reg,
+                   const uint chan_index)
 {
    union tgsi_exec_channel index;
    union tgsi_exec_channel index2D;
@@ -1296,6 +1415,20 @@ fetch_source(const struct tgsi_exec_machine *mach,
                           &index,
                           &index2D,
                           chan);
+}
+
+static void
+fetch_source(const struct tgsi_exec_machine *mach,
+             union tgsi_exec_channel *chan,
+             const struct tgsi_full_src_register *reg,
+             const uint chan_index,
+             enum tgsi_exec_datatype src_datatype)
+{
+   if (reg->Register.Indirect ||
+       reg->Register.Dimension ||
+       !fetch_src_direct(mach, reg, chan_index, chan)) {
+      fetch_src_register(mach, chan, reg, chan_index);
+   }
 
    if (reg->Register.Absolute) {
       if (src_datatype == TGSI_EXEC_DATA_FLOAT) {
@@ -1530,6 +1663,35 @@ store_dest(struct tgsi_exec_machine *mach,
       }
    }
 
+   /* All lanes enabled: store the whole channel at once */
+   if (execmask == 0xf) {
+      switch (inst->Instruction.Saturate) {
+      case TGSI_SAT_NONE:
+         *dst = *chan;
+         return;
+
+#if defined(PIPE_ARCH_SSE)
+      /* max(lo, x) and min(hi, x) let NaNs through, like the loops below */
+      case TGSI_SAT_ZERO_ONE:
+         _mm_storeu_ps(dst->f,
+                       _mm_min_ps(_mm_set1_ps(1.0f),
+                                  _mm_max_ps(_mm_setzero_ps(),
+                                             _mm_loadu_ps(chan->f))));
+         return;
+
+      case TGSI_SAT_MINUS_PLUS_ONE:
+         _mm_storeu_ps(dst->f,
+                       _mm_min_ps(_mm_set1_ps(1.0f),
+                                  _mm_max_ps(_mm_set1_ps(-1.0f),
+                                             _mm_loadu_ps(chan->f))));
+         return;
+#endif
+
+      default:
+         break;
+      }
+   }
+
    switch (inst->Instruction.Saturate) {
    case TGSI_SAT_NONE:
       for (i = 0; i < TGSI_QUAD_SIZE; i++)
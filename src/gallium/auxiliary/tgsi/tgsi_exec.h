@@ -259,6 +259,8 @@ enum tgsi_break_type {
 #define TGSI_EXEC_MAX_BREAK_STACK (TGSI_EXEC_MAX_LOOP_NESTING + TGSI_EXEC_MAX_SWITCH_NESTING)
 
 
+struct tgsi_decoded_shader;
+
 /**
  * Run-time virtual machine state for executing TGSI shader.
  */
@@ -347,10 +349,14 @@ struct tgsi_exec_machine
    struct tgsi_call_record CallStack[TGSI_EXEC_MAX_CALL_NESTING];
    int CallStackTop;
 
-   struct tgsi_full_instruction *Instructions;
+   /** The bound shader, and the copy decoded by bind_shader, if any */
+   const struct tgsi_decoded_shader *Shader;
+   struct tgsi_decoded_shader *OwnShader;
+
+   const struct tgsi_full_instruction *Instructions;
    uint NumInstructions;
 
-   struct tgsi_full_declaration *Declarations;
+   const struct tgsi_full_declaration *Declarations;
    uint NumDeclarations;
 
    struct tgsi_declaration_sampler_view
@@ -372,6 +378,12 @@ tgsi_exec_machine_bind_shader(
    const struct tgsi_token *tokens,
    struct tgsi_sampler *sampler);
 
+void
+tgsi_exec_machine_bind_decoded_shader(
+   struct tgsi_exec_machine *mach,
+   const struct tgsi_decoded_shader *shader,
+   struct tgsi_sampler *sampler);
+
 uint
 tgsi_exec_machine_run(
    struct tgsi_exec_machine *mach );
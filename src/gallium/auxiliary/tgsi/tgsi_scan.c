@@ -37,6 +37,7 @@
 #include "util/u_debug.h"
 #include "util/u_math.h"
 #include "util/u_prim.h"
+#include "tgsi/tgsi_decode.h"
 #include "tgsi/tgsi_parse.h"
 #include "tgsi/tgsi_util.h"
 #include "tgsi/tgsi_scan.h"
@@ -44,208 +45,185 @@
 
 
 
-/**
- * Scan the given TGSI shader to collect information such as number of
- * registers used, special instructions used, etc.
- * \return info  the result of the scan
- */
-void
-tgsi_scan_shader(const struct tgsi_token *tokens,
-                 struct tgsi_shader_info *info)
+static void
+scan_instruction(struct tgsi_shader_info *info,
+                 uint procType,
+                 const struct tgsi_full_instruction *fullinst)
 {
-   uint procType, i;
-   struct tgsi_parse_context parse;
+   uint i;
+
+   assert(fullinst->Instruction.Opcode < TGSI_OPCODE_LAST);
+   info->opcode_count[fullinst->Instruction.Opcode]++;
+
+   for (i = 0; i < fullinst->Instruction.NumSrcRegs; i++) {
+      const struct tgsi_full_src_register *src =
+         &fullinst->Src[i];
+      int ind = src->Register.Index;
+
+      /* Mark which inputs are effectively used */
+      if (src->Register.File == TGSI_FILE_INPUT) {
+         unsigned usage_mask;
+         usage_mask = tgsi_util_get_inst_usage_mask(fullinst, i);
+         if (src->Register.Indirect) {
+            for (ind = 0; ind < info->num_inputs; ++ind) {
+               info->input_usage_mask[ind] |= usage_mask;
+            }
+         } else {
+            assert(ind >= 0);
+            assert(ind < PIPE_MAX_SHADER_INPUTS);
+            info->input_usage_mask[ind] |= usage_mask;
+         }
 
-   memset(info, 0, sizeof(*info));
-   for (i = 0; i < TGSI_FILE_COUNT; i++)
-      info->file_max[i] = -1;
+         if (procType == TGSI_PROCESSOR_FRAGMENT &&
+             src->Register.File == TGSI_FILE_INPUT &&
+             info->reads_position &&
+             src->Register.Index == 0 &&
+             (src->Register.SwizzleX == TGSI_SWIZZLE_Z ||
+              src->Register.SwizzleY == TGSI_SWIZZLE_Z ||
+              src->Register.SwizzleZ == TGSI_SWIZZLE_Z ||
+              src->Register.SwizzleW == TGSI_SWIZZLE_Z)) {
+            info->reads_z = TRUE;
+         }
+      }
 
-   /**
-    ** Setup to begin parsing input shader
-    **/
-   if (tgsi_parse_init( &parse, tokens ) != TGSI_PARSE_OK) {
-      debug_printf("tgsi_parse_init() failed in tgsi_scan_shader()!\n");
-      return;
+      /* check for indirect register reads */
+      if (src->Register.Indirect) {
+         info->indirect_files |= (1 << src->Register.File);
+      }
    }
-   procType = parse.FullHeader.Processor.Processor;
-   assert(procType == TGSI_PROCESSOR_FRAGMENT ||
-          procType == TGSI_PROCESSOR_VERTEX ||
-          procType == TGSI_PROCESSOR_GEOMETRY ||
-          procType == TGSI_PROCESSOR_COMPUTE);
 
+   /* check for indirect register writes */
+   for (i = 0; i < fullinst->Instruction.NumDstRegs; i++) {
+      const struct tgsi_full_dst_register *dst = &fullinst->Dst[i];
+      if (dst->Register.Indirect) {
+         info->indirect_files |= (1 << dst->Register.File);
+      }
+   }
 
-   /**
-    ** Loop over incoming program tokens/instructions
-    */
-   while( !tgsi_parse_end_of_tokens( &parse ) ) {
+   info->num_instructions++;
+}
 
-      info->num_tokens++;
 
-      tgsi_parse_token( &parse );
+static void
+scan_declaration(struct tgsi_shader_info *info,
+                 uint procType,
+                 const struct tgsi_full_declaration *fulldecl)
+{
+   const uint file = fulldecl->Declaration.File;
+   uint reg;
+   for (reg = fulldecl->Range.First;
+        reg <= fulldecl->Range.Last;
+        reg++) {
+
+      /* only first 32 regs will appear in this bitfield */
+      info->file_mask[file] |= (1 << reg);
+      info->file_count[file]++;
+      info->file_max[file] = MAX2(info->file_max[file], (int)reg);
+
+      if (file == TGSI_FILE_INPUT) {
+         info->input_semantic_name[reg] = (ubyte)fulldecl->Semantic.Name;
+         info->input_semantic_index[reg] = (ubyte)fulldecl->Semantic.Index;
+         info->input_interpolate[reg] = (ubyte)fulldecl->Interp.Interpolate;
+         info->input_centroid[reg] = (ubyte)fulldecl->Interp.Centroid;
+         info->input_cylindrical_wrap[reg] = (ubyte)fulldecl->Interp.CylindricalWrap;
+         info->num_inputs++;
+
+         if (procType == TGSI_PROCESSOR_FRAGMENT &&
+             fulldecl->Semantic.Name == TGSI_SEMANTIC_POSITION)
+               info->reads_position = TRUE;
+      }
+      else if (file == TGSI_FILE_SYSTEM_VALUE) {
+         unsigned index = fulldecl->Range.First;
+         unsigned semName = fulldecl->Semantic.Name;
 
-      switch( parse.FullToken.Token.Type ) {
-      case TGSI_TOKEN_TYPE_INSTRUCTION:
-         {
-            const struct tgsi_full_instruction *fullinst
-               = &parse.FullToken.FullInstruction;
-            uint i;
-
-            assert(fullinst->Instruction.Opcode < TGSI_OPCODE_LAST);
-            info->opcode_count[fullinst->Instruction.Opcode]++;
-
-            for (i = 0; i < fullinst->Instruction.NumSrcRegs; i++) {
-               const struct tgsi_full_src_register *src =
-                  &fullinst->Src[i];
-               int ind = src->Register.Index;
-
-               /* Mark which inputs are effectively used */
-               if (src->Register.File == TGSI_FILE_INPUT) {
-                  unsigned usage_mask;
-                  usage_mask = tgsi_util_get_inst_usage_mask(fullinst, i);
-                  if (src->Register.Indirect) {
-                     for (ind = 0; ind < info->num_inputs; ++ind) {
-                        info->input_usage_mask[ind] |= usage_mask;
-                     }
-                  } else {
-                     assert(ind >= 0);
-                     assert(ind < PIPE_MAX_SHADER_INPUTS);
-                     info->input_usage_mask[ind] |= usage_mask;
-                  }
-
-                  if (procType == TGSI_PROCESSOR_FRAGMENT &&
-                      src->Register.File == TGSI_FILE_INPUT &&
-                      info->reads_position &&
-                      src->Register.Index == 0 &&
-                      (src->Register.SwizzleX == TGSI_SWIZZLE_Z ||
-                       src->Register.SwizzleY == TGSI_SWIZZLE_Z ||
-                       src->Register.SwizzleZ == TGSI_SWIZZLE_Z ||
-                       src->Register.SwizzleW == TGSI_SWIZZLE_Z)) {
-                     info->reads_z = TRUE;
-                  }
-               }
-
-               /* check for indirect register reads */
-               if (src->Register.Indirect) {
-                  info->indirect_files |= (1 << src->Register.File);
-               }
-            }
+         info->system_value_semantic_name[index] = semName;
+         info->num_system_values = MAX2(info->num_system_values,
+                                        index + 1);
 
-            /* check for indirect register writes */
-            for (i = 0; i < fullinst->Instruction.NumDstRegs; i++) {
-               const struct tgsi_full_dst_register *dst = &fullinst->Dst[i];
-               if (dst->Register.Indirect) {
-                  info->indirect_files |= (1 << dst->Register.File);
-               }
-            }
+         /*
+         info->system_value_semantic_name[info->num_system_values++] = 
+            fulldecl->Semantic.Name;
+         */
 
-            info->num_instructions++;
+         if (fulldecl->Semantic.Name == TGSI_SEMANTIC_INSTANCEID) {
+            info->uses_instanceid = TRUE;
          }
-         break;
-
-      case TGSI_TOKEN_TYPE_DECLARATION:
-         {
-            const struct tgsi_full_declaration *fulldecl
-               = &parse.FullToken.FullDeclaration;
-            const uint file = fulldecl->Declaration.File;
-            uint reg;
-            for (reg = fulldecl->Range.First;
-                 reg <= fulldecl->Range.Last;
-                 reg++) {
-
-               /* only first 32 regs will appear in this bitfield */
-               info->file_mask[file] |= (1 << reg);
-               info->file_count[file]++;
-               info->file_max[file] = MAX2(info->file_max[file], (int)reg);
-
-               if (file == TGSI_FILE_INPUT) {
-                  info->input_semantic_name[reg] = (ubyte)fulldecl->Semantic.Name;
-                  info->input_semantic_index[reg] = (ubyte)fulldecl->Semantic.Index;
-                  info->input_interpolate[reg] = (ubyte)fulldecl->Interp.Interpolate;
-                  info->input_centroid[reg] = (ubyte)fulldecl->Interp.Centroid;
-                  info->input_cylindrical_wrap[reg] = (ubyte)fulldecl->Interp.CylindricalWrap;
-                  info->num_inputs++;
-
-                  if (procType == TGSI_PROCESSOR_FRAGMENT &&
-                      fulldecl->Semantic.Name == TGSI_SEMANTIC_POSITION)
-                        info->reads_position = TRUE;
-               }
-               else if (file == TGSI_FILE_SYSTEM_VALUE) {
-                  unsigned index = fulldecl->Range.First;
-                  unsigned semName = fulldecl->Semantic.Name;
-
-                  info->system_value_semantic_name[index] = semName;
-                  info->num_system_values = MAX2(info->num_system_values,
-                                                 index + 1);
-
-                  /*
-                  info->system_value_semantic_name[info->num_system_values++] = 
-                     fulldecl->Semantic.Name;
-                  */
-
-                  if (fulldecl->Semantic.Name == TGSI_SEMANTIC_INSTANCEID) {
-                     info->uses_instanceid = TRUE;
-                  }
-                  else if (fulldecl->Semantic.Name == TGSI_SEMANTIC_VERTEXID) {
-                     info->uses_vertexid = TRUE;
-                  } else if (fulldecl->Semantic.Name == TGSI_SEMANTIC_PRIMID) {
-                     info->uses_primid = TRUE;
-                  }
-               }
-               else if (file == TGSI_FILE_OUTPUT) {
-                  info->output_semantic_name[reg] = (ubyte)fulldecl->Semantic.Name;
-                  info->output_semantic_index[reg] = (ubyte)fulldecl->Semantic.Index;
-                  info->num_outputs++;
-
-                  if (procType == TGSI_PROCESSOR_VERTEX &&
-                      fulldecl->Semantic.Name == TGSI_SEMANTIC_CLIPDIST) {
-                     info->num_written_clipdistance += util_bitcount(fulldecl->Declaration.UsageMask);
-                  }
-                  /* extra info for special outputs */
-                  if (procType == TGSI_PROCESSOR_FRAGMENT &&
-                      fulldecl->Semantic.Name == TGSI_SEMANTIC_POSITION)
-                        info->writes_z = TRUE;
-                  if (procType == TGSI_PROCESSOR_FRAGMENT &&
-                      fulldecl->Semantic.Name == TGSI_SEMANTIC_STENCIL)
-                        info->writes_stencil = TRUE;
-                  if (procType == TGSI_PROCESSOR_VERTEX &&
-                      fulldecl->Semantic.Name == TGSI_SEMANTIC_EDGEFLAG) {
-                     info->writes_edgeflag = TRUE;
-                  }
-               }
-
-             }
+         else if (fulldecl->Semantic.Name == TGSI_SEMANTIC_VERTEXID) {
+            info->uses_vertexid = TRUE;
+         } else if (fulldecl->Semantic.Name == TGSI_SEMANTIC_PRIMID) {
+            info->uses_primid = TRUE;
          }
-         break;
+      }
+      else if (file == TGSI_FILE_OUTPUT) {
+         info->output_semantic_name[reg] = (ubyte)fulldecl->Semantic.Name;
+         info->output_semantic_index[reg] = (ubyte)fulldecl->Semantic.Index;
+         info->num_outputs++;
+
+         if (procType == TGSI_PROCESSOR_VERTEX &&
+             fulldecl->Semantic.Name == TGSI_SEMANTIC_CLIPDIST) {
+            info->num_written_clipdistance += util_bitcount(fulldecl->Declaration.UsageMask);
+         }
+         /* extra info for special outputs */
+         if (procType == TGSI_PROCESSOR_FRAGMENT &&
+             fulldecl->Semantic.Name == TGSI_SEMANTIC_POSITION)
+               info->writes_z = TRUE;
+         if (procType == TGSI_PROCESSOR_FRAGMENT &&
+             fulldecl->Semantic.Name == TGSI_SEMANTIC_STENCIL)
+               info->writes_stencil = TRUE;
+         if (procType == TGSI_PROCESSOR_VERTEX &&
+             fulldecl->Semantic.Name == TGSI_SEMANTIC_EDGEFLAG) {
+            info->writes_edgeflag = TRUE;
+         }
+      }
+   }
+}
 
-      case TGSI_TOKEN_TYPE_IMMEDIATE:
-         {
-            uint reg = info->immediate_count++;
-            uint file = TGSI_FILE_IMMEDIATE;
 
-            info->file_mask[file] |= (1 << reg);
-            info->file_count[file]++;
-            info->file_max[file] = MAX2(info->file_max[file], (int)reg);
-         }
-         break;
+static void
+scan_immediate(struct tgsi_shader_info *info)
+{
+   uint reg = info->immediate_count++;
+   uint file = TGSI_FILE_IMMEDIATE;
 
-      case TGSI_TOKEN_TYPE_PROPERTY:
-         {
-            const struct tgsi_full_property *fullprop
-               = &parse.FullToken.FullProperty;
+   info->file_mask[file] |= (1 << reg);
+   info->file_count[file]++;
+   info->file_max[file] = MAX2(info->file_max[file], (int)reg);
+}
 
-            info->properties[info->num_properties].name =
-               fullprop->Property.PropertyName;
-            memcpy(info->properties[info->num_properties].data,
-                   fullprop->u, 8 * sizeof(unsigned));;
 
-            ++info->num_properties;
-         }
-         break;
+static void
+scan_property(struct tgsi_shader_info *info,
+              const struct tgsi_full_property *fullprop)
+{
+   info->properties[info->num_properties].name =
+      fullprop->Property.PropertyName;
+   memcpy(info->properties[info->num_properties].data,
+          fullprop->u, 8 * sizeof(unsigned));;
 
-      default:
-         assert( 0 );
-      }
-   }
+   ++info->num_properties;
+}
+
+
+static void
+scan_init(struct tgsi_shader_info *info, uint procType)
+{
+   uint i;
+
+   memset(info, 0, sizeof(*info));
+   for (i = 0; i < TGSI_FILE_COUNT; i++)
+      info->file_max[i] = -1;
+
+   assert(procType == TGSI_PROCESSOR_FRAGMENT ||
+          procType == TGSI_PROCESSOR_VERTEX ||
+          procType == TGSI_PROCESSOR_GEOMETRY ||
+          procType == TGSI_PROCESSOR_COMPUTE);
+}
+
+
+static void
+scan_finish(struct tgsi_shader_info *info, uint procType)
+{
+   uint i;
 
    info->uses_kill = (info->opcode_count[TGSI_OPCODE_KIL] ||
                       info->opcode_count[TGSI_OPCODE_KILP]);
@@ -282,11 +260,107 @@ tgsi_scan_shader(const struct tgsi_token *tokens,
          ;
       }
    }
+}
+
+
+/**
+ * Scan the given TGSI shader to collect information such as number of
+ * registers used, special instructions used, etc.
+ * \return info  the result of the scan
+ */
+void
+tgsi_scan_shader(const struct tgsi_token *tokens,
+                 struct tgsi_shader_info *info)
+{
+   uint procType, i;
+   struct tgsi_parse_context parse;
+
+   /**
+    ** Setup to begin parsing input shader
+    **/
+   if (tgsi_parse_init( &parse, tokens ) != TGSI_PARSE_OK) {
+      debug_printf("tgsi_parse_init() failed in tgsi_scan_shader()!\n");
+      memset(info, 0, sizeof(*info));
+      for (i = 0; i < TGSI_FILE_COUNT; i++)
+         info->file_max[i] = -1;
+      return;
+   }
+   procType = parse.FullHeader.Processor.Processor;
+   scan_init(info, procType);
+
+   /**
+    ** Loop over incoming program tokens/instructions
+    */
+   while( !tgsi_parse_end_of_tokens( &parse ) ) {
+
+      info->num_tokens++;
+
+      tgsi_parse_token( &parse );
+
+      switch( parse.FullToken.Token.Type ) {
+      case TGSI_TOKEN_TYPE_INSTRUCTION:
+         scan_instruction(info, procType, &parse.FullToken.FullInstruction);
+         break;
+      case TGSI_TOKEN_TYPE_DECLARATION:
+         scan_declaration(info, procType, &parse.FullToken.FullDeclaration);
+         break;
+      case TGSI_TOKEN_TYPE_IMMEDIATE:
+         scan_immediate(info);
+         break;
+      case TGSI_TOKEN_TYPE_PROPERTY:
+         scan_property(info, &parse.FullToken.FullProperty);
+         break;
+      default:
+         assert( 0 );
+      }
+   }
+
+   scan_finish(info, procType);
 
    tgsi_parse_free (&parse);
 }
 
 
+/**
+ * As tgsi_scan_shader(), for a shader already decoded with
+ * tgsi_decode_shader().
+ */
+void
+tgsi_scan_decoded_shader(const struct tgsi_decoded_shader *shader,
+                         struct tgsi_shader_info *info)
+{
+   const uint procType = shader->FullHeader.Processor.Processor;
+   struct tgsi_decoded_iterator it;
+
+   scan_init(info, procType);
+
+   tgsi_decoded_iterator_init(&it, shader);
+   while (tgsi_decoded_next(&it)) {
+
+      info->num_tokens++;
+
+      switch (it.Type) {
+      case TGSI_TOKEN_TYPE_INSTRUCTION:
+         scan_instruction(info, procType, it.FullInstruction);
+         break;
+      case TGSI_TOKEN_TYPE_DECLARATION:
+         scan_declaration(info, procType, it.FullDeclaration);
+         break;
+      case TGSI_TOKEN_TYPE_IMMEDIATE:
+         scan_immediate(info);
+         break;
+      case TGSI_TOKEN_TYPE_PROPERTY:
+         scan_property(info, it.FullProperty);
+         break;
+      default:
+         assert(0);
+      }
+   }
+
+   scan_finish(info, procType);
+}
+
+
 
 /**
  * Check if the given shader is a "passthrough" shader consisting of only
@@ -94,6 +94,12 @@ extern void
 tgsi_scan_shader(const struct tgsi_token *tokens,
                  struct tgsi_shader_info *info);
 
+struct tgsi_decoded_shader;
+
+extern void
+tgsi_scan_decoded_shader(const struct tgsi_decoded_shader *shader,
+                         struct tgsi_shader_info *info);
+
 
 extern boolean
 tgsi_is_passthrough_shader(const struct tgsi_token *tokens);
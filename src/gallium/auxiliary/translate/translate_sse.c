@@ -62,7 +62,9 @@ struct translate_buffer_variant {
 
 #define ELEMENT_BUFFER_INSTANCE_ID  1001
 
-#define NUM_CONSTS 7
+#define NUM_FLOAT_CONSTS 16
+#define NUM_INT_CONSTS 4
+#define NUM_CONSTS (NUM_FLOAT_CONSTS + NUM_INT_CONSTS)
 
 enum
 {
@@ -72,21 +74,55 @@ enum
    CONST_INV_32767,
    CONST_INV_65535,
    CONST_INV_2147483647,
-   CONST_255
+   CONST_255,
+   CONST_2POW112,
+   CONST_65536,
+   CONST_INV_1023_3,
+   CONST_INV_511_1,
+   CONST_SCALE_UNORM1010102,
+   CONST_SCALE_SNORM1010102,
+   CONST_SCALE_SCALED1010102,
+   CONST_SIGN_1010102,
+   CONST_BIAS_1010102,
+
+   /* integer constants, from int_consts */
+   CONST_MASK_LO_1010102 = NUM_FLOAT_CONSTS,
+   CONST_MASK_HI_1010102,
+   CONST_SHL_1010102,
+   CONST_SHR_1010102
 };
 
 #define C(v) {(float)(v), (float)(v), (float)(v), (float)(v)}
-static float consts[NUM_CONSTS][4] = {
+static float consts[NUM_FLOAT_CONSTS][4] = {
       {0, 0, 0, 1},
       C(1.0 / 127.0),
       C(1.0 / 255.0),
       C(1.0 / 32767.0),
       C(1.0 / 65535.0),
       C(1.0 / 2147483647.0),
-      C(255.0)
+      C(255.0),
+      C(5192296858534827628530496329220096.0), /* 2^112 */
+      C(65536.0),
+      {(float)(1.0 / 1023.0), (float)(1.0 / 1023.0), (float)(1.0 / 1023.0), (float)(1.0 / 3.0)},
+      {(float)(1.0 / 511.0), (float)(1.0 / 511.0), (float)(1.0 / 511.0), 1.0f},
+      /* 10_10_10_2 channels left in place by the SSE2 unpacking, see
+       * emit_load_1010102()
+       */
+      {(float)(1.0 / 1023.0), (float)(1.0 / 1023.0 / 1024.0), (float)(1.0 / 1023.0 / 1048576.0), (float)(1.0 / 3.0 / 268435456.0)},
+      {(float)(1.0 / 511.0), (float)(1.0 / 511.0 / 1024.0), (float)(1.0 / 511.0 / 1048576.0), (float)(1.0 / 268435456.0)},
+      {1.0f, (float)(1.0 / 1024.0), (float)(1.0 / 1048576.0), (float)(1.0 / 268435456.0)},
+      {512.0f, 524288.0f, 536870912.0f, 536870912.0f},
+      {1024.0f, 1048576.0f, 1073741824.0f, 1073741824.0f}
 };
 #undef C
 
+static uint32_t int_consts[NUM_INT_CONSTS][4] = {
+      {0x3ff, 0xffc00, 0x3ff00000, 0},
+      {0, 0, 0, 0x30000000},
+      {22, 12, 2, 0},
+      {22, 22, 22, 30}
+};
+
 struct translate_sse {
    struct translate translate;
 
@@ -321,6 +357,127 @@ static void emit_load_float64to32( struct translate_sse *p,
    }
 }
 
+/* this function behaves like emit_load_float32, but loads
+   16-bit floating point numbers, converting them to 32-bit
+   ones */
+static void emit_load_float16to32( struct translate_sse *p,
+                                   struct x86_reg data,
+                                   struct x86_reg arg0,
+                                   unsigned out_chans,
+                                   unsigned chans)
+{
+   struct x86_reg tmpXMM = x86_make_reg(file_XMM, 1);
+
+   emit_load_sse2(p, data, arg0, chans * 2);
+
+   if(x86_target_caps(p->func) & X86_F16C)
+      f16c_vcvtph2ps(p->func, data, data);
+   else
+   {
+      /* Move the exponent and mantissa of each half to the top of a
+       * float's, and rebias the exponent by multiplying with 2^112, which
+       * also makes normal floats out of half denormals.  Halves with the
+       * maximum exponent, ie. infinities and NaNs, end up >= 65536 and get
+       * the maximum float exponent.
+       */
+      sse2_punpcklwd(p->func, data, get_const(p, CONST_IDENTITY));
+      sse_movaps(p->func, tmpXMM, data);
+      sse2_pslld_imm(p->func, tmpXMM, 17);
+      sse2_psrld_imm(p->func, tmpXMM, 4);
+      sse_mulps(p->func, tmpXMM, get_const(p, CONST_2POW112));
+      sse2_psrld_imm(p->func, data, 15);
+      sse2_pslld_imm(p->func, data, 31);
+      sse_orps(p->func, data, tmpXMM);
+      sse_cmpps(p->func, tmpXMM, get_const(p, CONST_65536), cc_NotLessThan);
+      sse2_psrld_imm(p->func, tmpXMM, 24);
+      sse2_pslld_imm(p->func, tmpXMM, 23);
+      sse_orps(p->func, data, tmpXMM);
+   }
+
+   if(out_chans == CHANNELS_0001)
+      sse_orps(p->func, data, get_const(p, CONST_IDENTITY));
+}
+
+/* whether the format packs four integer channels in 10, 10, 10 and 2 bits */
+static boolean is_format_1010102( const struct util_format_description *desc )
+{
+   unsigned i;
+
+   if(desc->layout != UTIL_FORMAT_LAYOUT_PLAIN
+         || !desc->is_bitmask
+         || desc->block.bits != 32
+         || desc->nr_channels != 4)
+      return FALSE;
+
+   if(desc->channel[0].type != UTIL_FORMAT_TYPE_UNSIGNED
+         && desc->channel[0].type != UTIL_FORMAT_TYPE_SIGNED)
+      return FALSE;
+
+   for(i = 0; i < 4; ++i)
+   {
+      if(desc->channel[i].type != desc->channel[0].type
+            || desc->channel[i].normalized != desc->channel[0].normalized
+            || desc->channel[i].pure_integer
+            || desc->channel[i].size != (i == 3 ? 2 : 10))
+         return FALSE;
+   }
+   return TRUE;
+}
+
+/* load a 10_10_10_2 value, converting each channel to a float in its
+ * own lane, normalized if the format is
+ */
+static void emit_load_1010102( struct translate_sse *p,
+                               struct x86_reg data,
+                               struct x86_reg arg0,
+                               const struct util_format_channel_description *channel)
+{
+   struct x86_reg tmpXMM = x86_make_reg(file_XMM, 1);
+   boolean is_signed = channel->type == UTIL_FORMAT_TYPE_SIGNED;
+
+   sse2_movd(p->func, data, arg0);
+   sse2_pshufd(p->func, data, data, SHUF(X, X, X, X));
+
+   if(x86_target_caps(p->func) & X86_AVX2)
+   {
+      /* move each channel to the top of its lane, then back down */
+      avx2_vpsllvd(p->func, data, data, get_const(p, CONST_SHL_1010102));
+      if(is_signed)
+         avx2_vpsravd(p->func, data, data, get_const(p, CONST_SHR_1010102));
+      else
+         avx2_vpsrlvd(p->func, data, data, get_const(p, CONST_SHR_1010102));
+      sse2_cvtdq2ps(p->func, data, data);
+      if(channel->normalized)
+         sse_mulps(p->func, data, get_const(p, is_signed ? CONST_INV_511_1 : CONST_INV_1023_3));
+   }
+   else
+   {
+      /* Without per lane shifts, mask each channel in place, except for
+       * the 2-bit one which would end up in the sign bit, and scale the
+       * floats down instead.  All of this is exact.
+       */
+      sse_movaps(p->func, tmpXMM, data);
+      sse_andps(p->func, data, get_const(p, CONST_MASK_LO_1010102));
+      sse2_psrld_imm(p->func, tmpXMM, 2);
+      sse_andps(p->func, tmpXMM, get_const(p, CONST_MASK_HI_1010102));
+      sse_orps(p->func, data, tmpXMM);
+      sse2_cvtdq2ps(p->func, data, data);
+      if(is_signed)
+      {
+         sse_movaps(p->func, tmpXMM, data);
+         sse_cmpps(p->func, tmpXMM, get_const(p, CONST_SIGN_1010102), cc_NotLessThan);
+         sse_andps(p->func, tmpXMM, get_const(p, CONST_BIAS_1010102));
+         sse_subps(p->func, data, tmpXMM);
+      }
+      if(!channel->normalized)
+         sse_mulps(p->func, data, get_const(p, CONST_SCALE_SCALED1010102));
+      else if(is_signed)
+         sse_mulps(p->func, data, get_const(p, CONST_SCALE_SNORM1010102));
+      else
+         sse_mulps(p->func, data, get_const(p, CONST_SCALE_UNORM1010102));
+   }
+}
+
 static void emit_mov64(struct translate_sse *p, struct x86_reg dst_gpr, struct x86_reg dst_xmm, struct x86_reg src_gpr,  struct x86_reg src_xmm)
 {
    if(x86_target(p->func) != X86_32)
@@ -453,17 +610,21 @@ static boolean translate_attr_convert( struct translate_sse *p,
    unsigned swizzle[4] = {UTIL_FORMAT_SWIZZLE_NONE, UTIL_FORMAT_SWIZZLE_NONE, UTIL_FORMAT_SWIZZLE_NONE, UTIL_FORMAT_SWIZZLE_NONE};
    unsigned needed_chans = 0;
    unsigned imms[2] = {0, 0x3f800000};
+   boolean input_1010102;
 
    if(a->output_format == PIPE_FORMAT_NONE || a->input_format == PIPE_FORMAT_NONE)
       return FALSE;
 
-   if(input_desc->channel[0].size & 7)
+   /* packed 10_10_10_2 inputs are only handled when converting to floats */
+   input_1010102 = is_format_1010102(input_desc);
+
+   if((input_desc->channel[0].size & 7) && !input_1010102)
       return FALSE;
 
    if(input_desc->colorspace != output_desc->colorspace)
       return FALSE;
 
-   for(i = 1; i < input_desc->nr_channels; ++i)
+   for(i = 1; i < input_desc->nr_channels && !input_1010102; ++i)
    {
       if(memcmp(&input_desc->channel[i], &input_desc->channel[0], sizeof(input_desc->channel[0])))
          return FALSE;
@@ -503,7 +664,16 @@ static boolean translate_attr_convert( struct translate_sse *p,
             id_swizzle = FALSE;
       }
 
-      if(needed_chans > 0)
+      if(needed_chans > 0 && input_1010102)
+      {
+         if(!(x86_target_caps(p->func) & X86_SSE2))
+            return FALSE;
+         emit_load_1010102(p, dataXMM, src, &input_desc->channel[0]);
+
+         if(!id_swizzle)
+            sse_shufps(p->func, dataXMM, dataXMM, SHUF(swizzle[0], swizzle[1], swizzle[2], swizzle[3]) );
+      }
+      else if(needed_chans > 0)
       {
          switch(input_desc->channel[0].type)
          {
@@ -608,7 +778,7 @@ static boolean translate_attr_convert( struct translate_sse *p,
 
             break;
          case UTIL_FORMAT_TYPE_FLOAT:
-            if(input_desc->channel[0].size != 32 && input_desc->channel[0].size != 64)
+            if(input_desc->channel[0].size != 16 && input_desc->channel[0].size != 32 && input_desc->channel[0].size != 64)
                return FALSE;
             if(swizzle[3] == UTIL_FORMAT_SWIZZLE_1 && input_desc->nr_channels <= 3)
             {
@@ -617,6 +787,11 @@ static boolean translate_attr_convert( struct translate_sse *p,
             }
             switch(input_desc->channel[0].size)
             {
+            case 16:
+               if(!(x86_target_caps(p->func) & X86_SSE2))
+                  return FALSE;
+               emit_load_float16to32(p, dataXMM, src, needed_chans, input_desc->nr_channels);
+               break;
             case 32:
                emit_load_float32(p, dataXMM, src, needed_chans, input_desc->nr_channels);
                break;
@@ -1465,6 +1640,7 @@ struct translate *translate_sse2_create( const struct translate_key *key )
       goto fail;
    memset(p, 0, sizeof(*p));
    memcpy(p->consts, consts, sizeof(consts));
+   memcpy(p->consts[NUM_FLOAT_CONSTS], int_consts, sizeof(int_consts));
 
    p->translate.key = *key;
    p->translate.release = translate_sse_release;
@@ -211,6 +211,70 @@ cpuid(uint32_t ax, uint32_t *p)
    p[3] = 0;
 #endif
 }
+
+
+/**
+ * As above, for leaves with sub-leaves, selected by ecx.
+ */
+static INLINE void
+cpuid_count(uint32_t ax, uint32_t cx, uint32_t *p)
+{
+#if (defined(PIPE_CC_GCC) || defined(PIPE_CC_SUNPRO)) && defined(PIPE_ARCH_X86)
+   __asm __volatile (
+     "xchgl %%ebx, %1\n\t"
+     "cpuid\n\t"
+     "xchgl %%ebx, %1"
+     : "=a" (p[0]),
+       "=S" (p[1]),
+       "=c" (p[2]),
+       "=d" (p[3])
+     : "0" (ax), "2" (cx)
+   );
+#elif (defined(PIPE_CC_GCC) || defined(PIPE_CC_SUNPRO)) && defined(PIPE_ARCH_X86_64)
+   __asm __volatile (
+     "cpuid\n\t"
+     : "=a" (p[0]),
+       "=b" (p[1]),
+       "=c" (p[2]),
+       "=d" (p[3])
+     : "0" (ax), "2" (cx)
+   );
+#elif defined(PIPE_CC_MSVC)
+   __cpuidex(p, ax, cx);
+#else
+   p[0] = 0;
+   p[1] = 0;
+   p[2] = 0;
+   p[3] = 0;
+#endif
+}
+
+
+/**
+ * Return the XCR0 register, i.e. which register states the OS saves on
+ * context switches.  Only valid when CPUID reports OSXSAVE.
+ */
+static INLINE uint64_t
+xgetbv(void)
+{
+#if defined(PIPE_CC_GCC)
+   uint32_t eax, edx;
+
+   /* xgetbv, spelled out for old assemblers */
+   __asm __volatile (
+     ".byte 0x0f, 0x01, 0xd0"
+     : "=a" (eax),
+       "=d" (edx)
+     : "c" (0)
+   );
+
+   return ((uint64_t)edx << 32) | eax;
+#elif defined(PIPE_CC_MSVC) && defined(_MSC_FULL_VER) && _MSC_FULL_VER >= 160040219
+   return _xgetbv(0);
+#else
+   return 0;
+#endif
+}
 #endif /* X86 or X86_64 */
 
 void
@@ -279,9 +343,35 @@ util_cpu_detect(void)
          util_cpu_caps.has_sse4_1 = (regs2[2] >> 19) & 1;
          util_cpu_caps.has_sse4_2 = (regs2[2] >> 20) & 1;
          util_cpu_caps.has_avx    = (regs2[2] >> 28) & 1;
+         util_cpu_caps.has_fma    = (regs2[2] >> 12) & 1;
          util_cpu_caps.has_f16c   = (regs2[2] >> 29) & 1;
          util_cpu_caps.has_mmx2   = util_cpu_caps.has_sse; /* SSE cpus supports mmxext too */
 
+         /* The wider register states must also be enabled by the OS
+          * (OSXSAVE, then XCR0 bits: 1-2 for XMM/YMM, 5-7 for the AVX-512
+          * opmask and ZMM registers).
+          */
+         if (util_cpu_caps.has_avx) {
+            uint64_t xcr0 = ((regs2[2] >> 27) & 1) ? xgetbv() : 0;
+
+            if ((xcr0 & 0x6) != 0x6) {
+               util_cpu_caps.has_avx = 0;
+               util_cpu_caps.has_fma = 0;
+               util_cpu_caps.has_f16c = 0;
+            }
+            else if (regs[0] >= 0x00000007) {
+               uint32_t regs7[4];
+
+               cpuid_count(0x00000007, 0x00000000, regs7);
+               util_cpu_caps.has_avx2 = (regs7[1] >> 5) & 1;
+               if ((xcr0 & 0xe6) == 0xe6)
+                  util_cpu_caps.has_avx512f = (regs7[1] >> 16) & 1;
+            }
+         }
+         else {
+            util_cpu_caps.has_fma = 0;
+         }
+
          cacheline = ((regs2[1] >> 8) & 0xFF) * 8;
          if (cacheline > 0)
             util_cpu_caps.cacheline = cacheline;
@@ -339,6 +429,9 @@ util_cpu_detect(void)
       debug_printf("util_cpu_caps.has_sse4_1 = %u\n", util_cpu_caps.has_sse4_1);
       debug_printf("util_cpu_caps.has_sse4_2 = %u\n", util_cpu_caps.has_sse4_2);
       debug_printf("util_cpu_caps.has_avx = %u\n", util_cpu_caps.has_avx);
+      debug_printf("util_cpu_caps.has_avx2 = %u\n", util_cpu_caps.has_avx2);
+      debug_printf("util_cpu_caps.has_fma = %u\n", util_cpu_caps.has_fma);
+      debug_printf("util_cpu_caps.has_avx512f = %u\n", util_cpu_caps.has_avx512f);
       debug_printf("util_cpu_caps.has_3dnow = %u\n", util_cpu_caps.has_3dnow);
       debug_printf("util_cpu_caps.has_3dnow_ext = %u\n", util_cpu_caps.has_3dnow_ext);
       debug_printf("util_cpu_caps.has_altivec = %u\n", util_cpu_caps.has_altivec);
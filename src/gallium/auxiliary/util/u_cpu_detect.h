@@ -63,6 +63,9 @@ struct util_cpu_caps {
    unsigned has_sse4_1:1;
    unsigned has_sse4_2:1;
    unsigned has_avx:1;
+   unsigned has_avx2:1;
+   unsigned has_fma:1;
+   unsigned has_avx512f:1;
    unsigned has_f16c:1;
    unsigned has_3dnow:1;
    unsigned has_3dnow_ext:1;
@@ -59,6 +59,9 @@ st_print_current(void);
 #define PERF_NO_BLEND       0x20  	/* disable blending */
 #define PERF_NO_DEPTH       0x40  	/* disable depth buffering entirely */
 #define PERF_NO_ALPHATEST   0x80  	/* disable alpha testing */
+#define PERF_NO_HIZ         0x100 	/* disable hierarchical depth culling */
+#define PERF_NO_LAZY_CLEAR  0x200 	/* apply clears right away */
+#define PERF_NO_GUARD_BAND  0x400 	/* clip everything to the viewport */
 
 
 extern int LP_PERF;
@@ -112,12 +112,15 @@ llvmpipe_flush_resource(struct pipe_context *pipe,
 
       if (cpu_access) {
          /*
-          * Flush and wait.
+          * Flush and wait, but only for the scenes using the resource.
           */
+         struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+
          if (do_not_block)
             return FALSE;
 
-         llvmpipe_finish(pipe, reason);
+         draw_flush(llvmpipe->draw);
+         lp_setup_wait_resource(llvmpipe->setup, resource, reason);
       } else {
          /*
           * Just flush.
@@ -0,0 +1,534 @@
+/**************************************************************************
+ *
+ * Copyright 2013 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <float.h>
+
+#include "pipe/p_state.h"
+#include "util/u_format.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_rect.h"
+#include "lp_debug.h"
+#include "lp_rast.h"
+#include "lp_hiz.h"
+
+
+/**
+ * Relative error of the shader's depth interpolation, which evaluates the
+ * plane equation in single precision, possibly in a different order.
+ */
+#define LP_HIZ_REL_ERROR (1.0f / (1 << 20))
+
+
+void
+lp_hiz_plane_init(struct lp_hiz_plane *plane,
+                  const struct lp_rast_shader_inputs *inputs)
+{
+   /* The position is always in input slot zero */
+   plane->a0   = GET_A0(inputs)[0][2];
+   plane->dzdx = GET_DADX(inputs)[0][2];
+   plane->dzdy = GET_DADY(inputs)[0][2];
+}
+
+
+/**
+ * Compute the range of the plane over the pixels [x0,x1] x [y0,y1], and
+ * a bound of the rounding error the shader may make on it.
+ */
+static INLINE void
+plane_range(const struct lp_hiz_plane *plane,
+            int x0, int y0, int x1, int y1,
+            float *zmin, float *zmax, float *err)
+{
+   float zx0 = plane->dzdx * (float) x0;
+   float zx1 = plane->dzdx * (float) x1;
+   float zy0 = plane->dzdy * (float) y0;
+   float zy1 = plane->dzdy * (float) y1;
+
+   *zmin = plane->a0 + MIN2(zx0, zx1) + MIN2(zy0, zy1);
+   *zmax = plane->a0 + MAX2(zx0, zx1) + MAX2(zy0, zy1);
+   *err = (fabsf(plane->a0) +
+           MAX2(fabsf(zx0), fabsf(zx1)) +
+           MAX2(fabsf(zy0), fabsf(zy1))) * LP_HIZ_REL_ERROR;
+}
+
+
+void
+lp_hiz_init(struct lp_hiz *hiz)
+{
+   memset(hiz, 0, sizeof *hiz);
+}
+
+
+void
+lp_hiz_destroy(struct lp_hiz *hiz)
+{
+   FREE(hiz->tiles);
+   memset(hiz, 0, sizeof *hiz);
+}
+
+
+/**
+ * Make sure *tiles has room for nr_tiles.  Contents are not preserved.
+ */
+boolean
+lp_hiz_alloc_tiles(struct lp_hiz_tile **tiles,
+                   unsigned *max_tiles,
+                   unsigned nr_tiles)
+{
+   if (nr_tiles <= *max_tiles)
+      return TRUE;
+
+   FREE(*tiles);
+   *tiles = MALLOC(nr_tiles * sizeof **tiles);
+   if (!*tiles) {
+      *max_tiles = 0;
+      return FALSE;
+   }
+
+   *max_tiles = nr_tiles;
+   return TRUE;
+}
+
+
+/**
+ * Start tracking the bounds of a new depth buffer, whose contents are
+ * unknown.
+ */
+void
+lp_hiz_bind_framebuffer(struct lp_hiz *hiz,
+                        const struct pipe_framebuffer_state *fb)
+{
+   const struct util_format_description *desc;
+   const struct util_format_channel_description *chan;
+
+   hiz->enabled = FALSE;
+   hiz->epoch_min++;
+   hiz->epoch_max++;
+
+   if (!fb->zsbuf ||
+       (LP_PERF & (PERF_NO_HIZ | PERF_NO_DEPTH)))
+      return;
+
+   desc = util_format_description(fb->zsbuf->format);
+   if (!desc || !util_format_has_depth(desc))
+      return;
+
+   hiz->tiles_x = align(fb->width, TILE_SIZE) / TILE_SIZE;
+   hiz->tiles_y = align(fb->height, TILE_SIZE) / TILE_SIZE;
+
+   if (!lp_hiz_alloc_tiles(&hiz->tiles, &hiz->max_tiles,
+                           hiz->tiles_x * hiz->tiles_y))
+      return;
+
+   chan = &desc->channel[desc->swizzle[0]];
+   if (chan->type == UTIL_FORMAT_TYPE_FLOAT) {
+      /* Float depth is neither clamped nor quantized */
+      hiz->zlo = -FLT_MAX;
+      hiz->zhi = FLT_MAX;
+      hiz->eps = 0.0f;
+   }
+   else {
+      /* Allow for the quantization of the shader's depth values, and for
+       * the rounding of the values read back from the depth buffer.
+       */
+      hiz->zlo = 0.0f;
+      hiz->zhi = 1.0f;
+      hiz->eps = 2.0f / (float) ((1 << MIN2(chan->size, 22)) - 1);
+   }
+
+   hiz->enabled = TRUE;
+   lp_hiz_invalidate(hiz);
+}
+
+
+/**
+ * Forget everything known about the depth buffer contents, e.g. after
+ * they were written to outside of setup's view.
+ */
+void
+lp_hiz_invalidate(struct lp_hiz *hiz)
+{
+   unsigned i;
+
+   hiz->epoch_min++;
+   hiz->epoch_max++;
+
+   if (!hiz->enabled)
+      return;
+
+   for (i = 0; i < hiz->tiles_x * hiz->tiles_y; i++) {
+      struct lp_hiz_tile *tile = &hiz->tiles[i];
+      unsigned x, y;
+
+      for (y = 0; y < LP_HIZ_BLOCKS; y++) {
+         for (x = 0; x < LP_HIZ_BLOCKS; x++) {
+            tile->zmin[y][x] = hiz->zlo;
+            tile->zmax[y][x] = hiz->zhi;
+         }
+      }
+   }
+}
+
+
+/**
+ * The whole depth buffer is being cleared to the given value.
+ */
+void
+lp_hiz_clear(struct lp_hiz *hiz, double depth)
+{
+   float z = (float) depth;
+   unsigned i;
+
+   hiz->epoch_min++;
+   hiz->epoch_max++;
+
+   if (!hiz->enabled)
+      return;
+
+   z = CLAMP(z, hiz->zlo, hiz->zhi);
+
+   for (i = 0; i < hiz->tiles_x * hiz->tiles_y; i++) {
+      lp_hiz_tile_set(&hiz->tiles[i], z);
+   }
+}
+
+
+/**
+ * Derive which bounds the current depth/stencil state can reject
+ * against, and which ones its depth writes may move.
+ */
+void
+lp_hiz_set_state(struct lp_hiz *hiz,
+                 const struct pipe_depth_state *depth,
+                 const struct pipe_stencil_state stencil[2],
+                 boolean writes_z)
+{
+   unsigned test = 0;
+   unsigned write = 0;
+   unsigned i;
+
+   if (depth->enabled) {
+      switch (depth->func) {
+      case PIPE_FUNC_LESS:
+      case PIPE_FUNC_LEQUAL:
+         test = LP_HIZ_TEST_ZMAX;
+         break;
+      case PIPE_FUNC_GREATER:
+      case PIPE_FUNC_GEQUAL:
+         test = LP_HIZ_TEST_ZMIN;
+         break;
+      case PIPE_FUNC_EQUAL:
+         test = LP_HIZ_TEST_ZMAX | LP_HIZ_TEST_ZMIN;
+         break;
+      default:
+         break;
+      }
+
+      if (depth->writemask) {
+         switch (depth->func) {
+         case PIPE_FUNC_LESS:
+         case PIPE_FUNC_LEQUAL:
+            write = LP_HIZ_WRITE_DOWN;
+            break;
+         case PIPE_FUNC_GREATER:
+         case PIPE_FUNC_GEQUAL:
+            write = LP_HIZ_WRITE_UP;
+            break;
+         case PIPE_FUNC_NOTEQUAL:
+         case PIPE_FUNC_ALWAYS:
+            write = LP_HIZ_WRITE_DOWN | LP_HIZ_WRITE_UP;
+            break;
+         default:
+            break;
+         }
+      }
+
+      if (writes_z) {
+         /* Nothing is known about the fragment depth values */
+         test = 0;
+         if (depth->writemask)
+            write = LP_HIZ_WRITE_ANY;
+      }
+   }
+
+   /* Rejected fragments must not have had any stencil side effects */
+   for (i = 0; i < 2; i++) {
+      if (stencil[i].enabled &&
+          stencil[i].writemask &&
+          (stencil[i].fail_op != PIPE_STENCIL_OP_KEEP ||
+           stencil[i].zfail_op != PIPE_STENCIL_OP_KEEP)) {
+         test = 0;
+      }
+   }
+
+   hiz->test = test;
+   hiz->write = write;
+}
+
+
+/**
+ * Whether every pixel of rect the primitive with the given depth plane
+ * may cover is known to fail the depth test.
+ */
+boolean
+lp_hiz_rect_occluded(const struct lp_hiz *hiz,
+                     const struct lp_hiz_plane *plane,
+                     const struct u_rect *rect)
+{
+   const int width = hiz->tiles_x * TILE_SIZE;
+   const int height = hiz->tiles_y * TILE_SIZE;
+   int x0 = MAX2(rect->x0, 0);
+   int y0 = MAX2(rect->y0, 0);
+   int x1 = MIN2(rect->x1, width - 1);
+   int y1 = MIN2(rect->y1, height - 1);
+   int bx, by;
+
+   if (!hiz->enabled || !hiz->test || x1 < x0 || y1 < y0)
+      return FALSE;
+
+   for (by = y0 >> LP_HIZ_BLOCK_ORDER; by <= y1 >> LP_HIZ_BLOCK_ORDER; by++) {
+      const struct lp_hiz_tile *row =
+         &hiz->tiles[(by / LP_HIZ_BLOCKS) * hiz->tiles_x];
+      int py0 = MAX2(by << LP_HIZ_BLOCK_ORDER, y0);
+      int py1 = MIN2(((by + 1) << LP_HIZ_BLOCK_ORDER) - 1, y1);
+
+      for (bx = x0 >> LP_HIZ_BLOCK_ORDER; bx <= x1 >> LP_HIZ_BLOCK_ORDER; bx++) {
+         const struct lp_hiz_tile *tile = &row[bx / LP_HIZ_BLOCKS];
+         int px0 = MAX2(bx << LP_HIZ_BLOCK_ORDER, x0);
+         int px1 = MIN2(((bx + 1) << LP_HIZ_BLOCK_ORDER) - 1, x1);
+         float zmin, zmax, err;
+         boolean occluded = FALSE;
+
+         plane_range(plane, px0, py0, px1, py1, &zmin, &zmax, &err);
+
+         /* Written this way so that NaNs are never occluded.  Values past
+          * the representable range are clamped by the depth test.
+          */
+         if ((hiz->test & LP_HIZ_TEST_ZMAX) &&
+             MIN2(zmin, hiz->zhi) - err >
+             tile->zmax[by % LP_HIZ_BLOCKS][bx % LP_HIZ_BLOCKS] + hiz->eps)
+            occluded = TRUE;
+
+         if ((hiz->test & LP_HIZ_TEST_ZMIN) &&
+             MAX2(zmax, hiz->zlo) + err <
+             tile->zmin[by % LP_HIZ_BLOCKS][bx % LP_HIZ_BLOCKS] - hiz->eps)
+            occluded = TRUE;
+
+         if (!occluded)
+            return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Account for the depth writes of a primitive binned over rect.
+ */
+void
+lp_hiz_rect_update(struct lp_hiz *hiz,
+                   const struct lp_hiz_plane *plane,
+                   const struct u_rect *rect)
+{
+   const int width = hiz->tiles_x * TILE_SIZE;
+   const int height = hiz->tiles_y * TILE_SIZE;
+   const unsigned write = hiz->write;
+   int x0 = MAX2(rect->x0, 0);
+   int y0 = MAX2(rect->y0, 0);
+   int x1 = MIN2(rect->x1, width - 1);
+   int y1 = MIN2(rect->y1, height - 1);
+   int bx, by;
+
+   if (!hiz->enabled || !write || x1 < x0 || y1 < y0)
+      return;
+
+   if (write & (LP_HIZ_WRITE_DOWN | LP_HIZ_WRITE_ANY))
+      hiz->epoch_min++;
+   if (write & (LP_HIZ_WRITE_UP | LP_HIZ_WRITE_ANY))
+      hiz->epoch_max++;
+
+   for (by = y0 >> LP_HIZ_BLOCK_ORDER; by <= y1 >> LP_HIZ_BLOCK_ORDER; by++) {
+      struct lp_hiz_tile *row =
+         &hiz->tiles[(by / LP_HIZ_BLOCKS) * hiz->tiles_x];
+      int py0 = MAX2(by << LP_HIZ_BLOCK_ORDER, y0);
+      int py1 = MIN2(((by + 1) << LP_HIZ_BLOCK_ORDER) - 1, y1);
+
+      for (bx = x0 >> LP_HIZ_BLOCK_ORDER; bx <= x1 >> LP_HIZ_BLOCK_ORDER; bx++) {
+         struct lp_hiz_tile *tile = &row[bx / LP_HIZ_BLOCKS];
+         float *tile_zmin = &tile->zmin[by % LP_HIZ_BLOCKS][bx % LP_HIZ_BLOCKS];
+         float *tile_zmax = &tile->zmax[by % LP_HIZ_BLOCKS][bx % LP_HIZ_BLOCKS];
+         int px0 = MAX2(bx << LP_HIZ_BLOCK_ORDER, x0);
+         int px1 = MIN2(((bx + 1) << LP_HIZ_BLOCK_ORDER) - 1, x1);
+         float zmin, zmax, err, lo, hi;
+
+         if (write & LP_HIZ_WRITE_ANY) {
+            *tile_zmin = hiz->zlo;
+            *tile_zmax = hiz->zhi;
+            continue;
+         }
+
+         plane_range(plane, px0, py0, px1, py1, &zmin, &zmax, &err);
+
+         /* Clamp to the representable range, mapping NaNs to the
+          * loosest bound.
+          */
+         if (write & LP_HIZ_WRITE_DOWN) {
+            lo = zmin - err - hiz->eps;
+            if (!(lo > hiz->zlo))
+               lo = hiz->zlo;
+            if (lo > hiz->zhi)
+               lo = hiz->zhi;
+            *tile_zmin = MIN2(*tile_zmin, lo);
+         }
+
+         if (write & LP_HIZ_WRITE_UP) {
+            hi = zmax + err + hiz->eps;
+            if (!(hi < hiz->zhi))
+               hi = hiz->zhi;
+            if (hi < hiz->zlo)
+               hi = hiz->zlo;
+            *tile_zmax = MAX2(*tile_zmax, hi);
+         }
+      }
+   }
+}
+
+
+/**
+ * Tighten the bounds with the values measured by the rasterizer at the
+ * end of a scene, unless the bounds were loosened since that scene was
+ * binned.
+ */
+void
+lp_hiz_fold(struct lp_hiz *hiz,
+            const struct lp_hiz_tile *measured,
+            unsigned epoch_min,
+            unsigned epoch_max)
+{
+   boolean fold_min = (epoch_min == hiz->epoch_min);
+   boolean fold_max = (epoch_max == hiz->epoch_max);
+   unsigned i;
+
+   if (!hiz->enabled || !measured || !(fold_min || fold_max))
+      return;
+
+   for (i = 0; i < hiz->tiles_x * hiz->tiles_y; i++) {
+      struct lp_hiz_tile *tile = &hiz->tiles[i];
+      unsigned x, y;
+
+      if (!measured[i].valid)
+         continue;
+
+      for (y = 0; y < LP_HIZ_BLOCKS; y++) {
+         for (x = 0; x < LP_HIZ_BLOCKS; x++) {
+            if (fold_min)
+               tile->zmin[y][x] = MAX2(tile->zmin[y][x], measured[i].zmin[y][x]);
+            if (fold_max)
+               tile->zmax[y][x] = MIN2(tile->zmax[y][x], measured[i].zmax[y][x]);
+         }
+      }
+   }
+}
+
+
+void
+lp_hiz_tile_set(struct lp_hiz_tile *tile, float z)
+{
+   unsigned x, y;
+
+   for (y = 0; y < LP_HIZ_BLOCKS; y++) {
+      for (x = 0; x < LP_HIZ_BLOCKS; x++) {
+         tile->zmin[y][x] = z;
+         tile->zmax[y][x] = z;
+      }
+   }
+
+   tile->valid = TRUE;
+}
+
+
+/**
+ * Compute the exact bounds of a tile of the depth buffer.
+ *
+ * \param depth  pointer to the tile's upper left pixel
+ * \param width, height  size of the part of the tile inside the surface
+ */
+void
+lp_hiz_tile_measure(struct lp_hiz_tile *tile,
+                    enum pipe_format format,
+                    const uint8_t *depth,
+                    unsigned stride,
+                    unsigned width,
+                    unsigned height)
+{
+   const struct util_format_description *desc = util_format_description(format);
+   const unsigned blocksize = desc->block.bits / 8;
+   float z[LP_HIZ_BLOCK_SIZE * LP_HIZ_BLOCK_SIZE];
+   unsigned bx, by, i;
+
+   for (by = 0; by < LP_HIZ_BLOCKS; by++) {
+      for (bx = 0; bx < LP_HIZ_BLOCKS; bx++) {
+         unsigned x0 = bx * LP_HIZ_BLOCK_SIZE;
+         unsigned y0 = by * LP_HIZ_BLOCK_SIZE;
+         unsigned w = x0 < width ? MIN2(width - x0, LP_HIZ_BLOCK_SIZE) : 0;
+         unsigned h = y0 < height ? MIN2(height - y0, LP_HIZ_BLOCK_SIZE) : 0;
+         float zmin = FLT_MAX;
+         float zmax = -FLT_MAX;
+
+         if (w && h) {
+            desc->unpack_z_float(z, LP_HIZ_BLOCK_SIZE * sizeof z[0],
+                                 depth + y0 * stride + x0 * blocksize,
+                                 stride, w, h);
+
+            /* NaNs fail any depth test, so they can be skipped */
+            for (i = 0; i < h * LP_HIZ_BLOCK_SIZE; i += LP_HIZ_BLOCK_SIZE) {
+               unsigned j;
+               for (j = 0; j < w; j++) {
+                  if (z[i + j] < zmin)
+                     zmin = z[i + j];
+                  if (z[i + j] > zmax)
+                     zmax = z[i + j];
+               }
+            }
+         }
+
+         if (zmin > zmax) {
+            /* Outside the surface */
+            zmin = -FLT_MAX;
+            zmax = FLT_MAX;
+         }
+
+         tile->zmin[by][bx] = zmin;
+         tile->zmax[by][bx] = zmax;
+      }
+   }
+
+   tile->valid = TRUE;
+}
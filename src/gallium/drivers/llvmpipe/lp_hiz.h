@@ -0,0 +1,193 @@
+/**************************************************************************
+ *
+ * Copyright 2013 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * Hierarchical depth (HiZ) bounds.
+ *
+ * Setup keeps a conservative [zmin, zmax] range of the depth buffer
+ * contents for every 16x16 block, and uses it to throw away triangles,
+ * or the parts of them falling in whole tiles, which would fail the
+ * depth test anyway.
+ *
+ * The bounds are tightened by depth clears, loosened by depth writes as
+ * triangles are binned, and refined with the exact values the rasterizer
+ * measures at the end of each tile it rendered depth to.  Those
+ * measurements come back with the scene, possibly after later scenes
+ * were binned, so they may only be folded in when nothing binned since
+ * could have moved the depth values the other way.  Two epoch counters,
+ * bumped whenever the respective bound is loosened, track that.
+ */
+
+
+#ifndef LP_HIZ_H
+#define LP_HIZ_H
+
+
+#include "pipe/p_compiler.h"
+#include "pipe/p_format.h"
+#include "lp_limits.h"
+
+
+struct pipe_depth_state;
+struct pipe_stencil_state;
+struct pipe_framebuffer_state;
+struct lp_rast_shader_inputs;
+struct u_rect;
+
+
+#define LP_HIZ_BLOCK_ORDER 4
+#define LP_HIZ_BLOCK_SIZE  (1 << LP_HIZ_BLOCK_ORDER)
+#define LP_HIZ_BLOCKS      (TILE_SIZE / LP_HIZ_BLOCK_SIZE)
+
+
+/** Depth test directions setup can reject against */
+#define LP_HIZ_TEST_ZMAX  0x1   /**< LESS, LEQUAL, EQUAL */
+#define LP_HIZ_TEST_ZMIN  0x2   /**< GREATER, GEQUAL, EQUAL */
+
+/** How depth writes may move the stored values */
+#define LP_HIZ_WRITE_DOWN 0x1   /**< may lower depth values */
+#define LP_HIZ_WRITE_UP   0x2   /**< may raise depth values */
+#define LP_HIZ_WRITE_ANY  0x4   /**< shader writes depth, anything goes */
+
+
+/**
+ * Depth bounds of one tile, per 16x16 block, indexed [by][bx].
+ */
+struct lp_hiz_tile
+{
+   float zmin[LP_HIZ_BLOCKS][LP_HIZ_BLOCKS];
+   float zmax[LP_HIZ_BLOCKS][LP_HIZ_BLOCKS];
+   boolean valid;   /**< only used for the rasterizer's measurements */
+};
+
+
+/**
+ * Per-context HiZ state, owned by setup.
+ */
+struct lp_hiz
+{
+   boolean enabled;
+
+   struct lp_hiz_tile *tiles;   /**< tiles_x * tiles_y, row major */
+   unsigned tiles_x, tiles_y;
+   unsigned max_tiles;
+
+   /** Range of representable depth values */
+   float zlo, zhi;
+
+   /** Depth buffer precision, see lp_hiz_bind_framebuffer() */
+   float eps;
+
+   /** Derived from the current depth/stencil state */
+   unsigned test;
+   unsigned write;
+
+   unsigned epoch_min, epoch_max;
+};
+
+
+/**
+ * Depth plane of a primitive: z = a0 + dzdx * x + dzdy * y, with x and y
+ * in whole pixels.
+ */
+struct lp_hiz_plane
+{
+   float a0, dzdx, dzdy;
+};
+
+
+void
+lp_hiz_plane_init(struct lp_hiz_plane *plane,
+                  const struct lp_rast_shader_inputs *inputs);
+
+void
+lp_hiz_init(struct lp_hiz *hiz);
+
+void
+lp_hiz_destroy(struct lp_hiz *hiz);
+
+boolean
+lp_hiz_alloc_tiles(struct lp_hiz_tile **tiles,
+                   unsigned *max_tiles,
+                   unsigned nr_tiles);
+
+void
+lp_hiz_bind_framebuffer(struct lp_hiz *hiz,
+                        const struct pipe_framebuffer_state *fb);
+
+void
+lp_hiz_invalidate(struct lp_hiz *hiz);
+
+void
+lp_hiz_clear(struct lp_hiz *hiz, double depth);
+
+void
+lp_hiz_set_state(struct lp_hiz *hiz,
+                 const struct pipe_depth_state *depth,
+                 const struct pipe_stencil_state stencil[2],
+                 boolean writes_z);
+
+boolean
+lp_hiz_rect_occluded(const struct lp_hiz *hiz,
+                     const struct lp_hiz_plane *plane,
+                     const struct u_rect *rect);
+
+void
+lp_hiz_rect_update(struct lp_hiz *hiz,
+                   const struct lp_hiz_plane *plane,
+                   const struct u_rect *rect);
+
+void
+lp_hiz_fold(struct lp_hiz *hiz,
+            const struct lp_hiz_tile *measured,
+            unsigned epoch_min,
+            unsigned epoch_max);
+
+void
+lp_hiz_tile_set(struct lp_hiz_tile *tile, float z);
+
+void
+lp_hiz_tile_measure(struct lp_hiz_tile *tile,
+                    enum pipe_format format,
+                    const uint8_t *depth,
+                    unsigned stride,
+                    unsigned width,
+                    unsigned height);
+
+
+/**
+ * Whether setup should test or update the bounds for the current state.
+ */
+static INLINE boolean
+lp_hiz_active(const struct lp_hiz *hiz)
+{
+   return hiz->enabled && (hiz->test | hiz->write) != 0;
+}
+
+
+#endif /* LP_HIZ_H */
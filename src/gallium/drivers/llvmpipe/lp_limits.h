@@ -61,7 +61,11 @@
 #define LP_MAX_WIDTH  (1 << (LP_MAX_TEXTURE_LEVELS - 1))
 
 
-#define LP_MAX_THREADS 16
+/**
+ * Max number of rasterization threads.  The default is one thread per CPU,
+ * clamped to this.
+ */
+#define LP_MAX_THREADS 64
 
 
 /**
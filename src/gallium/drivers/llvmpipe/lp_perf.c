@@ -27,6 +27,8 @@
 
 #include "util/u_debug.h"
 #include "lp_debug.h"
+#include "gallivm/lp_bld_cache.h"
+#include "draw/draw_llvm.h"
 #include "lp_perf.h"
 
 
@@ -50,6 +52,8 @@ lp_print_counters(void)
 
       debug_printf("llvmpipe: nr_triangles:                 %9u\n", lp_count.nr_tris);
       debug_printf("llvmpipe: nr_culled_triangles:          %9u\n", lp_count.nr_culled_tris);
+      debug_printf("llvmpipe: nr_hiz_culled_triangles:      %9u\n", lp_count.nr_hiz_culled_tris);
+      debug_printf("llvmpipe: nr_hiz_culled_64x64:          %9u\n", lp_count.nr_hiz_culled_64);
 
       total_64 = (lp_count.nr_empty_64 + 
                   lp_count.nr_fully_covered_64 +
@@ -102,9 +106,38 @@ lp_print_counters(void)
       debug_printf("llvmpipe: nr_color_tile_load:           %9u\n", lp_count.nr_color_tile_load);
       debug_printf("llvmpipe: nr_color_tile_store:          %9u\n", lp_count.nr_color_tile_store);
 
+      debug_printf("llvmpipe: nr_stolen_bins:               %9u\n", lp_count.nr_stolen_bins);
+
+      debug_printf("llvmpipe: scene_kb_allocated:           %9u\n", lp_count.scene_kb_allocated);
+      debug_printf("llvmpipe: scene_kb_reused:              %9u\n", lp_count.scene_kb_reused);
+      debug_printf("llvmpipe: scene_kb_retained:            %9u\n", lp_count.scene_kb_retained);
+
       debug_printf("llvmpipe: nr_llvm_compiles:             %u\n", lp_count.nr_llvm_compiles);
       debug_printf("llvmpipe: total LLVM compile time:      %.2f sec\n", lp_count.llvm_compile_time / 1000000.0);
       debug_printf("llvmpipe: average LLVM compile time:    %.2f sec\n", lp_count.llvm_compile_time / 1000000.0 / lp_count.nr_llvm_compiles);
 
+      if (gallivm_cache_enabled()) {
+         struct gallivm_cache_stats stats;
+
+         gallivm_cache_get_stats(&stats);
+
+         debug_printf("llvmpipe: nr_llvm_cache_hits:           %9u\n", stats.hits);
+         debug_printf("llvmpipe: nr_llvm_cache_misses:         %9u\n", stats.misses);
+         debug_printf("llvmpipe: nr_llvm_cache_stores:         %9u\n", stats.stores);
+         debug_printf("llvmpipe: nr_llvm_cache_uncacheable:    %9u\n", stats.uncacheable);
+      }
+
+      {
+         struct draw_llvm_cache_stats stats;
+
+         draw_llvm_cache_get_stats(&stats);
+
+         debug_printf("llvmpipe: nr_draw_variant_hits:         %9u\n", stats.hits);
+         debug_printf("llvmpipe: nr_draw_variant_misses:       %9u\n", stats.misses);
+         debug_printf("llvmpipe: nr_draw_variant_evictions:    %9u\n", stats.evictions);
+         debug_printf("llvmpipe: draw variant compile time:    %.2f sec\n", stats.compile_time / 1000000.0);
+         debug_printf("llvmpipe: draw variant time saved:      %.2f sec\n", stats.time_saved / 1000000.0);
+      }
+
    }
 }
@@ -42,6 +42,8 @@ struct lp_counters
 {
    unsigned nr_tris;
    unsigned nr_culled_tris;
+   unsigned nr_hiz_culled_tris;  /**< rejected by the depth bounds */
+   unsigned nr_hiz_culled_64;
    unsigned nr_empty_64;
    unsigned nr_fully_covered_64;
    unsigned nr_partially_covered_64;
@@ -62,6 +64,13 @@ struct lp_counters
    unsigned nr_color_tile_clear;
    unsigned nr_color_tile_load;
    unsigned nr_color_tile_store;
+
+   unsigned nr_stolen_bins;
+
+   /** Scene data memory, in KB */
+   unsigned scene_kb_allocated;
+   unsigned scene_kb_reused;
+   unsigned scene_kb_retained;  /**< summed over scene resets */
 };
 
 
@@ -31,6 +31,8 @@
 #include "util/u_rect.h"
 #include "util/u_surface.h"
 #include "util/u_pack_color.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_string.h"
 
 #include "os/os_time.h"
 
@@ -67,16 +69,70 @@ lp_rast_begin( struct lp_rasterizer *rast,
    LP_DBG(DEBUG_RAST, "%s\n", __FUNCTION__);
 
    lp_scene_begin_rasterization( scene );
-   lp_scene_bin_iter_begin( scene );
+   lp_scene_bin_iter_begin( scene, rast->num_threads );
 }
 
 
 static void
 lp_rast_end( struct lp_rasterizer *rast )
 {
-   lp_scene_end_rasterization( rast->curr_scene );
+   struct lp_scene *scene = rast->curr_scene;
+   struct lp_fence *fence = NULL;
+
+   lp_scene_end_rasterization( scene );
 
    rast->curr_scene = NULL;
+
+   /* Signal the fence last, as the setup code may reuse the scene as soon
+    * as it is signalled.  Hold our own reference to the fence, since the
+    * scene's one may be dropped at that point too.
+    */
+   lp_fence_reference(&fence, scene->fence);
+   if (fence) {
+      lp_fence_signal(fence);
+      lp_fence_reference(&fence, NULL);
+   }
+}
+
+
+/**
+ * Fetch the clear previous scenes deferred for the current tile of a
+ * surface.  Returns FALSE if its clears can't be deferred past the tile's
+ * end, leaving \p clear untouched.
+ */
+static boolean
+load_surface_tile_clear(const struct lp_rasterizer_task *task,
+                        struct pipe_surface *surf,
+                        struct llvmpipe_tile_clear *clear)
+{
+   if (!llvmpipe_resource_is_texture(surf->texture))
+      return FALSE;
+
+   return llvmpipe_load_tile_clear(llvmpipe_resource(surf->texture),
+                                   surf->u.tex.first_layer,
+                                   surf->u.tex.level,
+                                   task->bin->x, task->bin->y,
+                                   clear);
+}
+
+
+/**
+ * Defer the clear still pending for the current tile of a surface.
+ * Returns FALSE if the surface's clears can't be deferred.
+ */
+static boolean
+store_surface_tile_clear(const struct lp_rasterizer_task *task,
+                         struct pipe_surface *surf,
+                         const struct llvmpipe_tile_clear *clear)
+{
+   if (!llvmpipe_resource_is_texture(surf->texture))
+      return FALSE;
+
+   return llvmpipe_store_tile_clear(llvmpipe_resource(surf->texture),
+                                    surf->u.tex.first_layer,
+                                    surf->u.tex.level,
+                                    task->bin->x, task->bin->y,
+                                    clear);
 }
 
 
@@ -89,6 +145,9 @@ static void
 lp_rast_tile_begin(struct lp_rasterizer_task *task,
                    const struct cmd_bin *bin)
 {
+   const struct lp_scene *scene = task->scene;
+   unsigned i;
+
    LP_DBG(DEBUG_RAST, "%s %d,%d\n", __FUNCTION__, bin->x, bin->y);
 
    task->bin = bin;
@@ -98,12 +157,27 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
    /* reset pointers to color and depth tile(s) */
    memset(task->color_tiles, 0, sizeof(task->color_tiles));
    task->depth_tile = NULL;
+
+   task->hiz_dirty = FALSE;
+
+   /* pick up the clears previous scenes left pending */
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      task->color_clear[i].mask = 0;
+      load_surface_tile_clear(task, scene->fb.cbufs[i],
+                              &task->color_clear[i]);
+   }
+
+   task->zs_clear.mask = 0;
+   if (scene->fb.zsbuf)
+      load_surface_tile_clear(task, scene->fb.zsbuf, &task->zs_clear);
 }
 
 
 /**
  * Clear the rasterizer's current color tile.
  * This is a bin command called during bin processing.
+ * The clear is only recorded here, see lp_rast_get_unswizzled_color_tile_pointer()
+ * and lp_rast_tile_end() for where it gets applied.
  */
 static void
 lp_rast_clear_color(struct lp_rasterizer_task *task,
@@ -138,14 +212,9 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
                util_format_write_4ui(format, arg.clear_color.ui, 0, &uc, 0, 0, 0, 1, 1);
             }
 
-            util_fill_rect(scene->cbufs[i].map,
-                           scene->fb.cbufs[i]->format,
-                           scene->cbufs[i].stride,
-                           task->x,
-                           task->y,
-                           TILE_SIZE,
-                           TILE_SIZE,
-                           &uc);
+            task->color_clear[i].value = uc;
+            task->color_clear[i].mask = ~0;
+            task->color_tiles[i] = NULL;
          }
       }
       else {
@@ -166,14 +235,9 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
             util_pack_color(arg.clear_color.f,
                             scene->fb.cbufs[i]->format, &uc);
 
-            util_fill_rect(scene->cbufs[i].map,
-                           scene->fb.cbufs[i]->format,
-                           scene->cbufs[i].stride,
-                           task->x,
-                           task->y,
-                           TILE_SIZE,
-                           TILE_SIZE,
-                           &uc);
+            task->color_clear[i].value = uc;
+            task->color_clear[i].mask = ~0;
+            task->color_tiles[i] = NULL;
          }
       }
    }
@@ -184,9 +248,46 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
 
 
 
+/**
+ * Keep the tile's depth bounds exact across a depth clear.
+ */
+static void
+lp_rast_clear_hiz(struct lp_rasterizer_task *task,
+                  uint32_t clear_value,
+                  uint32_t clear_mask)
+{
+   const struct lp_scene *scene = task->scene;
+   enum pipe_format format = scene->fb.zsbuf->format;
+   uint32_t zmask = util_pack_mask_z(format, ~0);
+   struct lp_hiz_tile *tile;
+   union {
+      uint16_t ui16;
+      uint32_t ui32;
+   } packed;
+   float z;
+
+   if ((clear_mask & zmask) != zmask)
+      return;
+
+   if (scene->zsbuf.blocksize == 2)
+      packed.ui16 = (uint16_t) clear_value;
+   else
+      packed.ui32 = clear_value;
+
+   util_format_description(format)->unpack_z_float(&z, 0,
+                                                   (const uint8_t *) &packed,
+                                                   0, 1, 1);
+
+   tile = &scene->hiz[task->bin->y * scene->tiles_x + task->bin->x];
+   lp_hiz_tile_set(tile, z);
+}
+
+
 /**
  * Clear the rasterizer's current z/stencil tile.
  * This is a bin command called during bin processing.
+ * Like color clears, it is only recorded here, on top of any clear still
+ * pending for the tile.
  */
 static void
 lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
@@ -195,75 +296,23 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
    const struct lp_scene *scene = task->scene;
    uint32_t clear_value = arg.clear_zstencil.value;
    uint32_t clear_mask = arg.clear_zstencil.mask;
-   const unsigned height = TILE_SIZE;
-   const unsigned width = TILE_SIZE;
-   const unsigned block_size = scene->zsbuf.blocksize;
-   const unsigned dst_stride = scene->zsbuf.stride;
-   uint8_t *dst;
-   unsigned i, j;
 
    LP_DBG(DEBUG_RAST, "%s: value=0x%08x, mask=0x%08x\n",
            __FUNCTION__, clear_value, clear_mask);
 
-   /*
-    * Clear the area of the depth/depth buffer matching this tile.
-    */
-
    if (scene->fb.zsbuf) {
+      struct llvmpipe_tile_clear *clear = &task->zs_clear;
 
-      dst = lp_rast_get_unswizzled_depth_tile_pointer(task, LP_TEX_USAGE_READ_WRITE);
+      if (!clear->mask)
+         clear->value.ui = 0;
 
-      clear_value &= clear_mask;
+      clear->value.ui = (clear->value.ui & ~clear_mask) |
+                        (clear_value & clear_mask);
+      clear->mask |= clear_mask;
+      task->depth_tile = NULL;
 
-      switch (block_size) {
-      case 1:
-         assert(clear_mask == 0xff);
-         memset(dst, (uint8_t) clear_value, height * width);
-         break;
-      case 2:
-         if (clear_mask == 0xffff) {
-            for (i = 0; i < height; i++) {
-               uint16_t *row = (uint16_t *)dst;
-               for (j = 0; j < width; j++)
-                  *row++ = (uint16_t) clear_value;
-               dst += dst_stride;
-            }
-         }
-         else {
-            for (i = 0; i < height; i++) {
-               uint16_t *row = (uint16_t *)dst;
-               for (j = 0; j < width; j++) {
-                  uint16_t tmp = ~clear_mask & *row;
-                  *row++ = clear_value | tmp;
-               }
-               dst += dst_stride;
-            }
-         }
-         break;
-      case 4:
-         if (clear_mask == 0xffffffff) {
-            for (i = 0; i < height; i++) {
-               uint32_t *row = (uint32_t *)dst;
-               for (j = 0; j < width; j++)
-                  *row++ = clear_value;
-               dst += dst_stride;
-            }
-         }
-         else {
-            for (i = 0; i < height; i++) {
-               uint32_t *row = (uint32_t *)dst;
-               for (j = 0; j < width; j++) {
-                  uint32_t tmp = ~clear_mask & *row;
-                  *row++ = clear_value | tmp;
-               }
-               dst += dst_stride;
-            }
-         }
-         break;
-      default:
-         assert(0);
-         break;
-      }
+      if (scene->hiz_enabled)
+         lp_rast_clear_hiz(task, clear_value, clear_mask);
    }
 }
 
@@ -358,6 +407,14 @@ lp_rast_shade_tile_opaque(struct lp_rasterizer_task *task,
       return;
    }
 
+   /* All of the (single) color buffer gets overwritten, so there's no
+    * point in applying a pending clear first.
+    */
+   if (!arg.shade_tile->disable) {
+      assert(task->scene->fb.nr_cbufs == 1);
+      task->color_clear[0].mask = 0;
+   }
+
    lp_rast_shade_tile(task, arg);
 }
 
@@ -500,7 +557,17 @@ void
 lp_rast_set_state(struct lp_rasterizer_task *task,
                   const union lp_rast_cmd_arg arg)
 {
+   const struct lp_fragment_shader_variant *variant = arg.state->variant;
+
    task->state = arg.state;
+
+   /* Remeasure the depth bounds at the end of the tile if any of its
+    * shading commands may write depth.
+    */
+   if (variant &&
+       variant->key.depth.enabled &&
+       variant->key.depth.writemask)
+      task->hiz_dirty = TRUE;
 }
 
 
@@ -511,6 +578,7 @@ lp_rast_set_state(struct lp_rasterizer_task *task,
 static void
 lp_rast_tile_end(struct lp_rasterizer_task *task)
 {
+   const struct lp_scene *scene = task->scene;
    unsigned i;
 
    for (i = 0; i < PIPE_QUERY_TYPES; ++i) {
@@ -519,6 +587,36 @@ lp_rast_tile_end(struct lp_rasterizer_task *task)
       }
    }
 
+   /* Defer the clears which are still pending to the resources, so that
+    * tiles nothing else touches before the next clear cost nothing.
+    * Where that isn't possible, apply them now.
+    */
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      if (!store_surface_tile_clear(task, scene->fb.cbufs[i],
+                                    &task->color_clear[i]) &&
+          task->color_clear[i].mask)
+         (void) lp_rast_get_unswizzled_color_tile_pointer(task, i, LP_TEX_USAGE_READ_WRITE);
+   }
+
+   if (scene->fb.zsbuf) {
+      if (!store_surface_tile_clear(task, scene->fb.zsbuf,
+                                    &task->zs_clear) &&
+          task->zs_clear.mask)
+         (void) lp_rast_get_unswizzled_depth_tile_pointer(task, LP_TEX_USAGE_READ_WRITE);
+   }
+
+   /* A depth clear still pending already set the bounds, if any */
+   if (task->hiz_dirty && scene->hiz_enabled && !task->zs_clear.mask) {
+      const struct cmd_bin *bin = task->bin;
+
+      lp_hiz_tile_measure(&scene->hiz[bin->y * scene->tiles_x + bin->x],
+                          scene->fb.zsbuf->format,
+                          lp_rast_get_unswizzled_depth_tile_pointer(task, LP_TEX_USAGE_READ),
+                          scene->zsbuf.stride,
+                          MIN2(TILE_SIZE, scene->fb.width - task->x),
+                          MIN2(TILE_SIZE, scene->fb.height - task->y));
+   }
+
    /* debug */
    memset(task->color_tiles, 0, sizeof(task->color_tiles));
    task->depth_tile = NULL;
@@ -637,25 +735,22 @@ rasterize_scene(struct lp_rasterizer_task *task,
          struct cmd_bin *bin;
 
          assert(scene);
-         while ((bin = lp_scene_bin_iter_next(scene))) {
-            if (!is_empty_bin( bin ))
-               rasterize_bin(task, bin);
+         while ((bin = lp_scene_bin_iter_next(scene, task->thread_index))) {
+            assert(!is_empty_bin( bin ));
+            rasterize_bin(task, bin);
          }
       }
 #endif
    }
 
-
-   if (scene->fence) {
-      lp_fence_signal(scene->fence);
-   }
-
    task->scene = NULL;
 }
 
 
 /**
  * Called by setup module when it has something for us to render.
+ * This doesn't wait for the scene to be rasterized; the scene's fence is
+ * signalled once that is done.
  */
 void
 lp_rast_queue_scene( struct lp_rasterizer *rast,
@@ -668,7 +763,7 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 
       lp_rast_begin( rast, scene );
 
-      rasterize_scene( &rast->tasks[0], scene );
+      rasterize_scene( rast->tasks[0], scene );
 
       lp_rast_end( rast );
 
@@ -682,7 +777,7 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 
       /* signal the threads that there's work to do */
       for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_signal(&rast->tasks[i].work_ready);
+         pipe_semaphore_signal(&rast->threads[i].work_ready);
       }
    }
 
@@ -690,20 +785,27 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 }
 
 
-void
-lp_rast_finish( struct lp_rasterizer *rast )
+static struct lp_rasterizer_task *
+create_task(struct lp_rasterizer *rast, unsigned index)
 {
-   if (rast->num_threads == 0) {
-      /* nothing to do */
-   }
-   else {
-      int i;
+   struct lp_rasterizer_task *task;
 
-      /* wait for work to complete */
-      for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_wait(&rast->tasks[i].work_done);
-      }
+   /* Cache line aligned to avoid false sharing between threads */
+   task = align_malloc(sizeof *task, 64);
+   if (task) {
+      memset(task, 0, sizeof *task);
+      task->rast = rast;
+      task->thread_index = index;
    }
+
+   return task;
+}
+
+
+static void
+destroy_task(struct lp_rasterizer_task *task)
+{
+   align_free(task);
 }
 
 
@@ -712,19 +814,36 @@ lp_rast_finish( struct lp_rasterizer *rast )
  * It's a simple loop:
  *   1. wait for work
  *   2. do work
- *   3. signal that we're done
+ *   3. signal the scene's fence (thread 0)
  */
 static PIPE_THREAD_ROUTINE( thread_function, init_data )
 {
-   struct lp_rasterizer_task *task = (struct lp_rasterizer_task *) init_data;
-   struct lp_rasterizer *rast = task->rast;
+   struct lp_rasterizer_thread *thread = (struct lp_rasterizer_thread *) init_data;
+   struct lp_rasterizer *rast = thread->rast;
+   struct lp_rasterizer_task *task;
    boolean debug = false;
 
+   if (thread->cpu >= 0 &&
+       pipe_thread_pin_self(thread->cpu)) {
+      /* Replace the task object with one allocated by this thread, now that
+       * it stays on its CPU.  With the usual first-touch policy this places
+       * the per-thread data on the thread's own NUMA node.  Nobody else
+       * touches the task before the thread starts working.
+       */
+      task = create_task(rast, thread->index);
+      if (task) {
+         destroy_task(rast->tasks[thread->index]);
+         rast->tasks[thread->index] = task;
+      }
+   }
+
+   task = rast->tasks[thread->index];
+
    while (1) {
       /* wait for work */
       if (debug)
          debug_printf("thread %d waiting for work\n", task->thread_index);
-      pipe_semaphore_wait(&task->work_ready);
+      pipe_semaphore_wait(&thread->work_ready);
 
       if (rast->exit_flag)
          break;
@@ -753,17 +872,14 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
       /* wait for all threads to finish with this scene */
       pipe_barrier_wait( &rast->barrier );
 
-      /* XXX: shouldn't be necessary:
+      /* thread[0]: unmap the framebuffer and signal the scene's fence.
        */
       if (task->thread_index == 0) {
          lp_rast_end( rast );
       }
 
-      /* signal done with work */
       if (debug)
          debug_printf("thread %d done working\n", task->thread_index);
-
-      pipe_semaphore_signal(&task->work_done);
    }
 
    return NULL;
@@ -780,10 +896,71 @@ create_rast_threads(struct lp_rasterizer *rast)
 
    /* NOTE: if num_threads is zero, we won't use any threads */
    for (i = 0; i < rast->num_threads; i++) {
-      pipe_semaphore_init(&rast->tasks[i].work_ready, 0);
-      pipe_semaphore_init(&rast->tasks[i].work_done, 0);
-      rast->threads[i] = pipe_thread_create(thread_function,
-                                            (void *) &rast->tasks[i]);
+      struct lp_rasterizer_thread *thread = &rast->threads[i];
+      pipe_semaphore_init(&thread->work_ready, 0);
+      thread->handle = pipe_thread_create(thread_function, (void *) thread);
+   }
+}
+
+
+/**
+ * Choose the CPU each rasterization thread gets bound to.
+ *
+ * On Linux the CPUs are enumerated NUMA node by node, so that consecutive
+ * threads share a node and the scene data they all read crosses the
+ * interconnect as little as possible.  Elsewhere CPUs are taken in order.
+ */
+static void
+assign_thread_cpus(struct lp_rasterizer *rast)
+{
+   unsigned cpus[LP_MAX_THREADS];
+   unsigned num_cpus = 0;
+   unsigned i;
+
+#if defined(PIPE_OS_LINUX)
+   unsigned node;
+
+   for (node = 0; num_cpus < Elements(cpus); node++) {
+      char path[64];
+      unsigned first, last;
+      FILE *f;
+      int c;
+
+      util_snprintf(path, sizeof path,
+                    "/sys/devices/system/node/node%u/cpulist", node);
+      f = fopen(path, "r");
+      if (!f)
+         break;
+
+      /* The format is a comma separated list of ranges, e.g., "0-7,16-23" */
+      while (num_cpus < Elements(cpus) && fscanf(f, "%u", &first) == 1) {
+         last = first;
+         c = fgetc(f);
+         if (c == '-') {
+            if (fscanf(f, "%u", &last) != 1)
+               break;
+            c = fgetc(f);
+         }
+         while (first <= last && num_cpus < Elements(cpus)) {
+            cpus[num_cpus++] = first++;
+         }
+         if (c != ',')
+            break;
+      }
+
+      fclose(f);
+   }
+#endif
+
+   if (num_cpus == 0) {
+      num_cpus = MIN2(MAX2(util_cpu_caps.nr_cpus, 1), Elements(cpus));
+      for (i = 0; i < num_cpus; i++) {
+         cpus[i] = i;
+      }
+   }
+
+   for (i = 0; i < rast->num_threads; i++) {
+      rast->threads[i].cpu = cpus[i % num_cpus];
    }
 }
 
@@ -810,13 +987,25 @@ lp_rast_create( unsigned num_threads )
       goto no_full_scenes;
    }
 
-   for (i = 0; i < Elements(rast->tasks); i++) {
-      struct lp_rasterizer_task *task = &rast->tasks[i];
-      task->rast = rast;
-      task->thread_index = i;
+   rast->num_threads = num_threads;
+
+   /* Always at least one task, for rendering synchronously */
+   for (i = 0; i < MAX2(num_threads, 1); i++) {
+      rast->tasks[i] = create_task(rast, i);
+      if (!rast->tasks[i]) {
+         goto no_tasks;
+      }
    }
 
-   rast->num_threads = num_threads;
+   for (i = 0; i < num_threads; i++) {
+      rast->threads[i].rast = rast;
+      rast->threads[i].index = i;
+      rast->threads[i].cpu = -1;
+   }
+
+   if (num_threads && debug_get_bool_option("LP_PIN_THREADS", FALSE)) {
+      assign_thread_cpus(rast);
+   }
 
    rast->no_rast = debug_get_bool_option("LP_NO_RAST", FALSE);
 
@@ -829,6 +1018,12 @@ lp_rast_create( unsigned num_threads )
 
    return rast;
 
+no_tasks:
+   for (i = 0; i < Elements(rast->tasks); i++) {
+      if (rast->tasks[i])
+         destroy_task(rast->tasks[i]);
+   }
+   lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
    FREE(rast);
 no_rast:
@@ -848,18 +1043,22 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
     */
    rast->exit_flag = TRUE;
    for (i = 0; i < rast->num_threads; i++) {
-      pipe_semaphore_signal(&rast->tasks[i].work_ready);
+      pipe_semaphore_signal(&rast->threads[i].work_ready);
    }
 
    /* Wait for threads to terminate before cleaning up per-thread data */
    for (i = 0; i < rast->num_threads; i++) {
-      pipe_thread_wait(rast->threads[i]);
+      pipe_thread_wait(rast->threads[i].handle);
    }
 
    /* Clean up per-thread data */
    for (i = 0; i < rast->num_threads; i++) {
-      pipe_semaphore_destroy(&rast->tasks[i].work_ready);
-      pipe_semaphore_destroy(&rast->tasks[i].work_done);
+      pipe_semaphore_destroy(&rast->threads[i].work_ready);
+   }
+
+   for (i = 0; i < Elements(rast->tasks); i++) {
+      if (rast->tasks[i])
+         destroy_task(rast->tasks[i]);
    }
 
    /* for synchronizing rasterization threads */
@@ -141,9 +141,6 @@ void
 lp_rast_queue_scene( struct lp_rasterizer *rast,
                      struct lp_scene *scene );
 
-void
-lp_rast_finish( struct lp_rasterizer *rast );
-
 
 union lp_rast_cmd_arg {
    const struct lp_rast_shader_inputs *shade_tile;
@@ -88,6 +88,17 @@ struct lp_rasterizer_task
    uint8_t *color_tiles[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth_tile;
 
+   /**
+    * Clears of the current tile not applied yet.  They're applied when
+    * the tile memory is first accessed, or deferred further to the
+    * resource at the end of the tile.
+    */
+   struct llvmpipe_tile_clear color_clear[PIPE_MAX_COLOR_BUFS];
+   struct llvmpipe_tile_clear zs_clear;
+
+   /** Depth may have been written to this tile, see lp_hiz.h */
+   boolean hiz_dirty;
+
    /** "back" pointer */
    struct lp_rasterizer *rast;
 
@@ -98,9 +109,25 @@ struct lp_rasterizer_task
    struct lp_jit_thread_data thread_data;
    uint64_t query_start;
    struct llvmpipe_query *query[PIPE_QUERY_TYPES];
+};
+
 
+/**
+ * Rasterization thread control state.
+ *
+ * Kept separately from lp_rasterizer_task, so that the latter can be
+ * allocated by the thread itself, on its own NUMA node.
+ */
+struct lp_rasterizer_thread
+{
+   struct lp_rasterizer *rast;
+   unsigned index;
+
+   /** CPU to bind the thread to, or -1 */
+   int cpu;
+
+   pipe_thread handle;
    pipe_semaphore work_ready;
-   pipe_semaphore work_done;
 };
 
 
@@ -121,10 +148,10 @@ struct lp_rasterizer
    struct lp_scene *curr_scene;
 
    /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   struct lp_rasterizer_task *tasks[LP_MAX_THREADS];
 
    unsigned num_threads;
-   pipe_thread threads[LP_MAX_THREADS];
+   struct lp_rasterizer_thread threads[LP_MAX_THREADS];
 
    /** For synchronizing the rasterization threads */
    pipe_barrier barrier;
@@ -161,6 +188,12 @@ lp_rast_get_unswizzled_color_tile_pointer(struct lp_rasterizer_task *task,
 
       format_bytes = util_format_get_blocksize(cbuf->format);
       task->color_tiles[buf] = scene->cbufs[buf].map + scene->cbufs[buf].stride * task->y + format_bytes * task->x;
+
+      if (task->color_clear[buf].mask) {
+         llvmpipe_fill_tile(task->color_tiles[buf], scene->cbufs[buf].stride,
+                            cbuf->format, &task->color_clear[buf]);
+         task->color_clear[buf].mask = 0;
+      }
    }
 
    return task->color_tiles[buf];
@@ -188,6 +221,12 @@ lp_rast_get_unswizzled_depth_tile_pointer(struct lp_rasterizer_task *task,
 
       format_bytes = util_format_get_blocksize(dbuf->format);
       task->depth_tile = scene->zsbuf.map + scene->zsbuf.stride * task->y + format_bytes * task->x;
+
+      if (task->zs_clear.mask) {
+         llvmpipe_fill_tile(task->depth_tile, scene->zsbuf.stride,
+                            dbuf->format, &task->zs_clear);
+         task->zs_clear.mask = 0;
+      }
    }
 
    return task->depth_tile;
@@ -25,6 +25,7 @@
  *
  **************************************************************************/
 
+#include "util/u_atomic.h"
 #include "util/u_framebuffer.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
@@ -34,6 +35,7 @@
 #include "lp_scene.h"
 #include "lp_fence.h"
 #include "lp_debug.h"
+#include "lp_perf.h"
 
 
 #define RESOURCE_REF_SZ 32
@@ -62,8 +64,6 @@ lp_scene_create( struct pipe_context *pipe )
    scene->data.head =
       CALLOC_STRUCT(data_block);
 
-   pipe_mutex_init(scene->mutex);
-
 #ifdef DEBUG
    /* Do some scene limit sanity checks here */
    {
@@ -90,9 +90,16 @@ void
 lp_scene_destroy(struct lp_scene *scene)
 {
    lp_fence_reference(&scene->fence, NULL);
-   pipe_mutex_destroy(scene->mutex);
    assert(scene->data.head->next == NULL);
    FREE(scene->data.head);
+
+   while (scene->data.free) {
+      struct data_block *block = scene->data.free;
+      scene->data.free = block->next;
+      FREE(block);
+   }
+
+   FREE(scene->hiz);
    FREE(scene);
 }
 
@@ -154,6 +161,18 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
 
    //LP_DBG(DEBUG_RAST, "%s\n", __FUNCTION__);
 
+   /* The shaders read textures straight from memory, so any clears still
+    * deferred for them must be applied first.
+    */
+   {
+      const struct resource_ref *ref;
+
+      for (ref = scene->resources; ref; ref = ref->next) {
+         for (i = 0; i < ref->count; i++)
+            llvmpipe_resolve_tile_clears(ref->resource[i]);
+      }
+   }
+
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
       struct pipe_surface *cbuf = scene->fb.cbufs[i];
       if (llvmpipe_resource_is_texture(cbuf->texture)) {
@@ -193,12 +212,13 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
 
 
 /**
- * Free all the temporary data in a scene.
+ * Called by the rasterizer when it is done with a scene.
+ * Unmap the color and z/stencil buffers.
  */
 void
 lp_scene_end_rasterization(struct lp_scene *scene )
 {
-   int i, j;
+   int i;
 
    /* Unmap color buffers */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
@@ -221,6 +241,19 @@ lp_scene_end_rasterization(struct lp_scene *scene )
                               zsbuf->u.tex.first_layer);
       scene->zsbuf.map = NULL;
    }
+}
+
+
+/**
+ * Free all the temporary data in a scene, making it ready for binning
+ * again.  Called by the setup module once the scene's fence is signalled,
+ * or when binning failed.  Until then the scene keeps its resource
+ * references, so that they can be tracked precisely.
+ */
+void
+lp_scene_reset(struct lp_scene *scene )
+{
+   int i, j;
 
    /* Reset all command lists:
     */
@@ -263,19 +296,42 @@ lp_scene_end_rasterization(struct lp_scene *scene )
                       j, scene->resource_reference_size);
    }
 
-   /* Free all scene data blocks:
+   /* Recycle the scene data blocks, keeping as many as the recent scenes
+    * needed and freeing the rest:
     */
    {
       struct data_block_list *list = &scene->data;
       struct data_block *block, *tmp;
+      unsigned retain;
+
+      list->peak = MAX2(list->peak, list->nr_used);
+      retain = MAX2(list->retain, list->peak);
+
+      if (++list->nr_resets == LP_SCENE_RETAIN_PERIOD) {
+         list->retain = list->peak;
+         list->peak = 0;
+         list->nr_resets = 0;
+      }
 
       for (block = list->head->next; block; block = tmp) {
          tmp = block->next;
-	 FREE(block);
+         block->next = list->free;
+         list->free = block;
+         list->nr_free++;
+      }
+
+      while (list->nr_free > retain) {
+         block = list->free;
+         list->free = block->next;
+         list->nr_free--;
+         FREE(block);
       }
 
+      LP_COUNT_ADD(scene_kb_retained, list->nr_free * (DATA_BLOCK_SIZE / 1024));
+
       list->head->next = NULL;
       list->head->used = 0;
+      list->nr_used = 0;
    }
 
    lp_fence_reference(&scene->fence, NULL);
@@ -286,6 +342,7 @@ lp_scene_end_rasterization(struct lp_scene *scene )
 
    scene->has_depthstencil_clear = FALSE;
    scene->alloc_failed = FALSE;
+   scene->hiz_enabled = FALSE;
 
    util_unreference_framebuffer_state( &scene->fb );
 }
@@ -326,10 +383,22 @@ lp_scene_new_data_block( struct lp_scene *scene )
       return NULL;
    }
    else {
-      struct data_block *block = MALLOC_STRUCT(data_block);
-      if (block == NULL)
-         return NULL;
-      
+      struct data_block_list *list = &scene->data;
+      struct data_block *block = list->free;
+
+      if (block) {
+         list->free = block->next;
+         list->nr_free--;
+         LP_COUNT_ADD(scene_kb_reused, DATA_BLOCK_SIZE / 1024);
+      }
+      else {
+         block = MALLOC_STRUCT(data_block);
+         if (block == NULL)
+            return NULL;
+         LP_COUNT_ADD(scene_kb_allocated, DATA_BLOCK_SIZE / 1024);
+      }
+
+      list->nr_used++;
       scene->scene_size += sizeof *block;
 
       block->used = 0;
@@ -439,59 +508,128 @@ lp_scene_is_resource_referenced(const struct lp_scene *scene,
 
 
 
-/** advance curr_x,y to the next bin */
-static boolean
-next_bin(struct lp_scene *scene)
+/**
+ * Estimated cost of rasterizing a bin, saturated to 16 bits.
+ * We simply use the number of commands in the bin.
+ */
+static INLINE unsigned
+bin_cost(const struct cmd_bin *bin)
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
-   }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return FALSE;
+   const struct cmd_block *block;
+   unsigned cost = 0;
+
+   for (block = bin->head; block; block = block->next) {
+      cost += block->count;
    }
-   return TRUE;
+
+   return MIN2(cost, 0xffff);
 }
 
 
-void
-lp_scene_bin_iter_begin( struct lp_scene *scene )
+static int
+compare_bin_order(const void *a, const void *b)
 {
-   scene->curr_x = scene->curr_y = -1;
+   const uint32_t order_a = *(const uint32_t *) a;
+   const uint32_t order_b = *(const uint32_t *) b;
+
+   /* Descending cost, ties broken by ascending bin index */
+   if ((order_a >> 16) != (order_b >> 16))
+      return (order_a >> 16) < (order_b >> 16) ? 1 : -1;
+   return order_a < order_b ? -1 : order_a > order_b;
 }
 
 
 /**
- * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
- * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * Prepare for handing out bins to the rasterizer threads.
+ *
+ * The non-empty bins are sorted by estimated cost, and dealt round-robin to
+ * the threads, so that each thread starts with a similar amount of work and
+ * the most expensive bins are done first.  Threads which run out of work
+ * steal from the others, see lp_scene_bin_iter_next().
+ *
+ * Called once per scene by one thread, before the others start iterating.
  */
-struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene )
+void
+lp_scene_bin_iter_begin( struct lp_scene *scene, unsigned num_threads )
 {
-   struct cmd_bin *bin = NULL;
-
-   pipe_mutex_lock(scene->mutex);
+   unsigned num_bins = 0;
+   unsigned x, y;
+   unsigned i;
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
+   for (y = 0; y < scene->tiles_y; y++) {
+      for (x = 0; x < scene->tiles_x; x++) {
+         const struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
+         if (bin->head) {
+            scene->bin_order[num_bins++] =
+               (bin_cost(bin) << 16) | (y * TILES_X + x);
+         }
+      }
    }
-   else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
+
+   qsort(scene->bin_order, num_bins, sizeof scene->bin_order[0],
+         compare_bin_order);
+
+   scene->num_ranges = MAX2(num_threads, 1);
+   assert(scene->num_ranges <= LP_MAX_THREADS);
+
+   for (i = 0; i < scene->num_ranges; i++) {
+      struct lp_scene_bin_range *range = &scene->ranges[i];
+      range->next = 0;
+      range->end = num_bins > i ?
+         (num_bins - i + scene->num_ranges - 1) / scene->num_ranges : 0;
    }
+}
+
+
+/**
+ * Claim the next bin of a range.
+ * \return position in lp_scene::bin_order, or -1 if the range is exhausted
+ */
+static INLINE int
+claim_bin(struct lp_scene *scene, unsigned range_index)
+{
+   struct lp_scene_bin_range *range = &scene->ranges[range_index];
+   int32_t next;
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
+   do {
+      next = p_atomic_read(&range->next);
+      if (next >= range->end)
+         return -1;
+   } while (p_atomic_cmpxchg(&range->next, next, next + 1) != next);
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   pipe_mutex_unlock(scene->mutex);
-   return bin;
+   return range_index + next * scene->num_ranges;
+}
+
+
+/**
+ * Return pointer to next bin to be rendered by the given thread, or NULL
+ * when all bins of the scene have been handed out.
+ *
+ * Multiple rendering threads will call this function concurrently.  No lock
+ * is taken: bins are claimed with compare-and-swap, first from the thread's
+ * own range, then from the other threads' ranges.
+ */
+struct cmd_bin *
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned thread_index )
+{
+   unsigned num_ranges = scene->num_ranges;
+   unsigned i;
+
+   assert(thread_index < num_ranges);
+
+   for (i = 0; i < num_ranges; i++) {
+      unsigned range_index = (thread_index + i) % num_ranges;
+      int pos = claim_bin(scene, range_index);
+      if (pos >= 0) {
+         unsigned index = scene->bin_order[pos] & 0xffff;
+         if (i) {
+            LP_COUNT(nr_stolen_bins);
+         }
+         return lp_scene_get_bin(scene, index % TILES_X, index / TILES_X);
+      }
+   }
+
+   return NULL;
 }
 
 
@@ -511,6 +649,26 @@ void lp_scene_begin_binning( struct lp_scene *scene,
 }
 
 
+/**
+ * Have the rasterizer measure the depth bounds of the tiles it renders
+ * depth to.  Called after lp_scene_begin_binning().
+ */
+void lp_scene_enable_hiz( struct lp_scene *scene )
+{
+   unsigned nr_tiles = scene->tiles_x * scene->tiles_y;
+   unsigned i;
+
+   scene->hiz_enabled = lp_hiz_alloc_tiles(&scene->hiz,
+                                           &scene->hiz_max_tiles,
+                                           nr_tiles);
+   if (!scene->hiz_enabled)
+      return;
+
+   for (i = 0; i < nr_tiles; i++)
+      scene->hiz[i].valid = FALSE;
+}
+
+
 void lp_scene_end_binning( struct lp_scene *scene )
 {
    if (LP_DEBUG & DEBUG_SCENE) {
@@ -37,6 +37,7 @@
 
 #include "os/os_thread.h"
 #include "lp_rast.h"
+#include "lp_hiz.h"
 #include "lp_debug.h"
 
 struct lp_scene_queue;
@@ -62,6 +63,11 @@ struct lp_rast_state;
  */
 #define LP_SCENE_MAX_SIZE (9*1024*1024)
 
+/* Number of scene resets over which the high-water mark of data blocks
+ * in use is taken, to decide how many blocks a scene keeps for reuse.
+ */
+#define LP_SCENE_RETAIN_PERIOD 16
+
 /* The maximum amount of texture storage referenced by a scene is
  * clamped ot this size:
  */
@@ -111,14 +117,42 @@ struct cmd_bin {
  *
  * Include the first block of data statically to ensure we can always
  * initiate a scene without relying on malloc succeeding.
+ *
+ * Blocks are not freed when the scene is reset, but kept on a free list
+ * up to the high-water mark of the recent scenes, so that steady state
+ * rendering doesn't call into the allocator at all.  All scene data is
+ * bump-allocated within the blocks, so a single block size is enough.
  */
 struct data_block_list {
    struct data_block first;
    struct data_block *head;
+
+   struct data_block *free;   /**< retained blocks, ready for reuse */
+   unsigned nr_free;
+   unsigned nr_used;          /**< blocks allocated since the last reset */
+   unsigned peak;             /**< max nr_used in the current period */
+   unsigned retain;           /**< peak of the previous period */
+   unsigned nr_resets;
 };
 
 struct resource_ref;
 
+
+/**
+ * Bins handed out to one rasterizer thread, see lp_scene_bin_iter_begin().
+ *
+ * The thread owns every num_ranges-th entry of lp_scene::bin_order, starting
+ * at its own index.  Entries are claimed by atomically bumping 'next', both
+ * by the owner and by other threads stealing work once their own range is
+ * exhausted.  Padded to a cache line to avoid false sharing.
+ */
+struct lp_scene_bin_range {
+   int32_t next;
+   int32_t end;
+   char pad[64 - 2 * sizeof(int32_t)];
+};
+
+
 /**
  * All bins and bin data are contained here.
  * Per-bin data goes into the 'tile' bins.
@@ -166,11 +200,28 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   pipe_mutex mutex;
+   /** Scheduling of bins among the rasterizer threads */
+   unsigned num_ranges;
+   struct lp_scene_bin_range ranges[LP_MAX_THREADS];
+
+   /**
+    * Non-empty bins, most expensive first.  The upper 16 bits hold the
+    * estimated cost, the lower 16 bits the bin index (y * TILES_X + x).
+    */
+   uint32_t bin_order[TILES_X * TILES_Y];
 
    struct cmd_bin tile[TILES_X][TILES_Y];
    struct data_block_list data;
+
+   /**
+    * Depth bounds measured by the rasterizer for each tile it rendered
+    * depth to, indexed y * tiles_x + x, and the setup HiZ epochs when
+    * binning ended.  See lp_hiz.h.
+    */
+   boolean hiz_enabled;
+   struct lp_hiz_tile *hiz;
+   unsigned hiz_max_tiles;
+   unsigned hiz_epoch_min, hiz_epoch_max;
 };
 
 
@@ -372,10 +423,10 @@ lp_scene_get_num_bins( const struct lp_scene *scene )
 
 
 void
-lp_scene_bin_iter_begin( struct lp_scene *scene );
+lp_scene_bin_iter_begin( struct lp_scene *scene, unsigned num_threads );
 
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene );
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned thread_index );
 
 
 
@@ -389,6 +440,9 @@ lp_scene_begin_binning( struct lp_scene *scene,
 void
 lp_scene_end_binning( struct lp_scene *scene );
 
+void
+lp_scene_enable_hiz( struct lp_scene *scene );
+
 
 /* Begin/end rasterization of a scene
  */
@@ -398,6 +452,9 @@ lp_scene_begin_rasterization(struct lp_scene *scene);
 void
 lp_scene_end_rasterization(struct lp_scene *scene );
 
+void
+lp_scene_reset(struct lp_scene *scene );
+
 
 
 
@@ -80,6 +80,9 @@ static const struct debug_named_value lp_perf_flags[] = {
    { "no_blend",       PERF_NO_BLEND, NULL },
    { "no_depth",       PERF_NO_DEPTH, NULL },
    { "no_alphatest",   PERF_NO_ALPHATEST, NULL },
+   { "no_hiz",         PERF_NO_HIZ, NULL },
+   { "no_lazy_clear",  PERF_NO_LAZY_CLEAR, NULL },
+   { "no_guard_band",  PERF_NO_GUARD_BAND, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -404,6 +407,21 @@ llvmpipe_flush_frontbuffer(struct pipe_screen *_screen,
    struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
    struct sw_winsys *winsys = screen->winsys;
    struct llvmpipe_resource *texture = llvmpipe_resource(resource);
+   struct lp_fence *fence = NULL;
+
+   /* Scenes are rasterized asynchronously, so wait for the ones already
+    * queued before presenting.
+    */
+   pipe_mutex_lock(screen->rast_mutex);
+   lp_fence_reference(&fence, screen->last_fence);
+   pipe_mutex_unlock(screen->rast_mutex);
+
+   if (fence) {
+      lp_fence_wait(fence);
+      lp_fence_reference(&fence, NULL);
+   }
+
+   llvmpipe_resolve_tile_clears(resource);
 
    assert(texture->dt);
    if (texture->dt)
@@ -420,6 +438,8 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
    if (screen->rast)
       lp_rast_destroy(screen->rast);
 
+   lp_fence_reference(&screen->last_fence, NULL);
+
    lp_jit_screen_cleanup(screen);
 
    if(winsys->destroy)
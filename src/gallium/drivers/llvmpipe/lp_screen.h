@@ -41,6 +41,7 @@
 
 
 struct sw_winsys;
+struct lp_fence;
 
 
 struct llvmpipe_screen
@@ -57,6 +58,9 @@ struct llvmpipe_screen
 
    struct lp_rasterizer *rast;
    pipe_mutex rast_mutex;
+
+   /** Fence of the last scene queued by any context, under rast_mutex */
+   struct lp_fence *last_fence;
 };
 
 
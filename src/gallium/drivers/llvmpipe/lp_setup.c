@@ -51,6 +51,7 @@
 #include "lp_setup_context.h"
 #include "lp_screen.h"
 #include "lp_state.h"
+#include "lp_state_fs.h"
 #include "state_tracker/sw_winsys.h"
 
 #include "draw/draw_context.h"
@@ -71,20 +72,36 @@ lp_setup_get_empty_scene(struct lp_setup_context *setup)
    assert(setup->scene == NULL);
 
    setup->scene_idx++;
-   setup->scene_idx %= Elements(setup->scenes);
+   setup->scene_idx %= setup->num_scenes;
 
    setup->scene = setup->scenes[setup->scene_idx];
 
+   /* Recycle the oldest scene.  Only waits if all the scenes are still
+    * queued for rasterization.
+    */
    if (setup->scene->fence) {
       if (LP_DEBUG & DEBUG_SETUP)
          debug_printf("%s: wait for scene %d\n",
                       __FUNCTION__, setup->scene->fence->id);
 
       lp_fence_wait(setup->scene->fence);
+
+      /* The scene's depth measurements are final now */
+      if (setup->scene->hiz_enabled &&
+          setup->scene->tiles_x == setup->hiz.tiles_x &&
+          setup->scene->tiles_y == setup->hiz.tiles_y) {
+         lp_hiz_fold(&setup->hiz, setup->scene->hiz,
+                     setup->scene->hiz_epoch_min,
+                     setup->scene->hiz_epoch_max);
+      }
+
+      lp_scene_reset(setup->scene);
    }
 
    lp_scene_begin_binning(setup->scene, &setup->fb, discard);
-   
+
+   if (setup->hiz.enabled)
+      lp_scene_enable_hiz(setup->scene);
 }
 
 
@@ -157,17 +174,23 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
 
    lp_scene_end_binning(scene);
 
+   scene->hiz_epoch_min = setup->hiz.epoch_min;
+   scene->hiz_epoch_max = setup->hiz.epoch_max;
+
    lp_fence_reference(&setup->last_fence, scene->fence);
 
    if (setup->last_fence)
       setup->last_fence->issued = TRUE;
 
+   /* Don't wait for the scene here: binning of the next scene overlaps
+    * with its rasterization.  The scene is recycled once its fence is
+    * signalled, see lp_setup_get_empty_scene().
+    */
    pipe_mutex_lock(screen->rast_mutex);
    lp_rast_queue_scene(screen->rast, scene);
-   lp_rast_finish(screen->rast);
+   lp_fence_reference(&screen->last_fence, scene->fence);
    pipe_mutex_unlock(screen->rast_mutex);
 
-   lp_scene_end_rasterization(setup->scene);
    lp_setup_reset( setup );
 
    LP_DBG(DEBUG_SETUP, "%s done \n", __FUNCTION__);
@@ -188,7 +211,7 @@ begin_binning( struct lp_setup_context *setup )
 
    /* Always create a fence:
     */
-   scene->fence = lp_fence_create(MAX2(1, setup->num_threads));
+   scene->fence = lp_fence_create(1);
    if (!scene->fence)
       return FALSE;
 
@@ -333,7 +356,7 @@ set_scene_state( struct lp_setup_context *setup,
 
 fail:
    if (setup->scene) {
-      lp_scene_end_rasterization(setup->scene);
+      lp_scene_reset(setup->scene);
       setup->scene = NULL;
    }
 
@@ -360,6 +383,8 @@ void
 lp_setup_bind_framebuffer( struct lp_setup_context *setup,
                            const struct pipe_framebuffer_state *fb )
 {
+   boolean same_zsbuf;
+
    LP_DBG(DEBUG_SETUP, "%s\n", __FUNCTION__);
 
    /* Flush any old scene.
@@ -371,6 +396,11 @@ lp_setup_bind_framebuffer( struct lp_setup_context *setup,
     */
    assert(!setup->scene);
 
+   /* Keep the depth bounds when the same depth buffer stays bound */
+   same_zsbuf = (setup->fb.zsbuf == fb->zsbuf &&
+                 setup->fb.width == fb->width &&
+                 setup->fb.height == fb->height);
+
    /* Set new state.  This will be picked up later when we next need a
     * scene.
     */
@@ -380,6 +410,9 @@ lp_setup_bind_framebuffer( struct lp_setup_context *setup,
    setup->framebuffer.x1 = fb->width-1;
    setup->framebuffer.y1 = fb->height-1;
    setup->dirty |= LP_SETUP_NEW_SCISSOR;
+
+   if (!same_zsbuf)
+      lp_hiz_bind_framebuffer(&setup->hiz, &setup->fb);
 }
 
 
@@ -463,7 +496,10 @@ lp_setup_try_clear( struct lp_setup_context *setup,
                 sizeof setup->clear.color.clear_color);
       }
    }
-   
+
+   if (flags & PIPE_CLEAR_DEPTH)
+      lp_hiz_clear(&setup->hiz, depth);
+
    return TRUE;
 }
 
@@ -499,9 +535,15 @@ lp_setup_set_triangle_state( struct lp_setup_context *setup,
    setup->ccw_is_frontface = ccw_is_frontface;
    setup->cullmode = cull_mode;
    setup->triangle = first_triangle;
-   setup->pixel_offset = half_pixel_center ? 0.5f : 0.0f;
    setup->bottom_edge_rule = bottom_edge_rule;
 
+   if (setup->pixel_offset != (half_pixel_center ? 0.5f : 0.0f)) {
+      /* moves the pixel centers relative to the viewport edges */
+      if (setup->guard_band)
+         setup->dirty |= LP_SETUP_NEW_SCISSOR;
+      setup->pixel_offset = half_pixel_center ? 0.5f : 0.0f;
+   }
+
    if (setup->scissor_test != scissor) {
       setup->dirty |= LP_SETUP_NEW_SCISSOR;
       setup->scissor_test = scissor;
@@ -551,6 +593,13 @@ lp_setup_set_fs_variant( struct lp_setup_context *setup,
 
    setup->fs.current.variant = variant;
    setup->dirty |= LP_SETUP_NEW_FS;
+
+   if (variant) {
+      lp_hiz_set_state(&setup->hiz,
+                       &variant->key.depth,
+                       variant->key.stencil,
+                       variant->shader->info.base.writes_z);
+   }
 }
 
 void
@@ -631,6 +680,48 @@ lp_setup_set_scissor( struct lp_setup_context *setup,
 }
 
 
+/**
+ * With the guard band, the draw module no longer clips primitives to the
+ * viewport, so the viewport becomes part of the draw region.
+ */
+void
+lp_setup_set_viewport( struct lp_setup_context *setup,
+                       const struct pipe_viewport_state *viewport )
+{
+   LP_DBG(DEBUG_SETUP, "%s\n", __FUNCTION__);
+
+   assert(viewport);
+
+   setup->viewport = *viewport;
+   if (setup->guard_band)
+      setup->dirty |= LP_SETUP_NEW_SCISSOR;
+}
+
+
+/**
+ * Compute the pixels whose centers lie inside the viewport, clamped to
+ * the framebuffer.
+ */
+static void
+viewport_region( const struct lp_setup_context *setup,
+                 struct u_rect *rect )
+{
+   const struct pipe_viewport_state *vp = &setup->viewport;
+   const struct u_rect *fb = &setup->framebuffer;
+   const float off = setup->pixel_offset;
+   float x0 = vp->translate[0] - fabsf(vp->scale[0]) - off;
+   float x1 = vp->translate[0] + fabsf(vp->scale[0]) - off;
+   float y0 = vp->translate[1] - fabsf(vp->scale[1]) - off;
+   float y1 = vp->translate[1] + fabsf(vp->scale[1]) - off;
+
+   /* Clamp before converting, the viewport may be huge */
+   rect->x0 = (int) ceilf(CLAMP(x0, (float) fb->x0, (float) fb->x1 + 1));
+   rect->x1 = (int) ceilf(CLAMP(x1, (float) fb->x0, (float) fb->x1 + 1)) - 1;
+   rect->y0 = (int) ceilf(CLAMP(y0, (float) fb->y0, (float) fb->y1 + 1));
+   rect->y1 = (int) ceilf(CLAMP(y1, (float) fb->y0, (float) fb->y1 + 1)) - 1;
+}
+
+
 void 
 lp_setup_set_flatshade_first( struct lp_setup_context *setup,
                               boolean flatshade_first )
@@ -658,6 +749,12 @@ lp_setup_set_vertex_info( struct lp_setup_context *setup,
 }
 
 
+static void
+wait_scene_using_resource( struct lp_setup_context *setup,
+                           const struct pipe_resource *texture,
+                           unsigned usage );
+
+
 /**
  * Called during state validation when LP_NEW_SAMPLER_VIEW is set.
  */
@@ -693,6 +790,17 @@ lp_setup_set_fragment_sampler_views(struct lp_setup_context *setup,
             unsigned first_level = 0;
             unsigned last_level = 0;
 
+            /* Converting the layout below must not race with the
+             * rasterizer mapping the texture for a queued scene rendering
+             * to it.  The scene being built renders to the current
+             * framebuffer, which can't be sampled from meanwhile.  Once
+             * the writers are done, resolving the deferred clears here
+             * also keeps the scenes already sampling from the texture
+             * from touching its layout when they start.
+             */
+            wait_scene_using_resource(setup, res, LP_REFERENCED_FOR_WRITE);
+            llvmpipe_resolve_tile_clears(res);
+
             if (llvmpipe_resource_is_texture(res)) {
                first_level = view->u.tex.first_level;
                last_level = view->u.tex.last_level;
@@ -838,34 +946,128 @@ lp_setup_set_fragment_sampler_state(struct lp_setup_context *setup,
 }
 
 
+/**
+ * How the given scene uses the texture: render targets are written,
+ * other resources are only read.
+ */
+static unsigned
+scene_resource_referenced( const struct lp_scene *scene,
+                           const struct pipe_resource *texture )
+{
+   unsigned i;
+
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      if (scene->fb.cbufs[i] && scene->fb.cbufs[i]->texture == texture)
+         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+   }
+   if (scene->fb.zsbuf && scene->fb.zsbuf->texture == texture) {
+      return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+   }
+
+   if (lp_scene_is_resource_referenced(scene, texture)) {
+      return LP_REFERENCED_FOR_READ;
+   }
+
+   return LP_UNREFERENCED;
+}
+
+
+/**
+ * Is the scene still in use, i.e. being built or waiting for / under
+ * rasterization?  Rasterized scenes keep their references until they are
+ * recycled, but those no longer count.
+ */
+static INLINE boolean
+scene_is_busy( const struct lp_setup_context *setup,
+               struct lp_scene *scene )
+{
+   return (scene == setup->scene ||
+           (scene->fence && !lp_fence_signalled(scene->fence)));
+}
+
+
 /**
  * Is the given texture referenced by any scene?
- * Note: we have to check all scenes including any scenes currently
- * being rendered and the current scene being built.
+ * Note: we have to check the current scene being built and all the scenes
+ * queued for or being rendered.
  */
 unsigned
 lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
                                 const struct pipe_resource *texture )
 {
+   unsigned referenced = LP_UNREFERENCED;
    unsigned i;
 
-   /* check the render targets */
-   for (i = 0; i < setup->fb.nr_cbufs; i++) {
-      if (setup->fb.cbufs[i]->texture == texture)
-         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
-   }
-   if (setup->fb.zsbuf && setup->fb.zsbuf->texture == texture) {
-      return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+   for (i = 0; i < setup->num_scenes; i++) {
+      struct lp_scene *scene = setup->scenes[i];
+
+      if (scene_is_busy(setup, scene))
+         referenced |= scene_resource_referenced(scene, texture);
    }
 
-   /* check textures referenced by the scene */
-   for (i = 0; i < Elements(setup->scenes); i++) {
-      if (lp_scene_is_resource_referenced(setup->scenes[i], texture)) {
-         return LP_REFERENCED_FOR_READ;
+   return referenced;
+}
+
+
+/**
+ * Wait for the most recently queued scene using the texture in any of the
+ * given ways, which is enough as scenes are rasterized in order.  The
+ * scene being built isn't considered.
+ */
+static void
+wait_scene_using_resource( struct lp_setup_context *setup,
+                           const struct pipe_resource *texture,
+                           unsigned usage )
+{
+   unsigned i;
+
+   /* Walk the scenes from the most recently queued one backwards */
+   for (i = 0; i < setup->num_scenes; i++) {
+      unsigned idx = (setup->scene_idx + setup->num_scenes - i) %
+                     setup->num_scenes;
+      struct lp_scene *scene = setup->scenes[idx];
+
+      if (scene != setup->scene &&
+          scene_is_busy(setup, scene) &&
+          (scene_resource_referenced(scene, texture) & usage)) {
+         lp_fence_wait(scene->fence);
+         break;
       }
    }
+}
 
-   return LP_UNREFERENCED;
+
+/**
+ * Wait until the GPU-side work on the given texture is done, for CPU
+ * access.  Only the current scene is flushed, and only if it references
+ * the texture; of the queued scenes, only the most recent one using the
+ * texture is waited for, as scenes are rasterized in order.
+ */
+void
+lp_setup_wait_resource( struct lp_setup_context *setup,
+                        const struct pipe_resource *texture,
+                        const char *reason )
+{
+   if (setup->scene &&
+       scene_resource_referenced(setup->scene, texture))
+      set_scene_state( setup, SETUP_FLUSHED, reason );
+
+   wait_scene_using_resource(setup, texture,
+                             LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE);
+}
+
+
+/**
+ * The texture is about to be written to other than by rendering, so
+ * forget the depth bounds if it's the depth buffer.
+ */
+void
+lp_setup_hiz_invalidate( struct lp_setup_context *setup,
+                         const struct pipe_resource *texture )
+{
+   if (setup->fb.zsbuf &&
+       setup->fb.zsbuf->texture == texture)
+      lp_hiz_invalidate(&setup->hiz);
 }
 
 
@@ -1008,10 +1210,23 @@ try_update_scene_state( struct lp_setup_context *setup )
 
    if (setup->dirty & LP_SETUP_NEW_SCISSOR) {
       setup->draw_region = setup->framebuffer;
+      setup->clip_to_region = setup->scissor_test;
       if (setup->scissor_test) {
          u_rect_possible_intersection(&setup->scissor,
                                       &setup->draw_region);
       }
+      if (setup->guard_band) {
+         struct u_rect vp;
+
+         viewport_region(setup, &vp);
+         if (vp.x0 > setup->framebuffer.x0 ||
+             vp.x1 < setup->framebuffer.x1 ||
+             vp.y0 > setup->framebuffer.y0 ||
+             vp.y1 < setup->framebuffer.y1) {
+            u_rect_possible_intersection(&vp, &setup->draw_region);
+            setup->clip_to_region = TRUE;
+         }
+      }
       /* If the framebuffer is large we have to think about fixed-point
        * integer overflow.  For 2K by 2K images, coordinates need 15 bits
        * (2^11 + 4 subpixel bits).  The product of two such numbers would
@@ -1022,6 +1237,15 @@ try_update_scene_state( struct lp_setup_context *setup )
        */
       setup->subdivide_large_triangles = (setup->fb.width > 2048 &&
                                           setup->fb.height > 2048);
+
+      /* Unclipped triangles may reach out to twice the viewport size
+       * away from its center.
+       */
+      if (setup->guard_band &&
+          (fabsf(setup->viewport.scale[0]) > 512.0f ||
+           fabsf(setup->viewport.scale[1]) > 512.0f)) {
+         setup->subdivide_large_triangles = TRUE;
+      }
    }
                                       
    setup->dirty = 0;
@@ -1122,18 +1346,23 @@ lp_setup_destroy( struct lp_setup_context *setup )
       pipe_resource_reference(&setup->constants[i].current.buffer, NULL);
    }
 
-   /* free the scenes in the 'empty' queue */
-   for (i = 0; i < Elements(setup->scenes); i++) {
+   /* free the scenes, waiting for any still queued */
+   for (i = 0; i < setup->num_scenes; i++) {
       struct lp_scene *scene = setup->scenes[i];
 
       if (scene->fence)
          lp_fence_wait(scene->fence);
 
+      lp_scene_reset(scene);
       lp_scene_destroy(scene);
    }
 
    lp_fence_reference(&setup->last_fence, NULL);
 
+   lp_setup_tri_batch_destroy( setup );
+
+   lp_hiz_destroy( &setup->hiz );
+
    FREE( setup );
 }
 
@@ -1172,8 +1401,17 @@ lp_setup_create( struct pipe_context *pipe,
    draw_set_rasterize_stage(draw, setup->vbuf);
    draw_set_render(draw, &setup->base);
 
+   /* Only have draw clip primitives reaching outside the guard band.
+    * The rest is confined to the viewport by the draw region.
+    */
+   setup->guard_band = !(LP_PERF & PERF_NO_GUARD_BAND);
+   draw_set_driver_clipping(draw, FALSE, FALSE, setup->guard_band);
+
    /* create some empty scenes */
-   for (i = 0; i < MAX_SCENES; i++) {
+   setup->num_scenes = debug_get_num_option("LP_NUM_SCENES", 3);
+   setup->num_scenes = CLAMP(setup->num_scenes, 2, MAX_SCENES);
+
+   for (i = 0; i < setup->num_scenes; i++) {
       setup->scenes[i] = lp_scene_create( pipe );
       if (!setup->scenes[i]) {
          goto no_scenes;
@@ -1186,10 +1424,14 @@ lp_setup_create( struct pipe_context *pipe,
    
    setup->dirty = ~0;
 
+   lp_hiz_init( &setup->hiz );
+
+   lp_setup_tri_batch_init( setup );
+
    return setup;
 
 no_scenes:
-   for (i = 0; i < MAX_SCENES; i++) {
+   for (i = 0; i < setup->num_scenes; i++) {
       if (setup->scenes[i]) {
          lp_scene_destroy(setup->scenes[i]);
       }
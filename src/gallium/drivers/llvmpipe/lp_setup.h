@@ -120,6 +120,10 @@ void
 lp_setup_set_scissor( struct lp_setup_context *setup,
                       const struct pipe_scissor_state *scissor );
 
+void
+lp_setup_set_viewport( struct lp_setup_context *setup,
+                       const struct pipe_viewport_state *viewport );
+
 void
 lp_setup_set_fragment_sampler_views(struct lp_setup_context *setup,
                                     unsigned num,
@@ -134,6 +138,15 @@ unsigned
 lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
                                 const struct pipe_resource *texture );
 
+void
+lp_setup_wait_resource( struct lp_setup_context *setup,
+                        const struct pipe_resource *texture,
+                        const char *reason );
+
+void
+lp_setup_hiz_invalidate( struct lp_setup_context *setup,
+                         const struct pipe_resource *texture );
+
 void
 lp_setup_set_flatshade_first( struct lp_setup_context *setup, 
                               boolean flatshade_first );
@@ -38,9 +38,11 @@
 #include "lp_setup.h"
 #include "lp_rast.h"
 #include "lp_scene.h"
+#include "lp_hiz.h"
 #include "lp_bld_interp.h"	/* for struct lp_shader_input */
 
 #include "draw/draw_vbuf.h"
+#include "os/os_thread.h"
 #include "util/u_rect.h"
 
 #define LP_SETUP_NEW_FS          0x01
@@ -52,8 +54,32 @@
 struct lp_setup_variant;
 
 
-/** Max number of scenes */
-#define MAX_SCENES 2
+/** Max number of scenes, see LP_NUM_SCENES */
+#define MAX_SCENES 8
+
+/** Max number of helper threads for parallel triangle setup */
+#define LP_MAX_SETUP_THREADS 8
+
+/** Max number of triangles queued for one parallel setup pass */
+#define LP_SETUP_TRI_BATCH 512
+
+
+struct lp_setup_context;
+struct lp_setup_tri_job;
+
+
+/**
+ * Helper thread which runs the per-triangle setup (culling, bounding box,
+ * interpolant and plane computation) for a slice of a triangle batch.
+ */
+struct lp_setup_thread
+{
+   struct lp_setup_context *setup;
+   unsigned index;              /**< slice of the batch, 0 is the app thread */
+   pipe_thread handle;
+   pipe_semaphore work_ready;
+   pipe_semaphore work_done;
+};
 
 
 
@@ -84,6 +110,7 @@ struct lp_setup_context
     */
    struct draw_stage *vbuf;
    unsigned num_threads;
+   unsigned num_scenes;                  /**< max scenes in flight */
    unsigned scene_idx;
    struct lp_scene *scenes[MAX_SCENES];  /**< all the scenes */
    struct lp_scene *scene;               /**< current scene being built */
@@ -95,6 +122,8 @@ struct lp_setup_context
    boolean flatshade_first;
    boolean ccw_is_frontface;
    boolean scissor_test;
+   boolean guard_band;         /**< draw only clips at the guard band */
+   boolean clip_to_region;     /**< tris/lines need draw_region planes */
    boolean point_size_per_vertex;
    boolean rasterizer_discard;
    unsigned cullmode;
@@ -107,7 +136,11 @@ struct lp_setup_context
    struct pipe_framebuffer_state fb;
    struct u_rect framebuffer;
    struct u_rect scissor;
-   struct u_rect draw_region;   /* intersection of fb & scissor */
+   struct pipe_viewport_state viewport;
+   struct u_rect draw_region;   /* intersection of fb, scissor & viewport */
+
+   /** Depth bounds of fb.zsbuf, for culling occluded primitives */
+   struct lp_hiz hiz;
 
    struct {
       unsigned flags;
@@ -158,12 +191,43 @@ struct lp_setup_context
                      const float (*v0)[4],
                      const float (*v1)[4],
                      const float (*v2)[4]);
+
+   /**
+    * Parallel triangle setup.  While a batch is open, setup->triangle only
+    * queues the triangles; the batch is then set up by the helper threads
+    * and binned in submission order by the calling thread.
+    */
+   struct {
+      unsigned num_threads;     /**< helper threads, not counting the caller */
+      boolean exit_flag;
+      struct lp_setup_thread threads[LP_MAX_SETUP_THREADS];
+
+      struct lp_setup_tri_job *jobs;
+      unsigned count;
+      ubyte *scratch;           /**< LP_SETUP_TRI_BATCH setup triangles */
+      unsigned tri_size;        /**< size of each triangle in scratch */
+      unsigned nr_planes;
+      boolean accept_ccw;
+      boolean accept_cw;
+
+      /** setup->triangle as it was when the batch was opened */
+      void (*triangle)( struct lp_setup_context *,
+                        const float (*v0)[4],
+                        const float (*v1)[4],
+                        const float (*v2)[4]);
+   } tri_batch;
 };
 
 void lp_setup_choose_triangle( struct lp_setup_context *setup );
 void lp_setup_choose_line( struct lp_setup_context *setup );
 void lp_setup_choose_point( struct lp_setup_context *setup );
 
+void lp_setup_tri_batch_init( struct lp_setup_context *setup );
+void lp_setup_tri_batch_destroy( struct lp_setup_context *setup );
+boolean lp_setup_tri_batch_begin( struct lp_setup_context *setup,
+                                  unsigned prim, unsigned nr );
+void lp_setup_tri_batch_end( struct lp_setup_context *setup );
+
 void lp_setup_init_vbuf(struct lp_setup_context *setup);
 
 boolean lp_setup_update_state( struct lp_setup_context *setup,
@@ -313,7 +313,7 @@ try_setup_line( struct lp_setup_context *setup,
    if (0)
       print_line(setup, v1, v2);
 
-   if (setup->scissor_test) {
+   if (setup->clip_to_region) {
       nr_planes = 8;
    }
    else {
@@ -672,7 +672,7 @@ try_setup_line( struct lp_setup_context *setup,
     * these planes elsewhere.
     */
    if (nr_planes == 8) {
-      const struct u_rect *scissor = &setup->scissor;
+      const struct u_rect *scissor = &setup->draw_region;
 
       plane[4].dcdx = -1;
       plane[4].dcdy = 0;
@@ -70,6 +70,21 @@ struct fixed_position {
 };
 
 
+/**
+ * Size of a triangle plus its input and plane arrays.
+ */
+static INLINE unsigned
+triangle_size(unsigned nr_inputs, unsigned nr_planes)
+{
+   unsigned input_array_sz = NUM_CHANNELS * (nr_inputs + 1) * sizeof(float);
+   unsigned plane_sz = nr_planes * sizeof(struct lp_rast_plane);
+
+   return (sizeof(struct lp_rast_triangle) +
+           3 * input_array_sz +
+           plane_sz);
+}
+
+
 /**
  * Alloc space for a new triangle plus the input.a0/dadx/dady arrays
  * immediately after it.
@@ -85,12 +100,9 @@ lp_setup_alloc_triangle(struct lp_scene *scene,
                         unsigned *tri_size)
 {
    unsigned input_array_sz = NUM_CHANNELS * (nr_inputs + 1) * sizeof(float);
-   unsigned plane_sz = nr_planes * sizeof(struct lp_rast_plane);
    struct lp_rast_triangle *tri;
 
-   *tri_size = (sizeof(struct lp_rast_triangle) +
-                3 * input_array_sz +
-                plane_sz);
+   *tri_size = triangle_size(nr_inputs, nr_planes);
 
    tri = lp_scene_alloc_aligned( scene, *tri_size, 16 );
    if (tri == NULL)
@@ -227,39 +239,24 @@ lp_setup_whole_tile(struct lp_setup_context *setup,
 
 
 /**
- * Do basic setup for triangle rasterization and determine which
- * framebuffer tiles are touched.  Put the triangle in the scene's
- * bins for the tiles which we overlap.
+ * Number of planes a triangle needs with the current draw region.
  */
-static boolean
-do_triangle_ccw(struct lp_setup_context *setup,
-                struct fixed_position* position,
-                const float (*v0)[4],
-                const float (*v1)[4],
-                const float (*v2)[4],
-                boolean frontfacing )
+static INLINE int
+triangle_nr_planes(const struct lp_setup_context *setup)
 {
-   struct lp_scene *scene = setup->scene;
-   const struct lp_setup_variant_key *key = &setup->setup.variant->key;
-   struct lp_rast_triangle *tri;
-   struct lp_rast_plane *plane;
-   struct u_rect bbox;
-   unsigned tri_bytes;
-   int nr_planes = 3;
-
-   /* Area should always be positive here */
-   assert(position->area > 0);
-
-   if (0)
-      lp_setup_print_triangle(setup, v0, v1, v2);
+   return setup->clip_to_region ? 7 : 3;
+}
 
-   if (setup->scissor_test) {
-      nr_planes = 7;
-   }
-   else {
-      nr_planes = 3;
-   }
 
+/**
+ * Compute the bounding rectangle of a ccw triangle, in pixels.
+ * \return FALSE if the triangle is empty or outside the draw region
+ */
+static boolean
+calc_triangle_bbox(const struct lp_setup_context *setup,
+                   const struct fixed_position *position,
+                   struct u_rect *bbox)
+{
    /* Bounding rectangle (in pixels) */
    {
       /* Yes this is necessary to accurately calculate bounding boxes
@@ -270,51 +267,52 @@ do_triangle_ccw(struct lp_setup_context *setup,
       int adj = (setup->pixel_offset != 0) ? 1 : 0;
 
       /* Inclusive x0, exclusive x1 */
-      bbox.x0 =  MIN3(position->x[0], position->x[1], position->x[2]) >> FIXED_ORDER;
-      bbox.x1 = (MAX3(position->x[0], position->x[1], position->x[2]) - 1) >> FIXED_ORDER;
+      bbox->x0 =  MIN3(position->x[0], position->x[1], position->x[2]) >> FIXED_ORDER;
+      bbox->x1 = (MAX3(position->x[0], position->x[1], position->x[2]) - 1) >> FIXED_ORDER;
 
       /* Inclusive / exclusive depending upon adj (bottom-left or top-right) */
-      bbox.y0 = (MIN3(position->y[0], position->y[1], position->y[2]) + adj) >> FIXED_ORDER;
-      bbox.y1 = (MAX3(position->y[0], position->y[1], position->y[2]) - 1 + adj) >> FIXED_ORDER;
+      bbox->y0 = (MIN3(position->y[0], position->y[1], position->y[2]) + adj) >> FIXED_ORDER;
+      bbox->y1 = (MAX3(position->y[0], position->y[1], position->y[2]) - 1 + adj) >> FIXED_ORDER;
    }
 
-   if (bbox.x1 < bbox.x0 ||
-       bbox.y1 < bbox.y0) {
+   if (bbox->x1 < bbox->x0 ||
+       bbox->y1 < bbox->y0) {
       if (0) debug_printf("empty bounding box\n");
-      LP_COUNT(nr_culled_tris);
-      return TRUE;
+      return FALSE;
    }
 
-   if (!u_rect_test_intersection(&setup->draw_region, &bbox)) {
+   if (!u_rect_test_intersection(&setup->draw_region, bbox)) {
       if (0) debug_printf("offscreen\n");
-      LP_COUNT(nr_culled_tris);
-      return TRUE;
+      return FALSE;
    }
 
    /* Can safely discard negative regions, but need to keep hold of
     * information about when the triangle extends past screen
     * boundaries.  See trimmed_box in lp_setup_bin_triangle().
     */
-   bbox.x0 = MAX2(bbox.x0, 0);
-   bbox.y0 = MAX2(bbox.y0, 0);
+   bbox->x0 = MAX2(bbox->x0, 0);
+   bbox->y0 = MAX2(bbox->y0, 0);
 
-   tri = lp_setup_alloc_triangle(scene,
-                                 key->num_inputs,
-                                 nr_planes,
-                                 &tri_bytes);
-   if (!tri)
-      return FALSE;
+   return TRUE;
+}
 
-#if 0
-   tri->v[0][0] = v0[0][0];
-   tri->v[1][0] = v1[0][0];
-   tri->v[2][0] = v2[0][0];
-   tri->v[0][1] = v0[0][1];
-   tri->v[1][1] = v1[0][1];
-   tri->v[2][1] = v2[0][1];
-#endif
 
-   LP_COUNT(nr_tris);
+/**
+ * Compute the interpolants and the edge/scissor planes of a ccw triangle
+ * into tri.  Only reads the setup state, so may be called concurrently
+ * from several threads.
+ */
+static void
+setup_triangle_coefs(const struct lp_setup_context *setup,
+                     struct lp_rast_triangle *tri,
+                     const struct fixed_position *position,
+                     const float (*v0)[4],
+                     const float (*v1)[4],
+                     const float (*v2)[4],
+                     boolean frontfacing,
+                     int nr_planes)
+{
+   struct lp_rast_plane *plane;
 
    /* Setup parameter interpolants:
     */
@@ -491,7 +489,7 @@ do_triangle_ccw(struct lp_setup_context *setup,
     * these planes elsewhere.
     */
    if (nr_planes == 7) {
-      const struct u_rect *scissor = &setup->scissor;
+      const struct u_rect *scissor = &setup->draw_region;
 
       plane[3].dcdx = -1;
       plane[3].dcdy = 0;
@@ -513,6 +511,62 @@ do_triangle_ccw(struct lp_setup_context *setup,
       plane[6].c = scissor->y1+1;
       plane[6].eo = 0;
    }
+}
+
+
+/**
+ * Do basic setup for triangle rasterization and determine which
+ * framebuffer tiles are touched.  Put the triangle in the scene's
+ * bins for the tiles which we overlap.
+ */
+static boolean
+do_triangle_ccw(struct lp_setup_context *setup,
+                struct fixed_position* position,
+                const float (*v0)[4],
+                const float (*v1)[4],
+                const float (*v2)[4],
+                boolean frontfacing )
+{
+   struct lp_scene *scene = setup->scene;
+   const struct lp_setup_variant_key *key = &setup->setup.variant->key;
+   struct lp_rast_triangle *tri;
+   struct u_rect bbox;
+   unsigned tri_bytes;
+   int nr_planes;
+
+   /* Area should always be positive here */
+   assert(position->area > 0);
+
+   if (0)
+      lp_setup_print_triangle(setup, v0, v1, v2);
+
+   nr_planes = triangle_nr_planes(setup);
+
+   if (!calc_triangle_bbox(setup, position, &bbox)) {
+      LP_COUNT(nr_culled_tris);
+      return TRUE;
+   }
+
+   tri = lp_setup_alloc_triangle(scene,
+                                 key->num_inputs,
+                                 nr_planes,
+                                 &tri_bytes);
+   if (!tri)
+      return FALSE;
+
+#if 0
+   tri->v[0][0] = v0[0][0];
+   tri->v[1][0] = v1[0][0];
+   tri->v[2][0] = v2[0][0];
+   tri->v[0][1] = v0[0][1];
+   tri->v[1][1] = v1[0][1];
+   tri->v[2][1] = v2[0][1];
+#endif
+
+   LP_COUNT(nr_tris);
+
+   setup_triangle_coefs(setup, tri, position, v0, v1, v2,
+                        frontfacing, nr_planes);
 
    return lp_setup_bin_triangle( setup, tri, &bbox, nr_planes );
 }
@@ -544,6 +598,34 @@ floor_pot(uint32_t n)
 }
 
 
+/**
+ * Test the part of a primitive within tile (x, y) against the depth
+ * bounds.  If it may be visible, account for its depth writes.
+ * \return TRUE if it is occluded there
+ */
+static boolean
+hiz_tile_occluded( struct lp_setup_context *setup,
+                   const struct lp_hiz_plane *zplane,
+                   const struct u_rect *box,
+                   int x, int y )
+{
+   struct u_rect rect;
+
+   rect.x0 = MAX2(x * TILE_SIZE, box->x0);
+   rect.y0 = MAX2(y * TILE_SIZE, box->y0);
+   rect.x1 = MIN2(x * TILE_SIZE + TILE_SIZE - 1, box->x1);
+   rect.y1 = MIN2(y * TILE_SIZE + TILE_SIZE - 1, box->y1);
+
+   if (lp_hiz_rect_occluded(&setup->hiz, zplane, &rect)) {
+      LP_COUNT(nr_hiz_culled_64);
+      return TRUE;
+   }
+
+   lp_hiz_rect_update(&setup->hiz, zplane, &rect);
+   return FALSE;
+}
+
+
 boolean
 lp_setup_bin_triangle( struct lp_setup_context *setup,
                        struct lp_rast_triangle *tri,
@@ -552,6 +634,8 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
 {
    struct lp_scene *scene = setup->scene;
    struct u_rect trimmed_box = *bbox;   
+   boolean hiz = lp_hiz_active(&setup->hiz);
+   struct lp_hiz_plane zplane;
    int i;
 
    /* What is the largest power-of-two boundary this triangle crosses:
@@ -572,6 +656,9 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
     */
    u_rect_find_intersection(&setup->draw_region, &trimmed_box);
 
+   if (hiz)
+      lp_hiz_plane_init(&zplane, &tri->inputs);
+
    /* Determine which tile(s) intersect the triangle's bounding box
     */
    if (dx < TILE_SIZE)
@@ -584,6 +671,11 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
       assert(iy0 == bbox->y1 / TILE_SIZE &&
 	     ix0 == bbox->x1 / TILE_SIZE);
 
+      if (hiz && hiz_tile_occluded(setup, &zplane, &trimmed_box, ix0, iy0)) {
+         LP_COUNT(nr_hiz_culled_tris);
+         return TRUE;
+      }
+
       if (nr_planes == 3) {
          if (sz < 4)
          {
@@ -655,6 +747,7 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
       int iy0 = trimmed_box.y0 / TILE_SIZE;
       int ix1 = trimmed_box.x1 / TILE_SIZE;
       int iy1 = trimmed_box.y1 / TILE_SIZE;
+      boolean binned = FALSE, hidden = FALSE;
       
       for (i = 0; i < nr_planes; i++) {
          c[i] = (plane[i].c + 
@@ -703,12 +796,18 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
                   break;  /* exiting triangle, all done with this row */
                LP_COUNT(nr_empty_64);
             }
+            else if (hiz && hiz_tile_occluded(setup, &zplane, &trimmed_box, x, y)) {
+               /* hidden behind what's already in the depth buffer */
+               in = TRUE;
+               hidden = TRUE;
+            }
             else if (partial) {
                /* Not trivially accepted by at least one plane - 
                 * rasterize/shade partial tile
                 */
                int count = util_bitcount(partial);
                in = TRUE;
+               binned = TRUE;
                
                if (!lp_scene_bin_cmd_with_state( scene, x, y,
                                                  setup->fs.stored,
@@ -722,6 +821,7 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
                /* triangle covers the whole tile- shade whole tile */
                LP_COUNT(nr_fully_covered_64);
                in = TRUE;
+               binned = TRUE;
                if (!lp_setup_whole_tile(setup, &tri->inputs, x, y))
                   goto fail;
             }
@@ -737,6 +837,9 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
          for (i = 0; i < nr_planes; i++)
             c[i] += ystep[i];
       }
+
+      if (hidden && !binned)
+         LP_COUNT(nr_hiz_culled_tris);
    }
 
    return TRUE;
@@ -776,7 +879,7 @@ static void retry_triangle_ccw( struct lp_setup_context *setup,
  * Calculate fixed position data for a triangle
  */
 static INLINE void
-calc_fixed_position( struct lp_setup_context *setup,
+calc_fixed_position( const struct lp_setup_context *setup,
                      struct fixed_position* position,
                      const float (*v0)[4],
                      const float (*v1)[4],
@@ -1106,21 +1209,418 @@ static void triangle_nop( struct lp_setup_context *setup,
 }
 
 
+static triangle_func_t
+select_triangle_func( const struct lp_setup_context *setup )
+{
+   switch (setup->cullmode) {
+   case PIPE_FACE_NONE:
+      return triangle_both;
+   case PIPE_FACE_BACK:
+      return setup->ccw_is_frontface ? triangle_ccw : triangle_cw;
+   case PIPE_FACE_FRONT:
+      return setup->ccw_is_frontface ? triangle_cw : triangle_ccw;
+   default:
+      return triangle_nop;
+   }
+}
+
+
 void 
 lp_setup_choose_triangle( struct lp_setup_context *setup )
 {
+   setup->triangle = select_triangle_func( setup );
+}
+
+
+
+/*
+ * Parallel triangle setup.
+ *
+ * With many triangles per draw, the per-triangle setup work (culling,
+ * bounding box, interpolant and plane computation) dominates the time
+ * spent in the app thread.  While a batch is open, setup->triangle just
+ * queues the vertex pointers.  Each full batch is split into contiguous
+ * slices which the helper threads and the calling thread set up
+ * concurrently into private scratch memory; the calling thread then
+ * copies the results into the scene and bins them in submission order,
+ * so the binned commands are the same as with serial setup.
+ */
+
+enum lp_setup_tri_status {
+   LP_SETUP_TRI_CULLED,
+   LP_SETUP_TRI_BIN,      /**< set up in scratch, ready to be binned */
+   LP_SETUP_TRI_SERIAL    /**< needs the serial path (subdivision) */
+};
+
+struct lp_setup_tri_job {
+   const float (*v[3])[4];
+   struct u_rect bbox;
+   enum lp_setup_tri_status status;
+};
+
+
+/** Minimum number of triangles in a draw to bother with parallel setup */
+#define LP_SETUP_TRI_BATCH_MIN 64
+
+
+static INLINE struct lp_rast_triangle *
+tri_batch_scratch( const struct lp_setup_context *setup, unsigned i )
+{
+   return (struct lp_rast_triangle *)
+      (setup->tri_batch.scratch + i * setup->tri_batch.tri_size);
+}
+
+
+/**
+ * Check whether check_subdivide_triangle() would split this triangle.
+ */
+static INLINE boolean
+triangle_is_large( const float (*v0)[4],
+                   const float (*v1)[4],
+                   const float (*v2)[4] )
+{
+   const float maxLen = 2048.0f;
+   float dx10 = v1[0][0] - v0[0][0];
+   float dy10 = v1[0][1] - v0[0][1];
+   float dx21 = v2[0][0] - v1[0][0];
+   float dy21 = v2[0][1] - v1[0][1];
+   float dx02 = v0[0][0] - v2[0][0];
+   float dy02 = v0[0][1] - v2[0][1];
+
+   return (dx10 * dx10 + dy10 * dy10 > maxLen * maxLen ||
+           dx21 * dx21 + dy21 * dy21 > maxLen * maxLen ||
+           dx02 * dx02 + dy02 * dy02 > maxLen * maxLen);
+}
+
+
+/**
+ * Set up one queued triangle into its scratch slot.  This mirrors
+ * triangle_both/cw/ccw() and do_triangle_ccw(), minus the binning.
+ */
+static void
+prepare_triangle( const struct lp_setup_context *setup,
+                  struct lp_setup_tri_job *job,
+                  struct lp_rast_triangle *tri )
+{
+   const float (*v0)[4] = job->v[0];
+   const float (*v1)[4] = job->v[1];
+   const float (*v2)[4] = job->v[2];
+   struct fixed_position position;
+   boolean front;
+
+   if (setup->subdivide_large_triangles &&
+       triangle_is_large(v0, v1, v2)) {
+      job->status = LP_SETUP_TRI_SERIAL;
+      return;
+   }
+
+   calc_fixed_position(setup, &position, v0, v1, v2);
+
+   if (position.area > 0 && setup->tri_batch.accept_ccw) {
+      front = setup->ccw_is_frontface;
+   }
+   else if (position.area < 0 && setup->tri_batch.accept_cw) {
+      const float (*tmp)[4];
+
+      if (setup->flatshade_first) {
+         rotate_fixed_position_12(&position);
+         tmp = v1; v1 = v2; v2 = tmp;
+      } else {
+         rotate_fixed_position_01(&position);
+         tmp = v0; v0 = v1; v1 = tmp;
+      }
+      front = !setup->ccw_is_frontface;
+   }
+   else {
+      job->status = LP_SETUP_TRI_CULLED;
+      return;
+   }
+
+   if (!calc_triangle_bbox(setup, &position, &job->bbox)) {
+      job->status = LP_SETUP_TRI_CULLED;
+      return;
+   }
+
+   tri->inputs.stride = NUM_CHANNELS *
+      (setup->setup.variant->key.num_inputs + 1) * sizeof(float);
+
+   setup_triangle_coefs(setup, tri, &position, v0, v1, v2,
+                        front, setup->tri_batch.nr_planes);
+
+   job->status = LP_SETUP_TRI_BIN;
+}
+
+
+/**
+ * Set up slice 'index' of the current batch.
+ */
+static void
+prepare_triangles( const struct lp_setup_context *setup, unsigned index )
+{
+   unsigned nr_slices = setup->tri_batch.num_threads + 1;
+   unsigned count = setup->tri_batch.count;
+   unsigned begin = count * index / nr_slices;
+   unsigned end = count * (index + 1) / nr_slices;
+   unsigned i;
+
+   for (i = begin; i < end; i++) {
+      prepare_triangle(setup, &setup->tri_batch.jobs[i],
+                       tri_batch_scratch(setup, i));
+   }
+}
+
+
+/**
+ * Copy a triangle from scratch into the scene and bin it.
+ */
+static boolean
+bin_prepared_triangle( struct lp_setup_context *setup,
+                       const struct lp_rast_triangle *src,
+                       const struct u_rect *bbox )
+{
+   const struct lp_setup_variant_key *key = &setup->setup.variant->key;
+   int nr_planes = setup->tri_batch.nr_planes;
+   struct lp_rast_triangle *tri;
+   unsigned tri_bytes;
+
+   tri = lp_setup_alloc_triangle(setup->scene,
+                                 key->num_inputs,
+                                 nr_planes,
+                                 &tri_bytes);
+   if (!tri)
+      return FALSE;
+
+   LP_COUNT(nr_tris);
+
+   memcpy(tri, src, tri_bytes);
+
+   return lp_setup_bin_triangle( setup, tri, bbox, nr_planes );
+}
+
+
+/**
+ * Set up all queued triangles in parallel, then bin them in order.
+ */
+static void
+flush_tri_batch( struct lp_setup_context *setup )
+{
+   unsigned num_threads = setup->tri_batch.num_threads;
+   unsigned count = setup->tri_batch.count;
+   unsigned i;
+
+   if (!count)
+      return;
+
+   for (i = 0; i < num_threads; i++)
+      pipe_semaphore_signal(&setup->tri_batch.threads[i].work_ready);
+
+   prepare_triangles(setup, 0);
+
+   for (i = 0; i < num_threads; i++)
+      pipe_semaphore_wait(&setup->tri_batch.threads[i].work_done);
+
+   for (i = 0; i < count; i++) {
+      struct lp_setup_tri_job *job = &setup->tri_batch.jobs[i];
+      const struct lp_rast_triangle *tri = tri_batch_scratch(setup, i);
+
+      switch (job->status) {
+      case LP_SETUP_TRI_CULLED:
+         LP_COUNT(nr_culled_tris);
+         break;
+      case LP_SETUP_TRI_SERIAL:
+         setup->tri_batch.triangle(setup, job->v[0], job->v[1], job->v[2]);
+         break;
+      case LP_SETUP_TRI_BIN:
+         if (!bin_prepared_triangle(setup, tri, &job->bbox)) {
+            if (lp_setup_flush_and_restart(setup))
+               bin_prepared_triangle(setup, tri, &job->bbox);
+         }
+         break;
+      }
+   }
+
+   setup->tri_batch.count = 0;
+}
+
+
+static void
+triangle_queue( struct lp_setup_context *setup,
+                const float (*v0)[4],
+                const float (*v1)[4],
+                const float (*v2)[4] )
+{
+   struct lp_setup_tri_job *job =
+      &setup->tri_batch.jobs[setup->tri_batch.count++];
+
+   job->v[0] = v0;
+   job->v[1] = v1;
+   job->v[2] = v2;
+
+   if (setup->tri_batch.count == LP_SETUP_TRI_BATCH)
+      flush_tri_batch(setup);
+}
+
+
+static PIPE_THREAD_ROUTINE( tri_setup_thread, init_data )
+{
+   struct lp_setup_thread *thread = (struct lp_setup_thread *) init_data;
+   struct lp_setup_context *setup = thread->setup;
+
+   while (1) {
+      pipe_semaphore_wait(&thread->work_ready);
+
+      if (setup->tri_batch.exit_flag)
+         break;
+
+      prepare_triangles(setup, thread->index);
+
+      pipe_semaphore_signal(&thread->work_done);
+   }
+
+   return NULL;
+}
+
+
+/**
+ * Start the parallel triangle setup helper threads, if wanted.
+ * On failure setup just stays serial.
+ */
+void
+lp_setup_tri_batch_init( struct lp_setup_context *setup )
+{
+   unsigned num_threads;
+   unsigned i;
+
+   num_threads = setup->num_threads > 1 ? MIN2(setup->num_threads - 1, 3) : 0;
+   num_threads = debug_get_num_option("LP_NUM_SETUP_THREADS", num_threads);
+   num_threads = MIN2(num_threads, LP_MAX_SETUP_THREADS);
+
+   setup->tri_batch.num_threads = 0;
+
+   if (!num_threads)
+      return;
+
+   /* Scratch slots are sized for the largest possible triangle */
+   setup->tri_batch.tri_size = align(triangle_size(PIPE_MAX_SHADER_INPUTS, 7), 16);
+   setup->tri_batch.jobs = MALLOC(LP_SETUP_TRI_BATCH *
+                                  sizeof setup->tri_batch.jobs[0]);
+   setup->tri_batch.scratch = align_malloc(LP_SETUP_TRI_BATCH *
+                                           setup->tri_batch.tri_size, 16);
+   if (!setup->tri_batch.jobs || !setup->tri_batch.scratch) {
+      lp_setup_tri_batch_destroy(setup);
+      return;
+   }
+
+   setup->tri_batch.exit_flag = FALSE;
+
+   for (i = 0; i < num_threads; i++) {
+      struct lp_setup_thread *thread = &setup->tri_batch.threads[i];
+
+      thread->setup = setup;
+      thread->index = i + 1;
+      pipe_semaphore_init(&thread->work_ready, 0);
+      pipe_semaphore_init(&thread->work_done, 0);
+      thread->handle = pipe_thread_create(tri_setup_thread, (void *) thread);
+   }
+
+   setup->tri_batch.num_threads = num_threads;
+}
+
+
+void
+lp_setup_tri_batch_destroy( struct lp_setup_context *setup )
+{
+   unsigned i;
+
+   setup->tri_batch.exit_flag = TRUE;
+
+   for (i = 0; i < setup->tri_batch.num_threads; i++)
+      pipe_semaphore_signal(&setup->tri_batch.threads[i].work_ready);
+
+   for (i = 0; i < setup->tri_batch.num_threads; i++) {
+      pipe_thread_wait(setup->tri_batch.threads[i].handle);
+      pipe_semaphore_destroy(&setup->tri_batch.threads[i].work_ready);
+      pipe_semaphore_destroy(&setup->tri_batch.threads[i].work_done);
+   }
+
+   setup->tri_batch.num_threads = 0;
+
+   FREE(setup->tri_batch.jobs);
+   setup->tri_batch.jobs = NULL;
+
+   align_free(setup->tri_batch.scratch);
+   setup->tri_batch.scratch = NULL;
+}
+
+
+/**
+ * Open a triangle batch for a draw of 'nr' vertices of type 'prim', if
+ * parallel setup is enabled and worthwhile.  Must be called after
+ * lp_setup_update_state(), as the setup state may not change while the
+ * batch is open.
+ * \return TRUE if a batch was opened and lp_setup_tri_batch_end() must
+ *         be called
+ */
+boolean
+lp_setup_tri_batch_begin( struct lp_setup_context *setup,
+                          unsigned prim, unsigned nr )
+{
+   if (!setup->tri_batch.num_threads)
+      return FALSE;
+
+   switch (prim) {
+   case PIPE_PRIM_TRIANGLES:
+      if (nr < 3 * LP_SETUP_TRI_BATCH_MIN)
+         return FALSE;
+      break;
+   case PIPE_PRIM_TRIANGLE_STRIP:
+   case PIPE_PRIM_TRIANGLE_FAN:
+   case PIPE_PRIM_POLYGON:
+      if (nr < LP_SETUP_TRI_BATCH_MIN + 2)
+         return FALSE;
+      break;
+   default:
+      return FALSE;
+   }
+
    switch (setup->cullmode) {
    case PIPE_FACE_NONE:
-      setup->triangle = triangle_both;
+      setup->tri_batch.accept_ccw = TRUE;
+      setup->tri_batch.accept_cw = TRUE;
       break;
    case PIPE_FACE_BACK:
-      setup->triangle = setup->ccw_is_frontface ? triangle_ccw : triangle_cw;
+      setup->tri_batch.accept_ccw = setup->ccw_is_frontface;
+      setup->tri_batch.accept_cw = !setup->ccw_is_frontface;
       break;
    case PIPE_FACE_FRONT:
-      setup->triangle = setup->ccw_is_frontface ? triangle_cw : triangle_ccw;
+      setup->tri_batch.accept_ccw = !setup->ccw_is_frontface;
+      setup->tri_batch.accept_cw = setup->ccw_is_frontface;
       break;
    default:
-      setup->triangle = triangle_nop;
-      break;
+      /* everything culled */
+      return FALSE;
    }
+
+   assert(setup->tri_batch.count == 0);
+
+   setup->tri_batch.nr_planes = triangle_nr_planes(setup);
+   setup->tri_batch.triangle = select_triangle_func(setup);
+   setup->triangle = triangle_queue;
+
+   return TRUE;
+}
+
+
+/**
+ * Set up and bin the remaining queued triangles and close the batch.
+ */
+void
+lp_setup_tri_batch_end( struct lp_setup_context *setup )
+{
+   flush_tri_batch(setup);
+
+   /* Nothing in the serial path changes the rasterizer state, so the
+    * function chosen at begin time is still the right one.
+    */
+   setup->triangle = setup->tri_batch.triangle;
 }
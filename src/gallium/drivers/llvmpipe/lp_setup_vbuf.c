@@ -139,6 +139,7 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
    const unsigned stride = setup->vertex_info->size * sizeof(float);
    const void *vertex_buffer = setup->vertex_buffer;
    const boolean flatshade_first = setup->flatshade_first;
+   boolean batched;
    unsigned i;
 
    assert(setup->setup.variant);
@@ -146,6 +147,8 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
    if (!lp_setup_update_state(setup, TRUE))
       return;
 
+   batched = lp_setup_tri_batch_begin(setup, setup->prim, nr);
+
    switch (setup->prim) {
    case PIPE_PRIM_POINTS:
       for (i = 0; i < nr; i++) {
@@ -324,6 +327,9 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
    default:
       assert(0);
    }
+
+   if (batched)
+      lp_setup_tri_batch_end(setup);
 }
 
 
@@ -339,11 +345,14 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
    const void *vertex_buffer =
       (void *) get_vert(setup->vertex_buffer, start, stride);
    const boolean flatshade_first = setup->flatshade_first;
+   boolean batched;
    unsigned i;
 
    if (!lp_setup_update_state(setup, TRUE))
       return;
 
+   batched = lp_setup_tri_batch_begin(setup, setup->prim, nr);
+
    switch (setup->prim) {
    case PIPE_PRIM_POINTS:
       for (i = 0; i < nr; i++) {
@@ -519,6 +528,9 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
    default:
       assert(0);
    }
+
+   if (batched)
+      lp_setup_tri_batch_end(setup);
 }
 
 
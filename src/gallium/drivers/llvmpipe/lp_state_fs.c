@@ -74,6 +74,7 @@
 #include "tgsi/tgsi_scan.h"
 #include "tgsi/tgsi_parse.h"
 #include "gallivm/lp_bld_type.h"
+#include "gallivm/lp_bld_cache.h"
 #include "gallivm/lp_bld_const.h"
 #include "gallivm/lp_bld_conv.h"
 #include "gallivm/lp_bld_init.h"
@@ -106,6 +107,15 @@
 static unsigned fs_no = 0;
 
 
+/**
+ * Widest vectors the fragment shader and blend code can use.  The quad
+ * twiddling, the coverage mask expansion and the blend format conversions
+ * only handle 4 or 8 pixels per vector, so with 512-bit native vectors
+ * fragments are still shaded 8 at a time.
+ */
+#define LP_FS_MAX_VECTOR_WIDTH 256
+
+
 /**
  * Expand the relevant bits of mask_input to a n*4-dword mask for the
  * n*four pixels in n 2x2 quads.  This will set the n*four elements of the
@@ -1374,7 +1384,8 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
    lp_mem_type_from_format_desc(out_format_desc, &dst_type);
 
    row_type.length = fs_type.length;
-   vector_width    = dst_type.floating ? lp_native_vector_width : lp_integer_vector_width;
+   vector_width    = dst_type.floating ? MIN2(lp_native_vector_width, LP_FS_MAX_VECTOR_WIDTH)
+                                       : lp_integer_vector_width;
 
    /* Compute correct swizzle and count channels */
    memset(swizzle, LP_BLD_SWIZZLE_DONTCARE, TGSI_NUM_CHANNELS);
@@ -1819,7 +1830,7 @@ generate_fragment(struct llvmpipe_context *lp,
    fs_type.sign = TRUE;          /* values are signed */
    fs_type.norm = FALSE;         /* values are not limited to [0,1] or [-1,1] */
    fs_type.width = 32;           /* 32-bit float */
-   fs_type.length = MIN2(lp_native_vector_width / 32, 16); /* n*4 elements per vector */
+   fs_type.length = MIN2(lp_native_vector_width, LP_FS_MAX_VECTOR_WIDTH) / 32; /* n*4 elements per vector */
    num_fs = 16 / fs_type.length; /* number of loops per 4x4 stamp */
 
    memset(&blend_type, 0, sizeof blend_type);
@@ -2124,6 +2135,54 @@ lp_debug_fs_variant(const struct lp_fragment_shader_variant *variant)
 }
 
 
+/**
+ * Pick up the fragment functions from a module loaded from the disk cache.
+ * \return  TRUE for success, FALSE if the module doesn't look like ours
+ */
+static boolean
+load_cached_fragment(struct lp_fragment_shader_variant *variant)
+{
+   LLVMValueRef func;
+
+   for (func = LLVMGetFirstFunction(variant->gallivm->module);
+        func;
+        func = LLVMGetNextFunction(func)) {
+      const char *name;
+      unsigned len;
+      unsigned partial_mask;
+
+      if (LLVMIsDeclaration(func))
+         continue;
+
+      name = LLVMGetValueName(func);
+      len = strlen(name);
+      if (len > 8 && strcmp(name + len - 8, "_partial") == 0)
+         partial_mask = RAST_EDGE_TEST;
+      else if (len > 6 && strcmp(name + len - 6, "_whole") == 0)
+         partial_mask = RAST_WHOLE;
+      else
+         continue;
+
+      lp_build_name(func, "fs%u_variant%u_%s",
+                    variant->shader->no, variant->no,
+                    partial_mask ? "partial" : "whole");
+
+      variant->function[partial_mask] = func;
+      variant->nr_instrs += lp_build_count_instructions(func);
+   }
+
+   if (!variant->function[RAST_EDGE_TEST] ||
+       (variant->opaque && !variant->function[RAST_WHOLE])) {
+      variant->function[RAST_EDGE_TEST] = NULL;
+      variant->function[RAST_WHOLE] = NULL;
+      variant->nr_instrs = 0;
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
@@ -2136,13 +2195,33 @@ generate_variant(struct llvmpipe_context *lp,
    struct lp_fragment_shader_variant *variant;
    const struct util_format_description *cbuf0_format_desc;
    boolean fullcolormask;
+   boolean use_cache;
+   boolean cached = FALSE;
+   struct gallivm_cache_key cache_key;
 
    variant = CALLOC_STRUCT(lp_fragment_shader_variant);
    if(!variant)
       return NULL;
 
-   variant->gallivm = gallivm_create();
+   use_cache = gallivm_cache_enabled();
+   if (use_cache) {
+      gallivm_cache_key_init(&cache_key);
+      gallivm_cache_key_append(&cache_key, shader->base.tokens,
+                               tgsi_num_tokens(shader->base.tokens) *
+                               sizeof(struct tgsi_token));
+      gallivm_cache_key_append(&cache_key, key, shader->variant_key_size);
+
+      variant->gallivm = gallivm_cache_load(&cache_key);
+      cached = variant->gallivm != NULL;
+   }
+
+   if (!variant->gallivm) {
+      variant->gallivm = gallivm_create();
+   }
+
    if (!variant->gallivm) {
+      if (use_cache)
+         gallivm_cache_key_fini(&cache_key);
       FREE(variant);
       return NULL;
    }
@@ -2177,16 +2256,38 @@ generate_variant(struct llvmpipe_context *lp,
       lp_debug_fs_variant(variant);
    }
 
+   if (cached && !load_cached_fragment(variant)) {
+      /* Stale or foreign entry -- start over with an empty module */
+      gallivm_destroy(variant->gallivm);
+      variant->gallivm = gallivm_create();
+      cached = FALSE;
+      if (!variant->gallivm) {
+         gallivm_cache_key_fini(&cache_key);
+         FREE(variant);
+         return NULL;
+      }
+   }
+
    lp_jit_init_types(variant);
-   
-   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
 
-   if (variant->jit_function[RAST_WHOLE] == NULL) {
-      if (variant->opaque) {
-         /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
+   if (!cached) {
+      if (variant->jit_function[RAST_EDGE_TEST] == NULL)
+         generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
+
+      if (variant->jit_function[RAST_WHOLE] == NULL) {
+         if (variant->opaque) {
+            /* Specialized shader, which doesn't need to read the color buffer. */
+            generate_fragment(lp, shader, variant, RAST_WHOLE);
+         }
       }
+
+      if (use_cache) {
+         gallivm_cache_store(&cache_key, variant->gallivm);
+      }
+   }
+
+   if (use_cache) {
+      gallivm_cache_key_fini(&cache_key);
    }
 
    /*
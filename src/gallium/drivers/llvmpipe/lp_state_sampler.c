@@ -35,6 +35,7 @@
 #include "draw/draw_context.h"
 
 #include "lp_context.h"
+#include "lp_flush.h"
 #include "lp_screen.h"
 #include "lp_state.h"
 #include "lp_debug.h"
@@ -285,6 +286,16 @@ prepare_shader_sampling(
           */
          pipe_resource_reference(&mapped_tex[i], tex);
 
+         /* The draw module samples straight from the texture memory, right
+          * now, so scenes still rendering to it must be done first.
+          */
+         llvmpipe_flush_resource(&lp->pipe, tex, 0,
+                                 TRUE,  /* read_only */
+                                 TRUE,  /* cpu_access */
+                                 FALSE, /* do_not_block */
+                                 __FUNCTION__);
+         llvmpipe_resolve_tile_clears(tex);
+
          if (!lp_tex->dt) {
             /* regular texture - setup array of mipmap level offsets */
             struct pipe_resource *res = view->texture;
@@ -30,6 +30,7 @@
 #include "lp_context.h"
 #include "lp_flush.h"
 #include "lp_limits.h"
+#include "lp_setup.h"
 #include "lp_surface.h"
 #include "lp_texture.h"
 
@@ -79,6 +80,11 @@ lp_resource_copy(struct pipe_context *pipe,
                            FALSE, /* do_not_block */
                            "blit src");
 
+   lp_setup_hiz_invalidate(llvmpipe_context(pipe)->setup, dst);
+
+   llvmpipe_resolve_tile_clears(dst);
+   llvmpipe_resolve_tile_clears(src);
+
    /* Fallback for buffers. */
    if (dst->target == PIPE_BUFFER && src->target == PIPE_BUFFER) {
       util_resource_copy_region(pipe, dst, dst_level, dstx, dsty, dstz,
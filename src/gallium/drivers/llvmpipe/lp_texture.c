@@ -41,9 +41,11 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_simple_list.h"
+#include "util/u_surface.h"
 #include "util/u_transfer.h"
 
 #include "lp_context.h"
+#include "lp_debug.h"
 #include "lp_flush.h"
 #include "lp_screen.h"
 #include "lp_tile_image.h"
@@ -59,6 +61,13 @@ static struct llvmpipe_resource resource_list;
 #endif
 static unsigned id_counter = 0;
 
+/**
+ * Protects the deferred tile clears of all resources, and their
+ * tile_clears_pending flags, which the rasterizer threads write while
+ * other threads may resolve them.
+ */
+pipe_static_mutex(tile_clears_mutex);
+
 
 /**
  * Allocate storage for llvmpipe_texture::layout array.
@@ -257,6 +266,26 @@ llvmpipe_displaytarget_layout(struct llvmpipe_screen *screen,
 }
 
 
+/**
+ * Allocate the deferred clear arrays of a render target.  This is not
+ * fatal if it fails, clears are just applied right away for the levels
+ * without an array then.
+ */
+static void
+alloc_tile_clears(struct llvmpipe_resource *lpr)
+{
+   uint level;
+
+   for (level = 0; level <= lpr->base.last_level; level++) {
+      lpr->tile_clears[level] =
+         CALLOC(lpr->num_slices_faces[level] * lpr->tiles_per_image[level],
+                sizeof(struct llvmpipe_tile_clear));
+      if (!lpr->tile_clears[level])
+         break;
+   }
+}
+
+
 static struct pipe_resource *
 llvmpipe_resource_create(struct pipe_screen *_screen,
                          const struct pipe_resource *templat)
@@ -288,6 +317,15 @@ llvmpipe_resource_create(struct pipe_screen *_screen,
          assert(lpr->layout[0][0] == LP_TEX_LAYOUT_NONE);
       }
       assert(lpr->layout[0]);
+
+      /* Shared surfaces may be read behind our back, so only defer clears
+       * for our own render targets.
+       */
+      if ((lpr->base.bind & (PIPE_BIND_RENDER_TARGET |
+                             PIPE_BIND_DEPTH_STENCIL)) &&
+          !(lpr->base.bind & PIPE_BIND_SHARED) &&
+          !(LP_PERF & PERF_NO_LAZY_CLEAR))
+         alloc_tile_clears(lpr);
    }
    else {
       /* other data (vertex buffer, const buffer, etc) */
@@ -328,6 +366,7 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
 {
    struct llvmpipe_screen *screen = llvmpipe_screen(pscreen);
    struct llvmpipe_resource *lpr = llvmpipe_resource(pt);
+   uint level;
 
    if (lpr->dt) {
       /* display target */
@@ -343,8 +382,6 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
    }
    else if (llvmpipe_resource_is_texture(pt)) {
       /* regular texture */
-      uint level;
-
       /* free linear image data */
       if (lpr->linear_img.data) {
          align_free(lpr->linear_img.data);
@@ -368,6 +405,10 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
       align_free(lpr->data);
    }
 
+   for (level = 0; level < Elements(lpr->tile_clears); level++) {
+      FREE(lpr->tile_clears[level]);
+   }
+
 #ifdef DEBUG
    if (lpr->next)
       remove_from_list(lpr);
@@ -443,6 +484,196 @@ llvmpipe_resource_map(struct pipe_resource *resource,
 }
 
 
+/**
+ * Apply a clear to a whole tile.
+ * \param dst  start of the tile in the linear image
+ */
+void
+llvmpipe_fill_tile(uint8_t *dst, unsigned stride,
+                   enum pipe_format format,
+                   const struct llvmpipe_tile_clear *clear)
+{
+   const unsigned height = TILE_SIZE;
+   const unsigned width = TILE_SIZE;
+   const uint32_t clear_mask = clear->mask;
+   const uint32_t clear_value = clear->value.ui & clear_mask;
+   unsigned i, j;
+
+   if (!util_format_is_depth_or_stencil(format)) {
+      union util_color uc = clear->value;
+      util_fill_rect(dst, format, stride, 0, 0, width, height, &uc);
+      return;
+   }
+
+   switch (util_format_get_blocksize(format)) {
+   case 1:
+      assert(clear_mask == 0xff);
+      memset(dst, (uint8_t) clear_value, height * width);
+      break;
+   case 2:
+      if (clear_mask == 0xffff) {
+         for (i = 0; i < height; i++) {
+            uint16_t *row = (uint16_t *)dst;
+            for (j = 0; j < width; j++)
+               *row++ = (uint16_t) clear_value;
+            dst += stride;
+         }
+      }
+      else {
+         for (i = 0; i < height; i++) {
+            uint16_t *row = (uint16_t *)dst;
+            for (j = 0; j < width; j++) {
+               uint16_t tmp = ~clear_mask & *row;
+               *row++ = clear_value | tmp;
+            }
+            dst += stride;
+         }
+      }
+      break;
+   case 4:
+      if (clear_mask == 0xffffffff) {
+         for (i = 0; i < height; i++) {
+            uint32_t *row = (uint32_t *)dst;
+            for (j = 0; j < width; j++)
+               *row++ = clear_value;
+            dst += stride;
+         }
+      }
+      else {
+         for (i = 0; i < height; i++) {
+            uint32_t *row = (uint32_t *)dst;
+            for (j = 0; j < width; j++) {
+               uint32_t tmp = ~clear_mask & *row;
+               *row++ = clear_value | tmp;
+            }
+            dst += stride;
+         }
+      }
+      break;
+   default:
+      assert(0);
+      break;
+   }
+}
+
+
+/**
+ * Get the clear deferred for a tile of a render target.
+ * \param x, y  tile position, in tiles
+ * \return FALSE if the resource doesn't defer clears
+ */
+boolean
+llvmpipe_load_tile_clear(struct llvmpipe_resource *lpr,
+                         unsigned face_slice, unsigned level,
+                         unsigned x, unsigned y,
+                         struct llvmpipe_tile_clear *clear)
+{
+   const struct llvmpipe_tile_clear *entry =
+      llvmpipe_get_tile_clear(lpr, face_slice, level, x, y);
+
+   if (!entry)
+      return FALSE;
+
+   pipe_mutex_lock(tile_clears_mutex);
+   *clear = *entry;
+   pipe_mutex_unlock(tile_clears_mutex);
+
+   return TRUE;
+}
+
+
+/**
+ * Defer a clear of a tile of a render target, replacing the one deferred
+ * before.  A zero mask leaves no clear pending.
+ * \param x, y  tile position, in tiles
+ * \return FALSE if the resource doesn't defer clears
+ */
+boolean
+llvmpipe_store_tile_clear(struct llvmpipe_resource *lpr,
+                          unsigned face_slice, unsigned level,
+                          unsigned x, unsigned y,
+                          const struct llvmpipe_tile_clear *clear)
+{
+   struct llvmpipe_tile_clear *entry =
+      llvmpipe_get_tile_clear(lpr, face_slice, level, x, y);
+
+   if (!entry)
+      return FALSE;
+
+   pipe_mutex_lock(tile_clears_mutex);
+   *entry = *clear;
+   if (clear->mask)
+      lpr->tile_clears_pending = TRUE;
+   pipe_mutex_unlock(tile_clears_mutex);
+
+   return TRUE;
+}
+
+
+/**
+ * Apply all the deferred clears of a resource.  This must be done before
+ * the resource is accessed other than as a render target, i.e. mapped,
+ * copied, sampled from or displayed, and after waiting for the scenes
+ * rendering to it, see llvmpipe_flush_resource().
+ */
+void
+llvmpipe_resolve_tile_clears(struct pipe_resource *resource)
+{
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   const unsigned block_size = util_format_get_blocksize(resource->format);
+   unsigned level;
+
+   /* The arrays are only ever set up at creation time */
+   if (!lpr->tile_clears[0])
+      return;
+
+   pipe_mutex_lock(tile_clears_mutex);
+
+   if (lpr->tile_clears_pending) {
+      for (level = 0;
+           level <= resource->last_level && lpr->tile_clears[level];
+           level++) {
+         const unsigned stride = lpr->row_stride[level];
+         const unsigned width_t = lpr->tiles_per_row[level];
+         const unsigned height_t = lpr->tiles_per_image[level] / width_t;
+         unsigned slice, x, y;
+
+         for (slice = 0; slice < lpr->num_slices_faces[level]; slice++) {
+            uint8_t *map = NULL;
+
+            for (y = 0; y < height_t; y++) {
+               for (x = 0; x < width_t; x++) {
+                  struct llvmpipe_tile_clear *clear =
+                     llvmpipe_get_tile_clear(lpr, slice, level, x, y);
+
+                  if (!clear->mask)
+                     continue;
+
+                  if (!map)
+                     map = llvmpipe_resource_map(resource, level, slice,
+                                                 LP_TEX_USAGE_READ_WRITE,
+                                                 LP_TEX_LAYOUT_LINEAR);
+                  if (map)
+                     llvmpipe_fill_tile(map + y * TILE_SIZE * stride
+                                            + x * TILE_SIZE * block_size,
+                                        stride, resource->format, clear);
+
+                  clear->mask = 0;
+               }
+            }
+
+            if (map)
+               llvmpipe_resource_unmap(resource, level, slice);
+         }
+      }
+
+      lpr->tile_clears_pending = FALSE;
+   }
+
+   pipe_mutex_unlock(tile_clears_mutex);
+}
+
+
 /**
  * Unmap a resource.
  */
@@ -666,6 +897,22 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
          return NULL;
       }
    }
+   else if (lpr->tile_clears[0]) {
+      /* Even so, the deferred clears can't be resolved below while a
+       * scene may still be rendering to the resource.
+       */
+      llvmpipe_flush_resource(pipe, resource,
+                              level,
+                              TRUE, /* read_only */
+                              TRUE, /* cpu_access */
+                              FALSE, /* do_not_block */
+                              __FUNCTION__);
+   }
+
+   if (usage & PIPE_TRANSFER_WRITE)
+      lp_setup_hiz_invalidate(llvmpipe->setup, resource);
+
+   llvmpipe_resolve_tile_clears(resource);
 
    /* Check if we're mapping the current constant buffer */
    if ((usage & PIPE_TRANSFER_WRITE) &&
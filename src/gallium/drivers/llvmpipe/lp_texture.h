@@ -31,6 +31,7 @@
 
 #include "pipe/p_state.h"
 #include "util/u_debug.h"
+#include "util/u_pack_color.h"
 #include "lp_limits.h"
 
 
@@ -67,6 +68,18 @@ struct sw_displaytarget;
  */
 
 
+/**
+ * A clear of one image tile which hasn't been applied to memory yet.
+ * The value is packed in the resource's format, and only the bits set
+ * in mask get replaced.  A zero mask means no clear is pending.
+ */
+struct llvmpipe_tile_clear
+{
+   union util_color value;
+   uint32_t mask;
+};
+
+
 /** A 1D/2D/3D image, one mipmap level */
 struct llvmpipe_texture_image
 {
@@ -118,6 +131,17 @@ struct llvmpipe_resource
    /** array [level][face or slice][tile_y][tile_x] of layout values) */
    enum lp_texture_layout *layout[LP_MAX_TEXTURE_LEVELS];
 
+   /**
+    * array [level][face or slice][tile_y][tile_x] of deferred clears, for
+    * render targets.  Written by the rasterizer at the end of each tile,
+    * applied by llvmpipe_resolve_tile_clears() before any other access.
+    * NULL when clears are always applied right away.  The entries are
+    * only accessed through the functions below, which serialize them.
+    */
+   struct llvmpipe_tile_clear *tile_clears[LP_MAX_TEXTURE_LEVELS];
+   /** Whether any tile_clears entry may be pending */
+   boolean tile_clears_pending;
+
    boolean userBuffer;  /** Is this a user-space buffer? */
    unsigned timestamp;
 
@@ -246,6 +270,47 @@ llvmpipe_get_texture_tile(struct llvmpipe_resource *lpr,
                            unsigned x, unsigned y);
 
 
+/**
+ * Get the deferred clear of a tile, or NULL if the resource doesn't
+ * defer clears.
+ * \param x, y  tile position, in tiles
+ */
+static INLINE struct llvmpipe_tile_clear *
+llvmpipe_get_tile_clear(struct llvmpipe_resource *lpr,
+                        unsigned face_slice, unsigned level,
+                        unsigned x, unsigned y)
+{
+   if (!lpr->tile_clears[level])
+      return NULL;
+
+   assert(x < lpr->tiles_per_row[level]);
+   assert(face_slice < lpr->num_slices_faces[level]);
+   return &lpr->tile_clears[level][face_slice * lpr->tiles_per_image[level]
+                                   + y * lpr->tiles_per_row[level] + x];
+}
+
+
+void
+llvmpipe_fill_tile(uint8_t *dst, unsigned stride,
+                   enum pipe_format format,
+                   const struct llvmpipe_tile_clear *clear);
+
+boolean
+llvmpipe_load_tile_clear(struct llvmpipe_resource *lpr,
+                         unsigned face_slice, unsigned level,
+                         unsigned x, unsigned y,
+                         struct llvmpipe_tile_clear *clear);
+
+boolean
+llvmpipe_store_tile_clear(struct llvmpipe_resource *lpr,
+                          unsigned face_slice, unsigned level,
+                          unsigned x, unsigned y,
+                          const struct llvmpipe_tile_clear *clear);
+
+void
+llvmpipe_resolve_tile_clears(struct pipe_resource *resource);
+
+
 extern void
 llvmpipe_print_resources(void);
 
@@ -37,6 +37,7 @@
 #include "pipe/p_state.h"
 #include "pipe/p_defines.h"
 #include "util/u_memory.h"
+#include "tgsi/tgsi_decode.h"
 #include "tgsi/tgsi_exec.h"
 #include "tgsi/tgsi_parse.h"
 
@@ -47,7 +48,8 @@
 struct sp_exec_fragment_shader
 {
    struct sp_fragment_shader_variant base;
-   /* No other members for now */
+   /** The tokens decoded on first use, shared by every bind */
+   struct tgsi_decoded_shader *decoded;
 };
 
 
@@ -64,12 +66,17 @@ exec_prepare( const struct sp_fragment_shader_variant *var,
               struct tgsi_exec_machine *machine,
               struct tgsi_sampler *sampler )
 {
+   struct sp_exec_fragment_shader *spefs = sp_exec_fragment_shader(var);
+
+   if (!spefs->decoded)
+      spefs->decoded = tgsi_decode_shader(var->tokens);
+
    /*
     * Bind tokens/shader to the interpreter's machine state.
     */
-   tgsi_exec_machine_bind_shader(machine,
-                                 var->tokens,
-                                 sampler);
+   tgsi_exec_machine_bind_decoded_shader(machine,
+                                         spefs->decoded,
+                                         sampler);
 }
 
 
@@ -179,10 +186,14 @@ static void
 exec_delete(struct sp_fragment_shader_variant *var,
             struct tgsi_exec_machine *machine)
 {
+   struct sp_exec_fragment_shader *spefs = sp_exec_fragment_shader(var);
+
    if (machine->Tokens == var->tokens) {
       tgsi_exec_machine_bind_shader(machine, NULL, NULL);
    }
 
+   if (spefs->decoded)
+      tgsi_decoded_shader_destroy(spefs->decoded);
    FREE( (void *) var->tokens );
    FREE(var);
 }
@@ -1,8 +1,17 @@
+#include "pipe/p_compiler.h"
+#include "util/u_debug.h"
+#include "target-helpers/inline_sw_helper.h"
+#include "target-helpers/inline_debug_helper.h"
+#include "sw/null/null_sw_winsys.h"
 #include "state_tracker/graw.h"
 
 
-
-
+/**
+ * There is no window system here, but a software driver on the null
+ * winsys is still good for rendering offscreen, e.g. for benchmarking.
+ * The driver is chosen with GALLIUM_DRIVER as usual, and *handle is
+ * left NULL, as there is nothing to display to.
+ */
 struct pipe_screen *
 graw_create_window_and_screen( int x,
                                int y,
@@ -11,7 +20,22 @@ graw_create_window_and_screen( int x,
                                enum pipe_format format,
                                void **handle)
 {
-   return NULL;
+   struct sw_winsys *winsys;
+   struct pipe_screen *screen;
+
+   *handle = NULL;
+
+   winsys = null_sw_create();
+   if (winsys == NULL)
+      return NULL;
+
+   screen = sw_screen_create( winsys );
+   if (screen == NULL) {
+      winsys->destroy( winsys );
+      return NULL;
+   }
+
+   return debug_screen_wrap( screen );
 }
 
 
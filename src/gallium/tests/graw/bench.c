@@ -0,0 +1,670 @@
+/* Offscreen performance benchmark for the software rasterizers.
+ *
+ * Runs a few synthetic workloads and writes the timings as JSON, so that
+ * results can be compared between builds and releases:
+ *
+ *   fill     depth tested, interpolated color full screen quads (ns/pixel)
+ *   tris     grid of small flat triangles                       (tris/sec)
+ *   tex      bilinear textured full screen quads                (ns/pixel)
+ *   blend    alpha blended full screen quads                    (ns/pixel)
+ *   compile  new fragment shaders, up to their first draw       (ms/shader)
+ *
+ * Usage: bench [-j results.json] [-n frames] [-s WIDTHxHEIGHT] [test ...]
+ *
+ * The driver is selected with GALLIUM_DRIVER=llvmpipe|softpipe.  Linked
+ * against the graw-null target it needs no window system at all.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "graw_util.h"
+
+#include "os/os_time.h"
+#include "util/u_draw.h"
+#include "util/u_string.h"
+
+
+#define QUADS_PER_FRAME 8
+#define TRI_CELL_SIZE 8
+#define TEX_SIZE 256
+#define NUM_SHADERS 16
+
+
+struct vertex {
+   float position[4];
+   float attrib[4];
+};
+
+
+static int width = 1024;
+static int height = 768;
+static int frames = 20;
+static const char *json_filename = NULL;
+
+static struct graw_info info;
+
+static void *vs;
+static void *fs_color;
+static void *fs_tex;
+static void *blend_none;
+static void *blend_alpha;
+static void *dsa_none;
+static void *dsa_less;
+
+static struct pipe_resource *quad_vbuf;
+static struct pipe_resource *tri_vbuf;
+static unsigned num_tris;
+
+static FILE *json;
+static boolean first_result = TRUE;
+
+
+typedef void (*bench_func)(void);
+
+struct bench_test {
+   const char *name;
+   bench_func func;
+};
+
+
+/**
+ * Wait for the driver to finish all rendering so far.
+ */
+static void
+finish(void)
+{
+   struct pipe_fence_handle *fence = NULL;
+
+   info.ctx->flush(info.ctx, &fence, 0);
+   if (fence) {
+      info.screen->fence_finish(info.screen, fence, PIPE_TIMEOUT_INFINITE);
+      info.screen->fence_reference(info.screen, &fence, NULL);
+   }
+}
+
+
+static void
+begin_result(const char *name, double ms)
+{
+   fprintf(json, "%s\n    \"%s\": { \"ms\": %.3f", first_result ? "" : ",",
+           name, ms);
+   first_result = FALSE;
+}
+
+
+static void
+end_result(void)
+{
+   fprintf(json, " }");
+}
+
+
+static void
+set_vertex_buffer(struct pipe_resource *buf)
+{
+   struct pipe_vertex_buffer vbuf;
+
+   memset(&vbuf, 0, sizeof vbuf);
+   vbuf.stride = sizeof(struct vertex);
+   vbuf.buffer_offset = 0;
+   vbuf.buffer = buf;
+
+   info.ctx->set_vertex_buffers(info.ctx, 0, 1, &vbuf);
+}
+
+
+static void
+clear(void)
+{
+   union pipe_color_union clear_color = { {0.2, 0.2, 0.2, 1.0} };
+
+   info.ctx->clear(info.ctx, PIPE_CLEAR_COLOR | PIPE_CLEAR_DEPTHSTENCIL,
+                   &clear_color, 1.0, 0);
+}
+
+
+/**
+ * Draw QUADS_PER_FRAME full screen quads per frame, back to front so that
+ * every one of them passes the depth test, and time it.
+ * \return  nanoseconds per pixel
+ */
+static double
+run_quads(double *ms)
+{
+   int64_t start, end;
+   int i, j;
+
+   set_vertex_buffer(quad_vbuf);
+
+   /* warm up, this compiles the shader variants */
+   clear();
+   util_draw_arrays(info.ctx, PIPE_PRIM_QUADS, 0, 4 * QUADS_PER_FRAME);
+   finish();
+
+   start = os_time_get_nano();
+   for (i = 0; i < frames; i++) {
+      clear();
+      for (j = 0; j < QUADS_PER_FRAME; j++)
+         util_draw_arrays(info.ctx, PIPE_PRIM_QUADS, 4 * j, 4);
+      info.ctx->flush(info.ctx, NULL, 0);
+   }
+   finish();
+   end = os_time_get_nano();
+
+   *ms = (end - start) / 1.0e6;
+   return (double) (end - start) /
+          ((double) width * height * QUADS_PER_FRAME * frames);
+}
+
+
+static void
+bench_fill(void)
+{
+   double ms, ns;
+
+   info.ctx->bind_fs_state(info.ctx, fs_color);
+   info.ctx->bind_blend_state(info.ctx, blend_none);
+   info.ctx->bind_depth_stencil_alpha_state(info.ctx, dsa_less);
+
+   ns = run_quads(&ms);
+
+   begin_result("fill", ms);
+   fprintf(json, ", \"ns_per_pixel\": %.4f", ns);
+   end_result();
+}
+
+
+static void
+bench_tex(void)
+{
+   double ms, ns;
+
+   info.ctx->bind_fs_state(info.ctx, fs_tex);
+   info.ctx->bind_blend_state(info.ctx, blend_none);
+   info.ctx->bind_depth_stencil_alpha_state(info.ctx, dsa_less);
+
+   ns = run_quads(&ms);
+
+   begin_result("tex", ms);
+   fprintf(json, ", \"ns_per_pixel\": %.4f", ns);
+   end_result();
+}
+
+
+static void
+bench_blend(void)
+{
+   double ms, ns;
+
+   info.ctx->bind_fs_state(info.ctx, fs_color);
+   info.ctx->bind_blend_state(info.ctx, blend_alpha);
+   info.ctx->bind_depth_stencil_alpha_state(info.ctx, dsa_none);
+
+   ns = run_quads(&ms);
+
+   begin_result("blend", ms);
+   fprintf(json, ", \"ns_per_pixel\": %.4f", ns);
+   end_result();
+}
+
+
+static void
+bench_tris(void)
+{
+   int64_t start, end;
+   double ms;
+   int i;
+
+   info.ctx->bind_fs_state(info.ctx, fs_color);
+   info.ctx->bind_blend_state(info.ctx, blend_none);
+   info.ctx->bind_depth_stencil_alpha_state(info.ctx, dsa_none);
+   set_vertex_buffer(tri_vbuf);
+
+   clear();
+   util_draw_arrays(info.ctx, PIPE_PRIM_TRIANGLES, 0, 3 * num_tris);
+   finish();
+
+   start = os_time_get_nano();
+   for (i = 0; i < frames; i++) {
+      clear();
+      util_draw_arrays(info.ctx, PIPE_PRIM_TRIANGLES, 0, 3 * num_tris);
+      info.ctx->flush(info.ctx, NULL, 0);
+   }
+   finish();
+   end = os_time_get_nano();
+
+   ms = (end - start) / 1.0e6;
+
+   begin_result("tris", ms);
+   fprintf(json, ", \"tris\": %u, \"tris_per_sec\": %.0f",
+           num_tris * frames, num_tris * frames / (ms / 1000.0));
+   end_result();
+}
+
+
+/**
+ * Time creating a new fragment shader and drawing with it, which is when
+ * the drivers compile it.  Every shader has different immediates, and a
+ * per-run nonce keeps any shader cache from hiding the compile cost.
+ */
+static void
+bench_compile(void)
+{
+   const float nonce = (float) (os_time_get_nano() % 1000000) / 1000000.0f;
+   int64_t start, end;
+   double ms;
+   int i;
+
+   info.ctx->bind_blend_state(info.ctx, blend_none);
+   info.ctx->bind_depth_stencil_alpha_state(info.ctx, dsa_none);
+   set_vertex_buffer(quad_vbuf);
+
+   start = os_time_get_nano();
+   for (i = 0; i < NUM_SHADERS; i++) {
+      char text[1024];
+      void *fs;
+
+      util_snprintf(text, sizeof text,
+                    "FRAG\n"
+                    "DCL IN[0], GENERIC[0], PERSPECTIVE\n"
+                    "DCL OUT[0], COLOR\n"
+                    "DCL TEMP[0..1]\n"
+                    "IMM FLT32 { %f, %f, 0.5, 1.0 }\n"
+                    "  0: MUL TEMP[0], IN[0], IMM[0]\n"
+                    "  1: MAD TEMP[1], TEMP[0], TEMP[0], IMM[0].wzyx\n"
+                    "  2: RSQ TEMP[1].x, TEMP[1].xxxx\n"
+                    "  3: LRP TEMP[0], TEMP[1].xxxx, TEMP[0], IMM[0]\n"
+                    "  4: MOV OUT[0], TEMP[0]\n"
+                    "  5: END\n",
+                    nonce, (float) i);
+
+      fs = graw_parse_fragment_shader(info.ctx, text);
+      if (!fs) {
+         fprintf(stderr, "bench: failed to create fragment shader\n");
+         exit(1);
+      }
+
+      info.ctx->bind_fs_state(info.ctx, fs);
+      util_draw_arrays(info.ctx, PIPE_PRIM_QUADS, 0, 4);
+      finish();
+
+      info.ctx->bind_fs_state(info.ctx, fs_color);
+      info.ctx->delete_fs_state(info.ctx, fs);
+   }
+   end = os_time_get_nano();
+
+   ms = (end - start) / 1.0e6;
+
+   begin_result("compile", ms);
+   fprintf(json, ", \"shaders\": %d, \"compile_ms\": %.3f",
+           NUM_SHADERS, ms / NUM_SHADERS);
+   end_result();
+}
+
+
+static const struct bench_test tests[] = {
+   { "fill", bench_fill },
+   { "tris", bench_tris },
+   { "tex", bench_tex },
+   { "blend", bench_blend },
+   { "compile", bench_compile },
+};
+
+
+static void
+init_framebuffer(void)
+{
+   struct pipe_resource templat;
+   struct pipe_surface surf_tmpl;
+   struct pipe_framebuffer_state fb;
+
+   memset(&templat, 0, sizeof templat);
+   templat.target = PIPE_TEXTURE_2D;
+   templat.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+   templat.width0 = width;
+   templat.height0 = height;
+   templat.depth0 = 1;
+   templat.array_size = 1;
+   templat.last_level = 0;
+   templat.nr_samples = 1;
+   templat.bind = PIPE_BIND_RENDER_TARGET | PIPE_BIND_SAMPLER_VIEW;
+   info.color_buf[0] = info.screen->resource_create(info.screen, &templat);
+
+   templat.format = PIPE_FORMAT_S8_UINT_Z24_UNORM;
+   templat.bind = PIPE_BIND_DEPTH_STENCIL;
+   info.zs_buf = info.screen->resource_create(info.screen, &templat);
+
+   if (!info.color_buf[0] || !info.zs_buf) {
+      fprintf(stderr, "bench: failed to create render targets\n");
+      exit(1);
+   }
+
+   memset(&surf_tmpl, 0, sizeof surf_tmpl);
+   surf_tmpl.format = info.color_buf[0]->format;
+   info.color_surf[0] = info.ctx->create_surface(info.ctx, info.color_buf[0],
+                                                 &surf_tmpl);
+   surf_tmpl.format = info.zs_buf->format;
+   info.zs_surf = info.ctx->create_surface(info.ctx, info.zs_buf,
+                                           &surf_tmpl);
+
+   memset(&fb, 0, sizeof fb);
+   fb.nr_cbufs = 1;
+   fb.width = width;
+   fb.height = height;
+   fb.cbufs[0] = info.color_surf[0];
+   fb.zsbuf = info.zs_surf;
+   info.ctx->set_framebuffer_state(info.ctx, &fb);
+}
+
+
+static void
+init_state(void)
+{
+   struct pipe_blend_state blend;
+   struct pipe_depth_stencil_alpha_state dsa;
+
+   graw_util_default_state(&info, FALSE);
+   graw_util_viewport(&info, 0, 0, width, height, 0.0, 1.0);
+
+   memset(&blend, 0, sizeof blend);
+   blend.rt[0].colormask = PIPE_MASK_RGBA;
+   blend_none = info.ctx->create_blend_state(info.ctx, &blend);
+
+   blend.rt[0].blend_enable = 1;
+   blend.rt[0].rgb_func = PIPE_BLEND_ADD;
+   blend.rt[0].rgb_src_factor = PIPE_BLENDFACTOR_SRC_ALPHA;
+   blend.rt[0].rgb_dst_factor = PIPE_BLENDFACTOR_INV_SRC_ALPHA;
+   blend.rt[0].alpha_func = PIPE_BLEND_ADD;
+   blend.rt[0].alpha_src_factor = PIPE_BLENDFACTOR_ONE;
+   blend.rt[0].alpha_dst_factor = PIPE_BLENDFACTOR_INV_SRC_ALPHA;
+   blend_alpha = info.ctx->create_blend_state(info.ctx, &blend);
+
+   memset(&dsa, 0, sizeof dsa);
+   dsa_none = info.ctx->create_depth_stencil_alpha_state(info.ctx, &dsa);
+
+   dsa.depth.enabled = 1;
+   dsa.depth.writemask = 1;
+   dsa.depth.func = PIPE_FUNC_LESS;
+   dsa_less = info.ctx->create_depth_stencil_alpha_state(info.ctx, &dsa);
+}
+
+
+static void
+init_shaders(void)
+{
+   struct pipe_vertex_element ve[2];
+   void *handle;
+
+   memset(ve, 0, sizeof ve);
+   ve[0].src_offset = Offset(struct vertex, position);
+   ve[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   ve[1].src_offset = Offset(struct vertex, attrib);
+   ve[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   handle = info.ctx->create_vertex_elements_state(info.ctx, 2, ve);
+   info.ctx->bind_vertex_elements_state(info.ctx, handle);
+
+   vs = graw_parse_vertex_shader(info.ctx,
+      "VERT\n"
+      "DCL IN[0]\n"
+      "DCL IN[1]\n"
+      "DCL OUT[0], POSITION\n"
+      "DCL OUT[1], GENERIC[0]\n"
+      "  0: MOV OUT[0], IN[0]\n"
+      "  1: MOV OUT[1], IN[1]\n"
+      "  2: END\n");
+
+   fs_color = graw_parse_fragment_shader(info.ctx,
+      "FRAG\n"
+      "DCL IN[0], GENERIC[0], PERSPECTIVE\n"
+      "DCL OUT[0], COLOR\n"
+      "  0: MOV OUT[0], IN[0]\n"
+      "  1: END\n");
+
+   fs_tex = graw_parse_fragment_shader(info.ctx,
+      "FRAG\n"
+      "DCL IN[0], GENERIC[0], PERSPECTIVE\n"
+      "DCL OUT[0], COLOR\n"
+      "DCL TEMP[0]\n"
+      "DCL SAMP[0]\n"
+      "  0: TEX TEMP[0], IN[0], SAMP[0], 2D\n"
+      "  1: MOV OUT[0], TEMP[0]\n"
+      "  2: END\n");
+
+   if (!vs || !fs_color || !fs_tex) {
+      fprintf(stderr, "bench: failed to create shaders\n");
+      exit(1);
+   }
+
+   info.ctx->bind_vs_state(info.ctx, vs);
+}
+
+
+static void
+init_texture(void)
+{
+   static uint8_t texels[TEX_SIZE][TEX_SIZE][4];
+   struct pipe_resource *texture;
+   struct pipe_sampler_view *sv;
+   void *sampler;
+   int s, t;
+
+   for (t = 0; t < TEX_SIZE; t++) {
+      for (s = 0; s < TEX_SIZE; s++) {
+         texels[t][s][0] = s;
+         texels[t][s][1] = t;
+         texels[t][s][2] = ((s ^ t) & 8) ? 255 : 0;
+         texels[t][s][3] = 255;
+      }
+   }
+
+   texture = graw_util_create_tex2d(&info, TEX_SIZE, TEX_SIZE,
+                                    PIPE_FORMAT_B8G8R8A8_UNORM, texels);
+   if (!texture)
+      exit(1);
+
+   sv = graw_util_create_simple_sampler_view(&info, texture);
+   info.ctx->set_fragment_sampler_views(info.ctx, 1, &sv);
+
+   sampler = graw_util_create_simple_sampler(&info,
+                                             PIPE_TEX_WRAP_REPEAT,
+                                             PIPE_TEX_FILTER_LINEAR);
+   info.ctx->bind_fragment_sampler_states(info.ctx, 1, &sampler);
+}
+
+
+static void
+init_vertices(void)
+{
+   struct vertex quads[4 * QUADS_PER_FRAME];
+   struct vertex *tris;
+   const int cols = width / TRI_CELL_SIZE;
+   const int rows = height / TRI_CELL_SIZE;
+   int i, x, y;
+
+   /* Full screen quads, each one nearer than the previous.  The attribute
+    * is the color, or the texture coordinates (tiling the texture a few
+    * times), and has alpha 0.5 for blending.
+    */
+   for (i = 0; i < QUADS_PER_FRAME; i++) {
+      static const float corners[4][2] = {
+         { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 }
+      };
+      const float z = 0.9f - 0.8f * i / QUADS_PER_FRAME;
+      int k;
+
+      for (k = 0; k < 4; k++) {
+         struct vertex *v = &quads[4 * i + k];
+         v->position[0] = corners[k][0];
+         v->position[1] = corners[k][1];
+         v->position[2] = z;
+         v->position[3] = 1.0f;
+         v->attrib[0] = (corners[k][0] + 1.0f) * 2.0f;
+         v->attrib[1] = (corners[k][1] + 1.0f) * 2.0f;
+         v->attrib[2] = (float) i / QUADS_PER_FRAME;
+         v->attrib[3] = 0.5f;
+      }
+   }
+
+   quad_vbuf = pipe_buffer_create_with_data(info.ctx,
+                                            PIPE_BIND_VERTEX_BUFFER,
+                                            PIPE_USAGE_STATIC,
+                                            sizeof quads, quads);
+
+   /* Two triangles per TRI_CELL_SIZE square cell of the window */
+   num_tris = 2 * cols * rows;
+   tris = MALLOC(3 * num_tris * sizeof *tris);
+   if (!tris)
+      exit(1);
+
+   i = 0;
+   for (y = 0; y < rows; y++) {
+      for (x = 0; x < cols; x++) {
+         static const int offsets[6][2] = {
+            { 0, 0 }, { 1, 0 }, { 1, 1 },
+            { 0, 0 }, { 1, 1 }, { 0, 1 }
+         };
+         int k;
+
+         for (k = 0; k < 6; k++) {
+            struct vertex *v = &tris[i++];
+            v->position[0] = 2.0f * (x + offsets[k][0]) / cols - 1.0f;
+            v->position[1] = 2.0f * (y + offsets[k][1]) / rows - 1.0f;
+            v->position[2] = 0.5f;
+            v->position[3] = 1.0f;
+            v->attrib[0] = (float) x / cols;
+            v->attrib[1] = (float) y / rows;
+            v->attrib[2] = (float) (k / 3);
+            v->attrib[3] = 1.0f;
+         }
+      }
+   }
+
+   tri_vbuf = pipe_buffer_create_with_data(info.ctx,
+                                           PIPE_BIND_VERTEX_BUFFER,
+                                           PIPE_USAGE_STATIC,
+                                           3 * num_tris * sizeof *tris,
+                                           tris);
+   FREE(tris);
+
+   if (!quad_vbuf || !tri_vbuf)
+      exit(1);
+}
+
+
+static void
+init(void)
+{
+   info.screen = graw_create_window_and_screen(0, 0, width, height,
+                                               PIPE_FORMAT_B8G8R8A8_UNORM,
+                                               &info.window);
+   if (!info.screen) {
+      fprintf(stderr, "bench: failed to create screen\n");
+      exit(1);
+   }
+
+   info.ctx = info.screen->context_create(info.screen, NULL);
+   if (!info.ctx) {
+      fprintf(stderr, "bench: failed to create context\n");
+      exit(1);
+   }
+
+   init_framebuffer();
+   init_state();
+   init_shaders();
+   init_texture();
+   init_vertices();
+}
+
+
+static void
+usage(void)
+{
+   unsigned i;
+
+   fprintf(stderr,
+           "usage: bench [-j results.json] [-n frames] [-s WIDTHxHEIGHT]"
+           " [-o image.bmp] [test ...]\n"
+           "tests:");
+   for (i = 0; i < Elements(tests); i++)
+      fprintf(stderr, " %s", tests[i].name);
+   fprintf(stderr, "\n");
+   exit(1);
+}
+
+
+int main( int argc, char *argv[] )
+{
+   boolean selected[Elements(tests)];
+   boolean any_selected = FALSE;
+   unsigned i;
+   int arg;
+
+   memset(selected, 0, sizeof selected);
+
+   for (arg = 1; arg < argc;) {
+      if (graw_parse_args(&arg, argc, argv))
+         continue;
+
+      if (strcmp(argv[arg], "-j") == 0 && arg + 1 < argc) {
+         json_filename = argv[arg + 1];
+         arg += 2;
+      }
+      else if (strcmp(argv[arg], "-n") == 0 && arg + 1 < argc) {
+         frames = atoi(argv[arg + 1]);
+         if (frames <= 0)
+            usage();
+         arg += 2;
+      }
+      else if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc) {
+         if (sscanf(argv[arg + 1], "%dx%d", &width, &height) != 2 ||
+             width < TRI_CELL_SIZE || height < TRI_CELL_SIZE)
+            usage();
+         arg += 2;
+      }
+      else {
+         for (i = 0; i < Elements(tests); i++) {
+            if (strcmp(argv[arg], tests[i].name) == 0)
+               break;
+         }
+         if (i == Elements(tests))
+            usage();
+         selected[i] = TRUE;
+         any_selected = TRUE;
+         arg++;
+      }
+   }
+
+   init();
+
+   json = json_filename ? fopen(json_filename, "w") : stdout;
+   if (!json) {
+      fprintf(stderr, "bench: can't open %s\n", json_filename);
+      return 1;
+   }
+
+   fprintf(json,
+           "{\n"
+           "  \"driver\": \"%s\",\n"
+           "  \"width\": %d,\n"
+           "  \"height\": %d,\n"
+           "  \"frames\": %d,\n"
+           "  \"results\": {",
+           info.screen->get_name(info.screen), width, height, frames);
+
+   for (i = 0; i < Elements(tests); i++) {
+      if (!any_selected || selected[i]) {
+         tests[i].func();
+         fflush(json);
+      }
+   }
+
+   fprintf(json, "\n  }\n}\n");
+
+   if (json != stdout)
+      fclose(json);
+
+   graw_save_surface_to_file(info.ctx, info.color_surf[0], NULL);
+
+   return 0;
+}
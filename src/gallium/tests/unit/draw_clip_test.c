@@ -0,0 +1,472 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+/*
+ * Test for the triangle batching of the draw module's clip stage.
+ *
+ * The same random stream of triangles, lines, points, flushes, stipple
+ * resets and ends of pipeline runs is fed to the clip stage twice.  The
+ * first time consecutive clipped triangles are batched as usual.  The
+ * second time the batch is drained after every triangle, so that each
+ * one is clipped alone, by the scalar path.  Whatever reaches the next
+ * stage must be identical, bit for bit and in the same order.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_shader_tokens.h"
+#include "pipe/p_state.h"
+#include "tgsi/tgsi_ureg.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+
+#include "draw/draw_context.h"
+#include "draw/draw_pipe.h"
+#include "draw/draw_private.h"
+
+
+#define NUM_OPS 20000
+#define NUM_VERTS 256
+
+/** Outputs of the vertex shader */
+#define OUT_POS 0
+#define OUT_COLOR 1
+#define OUT_GENERIC 2
+#define OUT_CLIPDIST 3
+#define NUM_OUTPUTS 4
+
+#define VERTEX_SIZE (sizeof(struct vertex_header) + NUM_OUTPUTS * 4 * sizeof(float))
+
+
+enum clip_op {
+   OP_TRI,
+   OP_LINE,
+   OP_POINT,
+   OP_FLUSH,
+   OP_RESET_STIPPLE,
+   OP_END_RUN
+};
+
+
+/**
+ * A vertex as it reached the next stage.  The fields are copied one by
+ * one, as the padding of the clipper's temporary vertices is undefined.
+ */
+struct captured_vertex {
+   unsigned clipmask;
+   unsigned edgeflag;
+   unsigned have_clipdist;
+   unsigned vertex_id;
+   float clip[4];
+   float pre_clip_pos[4];
+   float data[NUM_OUTPUTS][4];
+};
+
+struct captured_prim {
+   enum clip_op op;
+   unsigned flags;
+   float det;
+   unsigned nr;
+   struct captured_vertex v[3];
+};
+
+
+/**
+ * Last stage of the pipeline, recording everything it receives.
+ */
+struct capture_stage {
+   struct draw_stage stage;
+
+   struct captured_prim *prims;
+   unsigned num_prims;
+   unsigned max_prims;
+};
+
+
+static struct captured_prim *
+capture_prim(struct draw_stage *stage, enum clip_op op,
+             const struct prim_header *header, unsigned nr)
+{
+   struct capture_stage *capture = (struct capture_stage *) stage;
+   struct captured_prim *prim;
+   unsigned i;
+
+   if (capture->num_prims == capture->max_prims) {
+      unsigned max_prims = MAX2(capture->max_prims * 2, 1024);
+
+      capture->prims = REALLOC(capture->prims,
+                               capture->max_prims * sizeof *prim,
+                               max_prims * sizeof *prim);
+      capture->max_prims = max_prims;
+   }
+
+   prim = &capture->prims[capture->num_prims++];
+   memset(prim, 0, sizeof *prim);
+   prim->op = op;
+   prim->nr = nr;
+
+   if (header) {
+      prim->flags = header->flags;
+      prim->det = header->det;
+   }
+
+   for (i = 0; i < nr; i++) {
+      const struct vertex_header *vert = header->v[i];
+      struct captured_vertex *v = &prim->v[i];
+
+      v->clipmask = vert->clipmask;
+      v->edgeflag = vert->edgeflag;
+      v->have_clipdist = vert->have_clipdist;
+      v->vertex_id = vert->vertex_id;
+      memcpy(v->clip, vert->clip, sizeof v->clip);
+      memcpy(v->pre_clip_pos, vert->pre_clip_pos, sizeof v->pre_clip_pos);
+      memcpy(v->data, vert->data, sizeof v->data);
+   }
+
+   return prim;
+}
+
+static void
+capture_point(struct draw_stage *stage, struct prim_header *header)
+{
+   capture_prim(stage, OP_POINT, header, 1);
+}
+
+static void
+capture_line(struct draw_stage *stage, struct prim_header *header)
+{
+   struct captured_prim *prim = capture_prim(stage, OP_LINE, header, 2);
+
+   /* not set by the clipper for clipped lines */
+   prim->flags = 0;
+   prim->det = 0.0f;
+}
+
+static void
+capture_tri(struct draw_stage *stage, struct prim_header *header)
+{
+   capture_prim(stage, OP_TRI, header, 3);
+}
+
+static void
+capture_flush(struct draw_stage *stage, unsigned flags)
+{
+   capture_prim(stage, OP_FLUSH, NULL, 0)->flags = flags;
+}
+
+static void
+capture_reset_stipple_counter(struct draw_stage *stage)
+{
+   capture_prim(stage, OP_RESET_STIPPLE, NULL, 0);
+}
+
+
+static int
+dummy_get_param(struct pipe_screen *screen, enum pipe_cap param)
+{
+   return 0;
+}
+
+
+/** Random float in [min, max] */
+static float
+rand_float(float min, float max)
+{
+   return min + (max - min) * (float) rand() / (float) RAND_MAX;
+}
+
+
+/**
+ * Create a vertex shader with the outputs above, so that the clipper
+ * knows the vertex layout.
+ */
+static void *
+create_vertex_shader(struct draw_context *draw)
+{
+   struct ureg_program *ureg = ureg_create(TGSI_PROCESSOR_VERTEX);
+   struct pipe_shader_state state;
+   void *vs;
+
+   ureg_MOV(ureg, ureg_DECL_output(ureg, TGSI_SEMANTIC_POSITION, 0),
+            ureg_DECL_vs_input(ureg, 0));
+   ureg_MOV(ureg, ureg_DECL_output(ureg, TGSI_SEMANTIC_COLOR, 0),
+            ureg_DECL_vs_input(ureg, 1));
+   ureg_MOV(ureg, ureg_DECL_output(ureg, TGSI_SEMANTIC_GENERIC, 0),
+            ureg_DECL_vs_input(ureg, 2));
+   ureg_MOV(ureg, ureg_DECL_output(ureg, TGSI_SEMANTIC_CLIPDIST, 0),
+            ureg_DECL_vs_input(ureg, 3));
+   ureg_END(ureg);
+
+   memset(&state, 0, sizeof state);
+   state.tokens = ureg_get_tokens(ureg, NULL);
+   vs = draw_create_vertex_shader(draw, &state);
+   ureg_free_tokens(state.tokens);
+   ureg_destroy(ureg);
+
+   return vs;
+}
+
+
+/**
+ * Fill the vertex buffer with random vertices, with roughly half of them
+ * inside the view volume.  The vertices in the second half have shader
+ * written clip distances, which replace the user clip plane.
+ */
+static void
+init_vertices(struct draw_context *draw, ubyte *verts)
+{
+   unsigned i, j, k;
+
+   for (i = 0; i < NUM_VERTS; i++) {
+      struct vertex_header *v = (struct vertex_header *)(verts + i * VERTEX_SIZE);
+      const float w = rand_float(0.5f, 2.5f);
+
+      memset(v, 0, VERTEX_SIZE);
+      for (j = 0; j < 3; j++)
+         v->clip[j] = rand_float(-1.3f, 1.3f) * w;
+      v->clip[3] = w;
+      memcpy(v->pre_clip_pos, v->clip, sizeof v->clip);
+
+      for (j = 0; j < NUM_OUTPUTS; j++) {
+         for (k = 0; k < 4; k++)
+            v->data[j][k] = rand_float(-1.0f, 1.0f);
+      }
+
+      v->edgeflag = rand() & 1;
+      v->have_clipdist = i >= NUM_VERTS / 2;
+      v->vertex_id = i;
+
+      for (j = 0; j < 7; j++) {
+         const float *plane = draw->plane[j];
+         float dist;
+
+         if (j == 6 && v->have_clipdist)
+            dist = v->data[OUT_CLIPDIST][0];
+         else
+            dist = (v->clip[0] * plane[0] + v->clip[1] * plane[1] +
+                    v->clip[2] * plane[2] + v->clip[3] * plane[3]);
+
+         if (dist < 0.0f)
+            v->clipmask |= 1 << j;
+      }
+   }
+}
+
+
+/**
+ * Feed the operations to the clip stage.  If unbatched, the batch is
+ * drained after every triangle.
+ */
+static void
+run_ops(struct draw_stage *clip, const unsigned char *ops,
+        const struct prim_header *prims, boolean unbatched)
+{
+   unsigned i;
+
+   for (i = 0; i < NUM_OPS; i++) {
+      struct prim_header header = prims[i];
+
+      switch (ops[i]) {
+      case OP_TRI:
+         clip->tri(clip, &header);
+         if (unbatched)
+            draw_clip_end_run(clip);
+         break;
+      case OP_LINE:
+         clip->line(clip, &header);
+         break;
+      case OP_POINT:
+         clip->point(clip, &header);
+         break;
+      case OP_FLUSH:
+         clip->flush(clip, 0);
+         break;
+      case OP_RESET_STIPPLE:
+         clip->reset_stipple_counter(clip);
+         break;
+      case OP_END_RUN:
+         draw_clip_end_run(clip);
+         /* nothing may be left referencing the run's vertices */
+         capture_prim(clip->next, OP_END_RUN, NULL, 0);
+         break;
+      }
+   }
+
+   draw_clip_end_run(clip);
+}
+
+
+int main(int argc, char **argv)
+{
+   struct pipe_screen screen;
+   struct pipe_context pipe;
+   struct pipe_rasterizer_state rast;
+   struct pipe_clip_state clip_state;
+   struct draw_context *draw;
+   struct capture_stage capture[2];
+   struct draw_stage *clip;
+   unsigned char *ops;
+   struct prim_header *prims;
+   ubyte *verts;
+   unsigned i, j, counts[OP_END_RUN + 1];
+   void *vs;
+   int result = 0;
+
+   memset(&screen, 0, sizeof screen);
+   screen.get_param = dummy_get_param;
+   memset(&pipe, 0, sizeof pipe);
+   pipe.screen = &screen;
+
+   draw = draw_create_no_llvm(&pipe);
+   if (!draw) {
+      printf("failed to create draw context\n");
+      return 1;
+   }
+
+   /* flat shaded colors, one user clip plane */
+   memset(&rast, 0, sizeof rast);
+   rast.flatshade = 1;
+   rast.clip_plane_enable = 1;
+   draw_set_rasterizer_state(draw, &rast, NULL);
+
+   memset(&clip_state, 0, sizeof clip_state);
+   clip_state.ucp[0][0] = 0.3f;
+   clip_state.ucp[0][1] = 0.2f;
+   clip_state.ucp[0][2] = 0.1f;
+   clip_state.ucp[0][3] = 0.5f;
+   draw_set_clip_state(draw, &clip_state);
+
+   vs = create_vertex_shader(draw);
+   if (!vs) {
+      printf("failed to create vertex shader\n");
+      return 1;
+   }
+   draw_bind_vertex_shader(draw, vs);
+
+   srand(42);
+
+   verts = MALLOC(NUM_VERTS * VERTEX_SIZE);
+   ops = MALLOC(NUM_OPS);
+   prims = MALLOC(NUM_OPS * sizeof *prims);
+   init_vertices(draw, verts);
+
+   /* Mostly triangles, so that long runs of clipped ones fill the batch */
+   memset(counts, 0, sizeof counts);
+   for (i = 0; i < NUM_OPS; i++) {
+      const unsigned r = rand() % 100;
+      const unsigned half = (rand() & 1) * NUM_VERTS / 2;
+
+      if (r < 90)
+         ops[i] = OP_TRI;
+      else if (r < 93)
+         ops[i] = OP_LINE;
+      else if (r < 95)
+         ops[i] = OP_POINT;
+      else if (r < 97)
+         ops[i] = OP_FLUSH;
+      else if (r < 98)
+         ops[i] = OP_RESET_STIPPLE;
+      else
+         ops[i] = OP_END_RUN;
+      counts[ops[i]]++;
+
+      prims[i].flags = 0;
+      if (ops[i] == OP_TRI)
+         prims[i].flags = rand() & (DRAW_PIPE_EDGE_FLAG_ALL |
+                                    DRAW_PIPE_RESET_STIPPLE);
+      prims[i].pad = 0;
+      prims[i].det = rand_float(-1.0f, 1.0f);
+
+      /* the vertices of a primitive all have clip distances, or none */
+      for (j = 0; j < 3; j++) {
+         const unsigned index = half + rand() % (NUM_VERTS / 2);
+         prims[i].v[j] = (struct vertex_header *)(verts + index * VERTEX_SIZE);
+      }
+   }
+
+   clip = draw_clip_stage(draw);
+   if (!clip) {
+      printf("failed to create clip stage\n");
+      return 1;
+   }
+
+   for (i = 0; i < 2; i++) {
+      memset(&capture[i], 0, sizeof capture[i]);
+      capture[i].stage.draw = draw;
+      capture[i].stage.name = "capture";
+      capture[i].stage.point = capture_point;
+      capture[i].stage.line = capture_line;
+      capture[i].stage.tri = capture_tri;
+      capture[i].stage.flush = capture_flush;
+      capture[i].stage.reset_stipple_counter = capture_reset_stipple_counter;
+
+      clip->next = &capture[i].stage;
+      run_ops(clip, ops, prims, i == 1);
+   }
+
+   printf("%u triangles, %u lines, %u points, %u flushes, "
+          "%u stipple resets, %u ends of run\n",
+          counts[OP_TRI], counts[OP_LINE], counts[OP_POINT],
+          counts[OP_FLUSH], counts[OP_RESET_STIPPLE], counts[OP_END_RUN]);
+   printf("%u primitives and events out of the clipper\n",
+          capture[1].num_prims);
+
+   if (capture[0].num_prims != capture[1].num_prims) {
+      printf("batched: %u primitives and events, unbatched: %u\n",
+             capture[0].num_prims, capture[1].num_prims);
+      result = 1;
+   }
+
+   for (i = 0; i < MIN2(capture[0].num_prims, capture[1].num_prims); i++) {
+      if (memcmp(&capture[0].prims[i], &capture[1].prims[i],
+                 sizeof capture[0].prims[i]) != 0) {
+         printf("primitive or event %u differs (op %u vs %u)\n",
+                i, capture[0].prims[i].op, capture[1].prims[i].op);
+         result = 1;
+         break;
+      }
+   }
+
+   clip->destroy(clip);
+   draw_delete_vertex_shader(draw, vs);
+   draw_destroy(draw);
+   FREE(capture[0].prims);
+   FREE(capture[1].prims);
+   FREE(prims);
+   FREE(ops);
+   FREE(verts);
+
+   printf("%s\n", result ? "FAIL" : "PASS");
+   return result;
+}
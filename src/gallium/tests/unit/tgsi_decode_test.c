@@ -0,0 +1,241 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+/*
+ * Test and benchmark for tgsi_decode, on a synthetic shader with as many
+ * instructions as llvmpipe accepts.  Checks that the decoded tokens and the
+ * scan results match what tgsi_parse gives, and compares the time taken
+ * to walk the shader both ways.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "os/os_time.h"
+#include "tgsi/tgsi_decode.h"
+#include "tgsi/tgsi_parse.h"
+#include "tgsi/tgsi_scan.h"
+#include "tgsi/tgsi_ureg.h"
+
+
+#define NUM_INSTRUCTIONS (128 * 1024) /* LP_MAX_SHADER_INSTRUCTIONS */
+#define NUM_PASSES 10
+
+
+static const struct tgsi_token *
+build_shader(unsigned *num_tokens)
+{
+   struct ureg_program *ureg = ureg_create(TGSI_PROCESSOR_VERTEX);
+   struct ureg_src in, c[4], imm;
+   struct ureg_dst out, tmp[4];
+   const struct tgsi_token *tokens;
+   unsigned i;
+
+   in = ureg_DECL_vs_input(ureg, 0);
+   out = ureg_DECL_output(ureg, TGSI_SEMANTIC_POSITION, 0);
+   imm = ureg_imm4f(ureg, 0.5f, 1.0f, 2.0f, -1.0f);
+   for (i = 0; i < 4; i++) {
+      c[i] = ureg_DECL_constant(ureg, i);
+      tmp[i] = ureg_DECL_temporary(ureg);
+   }
+
+   ureg_MOV(ureg, tmp[0], in);
+   for (i = 0; i < NUM_INSTRUCTIONS - 2; i++) {
+      struct ureg_dst dst = tmp[(i + 1) % 4];
+      struct ureg_src src = ureg_src(tmp[i % 4]);
+
+      switch (i % 4) {
+      case 0:
+         ureg_MAD(ureg, dst, src, c[i % 3], ureg_negate(imm));
+         break;
+      case 1:
+         ureg_DP4(ureg, ureg_writemask(dst, TGSI_WRITEMASK_X),
+                  ureg_swizzle(src, 3, 2, 1, 0), c[3]);
+         break;
+      case 2:
+         ureg_MUL(ureg, dst, ureg_abs(src), ureg_scalar(imm, 1));
+         break;
+      default:
+         ureg_ADD(ureg, ureg_saturate(dst), src, c[i % 4]);
+         break;
+      }
+   }
+   ureg_MOV(ureg, out, ureg_src(tmp[0]));
+   ureg_END(ureg);
+
+   tokens = ureg_get_tokens(ureg, num_tokens);
+   ureg_destroy(ureg);
+   return tokens;
+}
+
+
+/** Compare the decoded shader with what tgsi_parse gives */
+static boolean
+check_decoded(const struct tgsi_token *tokens,
+              const struct tgsi_decoded_shader *shader)
+{
+   struct tgsi_parse_context parse;
+   struct tgsi_decoded_iterator it;
+   struct tgsi_shader_info info1, info2;
+   unsigned n = 0;
+
+   tgsi_parse_init(&parse, tokens);
+   tgsi_decoded_iterator_init(&it, shader);
+
+   while (!tgsi_parse_end_of_tokens(&parse)) {
+      const void *a, *b;
+      size_t size;
+
+      tgsi_parse_token(&parse);
+
+      if (!tgsi_decoded_next(&it) || it.Type != parse.FullToken.Token.Type) {
+         printf("token %u: type mismatch\n", n);
+         return FALSE;
+      }
+
+      switch (it.Type) {
+      case TGSI_TOKEN_TYPE_DECLARATION:
+         a = &parse.FullToken.FullDeclaration;
+         b = it.FullDeclaration;
+         size = sizeof *it.FullDeclaration;
+         break;
+      case TGSI_TOKEN_TYPE_IMMEDIATE:
+         a = &parse.FullToken.FullImmediate;
+         b = it.FullImmediate;
+         size = sizeof *it.FullImmediate;
+         break;
+      case TGSI_TOKEN_TYPE_INSTRUCTION:
+         a = &parse.FullToken.FullInstruction;
+         b = it.FullInstruction;
+         size = sizeof *it.FullInstruction;
+         break;
+      default:
+         a = &parse.FullToken.FullProperty;
+         b = it.FullProperty;
+         size = sizeof *it.FullProperty;
+         break;
+      }
+
+      if (memcmp(a, b, size) != 0) {
+         printf("token %u: contents mismatch\n", n);
+         return FALSE;
+      }
+      n++;
+   }
+
+   if (tgsi_decoded_next(&it)) {
+      printf("extra decoded tokens\n");
+      return FALSE;
+   }
+
+   tgsi_scan_shader(tokens, &info1);
+   tgsi_scan_decoded_shader(shader, &info2);
+   if (memcmp(&info1, &info2, sizeof info1) != 0) {
+      printf("scan mismatch\n");
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+int main(int argc, char **argv)
+{
+   const struct tgsi_token *tokens;
+   struct tgsi_decoded_shader *shader;
+   unsigned num_tokens, pass, count;
+   int64_t t0, t1, t2, t3;
+
+   tokens = build_shader(&num_tokens);
+   if (!tokens) {
+      printf("failed to build shader\n");
+      return 1;
+   }
+
+   t0 = os_time_get();
+   shader = tgsi_decode_shader(tokens);
+   t1 = os_time_get();
+   if (!shader) {
+      printf("failed to decode shader\n");
+      return 1;
+   }
+
+   if (!check_decoded(tokens, shader)) {
+      printf("FAIL\n");
+      return 1;
+   }
+
+   /* Walk the shader the way tgsi_exec and tgsi_scan do */
+   count = 0;
+   t2 = os_time_get();
+   for (pass = 0; pass < NUM_PASSES; pass++) {
+      struct tgsi_parse_context parse;
+
+      tgsi_parse_init(&parse, tokens);
+      while (!tgsi_parse_end_of_tokens(&parse)) {
+         tgsi_parse_token(&parse);
+         if (parse.FullToken.Token.Type == TGSI_TOKEN_TYPE_INSTRUCTION)
+            count += parse.FullToken.FullInstruction.Instruction.Opcode;
+      }
+      tgsi_parse_free(&parse);
+   }
+   t3 = os_time_get();
+
+   printf("%u instructions, %u tokens\n",
+          shader->NumInstructions, num_tokens);
+   printf("tgsi_parse:  %.3f ms per pass\n",
+          (t3 - t2) / 1000.0 / NUM_PASSES);
+
+   t2 = os_time_get();
+   for (pass = 0; pass < NUM_PASSES; pass++) {
+      struct tgsi_decoded_iterator it;
+
+      tgsi_decoded_iterator_init(&it, shader);
+      while (tgsi_decoded_next(&it)) {
+         if (it.Type == TGSI_TOKEN_TYPE_INSTRUCTION)
+            count -= it.FullInstruction->Instruction.Opcode;
+      }
+   }
+   t3 = os_time_get();
+
+   printf("tgsi_decode: %.3f ms once, then %.3f ms per pass\n",
+          (t1 - t0) / 1000.0, (t3 - t2) / 1000.0 / NUM_PASSES);
+
+   tgsi_decoded_shader_destroy(shader);
+   ureg_free_tokens(tokens);
+
+   if (count != 0) {
+      printf("FAIL\n");
+      return 1;
+   }
+
+   printf("PASS\n");
+   return 0;
+}
@@ -82,6 +82,9 @@ int main(int argc, char** argv)
       util_cpu_caps.has_sse2 = 0;
       util_cpu_caps.has_sse3 = 0;
       util_cpu_caps.has_sse4_1 = 0;
+      util_cpu_caps.has_avx = 0;
+      util_cpu_caps.has_avx2 = 0;
+      util_cpu_caps.has_f16c = 0;
       create_fn = translate_sse2_create;
    }
    else if (!strcmp(argv[1], "sse"))
@@ -94,6 +97,9 @@ int main(int argc, char** argv)
       util_cpu_caps.has_sse2 = 0;
       util_cpu_caps.has_sse3 = 0;
       util_cpu_caps.has_sse4_1 = 0;
+      util_cpu_caps.has_avx = 0;
+      util_cpu_caps.has_avx2 = 0;
+      util_cpu_caps.has_f16c = 0;
       create_fn = translate_sse2_create;
    }
    else if (!strcmp(argv[1], "sse2"))
@@ -105,6 +111,9 @@ int main(int argc, char** argv)
       }
       util_cpu_caps.has_sse3 = 0;
       util_cpu_caps.has_sse4_1 = 0;
+      util_cpu_caps.has_avx = 0;
+      util_cpu_caps.has_avx2 = 0;
+      util_cpu_caps.has_f16c = 0;
       create_fn = translate_sse2_create;
    }
    else if (!strcmp(argv[1], "sse3"))
@@ -115,6 +124,9 @@ int main(int argc, char** argv)
          return 2;
       }
       util_cpu_caps.has_sse4_1 = 0;
+      util_cpu_caps.has_avx = 0;
+      util_cpu_caps.has_avx2 = 0;
+      util_cpu_caps.has_f16c = 0;
       create_fn = translate_sse2_create;
    }
    else if (!strcmp(argv[1], "sse4.1"))
@@ -124,12 +136,24 @@ int main(int argc, char** argv)
          printf("Error: CPU doesn't support SSE4.1 (test with qemu)\n");
          return 2;
       }
+      util_cpu_caps.has_avx = 0;
+      util_cpu_caps.has_avx2 = 0;
+      util_cpu_caps.has_f16c = 0;
+      create_fn = translate_sse2_create;
+   }
+   else if (!strcmp(argv[1], "avx2"))
+   {
+      if(!util_cpu_caps.has_avx2 || !util_cpu_caps.has_f16c || !rtasm_cpu_has_sse())
+      {
+         printf("Error: CPU doesn't support AVX2 and F16C (test with qemu)\n");
+         return 2;
+      }
       create_fn = translate_sse2_create;
    }
 
    if (!create_fn)
    {
-      printf("Usage: ./translate_test [generic|x86|nosse|sse|sse2|sse3|sse4.1]\n");
+      printf("Usage: ./translate_test [generic|x86|nosse|sse|sse2|sse3|sse4.1|avx2]\n");
       return 2;
    }
 
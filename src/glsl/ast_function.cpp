@@ -314,6 +314,7 @@ generate_call(exec_list *instructions, ir_function_signature *sig,
 static ir_function_signature *
 match_function_by_name(const char *name,
 		       exec_list *actual_parameters,
+		       YYLTYPE *loc,
 		       struct _mesa_glsl_parse_state *state)
 {
    void *ctx = state;
@@ -349,8 +350,14 @@ match_function_by_name(const char *name,
    /* Local shader has no exact candidates; check the built-ins. */
    _mesa_glsl_initialize_functions(state);
    for (unsigned i = 0; i < state->num_builtins_to_link; i++) {
+      bool unreadable;
       ir_function *builtin =
-	 state->builtins_to_link[i]->symbols->get_function(name);
+	 _mesa_glsl_get_builtin_function(state->builtins_to_link[i], name,
+					 &unreadable);
+      if (unreadable) {
+	 _mesa_glsl_error(loc, state, "built-in function `%s' is missing",
+			  name);
+      }
       if (builtin == NULL)
 	 continue;
 
@@ -406,6 +413,8 @@ no_matching_function_error(const char *name,
 
    const char *prefix = "candidates are: ";
 
+   _mesa_glsl_lock_functions();
+
    for (int i = -1; i < (int) state->num_builtins_to_link; i++) {
       glsl_symbol_table *syms = i >= 0 ? state->builtins_to_link[i]->symbols
 				       : state->symbols;
@@ -423,6 +432,8 @@ no_matching_function_error(const char *name,
 	 prefix = "                ";
       }
    }
+
+   _mesa_glsl_unlock_functions();
 }
 
 /**
@@ -1491,7 +1502,7 @@ ast_function_expression::hir(exec_list *instructions,
 			 state);
 
       ir_function_signature *sig =
-	 match_function_by_name(func_name, &actual_parameters, state);
+	 match_function_by_name(func_name, &actual_parameters, &loc, state);
 
       ir_call *call = NULL;
       ir_rvalue *value = NULL;
@@ -0,0 +1,121 @@
+/*
+ * Copyright © 2014 VMware, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file blob.h
+ *
+ * A growable buffer for serializing data, and a reader for getting the
+ * data back out.
+ *
+ * Writes never fail as such: if memory runs out the blob is marked out of
+ * memory and later writes are ignored, so a whole sequence of writes can be
+ * checked at the end.  Likewise, reads past the end of the data return
+ * zeros and mark the reader overrun.
+ */
+
+#ifndef BLOB_H
+#define BLOB_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+struct blob {
+   uint8_t *data;
+   size_t size;
+   size_t allocated;
+
+   /** Set if growing the buffer ever failed */
+   bool out_of_memory;
+};
+
+struct blob_reader {
+   const uint8_t *data;
+   const uint8_t *end;
+   const uint8_t *current;
+
+   /** Set if a read went past the end of the data */
+   bool overrun;
+};
+
+/**
+ * Create an empty blob, allocated with ralloc as a child of \c mem_ctx.
+ */
+struct blob *
+blob_create(void *mem_ctx);
+
+bool
+blob_write_bytes(struct blob *blob, const void *bytes, size_t size);
+
+bool
+blob_write_uint32(struct blob *blob, uint32_t value);
+
+bool
+blob_write_uint64(struct blob *blob, uint64_t value);
+
+/**
+ * Write a NUL-terminated string, or NULL.
+ */
+bool
+blob_write_string(struct blob *blob, const char *str);
+
+/**
+ * Overwrite a uint32 written earlier at \c offset, for sizes and counts
+ * that are only known once the data that follows has been written.
+ */
+bool
+blob_overwrite_uint32(struct blob *blob, size_t offset, uint32_t value);
+
+void
+blob_reader_init(struct blob_reader *blob, const void *data, size_t size);
+
+/**
+ * Return a pointer to the next \c size bytes in the blob, or NULL if there
+ * are not that many left.
+ */
+const void *
+blob_read_bytes(struct blob_reader *blob, size_t size);
+
+uint32_t
+blob_read_uint32(struct blob_reader *blob);
+
+uint64_t
+blob_read_uint64(struct blob_reader *blob);
+
+/**
+ * Read a string written by blob_write_string().  The string points into
+ * the blob's data; it may be NULL, either because NULL was written or
+ * because the data is corrupt, in which case the reader is overrun.
+ */
+const char *
+blob_read_string(struct blob_reader *blob);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif /* BLOB_H */
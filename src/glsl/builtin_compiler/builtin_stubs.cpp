@@ -22,6 +22,7 @@
  */
 
 #include <stdio.h>
+#include "main/core.h" /* for struct gl_shader */
 #include "glsl_parser_extras.h"
 
 /* A dummy file.  When compiling prototypes, we don't care about builtins.
@@ -37,3 +38,21 @@ _mesa_glsl_initialize_functions(_mesa_glsl_parse_state *state)
 {
    (void) state;
 }
+
+ir_function *
+_mesa_glsl_get_builtin_function(gl_shader *builtins, const char *name,
+                                bool *unreadable)
+{
+   *unreadable = false;
+   return builtins->symbols->get_function(name);
+}
+
+void
+_mesa_glsl_lock_functions(void)
+{
+}
+
+void
+_mesa_glsl_unlock_functions(void)
+{
+}
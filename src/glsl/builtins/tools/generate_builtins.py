@@ -59,7 +59,7 @@ def stringify(s):
                 t += '\n'
             else:
                 t += "'" + c + "',"
-        return '{' + t[:-1] + '}'
+        return '{' + t + "'\\0'}"
 
     t = s.replace('\\', '\\\\').replace('"', '\\"').replace('\n', '\\n"\n   "')
     return '   "' + t + '"\n'
@@ -96,6 +96,25 @@ def run_compiler(args):
 
     return (output, p.returncode)
 
+# Split IR into its top-level (function ...) expressions, by name.
+def split_functions(ir):
+    functions = {}
+    depth = 0
+    start = 0
+    for i, c in enumerate(ir):
+        if c == '(':
+            depth += 1
+            if depth == 2:
+                start = i
+        elif c == ')':
+            if depth == 2:
+                func = ir[start:i + 1]
+                match = re.match(r'\(function (\S+)', func)
+                if match:
+                    functions[match.group(1)] = func
+            depth -= 1
+    return functions
+
 def write_profile(filename, profile):
     (proto_ir, returncode) = run_compiler([filename])
 
@@ -103,19 +122,19 @@ def write_profile(filename, profile):
         print '#error builtins profile', profile, 'failed to compile'
         return
 
-    print 'static const char prototypes_for_' + profile + '[] ='
-    print stringify(proto_ir), ';'
-
-    # Print a table of all the functions (not signatures) referenced.
-    # This is done so we can avoid bothering with a hash table in the C++ code.
+    # Print a table of the functions in the profile, sorted by name, with
+    # the prototypes of each one kept separate so that it can be read on
+    # its own the first time a shader calls it.
 
-    function_names = set()
-    for func in re.finditer(r'\(function (.+)\n', proto_ir):
-        function_names.add(func.group(1))
+    functions = split_functions(proto_ir)
 
-    print 'static const char *functions_for_' + profile + ' [] = {'
-    for func in sorted(function_names):
-        print '   builtin_' + func + ','
+    print 'static const struct builtin_function functions_for_' + profile + '[] = {'
+    for func in sorted(functions):
+        protos = '(' + functions[func] + ')'
+        assert len(protos) < 65535
+        print '   { "' + func + '",'
+        print stringify(protos).rstrip() + ','
+        print '     builtin_' + func + ' },'
     print '};'
 
 def write_profiles():
@@ -165,22 +184,46 @@ if __name__ == "__main__":
 #include "ir_reader.h"
 #include "program.h"
 #include "ast.h"
+#include "glapi/glthread.h"
 
 extern "C" struct gl_shader *
 _mesa_new_shader(struct gl_context *ctx, GLuint name, GLenum type);
 
-gl_shader *
-read_builtins(GLenum target, const char *protos, const char **functions, unsigned count)
+/**
+ * A built-in function: the prototypes of all of its signatures available
+ * in one profile, and the bodies of all of its signatures.
+ */
+struct builtin_function {
+   const char *name;
+   const char *prototypes;
+   const char *body;
+};
+
+/**
+ * The functions of a profile, sorted by name, and the shader holding the
+ * ones that have been read so far.
+ */
+struct builtin_profile {
+   const struct builtin_function *functions;
+   unsigned count;
+   gl_shader *shader;
+};
+
+static void
+init_fake_context(struct gl_context *ctx)
+{
+   ctx->API = API_OPENGL_COMPAT;
+   ctx->Const.GLSLVersion = 150;
+   ctx->Extensions.ARB_ES2_compatibility = true;
+   ctx->Extensions.ARB_ES3_compatibility = true;
+   ctx->Const.ForceGLSLExtensionsWarn = false;
+}
+
+static struct _mesa_glsl_parse_state *
+new_builtin_parse_state(struct gl_context *ctx, GLenum target, void *mem_ctx)
 {
-   struct gl_context fakeCtx;
-   fakeCtx.API = API_OPENGL_COMPAT;
-   fakeCtx.Const.GLSLVersion = 150;
-   fakeCtx.Extensions.ARB_ES2_compatibility = true;
-   fakeCtx.Extensions.ARB_ES3_compatibility = true;
-   fakeCtx.Const.ForceGLSLExtensionsWarn = false;
-   gl_shader *sh = _mesa_new_shader(NULL, 0, target);
    struct _mesa_glsl_parse_state *st =
-      new(sh) _mesa_glsl_parse_state(&fakeCtx, target, sh);
+      new(mem_ctx) _mesa_glsl_parse_state(ctx, target, mem_ctx);
 
    st->language_version = 150;
    st->symbols->separate_function_namespace = false;
@@ -193,33 +236,123 @@ read_builtins(GLenum target, const char *protos, const char **functions, unsigne
    st->ARB_texture_multisample_enable = true;
    st->ARB_texture_query_lod_enable = true;
    st->ARB_gpu_shader5_enable = true;
+
+   return st;
+}
+
+/**
+ * Create the shader holding the built-in functions of a profile.  It
+ * starts out with just the types; functions are read into it by
+ * read_builtin_function() when a shader first calls them.
+ */
+static gl_shader *
+new_builtin_shader(GLenum target)
+{
+   struct gl_context fakeCtx;
+   init_fake_context(&fakeCtx);
+
+   gl_shader *sh = _mesa_new_shader(NULL, 0, target);
+   struct _mesa_glsl_parse_state *st =
+      new_builtin_parse_state(&fakeCtx, target, sh);
    _mesa_glsl_initialize_types(st);
 
    sh->ir = new(sh) exec_list;
    sh->symbols = st->symbols;
+   delete st;
 
-   /* Read the IR containing the prototypes */
-   _mesa_glsl_read_ir(st, sh->ir, protos, true);
+   return sh;
+}
+
+static int
+compare_builtin_function(const void *key, const void *elem)
+{
+   return strcmp((const char *) key,
+                 ((const struct builtin_function *) elem)->name);
+}
 
-   /* Read ALL the function bodies, telling the IR reader not to scan for
-    * prototypes (we've already created them).  The IR reader will skip any
-    * signature that does not already exist as a prototype.
+static const struct builtin_function *
+find_builtin_function(const struct builtin_profile *profile, const char *name)
+{
+   return (const struct builtin_function *)
+      bsearch(name, profile->functions, profile->count,
+              sizeof(profile->functions[0]), compare_builtin_function);
+}
+
+/**
+ * Read the prototypes and bodies of a function into the profile's shader,
+ * after the functions it calls.
+ * \return the function, or NULL if it (or a function it calls) is broken
+ */
+static ir_function *
+read_builtin_function(const struct builtin_profile *profile,
+                      const struct builtin_function *f)
+{
+   gl_shader *sh = profile->shader;
+   ir_function *func = sh->symbols->get_function(f->name);
+   if (func != NULL)
+      return func;
+
+   /* Read the callees first, so that the calls in the body find them.
+    * Calls to other overloads of this function find the prototypes read
+    * below.
     */
-   for (unsigned i = 0; i < count; i++) {
-      _mesa_glsl_read_ir(st, sh->ir, functions[i], false);
-
-      if (st->error) {
-         printf("error reading builtin: %.35s ...\\n", functions[i]);
-         printf("Info log:\\n%s\\n", st->info_log);
-         ralloc_free(sh);
-         return NULL;
-      }
+   for (const char *call = strstr(f->body, "(call ");
+        call != NULL;
+        call = strstr(call + 1, "(call ")) {
+      char name[64];
+      const char *start = call + strlen("(call ");
+      const size_t len = strcspn(start, " ()\\n");
+
+      if (len >= sizeof(name))
+         continue;
+      memcpy(name, start, len);
+      name[len] = '\\0';
+
+      const struct builtin_function *callee =
+         find_builtin_function(profile, name);
+      if (callee != NULL && callee != f)
+         read_builtin_function(profile, callee);
    }
 
-   reparent_ir(sh->ir, sh);
-   delete st;
+   struct gl_context fakeCtx;
+   init_fake_context(&fakeCtx);
 
-   return sh;
+   void *mem_ctx = ralloc_context(NULL);
+   struct _mesa_glsl_parse_state *st =
+      new_builtin_parse_state(&fakeCtx, sh->Type, mem_ctx);
+   st->symbols = sh->symbols;
+
+   exec_list functions;
+
+   /* Read the function in a scope of its own, so that it can be dropped
+    * from the symbol table again if it turns out to be broken.
+    */
+   sh->symbols->push_scope();
+
+   /* Read the prototypes, then the bodies, telling the IR reader not to
+    * scan for prototypes the second time (we've already created them).
+    * The IR reader will skip any signature that does not already exist as
+    * a prototype.
+    */
+   _mesa_glsl_read_ir(st, &functions, f->prototypes, true);
+   if (!st->error)
+      _mesa_glsl_read_ir(st, &functions, f->body, false);
+
+   func = st->error ? NULL : sh->symbols->get_function(f->name);
+   sh->symbols->pop_scope();
+
+   if (func != NULL) {
+      sh->symbols->add_global_function(func);
+      reparent_ir(&functions, sh);
+      sh->ir->append_list(&functions);
+   } else {
+      printf("error reading builtin: %.35s ...\\n", f->body);
+      printf("Info log:\\n%s\\n", st->info_log);
+   }
+
+   ralloc_free(mem_ctx);
+
+   return func;
 }
 """
 
@@ -228,32 +361,95 @@ read_builtins(GLenum target, const char *protos, const char **functions, unsigne
 
     profiles = get_profile_list()
 
-    print 'static gl_shader *builtin_profiles[%d];' % len(profiles)
+    print 'static struct builtin_profile builtin_profiles[%d] = {' % len(profiles)
+    for (filename, profile) in profiles:
+        print '   { functions_for_' + profile + ','
+        print '     Elements(functions_for_' + profile + '), NULL },'
+    print '};'
 
     print """
 static void *builtin_mem_ctx = NULL;
 
+/**
+ * Protects the profiles and their shaders, which may be read into by one
+ * thread while others compile and link against them.  A function doesn't
+ * change once it has been read, so holding on to it is safe; looking
+ * anything up in the shaders isn't.
+ */
+_glthread_DECLARE_STATIC_MUTEX(builtin_mutex);
+
+void
+_mesa_glsl_lock_functions(void)
+{
+   _glthread_LOCK_MUTEX(builtin_mutex);
+}
+
+void
+_mesa_glsl_unlock_functions(void)
+{
+   _glthread_UNLOCK_MUTEX(builtin_mutex);
+}
+
 void
 _mesa_glsl_release_functions(void)
 {
+   _glthread_LOCK_MUTEX(builtin_mutex);
    ralloc_free(builtin_mem_ctx);
    builtin_mem_ctx = NULL;
-   memset(builtin_profiles, 0, sizeof(builtin_profiles));
+   for (unsigned i = 0; i < Elements(builtin_profiles); i++)
+      builtin_profiles[i].shader = NULL;
+   _glthread_UNLOCK_MUTEX(builtin_mutex);
+}
+
+static ir_function *
+get_builtin_function_locked(gl_shader *builtins, const char *name,
+                            bool *unreadable)
+{
+   ir_function *func = builtins->symbols->get_function(name);
+   if (func != NULL)
+      return func;
+
+   for (unsigned i = 0; i < Elements(builtin_profiles); i++) {
+      if (builtin_profiles[i].shader == builtins) {
+         const struct builtin_function *f =
+            find_builtin_function(&builtin_profiles[i], name);
+
+         if (f == NULL)
+            return NULL;
+
+         func = read_builtin_function(&builtin_profiles[i], f);
+         if (func == NULL)
+            *unreadable = true;
+         return func;
+      }
+   }
+
+   return NULL;
+}
+
+ir_function *
+_mesa_glsl_get_builtin_function(gl_shader *builtins, const char *name,
+                                bool *unreadable)
+{
+   *unreadable = false;
+
+   _glthread_LOCK_MUTEX(builtin_mutex);
+   ir_function *func = get_builtin_function_locked(builtins, name, unreadable);
+   _glthread_UNLOCK_MUTEX(builtin_mutex);
+
+   return func;
 }
 
 static void
 _mesa_read_profile(struct _mesa_glsl_parse_state *state,
-                   int profile_index,
-		   const char *prototypes,
-		   const char **functions,
-                   int count)
+                   int profile_index)
 {
-   gl_shader *sh = builtin_profiles[profile_index];
+   gl_shader *sh = builtin_profiles[profile_index].shader;
 
    if (sh == NULL) {
-      sh = read_builtins(GL_VERTEX_SHADER, prototypes, functions, count);
+      sh = new_builtin_shader(GL_VERTEX_SHADER);
       ralloc_steal(builtin_mem_ctx, sh);
-      builtin_profiles[profile_index] = sh;
+      builtin_profiles[profile_index].shader = sh;
    }
 
    state->builtins_to_link[state->num_builtins_to_link] = sh;
@@ -267,9 +463,12 @@ _mesa_glsl_initialize_functions(struct _mesa_glsl_parse_state *state)
    if (state->num_builtins_to_link > 0)
       return;
 
+   _glthread_LOCK_MUTEX(builtin_mutex);
+
    if (builtin_mem_ctx == NULL) {
       builtin_mem_ctx = ralloc_context(NULL); // "GLSL built-in functions"
-      memset(&builtin_profiles, 0, sizeof(builtin_profiles));
+      for (unsigned i = 0; i < Elements(builtin_profiles); i++)
+         builtin_profiles[i].shader = NULL;
    }
 """
 
@@ -293,12 +492,10 @@ _mesa_glsl_initialize_functions(struct _mesa_glsl_parse_state *state)
             check += 'state->' + version + '_enable'
 
         print '   if (' + check + ') {'
-        print '      _mesa_read_profile(state, %d,' % i
-        print '                         prototypes_for_' + profile + ','
-        print '                         functions_for_' + profile + ','
-        print '                         Elements(functions_for_' + profile + '));'
+        print '      _mesa_read_profile(state, %d);' % i
         print '   }'
         print
         i = i + 1
+    print '   _glthread_UNLOCK_MUTEX(builtin_mutex);'
     print '}'
 
@@ -28,6 +28,7 @@
 extern "C" {
 #include "main/core.h" /* for struct gl_context */
 #include "main/context.h"
+#include "glapi/glthread.h"
 }
 
 #include "ralloc.h"
@@ -35,7 +36,6 @@ extern "C" {
 #include "glsl_parser_extras.h"
 #include "glsl_parser.h"
 #include "ir_optimization.h"
-#include "loop_analysis.h"
 
 /**
  * Format a short human-readable description of the given GLSL version.
@@ -1175,84 +1175,23 @@ ast_struct_specifier::print(void) const
 }
 
 
+/** Shaders may be compiled on several threads at once */
+_glthread_DECLARE_STATIC_MUTEX(anon_struct_mutex);
+
 ast_struct_specifier::ast_struct_specifier(const char *identifier,
 					   ast_declarator_list *declarator_list)
 {
    if (identifier == NULL) {
       static unsigned anon_count = 1;
-      identifier = ralloc_asprintf(this, "#anon_struct_%04x", anon_count);
-      anon_count++;
+      _glthread_LOCK_MUTEX(anon_struct_mutex);
+      const unsigned n = anon_count++;
+      _glthread_UNLOCK_MUTEX(anon_struct_mutex);
+      identifier = ralloc_asprintf(this, "#anon_struct_%04x", n);
    }
    name = identifier;
    this->declarations.push_degenerate_list_at_head(&declarator_list->link);
 }
 
-/**
- * Do the set of common optimizations passes
- *
- * \param ir                          List of instructions to be optimized
- * \param linked                      Is the shader linked?  This enables
- *                                    optimizations passes that remove code at
- *                                    global scope and could cause linking to
- *                                    fail.
- * \param uniform_locations_assigned  Have locations already been assigned for
- *                                    uniforms?  This prevents the declarations
- *                                    of unused uniforms from being removed.
- *                                    The setting of this flag only matters if
- *                                    \c linked is \c true.
- * \param max_unroll_iterations       Maximum number of loop iterations to be
- *                                    unrolled.  Setting to 0 disables loop
- *                                    unrolling.
- */
-bool
-do_common_optimization(exec_list *ir, bool linked,
-		       bool uniform_locations_assigned,
-		       unsigned max_unroll_iterations)
-{
-   GLboolean progress = GL_FALSE;
-
-   progress = lower_instructions(ir, SUB_TO_ADD_NEG) || progress;
-
-   if (linked) {
-      progress = do_function_inlining(ir) || progress;
-      progress = do_dead_functions(ir) || progress;
-      progress = do_structure_splitting(ir) || progress;
-   }
-   progress = do_if_simplification(ir) || progress;
-   progress = opt_flatten_nested_if_blocks(ir) || progress;
-   progress = do_copy_propagation(ir) || progress;
-   progress = do_copy_propagation_elements(ir) || progress;
-   if (linked)
-      progress = do_dead_code(ir, uniform_locations_assigned) || progress;
-   else
-      progress = do_dead_code_unlinked(ir) || progress;
-   progress = do_dead_code_local(ir) || progress;
-   progress = do_tree_grafting(ir) || progress;
-   progress = do_constant_propagation(ir) || progress;
-   if (linked)
-      progress = do_constant_variable(ir) || progress;
-   else
-      progress = do_constant_variable_unlinked(ir) || progress;
-   progress = do_constant_folding(ir) || progress;
-   progress = do_algebraic(ir) || progress;
-   progress = do_lower_jumps(ir) || progress;
-   progress = do_vec_index_to_swizzle(ir) || progress;
-   progress = do_swizzle_swizzle(ir) || progress;
-   progress = do_noop_swizzle(ir) || progress;
-
-   progress = optimize_split_arrays(ir, linked) || progress;
-   progress = optimize_redundant_jumps(ir) || progress;
-
-   loop_state *ls = analyze_loop_variables(ir);
-   if (ls->loop_found) {
-      progress = set_loop_controls(ir, ls) || progress;
-      progress = unroll_loops(ir, ls, max_unroll_iterations) || progress;
-   }
-   delete ls;
-
-   return progress;
-}
-
 extern "C" {
 
 /**
@@ -1265,6 +1204,8 @@ extern "C" {
 void
 _mesa_destroy_shader_compiler(void)
 {
+   print_optimization_stats();
+
    _mesa_destroy_shader_compiler_caches();
 
    _mesa_glsl_release_types();
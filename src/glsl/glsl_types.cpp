@@ -30,6 +30,7 @@
 #include "builtin_types.h"
 extern "C" {
 #include "program/hash_table.h"
+#include "glapi/glthread.h"
 }
 
 hash_table *glsl_type::array_types = NULL;
@@ -37,6 +38,12 @@ hash_table *glsl_type::record_types = NULL;
 hash_table *glsl_type::interface_types = NULL;
 void *glsl_type::mem_ctx = NULL;
 
+/**
+ * Protects the type tables and mem_ctx, which are shared by the compiler
+ * threads.  The types themselves are immutable once created.
+ */
+_glthread_DECLARE_STATIC_MUTEX(glsl_type_mutex);
+
 void
 glsl_type::init_ralloc_type_ctx(void)
 {
@@ -492,6 +499,8 @@ const glsl_type *glsl_type::get_scalar_type() const
 void
 _mesa_glsl_release_types(void)
 {
+   _glthread_LOCK_MUTEX(glsl_type_mutex);
+
    if (glsl_type::array_types != NULL) {
       hash_table_dtor(glsl_type::array_types);
       glsl_type::array_types = NULL;
@@ -501,6 +510,8 @@ _mesa_glsl_release_types(void)
       hash_table_dtor(glsl_type::record_types);
       glsl_type::record_types = NULL;
    }
+
+   _glthread_UNLOCK_MUTEX(glsl_type_mutex);
 }
 
 
@@ -595,6 +606,7 @@ glsl_type::get_instance(unsigned base_type, unsigned rows, unsigned columns)
 const glsl_type *
 glsl_type::get_array_instance(const glsl_type *base, unsigned array_size)
 {
+   _glthread_LOCK_MUTEX(glsl_type_mutex);
 
    if (array_types == NULL) {
       array_types = hash_table_ctor(64, hash_table_string_hash,
@@ -616,6 +628,8 @@ glsl_type::get_array_instance(const glsl_type *base, unsigned array_size)
       hash_table_insert(array_types, (void *) t, ralloc_strdup(mem_ctx, key));
    }
 
+   _glthread_UNLOCK_MUTEX(glsl_type_mutex);
+
    assert(t->base_type == GLSL_TYPE_ARRAY);
    assert(t->length == array_size);
    assert(t->fields.array == base);
@@ -683,6 +697,9 @@ glsl_type::get_record_instance(const glsl_struct_field *fields,
 			       unsigned num_fields,
 			       const char *name)
 {
+   _glthread_LOCK_MUTEX(glsl_type_mutex);
+
+   /* The key allocates its name and fields from mem_ctx too */
    const glsl_type key(fields, num_fields, name);
 
    if (record_types == NULL) {
@@ -696,6 +713,8 @@ glsl_type::get_record_instance(const glsl_struct_field *fields,
       hash_table_insert(record_types, (void *) t, t);
    }
 
+   _glthread_UNLOCK_MUTEX(glsl_type_mutex);
+
    assert(t->base_type == GLSL_TYPE_STRUCT);
    assert(t->length == num_fields);
    assert(strcmp(t->name, name) == 0);
@@ -710,6 +729,8 @@ glsl_type::get_interface_instance(const glsl_struct_field *fields,
 				  enum glsl_interface_packing packing,
 				  const char *name)
 {
+   _glthread_LOCK_MUTEX(glsl_type_mutex);
+
    const glsl_type key(fields, num_fields, packing, name);
 
    if (interface_types == NULL) {
@@ -723,6 +744,8 @@ glsl_type::get_interface_instance(const glsl_struct_field *fields,
       hash_table_insert(interface_types, (void *) t, t);
    }
 
+   _glthread_UNLOCK_MUTEX(glsl_type_mutex);
+
    assert(t->base_type == GLSL_TYPE_INTERFACE);
    assert(t->length == num_fields);
    assert(strcmp(t->name, name) == 0);
@@ -731,6 +754,44 @@ glsl_type::get_interface_instance(const glsl_struct_field *fields,
 }
 
 
+const glsl_type *
+glsl_type::get_builtin_instance(const char *name)
+{
+   static const struct {
+      const glsl_type *types;
+      unsigned count;
+   } tables[] = {
+#define TABLE(t) { t, Elements(t) }
+      TABLE(builtin_core_types),
+      TABLE(builtin_structure_types),
+      TABLE(builtin_110_deprecated_structure_types),
+      TABLE(builtin_110_types),
+      TABLE(builtin_120_types),
+      TABLE(builtin_130_types),
+      TABLE(builtin_140_types),
+      TABLE(builtin_ARB_texture_rectangle_types),
+      TABLE(builtin_EXT_texture_array_types),
+      TABLE(builtin_EXT_texture_buffer_object_types),
+      TABLE(builtin_OES_EGL_image_external_types),
+      TABLE(builtin_ARB_texture_cube_map_array_types),
+      TABLE(builtin_ARB_texture_multisample_types),
+#undef TABLE
+      { &_sampler3D_type, 1 },
+      { &_samplerCubeShadow_type, 1 },
+      { &_void_type, 1 },
+   };
+
+   for (unsigned i = 0; i < Elements(tables); i++) {
+      for (unsigned j = 0; j < tables[i].count; j++) {
+	 if (strcmp(tables[i].types[j].name, name) == 0)
+	    return &tables[i].types[j];
+      }
+   }
+
+   return NULL;
+}
+
+
 const glsl_type *
 glsl_type::field_type(const char *name) const
 {
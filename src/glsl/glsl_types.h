@@ -248,6 +248,14 @@ struct glsl_type {
 						  enum glsl_interface_packing packing,
 						  const char *name);
 
+   /**
+    * Get the built-in type with the given name, or NULL if there is none
+    *
+    * This covers the scalar, vector, matrix, sampler, and built-in structure
+    * types, but not arrays, which have no name of their own.
+    */
+   static const glsl_type *get_builtin_instance(const char *name);
+
    /**
     * Query the total number of scalars that make up a scalar, vector or matrix
     */
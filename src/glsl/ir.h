@@ -2013,6 +2013,30 @@ _mesa_glsl_initialize_functions(_mesa_glsl_parse_state *state);
 extern void
 _mesa_glsl_release_functions(void);
 
+struct gl_shader;
+
+/**
+ * Look up a built-in function in one of the shaders set up by
+ * _mesa_glsl_initialize_functions(), reading it (and the built-ins it
+ * calls) into that shader the first time it's asked for.
+ *
+ * Returns NULL if there's no such function.  If there is one but it can't
+ * be read, NULL is returned as well and *unreadable is set.
+ */
+extern ir_function *
+_mesa_glsl_get_builtin_function(struct gl_shader *builtins, const char *name,
+                                bool *unreadable);
+
+/**
+ * Hold off other threads from reading functions into the built-in shaders,
+ * for looking them up directly, as the linker does.
+ */
+extern void
+_mesa_glsl_lock_functions(void);
+
+extern void
+_mesa_glsl_unlock_functions(void);
+
 extern void
 reparent_ir(exec_list *list, void *mem_ctx);
 
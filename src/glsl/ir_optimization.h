@@ -67,6 +67,7 @@ enum lower_packing_builtins_op {
 bool do_common_optimization(exec_list *ir, bool linked,
 			    bool uniform_locations_assigned,
 			    unsigned max_unroll_iterations);
+void print_optimization_stats(void);
 
 bool do_algebraic(exec_list *instructions);
 bool do_constant_folding(exec_list *instructions);
@@ -240,8 +240,10 @@ ir_reader::read_function_sig(ir_function *f, s_expression *expr, bool skip_body)
    exec_list_iterator it = paramlist->subexpressions.iterator();
    for (it.next() /* skip "parameters" */; it.has_next(); it.next()) {
       ir_variable *var = read_declaration((s_expression *) it.get());
-      if (var == NULL)
+      if (var == NULL) {
+	 state->symbols->pop_scope();
 	 return;
+      }
 
       hir_parameters.push_tail(var);
    }
@@ -257,12 +259,14 @@ ir_reader::read_function_sig(ir_function *f, s_expression *expr, bool skip_body)
       if (badvar != NULL) {
 	 ir_read_error(expr, "function `%s' parameter `%s' qualifiers "
 		       "don't match prototype", f->name, badvar);
+	 state->symbols->pop_scope();
 	 return;
       }
 
       if (sig->return_type != return_type) {
 	 ir_read_error(expr, "function `%s' return type doesn't "
 		       "match prototype", f->name);
+	 state->symbols->pop_scope();
 	 return;
       }
    } else {
@@ -277,6 +281,7 @@ ir_reader::read_function_sig(ir_function *f, s_expression *expr, bool skip_body)
    if (!skip_body && !body_list->subexpressions.is_empty()) {
       if (sig->is_defined) {
 	 ir_read_error(expr, "function %s redefined", f->name);
+	 state->symbols->pop_scope();
 	 return;
       }
       state->current_function = sig;
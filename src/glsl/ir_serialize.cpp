@@ -0,0 +1,1386 @@
+/*
+ * Copyright © 2014 VMware, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file ir_serialize.cpp
+ *
+ * Binary serialization of GLSL IR and of linked shader programs.
+ *
+ * Instructions are written as their \c ir_node_type followed by their
+ * fields, children first-to-last, with \c ir_type_unset standing for both a
+ * missing child and the end of an instruction list.  Variables and function
+ * signatures are referred to by the order they were written in.  The
+ * functions of a list are all written up front, with their parameters, so
+ * that calls can refer to functions defined later in the list.
+ */
+
+#include "main/core.h" /* for struct gl_shader_program */
+#include "ir.h"
+#include "ir_serialize.h"
+#include "linker.h"
+#include "program/hash_table.h"
+
+extern "C" {
+#include "main/shaderobj.h"
+}
+
+enum type_tag {
+   TYPE_NULL,
+   TYPE_BUILTIN,
+   TYPE_ARRAY,
+   TYPE_STRUCT,
+   TYPE_INTERFACE
+};
+
+/**
+ * Nesting limits for reading back, well beyond what real shaders use.
+ * The data may come from the application through glProgramBinary(), so
+ * these keep a crafted binary from exhausting the stack.
+ */
+/*@{*/
+#define MAX_TYPE_DEPTH 64
+#define MAX_IR_DEPTH 1024
+/*@}*/
+
+
+void
+serialize_glsl_type(struct blob *blob, const glsl_type *type)
+{
+   if (type == NULL) {
+      blob_write_uint32(blob, TYPE_NULL);
+      return;
+   }
+
+   switch (type->base_type) {
+   case GLSL_TYPE_ARRAY:
+      blob_write_uint32(blob, TYPE_ARRAY);
+      blob_write_uint32(blob, type->length);
+      serialize_glsl_type(blob, type->fields.array);
+      return;
+
+   case GLSL_TYPE_STRUCT:
+   case GLSL_TYPE_INTERFACE:
+      if (glsl_type::get_builtin_instance(type->name) != type) {
+         if (type->base_type == GLSL_TYPE_STRUCT) {
+            blob_write_uint32(blob, TYPE_STRUCT);
+         } else {
+            blob_write_uint32(blob, TYPE_INTERFACE);
+            blob_write_uint32(blob, type->interface_packing);
+         }
+
+         blob_write_string(blob, type->name);
+         blob_write_uint32(blob, type->length);
+         for (unsigned i = 0; i < type->length; i++) {
+            serialize_glsl_type(blob, type->fields.structure[i].type);
+            blob_write_string(blob, type->fields.structure[i].name);
+            blob_write_uint32(blob, type->fields.structure[i].row_major);
+         }
+         return;
+      }
+      /* fallthrough */
+
+   default:
+      blob_write_uint32(blob, TYPE_BUILTIN);
+      blob_write_string(blob, type->name);
+      return;
+   }
+}
+
+
+static const glsl_type *
+read_glsl_type(struct blob_reader *blob, unsigned depth)
+{
+   const uint32_t tag = blob_read_uint32(blob);
+
+   if (depth > MAX_TYPE_DEPTH) {
+      blob->overrun = true;
+      return NULL;
+   }
+
+   switch (tag) {
+   case TYPE_BUILTIN: {
+      const char *name = blob_read_string(blob);
+
+      return name ? glsl_type::get_builtin_instance(name) : NULL;
+   }
+
+   case TYPE_ARRAY: {
+      const unsigned length = blob_read_uint32(blob);
+      const glsl_type *element = read_glsl_type(blob, depth + 1);
+
+      return element ? glsl_type::get_array_instance(element, length) : NULL;
+   }
+
+   case TYPE_STRUCT:
+   case TYPE_INTERFACE: {
+      const glsl_interface_packing packing = tag == TYPE_INTERFACE
+         ? (glsl_interface_packing) blob_read_uint32(blob)
+         : GLSL_INTERFACE_PACKING_STD140;
+      const char *name = blob_read_string(blob);
+      const unsigned num_fields = blob_read_uint32(blob);
+
+      if (name == NULL ||
+          num_fields > (size_t) (blob->end - blob->current)) {
+         blob->overrun = true;
+         return NULL;
+      }
+
+      glsl_struct_field *fields = new glsl_struct_field[num_fields];
+      bool ok = true;
+
+      for (unsigned i = 0; i < num_fields && ok; i++) {
+         fields[i].type = read_glsl_type(blob, depth + 1);
+         fields[i].name = blob_read_string(blob);
+         fields[i].row_major = blob_read_uint32(blob) != 0;
+         ok = fields[i].type != NULL && fields[i].name != NULL;
+      }
+
+      const glsl_type *type = NULL;
+      if (ok) {
+         type = tag == TYPE_INTERFACE
+            ? glsl_type::get_interface_instance(fields, num_fields,
+                                                packing, name)
+            : glsl_type::get_record_instance(fields, num_fields, name);
+      }
+
+      delete [] fields;
+      return type;
+   }
+
+   case TYPE_NULL:
+   default:
+      return NULL;
+   }
+}
+
+
+const glsl_type *
+deserialize_glsl_type(struct blob_reader *blob)
+{
+   return read_glsl_type(blob, 0);
+}
+
+
+namespace {
+
+/**
+ * Assigns consecutive numbers to the pointers it's given.
+ */
+class id_map {
+public:
+   id_map()
+      : count(0)
+   {
+      ht = hash_table_ctor(0, hash_table_pointer_hash,
+                           hash_table_pointer_compare);
+   }
+
+   ~id_map()
+   {
+      hash_table_dtor(ht);
+   }
+
+   void add(const void *ptr)
+   {
+      hash_table_insert(ht, (void *) (intptr_t) ++count, ptr);
+   }
+
+   /** \return the number of \c ptr, or -1 if it wasn't added */
+   int find(const void *ptr)
+   {
+      return (int) (intptr_t) hash_table_find(ht, ptr) - 1;
+   }
+
+   unsigned count;
+
+private:
+   struct hash_table *ht;
+};
+
+
+class ir_serializer {
+public:
+   ir_serializer(struct blob *blob)
+      : blob(blob), error(false)
+   {
+   }
+
+   bool run(exec_list *instructions);
+
+private:
+   void write_list(exec_list *list);
+   void write_instruction(ir_instruction *ir);
+   void write_variable(ir_variable *var);
+   void write_variable_ref(ir_variable *var);
+   void write_constant(ir_constant *c);
+   void write_texture(ir_texture *tex);
+
+   struct blob *blob;
+   id_map variables;
+   id_map functions;
+   id_map signatures;
+
+   bool error;
+};
+
+
+bool
+ir_serializer::run(exec_list *instructions)
+{
+   /* Function table: every function with the prototypes of its signatures.
+    */
+   unsigned num_functions = 0;
+   foreach_list(node, instructions) {
+      if (((ir_instruction *) node)->as_function())
+         num_functions++;
+   }
+
+   blob_write_uint32(blob, num_functions);
+   foreach_list(node, instructions) {
+      ir_function *f = ((ir_instruction *) node)->as_function();
+      if (f == NULL)
+         continue;
+
+      functions.add(f);
+      blob_write_string(blob, f->name);
+
+      unsigned num_signatures = 0;
+      foreach_list(sig_node, &f->signatures)
+         num_signatures++;
+
+      blob_write_uint32(blob, num_signatures);
+      foreach_list(sig_node, &f->signatures) {
+         ir_function_signature *sig = (ir_function_signature *) sig_node;
+
+         signatures.add(sig);
+         serialize_glsl_type(blob, sig->return_type);
+         blob_write_uint32(blob, sig->is_builtin);
+         write_list(&sig->parameters);
+      }
+   }
+
+   write_list(instructions);
+
+   return !error && !blob->out_of_memory;
+}
+
+
+void
+ir_serializer::write_list(exec_list *list)
+{
+   foreach_list(node, list)
+      write_instruction((ir_instruction *) node);
+
+   blob_write_uint32(blob, ir_type_unset);
+}
+
+
+void
+ir_serializer::write_variable_ref(ir_variable *var)
+{
+   const int id = variables.find(var);
+
+   if (id < 0)
+      error = true;
+
+   blob_write_uint32(blob, id);
+}
+
+
+void
+ir_serializer::write_variable(ir_variable *var)
+{
+   variables.add(var);
+
+   serialize_glsl_type(blob, var->type);
+   blob_write_string(blob, var->name);
+   blob_write_uint32(blob, var->max_array_access);
+   blob_write_uint32(blob, var->read_only);
+   blob_write_uint32(blob, var->centroid);
+   blob_write_uint32(blob, var->invariant);
+   blob_write_uint32(blob, var->used);
+   blob_write_uint32(blob, var->assigned);
+   blob_write_uint32(blob, var->mode);
+   blob_write_uint32(blob, var->interpolation);
+   blob_write_uint32(blob, var->origin_upper_left);
+   blob_write_uint32(blob, var->pixel_center_integer);
+   blob_write_uint32(blob, var->explicit_location);
+   blob_write_uint32(blob, var->explicit_index);
+   blob_write_uint32(blob, var->has_initializer);
+   blob_write_uint32(blob, var->is_unmatched_generic_inout);
+   blob_write_uint32(blob, var->location_frac);
+   blob_write_uint32(blob, var->depth_layout);
+   blob_write_uint32(blob, var->location);
+   blob_write_uint32(blob, var->index);
+
+   blob_write_uint32(blob, var->num_state_slots);
+   for (unsigned i = 0; i < var->num_state_slots; i++) {
+      for (unsigned j = 0; j < Elements(var->state_slots[i].tokens); j++)
+         blob_write_uint32(blob, var->state_slots[i].tokens[j]);
+      blob_write_uint32(blob, var->state_slots[i].swizzle);
+   }
+
+   write_instruction(var->constant_value);
+   write_instruction(var->constant_initializer);
+   serialize_glsl_type(blob, var->interface_type);
+}
+
+
+void
+ir_serializer::write_constant(ir_constant *c)
+{
+   serialize_glsl_type(blob, c->type);
+
+   switch (c->type->base_type) {
+   case GLSL_TYPE_ARRAY:
+      for (unsigned i = 0; i < c->type->length; i++)
+         write_constant(c->array_elements[i]);
+      break;
+
+   case GLSL_TYPE_STRUCT:
+      foreach_list(node, &c->components)
+         write_constant((ir_constant *) node);
+      break;
+
+   default:
+      for (unsigned i = 0; i < c->type->components(); i++)
+         blob_write_uint32(blob, c->value.u[i]);
+      break;
+   }
+}
+
+
+void
+ir_serializer::write_texture(ir_texture *tex)
+{
+   blob_write_uint32(blob, tex->op);
+   serialize_glsl_type(blob, tex->type);
+   write_instruction(tex->sampler);
+   write_instruction(tex->coordinate);
+   write_instruction(tex->projector);
+   write_instruction(tex->shadow_comparitor);
+   write_instruction(tex->offset);
+
+   switch (tex->op) {
+   case ir_tex:
+   case ir_lod:
+      break;
+   case ir_txb:
+      write_instruction(tex->lod_info.bias);
+      break;
+   case ir_txl:
+   case ir_txf:
+   case ir_txs:
+      write_instruction(tex->lod_info.lod);
+      break;
+   case ir_txf_ms:
+      write_instruction(tex->lod_info.sample_index);
+      break;
+   case ir_txd:
+      write_instruction(tex->lod_info.grad.dPdx);
+      write_instruction(tex->lod_info.grad.dPdy);
+      break;
+   }
+}
+
+
+void
+ir_serializer::write_instruction(ir_instruction *ir)
+{
+   if (ir == NULL) {
+      blob_write_uint32(blob, ir_type_unset);
+      return;
+   }
+
+   blob_write_uint32(blob, ir->ir_type);
+
+   switch (ir->ir_type) {
+   case ir_type_variable:
+      write_variable((ir_variable *) ir);
+      break;
+
+   case ir_type_assignment: {
+      ir_assignment *assign = (ir_assignment *) ir;
+
+      write_instruction(assign->lhs);
+      write_instruction(assign->rhs);
+      write_instruction(assign->condition);
+      blob_write_uint32(blob, assign->write_mask);
+      break;
+   }
+
+   case ir_type_call: {
+      ir_call *call = (ir_call *) ir;
+      const int id = signatures.find(call->callee);
+
+      if (id < 0)
+         error = true;
+
+      blob_write_uint32(blob, id);
+      write_instruction(call->return_deref);
+      write_list(&call->actual_parameters);
+      break;
+   }
+
+   case ir_type_constant:
+      write_constant((ir_constant *) ir);
+      break;
+
+   case ir_type_dereference_array: {
+      ir_dereference_array *deref = (ir_dereference_array *) ir;
+
+      write_instruction(deref->array);
+      write_instruction(deref->array_index);
+      break;
+   }
+
+   case ir_type_dereference_record: {
+      ir_dereference_record *deref = (ir_dereference_record *) ir;
+
+      write_instruction(deref->record);
+      blob_write_string(blob, deref->field);
+      break;
+   }
+
+   case ir_type_dereference_variable:
+      write_variable_ref(((ir_dereference_variable *) ir)->var);
+      break;
+
+   case ir_type_discard:
+      write_instruction(((ir_discard *) ir)->condition);
+      break;
+
+   case ir_type_expression: {
+      ir_expression *expr = (ir_expression *) ir;
+
+      blob_write_uint32(blob, expr->operation);
+      serialize_glsl_type(blob, expr->type);
+      for (unsigned i = 0; i < expr->get_num_operands(); i++)
+         write_instruction(expr->operands[i]);
+      break;
+   }
+
+   case ir_type_function: {
+      ir_function *f = (ir_function *) ir;
+
+      blob_write_uint32(blob, functions.find(f));
+      foreach_list(node, &f->signatures) {
+         ir_function_signature *sig = (ir_function_signature *) node;
+
+         blob_write_uint32(blob, sig->is_defined);
+         write_list(&sig->body);
+      }
+      break;
+   }
+
+   case ir_type_if: {
+      ir_if *iff = (ir_if *) ir;
+
+      write_instruction(iff->condition);
+      write_list(&iff->then_instructions);
+      write_list(&iff->else_instructions);
+      break;
+   }
+
+   case ir_type_loop: {
+      ir_loop *loop = (ir_loop *) ir;
+
+      write_instruction(loop->from);
+      write_instruction(loop->to);
+      write_instruction(loop->increment);
+      if (loop->counter) {
+         blob_write_uint32(blob, 1);
+         write_variable_ref(loop->counter);
+      } else {
+         blob_write_uint32(blob, 0);
+      }
+      blob_write_uint32(blob, loop->cmp);
+      write_list(&loop->body_instructions);
+      break;
+   }
+
+   case ir_type_loop_jump:
+      blob_write_uint32(blob, ((ir_loop_jump *) ir)->mode);
+      break;
+
+   case ir_type_return:
+      write_instruction(((ir_return *) ir)->value);
+      break;
+
+   case ir_type_swizzle: {
+      ir_swizzle *swiz = (ir_swizzle *) ir;
+
+      write_instruction(swiz->val);
+      blob_write_uint32(blob, swiz->mask.x);
+      blob_write_uint32(blob, swiz->mask.y);
+      blob_write_uint32(blob, swiz->mask.z);
+      blob_write_uint32(blob, swiz->mask.w);
+      blob_write_uint32(blob, swiz->mask.num_components);
+      break;
+   }
+
+   case ir_type_texture:
+      write_texture((ir_texture *) ir);
+      break;
+
+   case ir_type_function_signature:
+   default:
+      /* Signatures are only written as part of their function. */
+      error = true;
+      break;
+   }
+}
+
+
+class ir_deserializer {
+public:
+   ir_deserializer(struct blob_reader *blob, void *mem_ctx)
+      : blob(blob), mem_ctx(mem_ctx), error(false), depth(0),
+        variables(NULL), num_variables(0),
+        functions(NULL), num_functions(0),
+        signatures(NULL), num_signatures(0)
+   {
+      this->ids_ctx = ralloc_context(NULL);
+   }
+
+   ~ir_deserializer()
+   {
+      ralloc_free(ids_ctx);
+   }
+
+   bool run(exec_list *instructions);
+
+private:
+   bool read_list(exec_list *list);
+   ir_instruction *read_instruction();
+   ir_instruction *read_instruction_body();
+   ir_rvalue *read_rvalue();
+   ir_dereference *read_dereference();
+   ir_variable *read_variable();
+   ir_variable *read_variable_ref();
+   ir_constant *read_constant();
+   ir_texture *read_texture();
+   const glsl_type *read_type();
+
+   bool failed()
+   {
+      return error || blob->overrun;
+   }
+
+   struct blob_reader *blob;
+   void *mem_ctx;
+   bool error;
+
+   /** Number of read_instruction() calls on the stack */
+   unsigned depth;
+
+   /** Allocation context for the tables below */
+   void *ids_ctx;
+
+   ir_variable **variables;
+   unsigned num_variables;
+   ir_function **functions;
+   unsigned num_functions;
+   ir_function_signature **signatures;
+   unsigned num_signatures;
+};
+
+
+bool
+ir_deserializer::run(exec_list *instructions)
+{
+   num_functions = blob_read_uint32(blob);
+   if (num_functions > (size_t) (blob->end - blob->current))
+      return false;
+
+   functions = ralloc_array(ids_ctx, ir_function *, num_functions);
+
+   for (unsigned i = 0; i < num_functions && !failed(); i++) {
+      const char *name = blob_read_string(blob);
+      const unsigned num_sigs = blob_read_uint32(blob);
+
+      if (name == NULL || num_sigs > (size_t) (blob->end - blob->current))
+         return false;
+
+      ir_function *f = new(mem_ctx) ir_function(name);
+      functions[i] = f;
+
+      signatures = reralloc(ids_ctx, signatures, ir_function_signature *,
+                            num_signatures + num_sigs);
+
+      for (unsigned j = 0; j < num_sigs && !failed(); j++) {
+         const glsl_type *return_type = read_type();
+         if (return_type == NULL)
+            return false;
+
+         ir_function_signature *sig =
+            new(mem_ctx) ir_function_signature(return_type);
+         sig->is_builtin = blob_read_uint32(blob) != 0;
+         read_list(&sig->parameters);
+
+         foreach_list(node, &sig->parameters) {
+            if (((ir_instruction *) node)->as_variable() == NULL)
+               return false;
+         }
+
+         f->add_signature(sig);
+         signatures[num_signatures++] = sig;
+      }
+   }
+
+   return read_list(instructions) && !failed();
+}
+
+
+const glsl_type *
+ir_deserializer::read_type()
+{
+   const glsl_type *type = deserialize_glsl_type(blob);
+
+   if (type == NULL)
+      error = true;
+
+   return type;
+}
+
+
+bool
+ir_deserializer::read_list(exec_list *list)
+{
+   while (!failed()) {
+      ir_instruction *ir = read_instruction();
+
+      if (ir == NULL)
+         break;
+
+      list->push_tail(ir);
+   }
+
+   return !failed();
+}
+
+
+ir_rvalue *
+ir_deserializer::read_rvalue()
+{
+   ir_instruction *ir = read_instruction();
+
+   if (ir == NULL)
+      return NULL;
+
+   ir_rvalue *rvalue = ir->as_rvalue();
+   if (rvalue == NULL)
+      error = true;
+
+   return rvalue;
+}
+
+
+ir_dereference *
+ir_deserializer::read_dereference()
+{
+   ir_rvalue *rvalue = read_rvalue();
+
+   if (rvalue == NULL)
+      return NULL;
+
+   ir_dereference *deref = rvalue->as_dereference();
+   if (deref == NULL)
+      error = true;
+
+   return deref;
+}
+
+
+ir_variable *
+ir_deserializer::read_variable_ref()
+{
+   const unsigned id = blob_read_uint32(blob);
+
+   if (id >= num_variables) {
+      error = true;
+      return NULL;
+   }
+
+   return variables[id];
+}
+
+
+ir_variable *
+ir_deserializer::read_variable()
+{
+   const glsl_type *type = read_type();
+   const char *name = blob_read_string(blob);
+
+   if (failed())
+      return NULL;
+
+   ir_variable *var = new(mem_ctx) ir_variable(type, name, ir_var_auto);
+
+   if ((num_variables & (num_variables + 1)) == 0 || num_variables == 0) {
+      variables = reralloc(ids_ctx, variables, ir_variable *,
+                           MAX2(2 * num_variables + 1, 64));
+   }
+   variables[num_variables++] = var;
+
+   var->max_array_access = blob_read_uint32(blob);
+   var->read_only = blob_read_uint32(blob);
+   var->centroid = blob_read_uint32(blob);
+   var->invariant = blob_read_uint32(blob);
+   var->used = blob_read_uint32(blob);
+   var->assigned = blob_read_uint32(blob);
+   var->mode = blob_read_uint32(blob);
+   var->interpolation = blob_read_uint32(blob);
+   var->origin_upper_left = blob_read_uint32(blob);
+   var->pixel_center_integer = blob_read_uint32(blob);
+   var->explicit_location = blob_read_uint32(blob);
+   var->explicit_index = blob_read_uint32(blob);
+   var->has_initializer = blob_read_uint32(blob);
+   var->is_unmatched_generic_inout = blob_read_uint32(blob);
+   var->location_frac = blob_read_uint32(blob);
+   var->depth_layout = (ir_depth_layout) blob_read_uint32(blob);
+   var->location = blob_read_uint32(blob);
+   var->index = blob_read_uint32(blob);
+
+   var->num_state_slots = blob_read_uint32(blob);
+   if (var->num_state_slots > (size_t) (blob->end - blob->current)) {
+      error = true;
+      return NULL;
+   }
+
+   if (var->num_state_slots) {
+      var->state_slots = ralloc_array(var, ir_state_slot,
+                                      var->num_state_slots);
+      for (unsigned i = 0; i < var->num_state_slots; i++) {
+         for (unsigned j = 0; j < Elements(var->state_slots[i].tokens); j++)
+            var->state_slots[i].tokens[j] = blob_read_uint32(blob);
+         var->state_slots[i].swizzle = blob_read_uint32(blob);
+      }
+   }
+
+   var->constant_value = (ir_constant *) read_rvalue();
+   var->constant_initializer = (ir_constant *) read_rvalue();
+   if ((var->constant_value && !var->constant_value->as_constant()) ||
+       (var->constant_initializer &&
+        !var->constant_initializer->as_constant())) {
+      error = true;
+      return NULL;
+   }
+
+   var->interface_type = deserialize_glsl_type(blob);
+
+   return var;
+}
+
+
+ir_constant *
+ir_deserializer::read_constant()
+{
+   const glsl_type *type = read_type();
+
+   if (type == NULL)
+      return NULL;
+
+   switch (type->base_type) {
+   case GLSL_TYPE_ARRAY:
+   case GLSL_TYPE_STRUCT: {
+      const unsigned count = type->length;
+      exec_list values;
+
+      for (unsigned i = 0; i < count && !failed(); i++) {
+         ir_constant *value = read_constant();
+
+         if (value != NULL)
+            values.push_tail(value);
+      }
+
+      if (failed())
+         return NULL;
+
+      return new(mem_ctx) ir_constant(type, &values);
+   }
+
+   case GLSL_TYPE_UINT:
+   case GLSL_TYPE_INT:
+   case GLSL_TYPE_FLOAT:
+   case GLSL_TYPE_BOOL: {
+      ir_constant_data data;
+
+      memset(&data, 0, sizeof(data));
+      for (unsigned i = 0; i < type->components(); i++)
+         data.u[i] = blob_read_uint32(blob);
+
+      return new(mem_ctx) ir_constant(type, &data);
+   }
+
+   default:
+      error = true;
+      return NULL;
+   }
+}
+
+
+ir_texture *
+ir_deserializer::read_texture()
+{
+   const unsigned op = blob_read_uint32(blob);
+
+   if (op > ir_lod) {
+      error = true;
+      return NULL;
+   }
+
+   ir_texture *tex = new(mem_ctx) ir_texture((ir_texture_opcode) op);
+   const glsl_type *type = read_type();
+   ir_dereference *sampler = read_dereference();
+
+   if (failed() || sampler == NULL) {
+      error = true;
+      return NULL;
+   }
+
+   tex->set_sampler(sampler, type);
+   tex->coordinate = read_rvalue();
+   tex->projector = read_rvalue();
+   tex->shadow_comparitor = read_rvalue();
+   tex->offset = read_rvalue();
+
+   switch (tex->op) {
+   case ir_tex:
+   case ir_lod:
+      break;
+   case ir_txb:
+      tex->lod_info.bias = read_rvalue();
+      break;
+   case ir_txl:
+   case ir_txf:
+   case ir_txs:
+      tex->lod_info.lod = read_rvalue();
+      break;
+   case ir_txf_ms:
+      tex->lod_info.sample_index = read_rvalue();
+      break;
+   case ir_txd:
+      tex->lod_info.grad.dPdx = read_rvalue();
+      tex->lod_info.grad.dPdy = read_rvalue();
+      break;
+   }
+
+   return tex;
+}
+
+
+ir_instruction *
+ir_deserializer::read_instruction()
+{
+   if (depth >= MAX_IR_DEPTH) {
+      error = true;
+      return NULL;
+   }
+
+   depth++;
+   ir_instruction *ir = read_instruction_body();
+   depth--;
+
+   return ir;
+}
+
+
+ir_instruction *
+ir_deserializer::read_instruction_body()
+{
+   const unsigned ir_type = blob_read_uint32(blob);
+
+   if (failed())
+      return NULL;
+
+   switch (ir_type) {
+   case ir_type_unset:
+      return NULL;
+
+   case ir_type_variable:
+      return read_variable();
+
+   case ir_type_assignment: {
+      ir_dereference *lhs = read_dereference();
+      ir_rvalue *rhs = read_rvalue();
+      ir_rvalue *condition = read_rvalue();
+      const unsigned write_mask = blob_read_uint32(blob);
+
+      if (failed() || lhs == NULL || rhs == NULL)
+         break;
+
+      return new(mem_ctx) ir_assignment(lhs, rhs, condition, write_mask);
+   }
+
+   case ir_type_call: {
+      const unsigned id = blob_read_uint32(blob);
+      ir_rvalue *return_deref = read_rvalue();
+      exec_list actual_parameters;
+
+      read_list(&actual_parameters);
+
+      if (failed() || id >= num_signatures ||
+          (return_deref && !return_deref->as_dereference_variable()))
+         break;
+
+      return new(mem_ctx) ir_call(signatures[id],
+                                  (ir_dereference_variable *) return_deref,
+                                  &actual_parameters);
+   }
+
+   case ir_type_constant:
+      return read_constant();
+
+   case ir_type_dereference_array: {
+      ir_rvalue *array = read_rvalue();
+      ir_rvalue *array_index = read_rvalue();
+
+      if (failed() || array == NULL || array_index == NULL)
+         break;
+
+      return new(mem_ctx) ir_dereference_array(array, array_index);
+   }
+
+   case ir_type_dereference_record: {
+      ir_rvalue *record = read_rvalue();
+      const char *field = blob_read_string(blob);
+
+      if (failed() || record == NULL || field == NULL ||
+          (!record->type->is_record() && !record->type->is_interface()))
+         break;
+
+      return new(mem_ctx) ir_dereference_record(record, field);
+   }
+
+   case ir_type_dereference_variable: {
+      ir_variable *var = read_variable_ref();
+
+      if (var == NULL)
+         break;
+
+      return new(mem_ctx) ir_dereference_variable(var);
+   }
+
+   case ir_type_discard: {
+      ir_rvalue *condition = read_rvalue();
+
+      if (failed())
+         break;
+
+      return new(mem_ctx) ir_discard(condition);
+   }
+
+   case ir_type_expression: {
+      const unsigned op = blob_read_uint32(blob);
+      const glsl_type *type = read_type();
+      ir_rvalue *operands[4] = { NULL, NULL, NULL, NULL };
+
+      if (failed() || op > ir_last_opcode)
+         break;
+
+      ir_expression *expr =
+         new(mem_ctx) ir_expression(op, type, NULL, NULL, NULL, NULL);
+      for (unsigned i = 0; i < expr->get_num_operands(); i++) {
+         operands[i] = read_rvalue();
+         if (operands[i] == NULL)
+            error = true;
+      }
+
+      if (failed())
+         break;
+
+      for (unsigned i = 0; i < Elements(operands); i++)
+         expr->operands[i] = operands[i];
+
+      return expr;
+   }
+
+   case ir_type_function: {
+      const unsigned id = blob_read_uint32(blob);
+
+      if (id >= num_functions)
+         break;
+
+      ir_function *f = functions[id];
+
+      foreach_list(node, &f->signatures) {
+         ir_function_signature *sig = (ir_function_signature *) node;
+
+         sig->is_defined = blob_read_uint32(blob) != 0;
+         if (!read_list(&sig->body))
+            return NULL;
+      }
+
+      return f;
+   }
+
+   case ir_type_if: {
+      ir_rvalue *condition = read_rvalue();
+
+      if (failed() || condition == NULL)
+         break;
+
+      ir_if *iff = new(mem_ctx) ir_if(condition);
+      read_list(&iff->then_instructions);
+      read_list(&iff->else_instructions);
+
+      return iff;
+   }
+
+   case ir_type_loop: {
+      ir_loop *loop = new(mem_ctx) ir_loop();
+
+      loop->from = read_rvalue();
+      loop->to = read_rvalue();
+      loop->increment = read_rvalue();
+      if (blob_read_uint32(blob))
+         loop->counter = read_variable_ref();
+      loop->cmp = blob_read_uint32(blob);
+      read_list(&loop->body_instructions);
+
+      return loop;
+   }
+
+   case ir_type_loop_jump: {
+      const unsigned mode = blob_read_uint32(blob);
+
+      if (mode != ir_loop_jump::jump_break &&
+          mode != ir_loop_jump::jump_continue)
+         break;
+
+      return new(mem_ctx) ir_loop_jump((ir_loop_jump::jump_mode) mode);
+   }
+
+   case ir_type_return: {
+      ir_rvalue *value = read_rvalue();
+
+      if (failed())
+         break;
+
+      return new(mem_ctx) ir_return(value);
+   }
+
+   case ir_type_swizzle: {
+      ir_rvalue *val = read_rvalue();
+      const unsigned x = blob_read_uint32(blob);
+      const unsigned y = blob_read_uint32(blob);
+      const unsigned z = blob_read_uint32(blob);
+      const unsigned w = blob_read_uint32(blob);
+      const unsigned count = blob_read_uint32(blob);
+
+      if (failed() || val == NULL || count < 1 || count > 4 ||
+          x > 3 || y > 3 || z > 3 || w > 3)
+         break;
+
+      return new(mem_ctx) ir_swizzle(val, x, y, z, w, count);
+   }
+
+   case ir_type_texture:
+      return read_texture();
+
+   default:
+      break;
+   }
+
+   error = true;
+   return NULL;
+}
+
+} /* anonymous namespace */
+
+
+bool
+serialize_ir(struct blob *blob, exec_list *instructions)
+{
+   ir_serializer s(blob);
+
+   return s.run(instructions);
+}
+
+
+bool
+deserialize_ir(struct blob_reader *blob, void *mem_ctx,
+               exec_list *instructions)
+{
+   ir_deserializer d(blob, mem_ctx);
+
+   return d.run(instructions);
+}
+
+
+static void
+serialize_uniform_blocks(struct blob *blob, const struct gl_shader *sh)
+{
+   blob_write_uint32(blob, sh->NumUniformBlocks);
+   for (unsigned i = 0; i < sh->NumUniformBlocks; i++) {
+      const struct gl_uniform_block *block = &sh->UniformBlocks[i];
+
+      blob_write_string(blob, block->Name);
+      blob_write_uint32(blob, block->NumUniforms);
+      for (unsigned j = 0; j < block->NumUniforms; j++) {
+         const struct gl_uniform_buffer_variable *var = &block->Uniforms[j];
+         const bool same_name = var->IndexName == var->Name;
+
+         blob_write_string(blob, var->Name);
+         blob_write_uint32(blob, same_name);
+         if (!same_name)
+            blob_write_string(blob, var->IndexName);
+         serialize_glsl_type(blob, var->Type);
+         blob_write_uint32(blob, var->Offset);
+         blob_write_uint32(blob, var->RowMajor);
+      }
+      blob_write_uint32(blob, block->Binding);
+      blob_write_uint32(blob, block->UniformBufferSize);
+      blob_write_uint32(blob, block->_Packing);
+   }
+}
+
+
+static bool
+deserialize_uniform_blocks(struct blob_reader *blob, struct gl_shader *sh)
+{
+   const unsigned num_blocks = blob_read_uint32(blob);
+
+   if (num_blocks > (size_t) (blob->end - blob->current))
+      return false;
+
+   sh->UniformBlocks = rzalloc_array(sh, struct gl_uniform_block, num_blocks);
+   sh->NumUniformBlocks = num_blocks;
+
+   for (unsigned i = 0; i < num_blocks && !blob->overrun; i++) {
+      struct gl_uniform_block *block = &sh->UniformBlocks[i];
+      const char *name = blob_read_string(blob);
+      const unsigned num_uniforms = blob_read_uint32(blob);
+
+      if (name == NULL ||
+          num_uniforms > (size_t) (blob->end - blob->current))
+         return false;
+
+      block->Name = ralloc_strdup(sh->UniformBlocks, name);
+      block->Uniforms = rzalloc_array(sh->UniformBlocks,
+                                      struct gl_uniform_buffer_variable,
+                                      num_uniforms);
+      block->NumUniforms = num_uniforms;
+
+      for (unsigned j = 0; j < num_uniforms; j++) {
+         struct gl_uniform_buffer_variable *var = &block->Uniforms[j];
+         const char *var_name = blob_read_string(blob);
+
+         if (var_name == NULL)
+            return false;
+
+         var->Name = ralloc_strdup(sh->UniformBlocks, var_name);
+         if (blob_read_uint32(blob)) {
+            var->IndexName = var->Name;
+         } else {
+            const char *index_name = blob_read_string(blob);
+
+            if (index_name == NULL)
+               return false;
+            var->IndexName = ralloc_strdup(sh->UniformBlocks, index_name);
+         }
+         var->Type = deserialize_glsl_type(blob);
+         var->Offset = blob_read_uint32(blob);
+         var->RowMajor = blob_read_uint32(blob);
+
+         if (var->Type == NULL)
+            return false;
+      }
+
+      block->Binding = blob_read_uint32(blob);
+      block->UniformBufferSize = blob_read_uint32(blob);
+      block->_Packing = (enum gl_uniform_block_packing) blob_read_uint32(blob);
+   }
+
+   return !blob->overrun;
+}
+
+
+/**
+ * Serialize the result of link_shaders(): the linked IR of each stage along
+ * with the program state the linker derived from it, except for what
+ * link_finish_restored_program() recomputes.
+ *
+ * \return false if the program can't be serialized
+ */
+extern "C" bool
+serialize_glsl_program(struct blob *blob, struct gl_shader_program *prog)
+{
+   const struct gl_transform_feedback_info *xfb =
+      &prog->LinkedTransformFeedback;
+
+   blob_write_uint32(blob, prog->Version);
+   blob_write_uint32(blob, prog->IsES);
+   blob_write_string(blob, prog->InfoLog);
+
+   blob_write_uint32(blob, prog->FragDepthLayout);
+   blob_write_uint32(blob, prog->Vert.UsesClipDistance);
+   blob_write_uint32(blob, prog->Vert.ClipDistanceArraySize);
+   blob_write_uint32(blob, prog->Geom.VerticesOut);
+   blob_write_uint32(blob, prog->Geom.InputType);
+   blob_write_uint32(blob, prog->Geom.OutputType);
+
+   blob_write_uint32(blob, xfb->NumOutputs);
+   blob_write_uint32(blob, xfb->NumBuffers);
+   for (unsigned i = 0; i < xfb->NumOutputs; i++) {
+      blob_write_uint32(blob, xfb->Outputs[i].OutputRegister);
+      blob_write_uint32(blob, xfb->Outputs[i].OutputBuffer);
+      blob_write_uint32(blob, xfb->Outputs[i].NumComponents);
+      blob_write_uint32(blob, xfb->Outputs[i].DstOffset);
+      blob_write_uint32(blob, xfb->Outputs[i].ComponentOffset);
+   }
+   blob_write_uint32(blob, xfb->NumVarying);
+   for (int i = 0; i < xfb->NumVarying; i++) {
+      blob_write_string(blob, xfb->Varyings[i].Name);
+      blob_write_uint32(blob, xfb->Varyings[i].Type);
+      blob_write_uint32(blob, xfb->Varyings[i].Size);
+   }
+   for (unsigned i = 0; i < MAX_FEEDBACK_BUFFERS; i++)
+      blob_write_uint32(blob, xfb->BufferStride[i]);
+
+   for (unsigned i = 0; i < MESA_SHADER_TYPES; i++) {
+      struct gl_shader *sh = prog->_LinkedShaders[i];
+
+      blob_write_uint32(blob, sh != NULL);
+      if (sh == NULL)
+         continue;
+
+      blob_write_uint32(blob, sh->Type);
+      serialize_uniform_blocks(blob, sh);
+      if (!serialize_ir(blob, sh->ir))
+         return false;
+   }
+
+   return !blob->out_of_memory;
+}
+
+
+/**
+ * Restore a program serialized by serialize_glsl_program(), in place of
+ * calling link_shaders().  The driver's LinkShader hook still has to be
+ * called afterwards.
+ *
+ * \return false if the data is truncated or malformed, in which case the
+ *         program is left unlinked
+ */
+extern "C" bool
+deserialize_glsl_program(struct blob_reader *blob, struct gl_context *ctx,
+                         struct gl_shader_program *prog)
+{
+   struct gl_transform_feedback_info *xfb = &prog->LinkedTransformFeedback;
+
+   prog->LinkStatus = false;
+   prog->Validated = false;
+   prog->_Used = false;
+
+   for (unsigned i = 0; i < MESA_SHADER_TYPES; i++) {
+      if (prog->_LinkedShaders[i] != NULL)
+         ctx->Driver.DeleteShader(ctx, prog->_LinkedShaders[i]);
+
+      prog->_LinkedShaders[i] = NULL;
+   }
+
+   prog->Version = blob_read_uint32(blob);
+   prog->IsES = blob_read_uint32(blob);
+
+   const char *info_log = blob_read_string(blob);
+   ralloc_free(prog->InfoLog);
+   prog->InfoLog = ralloc_strdup(NULL, info_log ? info_log : "");
+
+   prog->FragDepthLayout = (enum gl_frag_depth_layout) blob_read_uint32(blob);
+   prog->Vert.UsesClipDistance = blob_read_uint32(blob);
+   prog->Vert.ClipDistanceArraySize = blob_read_uint32(blob);
+   prog->Geom.VerticesOut = blob_read_uint32(blob);
+   prog->Geom.InputType = blob_read_uint32(blob);
+   prog->Geom.OutputType = blob_read_uint32(blob);
+
+   ralloc_free(xfb->Varyings);
+   ralloc_free(xfb->Outputs);
+   memset(xfb, 0, sizeof(*xfb));
+
+   const unsigned num_outputs = blob_read_uint32(blob);
+   if (num_outputs > (size_t) (blob->end - blob->current))
+      return false;
+
+   xfb->NumBuffers = blob_read_uint32(blob);
+   xfb->Outputs = rzalloc_array(prog, struct gl_transform_feedback_output,
+                                num_outputs);
+   xfb->NumOutputs = num_outputs;
+   for (unsigned i = 0; i < num_outputs; i++) {
+      xfb->Outputs[i].OutputRegister = blob_read_uint32(blob);
+      xfb->Outputs[i].OutputBuffer = blob_read_uint32(blob);
+      xfb->Outputs[i].NumComponents = blob_read_uint32(blob);
+      xfb->Outputs[i].DstOffset = blob_read_uint32(blob);
+      xfb->Outputs[i].ComponentOffset = blob_read_uint32(blob);
+   }
+
+   const unsigned num_varying = blob_read_uint32(blob);
+   if (num_varying > (size_t) (blob->end - blob->current))
+      return false;
+
+   xfb->Varyings = rzalloc_array(prog,
+                                 struct gl_transform_feedback_varying_info,
+                                 num_varying);
+   xfb->NumVarying = num_varying;
+   for (unsigned i = 0; i < num_varying; i++) {
+      const char *name = blob_read_string(blob);
+
+      if (name == NULL)
+         return false;
+
+      xfb->Varyings[i].Name = ralloc_strdup(xfb->Varyings, name);
+      xfb->Varyings[i].Type = blob_read_uint32(blob);
+      xfb->Varyings[i].Size = blob_read_uint32(blob);
+   }
+   for (unsigned i = 0; i < MAX_FEEDBACK_BUFFERS; i++)
+      xfb->BufferStride[i] = blob_read_uint32(blob);
+
+   for (unsigned i = 0; i < MESA_SHADER_TYPES && !blob->overrun; i++) {
+      if (!blob_read_uint32(blob))
+         continue;
+
+      const GLenum type = blob_read_uint32(blob);
+      if ((type != GL_VERTEX_SHADER && type != GL_FRAGMENT_SHADER &&
+           type != GL_GEOMETRY_SHADER) ||
+          _mesa_shader_type_to_index(type) != i)
+         return false;
+
+      struct gl_shader *sh = ctx->Driver.NewShader(NULL, 0, type);
+      sh->ir = new(sh) exec_list;
+      _mesa_reference_shader(ctx, &prog->_LinkedShaders[i], sh);
+
+      if (!deserialize_uniform_blocks(blob, sh) ||
+          !deserialize_ir(blob, sh->ir, sh->ir))
+         return false;
+   }
+
+   if (blob->overrun || blob->current != blob->end)
+      return false;
+
+   if (!link_finish_restored_program(prog))
+      return false;
+
+   prog->LinkStatus = true;
+   return true;
+}
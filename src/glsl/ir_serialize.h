@@ -0,0 +1,113 @@
+/*
+ * Copyright © 2014 VMware, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file ir_serialize.h
+ *
+ * Binary serialization of GLSL IR and of linked shader programs.
+ *
+ * This is used for glGetProgramBinary() and for the on-disk shader cache.
+ * The data is only meant to be read back by the same build of Mesa: it
+ * stores enum values and bitfields as they are in memory, and is
+ * versioned as a whole rather than being kept compatible.
+ */
+
+#pragma once
+#ifndef IR_SERIALIZE_H
+#define IR_SERIALIZE_H
+
+#include <stdbool.h>
+
+#include "blob.h"
+
+/**
+ * Version of the serialized format.  Bump whenever ir_serialize.cpp
+ * changes what it writes, or how it's read back.
+ */
+#define IR_SERIALIZE_VERSION 1
+
+#ifdef __cplusplus
+
+#include "ir.h"
+
+/**
+ * Serialize a list of IR instructions, as found in a linked shader.
+ *
+ * Every variable must be declared before it's dereferenced, and every
+ * function that's called must be defined in the same list.
+ *
+ * \return false if the IR cannot be serialized
+ */
+extern bool
+serialize_ir(struct blob *blob, exec_list *instructions);
+
+/**
+ * Read back the instructions written by serialize_ir(), allocating them
+ * with \c mem_ctx as the parent.
+ *
+ * \return false if the data is corrupt
+ */
+extern bool
+deserialize_ir(struct blob_reader *blob, void *mem_ctx,
+               exec_list *instructions);
+
+extern void
+serialize_glsl_type(struct blob *blob, const glsl_type *type);
+
+/**
+ * \return the type, or NULL if the data is corrupt or the type was NULL
+ */
+extern const glsl_type *
+deserialize_glsl_type(struct blob_reader *blob);
+
+extern "C" {
+#endif
+
+struct gl_context;
+struct gl_shader_program;
+
+/**
+ * Serialize the state of a program that's been linked by link_shaders(),
+ * before the driver's LinkShader hook has run.
+ *
+ * \return false if the program cannot be serialized
+ */
+extern bool
+serialize_glsl_program(struct blob *blob, struct gl_shader_program *prog);
+
+/**
+ * Restore the state written by serialize_glsl_program() into \c prog, as
+ * if link_shaders() had just been called on it.
+ *
+ * \return false if the data is corrupt, in which case \c prog must be
+ * relinked
+ */
+extern bool
+deserialize_glsl_program(struct blob_reader *blob, struct gl_context *ctx,
+                         struct gl_shader_program *prog);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* IR_SERIALIZE_H */
@@ -1059,8 +1059,13 @@ link_intrastage_shaders(void *mem_ctx,
 
    assert(idx == num_linking_shaders);
 
-   if (!link_function_calls(prog, linked, linking_shaders,
-			    num_linking_shaders)) {
+   /* The built-in shaders are shared with other compiler threads */
+   _mesa_glsl_lock_functions();
+   const bool calls_linked = link_function_calls(prog, linked, linking_shaders,
+                                                 num_linking_shaders);
+   _mesa_glsl_unlock_functions();
+
+   if (!calls_linked) {
       ctx->Driver.DeleteShader(ctx, linked);
       linked = NULL;
    }
@@ -1767,8 +1772,7 @@ link_shaders(struct gl_context *ctx, struct gl_shader_program *prog)
 
       unsigned max_unroll = ctx->ShaderCompilerOptions[i].MaxUnrollIterations;
 
-      while (do_common_optimization(prog->_LinkedShaders[i]->ir, true, false, max_unroll))
-	 ;
+      do_common_optimization(prog->_LinkedShaders[i]->ir, true, false, max_unroll);
    }
 
    /* Mark all generic shader inputs and outputs as unpaired. */
@@ -1931,3 +1935,31 @@ done:
 
    ralloc_free(mem_ctx);
 }
+
+
+/**
+ * Rebuild the program state that link_shaders() derives from the linked
+ * shaders, for a program whose _LinkedShaders were restored from a binary.
+ *
+ * This is the program-wide list of uniform blocks and the uniform storage,
+ * which is cheaper to recompute than to serialize, and comes out the same
+ * for the same linked IR.
+ */
+bool
+link_finish_restored_program(struct gl_shader_program *prog)
+{
+   ralloc_free(prog->UniformBlocks);
+   prog->UniformBlocks = NULL;
+   prog->NumUniformBlocks = 0;
+   for (int i = 0; i < MESA_SHADER_TYPES; i++) {
+      ralloc_free(prog->UniformBlockStageIndex[i]);
+      prog->UniformBlockStageIndex[i] = NULL;
+   }
+
+   if (!interstage_cross_validate_uniform_blocks(prog))
+      return false;
+
+   link_assign_uniform_locations(prog);
+
+   return true;
+}
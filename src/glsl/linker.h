@@ -40,6 +40,9 @@ link_assign_uniform_locations(struct gl_shader_program *prog);
 extern void
 link_set_uniform_initializers(struct gl_shader_program *prog);
 
+extern bool
+link_finish_restored_program(struct gl_shader_program *prog);
+
 extern int
 link_cross_validate_uniform_block(void *mem_ctx,
 				  struct gl_uniform_block **linked_blocks,
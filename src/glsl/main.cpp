@@ -21,6 +21,7 @@
  * DEALINGS IN THE SOFTWARE.
  */
 #include <getopt.h>
+#include <sys/resource.h>
 
 /** @file main.cpp
  *
@@ -109,6 +110,7 @@ int dump_ast = 0;
 int dump_hir = 0;
 int dump_lir = 0;
 int do_link = 0;
+int print_time = 0;
 
 const struct option compiler_opts[] = {
    { "glsl-es",  0, &glsl_es,  1 },
@@ -116,6 +118,7 @@ const struct option compiler_opts[] = {
    { "dump-hir", 0, &dump_hir, 1 },
    { "dump-lir", 0, &dump_lir, 1 },
    { "link",     0, &do_link,  1 },
+   { "time",     0, &print_time, 1 },
    { NULL, 0, NULL, 0 }
 };
 
@@ -174,10 +177,7 @@ compile_shader(struct gl_context *ctx, struct gl_shader *shader)
 
    /* Optimization passes */
    if (!state->error && !shader->ir->is_empty()) {
-      bool progress;
-      do {
-	 progress = do_common_optimization(shader->ir, false, false, 32);
-      } while (progress);
+      do_common_optimization(shader->ir, false, false, 32);
 
       validate_ir_tree(shader->ir);
    }
@@ -288,5 +288,16 @@ main(int argc, char **argv)
    _mesa_glsl_release_types();
    _mesa_glsl_release_functions();
 
+   /* For comparing the compile time and memory use of builds */
+   if (print_time) {
+      struct rusage usage;
+
+      getrusage(RUSAGE_SELF, &usage);
+      printf("CPU time: %.3f s, peak RSS: %ld KiB\n",
+             usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+             (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6,
+             usage.ru_maxrss);
+   }
+
    return status;
 }
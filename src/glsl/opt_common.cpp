@@ -0,0 +1,510 @@
+/*
+ * Copyright © 2014 VMware, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file opt_common.cpp
+ *
+ * The common set of optimization passes, run to a fixed point.
+ *
+ * Instead of rerunning every pass over the whole program until a full round
+ * makes no progress, each pass is only rerun where something changed since
+ * it last ran.  Most passes only look at one function at a time, and are
+ * run function by function: a pass that makes progress on a function
+ * invalidates the results of the other passes on that function only.  The
+ * passes that look across functions, such as inlining or dead code
+ * elimination, run over the whole program whenever anything changed, and
+ * invalidate everything when they make progress themselves.
+ *
+ * Setting MESA_GLSL_OPT_STATS prints the number of runs, the number of runs
+ * making progress, and the time spent in each pass when the compiler is torn
+ * down.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "main/core.h" /* for Elements() */
+#include "glapi/glthread.h"
+#include "ralloc.h"
+#include "ir.h"
+#include "ir_optimization.h"
+#include "loop_analysis.h"
+
+namespace {
+
+struct opt_params {
+   bool linked;
+   bool uniform_locations_assigned;
+   unsigned max_unroll_iterations;
+};
+
+enum opt_scope {
+   /** The pass only looks at one function at a time */
+   OPT_SCOPE_FUNCTION,
+   /** The pass needs to see the whole program */
+   OPT_SCOPE_PROGRAM
+};
+
+struct opt_pass {
+   const char *name;
+   bool (*run)(exec_list *ir, const opt_params *params);
+   opt_scope scope;
+   /** Only run on linked programs */
+   bool linked_only;
+};
+
+struct opt_pass_stats {
+   unsigned runs;
+   unsigned progress;
+   clock_t time;
+};
+
+} /* anonymous namespace */
+
+
+static bool
+run_lower_sub(exec_list *ir, const opt_params *)
+{
+   return lower_instructions(ir, SUB_TO_ADD_NEG);
+}
+
+static bool
+run_function_inlining(exec_list *ir, const opt_params *)
+{
+   return do_function_inlining(ir);
+}
+
+static bool
+run_dead_functions(exec_list *ir, const opt_params *)
+{
+   return do_dead_functions(ir);
+}
+
+static bool
+run_structure_splitting(exec_list *ir, const opt_params *)
+{
+   return do_structure_splitting(ir);
+}
+
+static bool
+run_if_simplification(exec_list *ir, const opt_params *)
+{
+   return do_if_simplification(ir);
+}
+
+static bool
+run_flatten_nested_if_blocks(exec_list *ir, const opt_params *)
+{
+   return opt_flatten_nested_if_blocks(ir);
+}
+
+static bool
+run_copy_propagation(exec_list *ir, const opt_params *)
+{
+   return do_copy_propagation(ir);
+}
+
+static bool
+run_copy_propagation_elements(exec_list *ir, const opt_params *)
+{
+   return do_copy_propagation_elements(ir);
+}
+
+static bool
+run_dead_code(exec_list *ir, const opt_params *params)
+{
+   if (params->linked)
+      return do_dead_code(ir, params->uniform_locations_assigned);
+   else
+      return do_dead_code_unlinked(ir);
+}
+
+static bool
+run_dead_code_local(exec_list *ir, const opt_params *)
+{
+   return do_dead_code_local(ir);
+}
+
+static bool
+run_tree_grafting(exec_list *ir, const opt_params *)
+{
+   return do_tree_grafting(ir);
+}
+
+static bool
+run_constant_propagation(exec_list *ir, const opt_params *)
+{
+   return do_constant_propagation(ir);
+}
+
+static bool
+run_constant_variable(exec_list *ir, const opt_params *params)
+{
+   if (params->linked)
+      return do_constant_variable(ir);
+   else
+      return do_constant_variable_unlinked(ir);
+}
+
+static bool
+run_constant_folding(exec_list *ir, const opt_params *)
+{
+   return do_constant_folding(ir);
+}
+
+static bool
+run_algebraic(exec_list *ir, const opt_params *)
+{
+   return do_algebraic(ir);
+}
+
+static bool
+run_lower_jumps(exec_list *ir, const opt_params *)
+{
+   return do_lower_jumps(ir);
+}
+
+static bool
+run_vec_index_to_swizzle(exec_list *ir, const opt_params *)
+{
+   return do_vec_index_to_swizzle(ir);
+}
+
+static bool
+run_swizzle_swizzle(exec_list *ir, const opt_params *)
+{
+   return do_swizzle_swizzle(ir);
+}
+
+static bool
+run_noop_swizzle(exec_list *ir, const opt_params *)
+{
+   return do_noop_swizzle(ir);
+}
+
+static bool
+run_split_arrays(exec_list *ir, const opt_params *params)
+{
+   return optimize_split_arrays(ir, params->linked);
+}
+
+static bool
+run_redundant_jumps(exec_list *ir, const opt_params *)
+{
+   return optimize_redundant_jumps(ir);
+}
+
+static bool
+run_loops(exec_list *ir, const opt_params *params)
+{
+   bool progress = false;
+   loop_state *ls = analyze_loop_variables(ir);
+
+   if (ls->loop_found) {
+      progress = set_loop_controls(ir, ls) || progress;
+      progress = unroll_loops(ir, ls, params->max_unroll_iterations)
+         || progress;
+   }
+   delete ls;
+
+   return progress;
+}
+
+
+/**
+ * The passes, in the order they run in.
+ *
+ * Tree grafting counts the references to variables, and array splitting
+ * rewrites declarations at global scope, so those need the whole program
+ * even though they mostly work within functions.
+ */
+static const opt_pass passes[] = {
+   { "lower_instructions", run_lower_sub, OPT_SCOPE_FUNCTION, false },
+   { "function_inlining", run_function_inlining, OPT_SCOPE_PROGRAM, true },
+   { "dead_functions", run_dead_functions, OPT_SCOPE_PROGRAM, true },
+   { "structure_splitting", run_structure_splitting, OPT_SCOPE_PROGRAM, true },
+   { "if_simplification", run_if_simplification, OPT_SCOPE_FUNCTION, false },
+   { "flatten_nested_if_blocks", run_flatten_nested_if_blocks,
+     OPT_SCOPE_FUNCTION, false },
+   { "copy_propagation", run_copy_propagation, OPT_SCOPE_FUNCTION, false },
+   { "copy_propagation_elements", run_copy_propagation_elements,
+     OPT_SCOPE_FUNCTION, false },
+   { "dead_code", run_dead_code, OPT_SCOPE_PROGRAM, false },
+   { "dead_code_local", run_dead_code_local, OPT_SCOPE_FUNCTION, false },
+   { "tree_grafting", run_tree_grafting, OPT_SCOPE_PROGRAM, false },
+   { "constant_propagation", run_constant_propagation,
+     OPT_SCOPE_FUNCTION, false },
+   { "constant_variable", run_constant_variable, OPT_SCOPE_PROGRAM, false },
+   { "constant_folding", run_constant_folding, OPT_SCOPE_FUNCTION, false },
+   { "algebraic", run_algebraic, OPT_SCOPE_FUNCTION, false },
+   { "lower_jumps", run_lower_jumps, OPT_SCOPE_FUNCTION, false },
+   { "vec_index_to_swizzle", run_vec_index_to_swizzle,
+     OPT_SCOPE_FUNCTION, false },
+   { "swizzle_swizzle", run_swizzle_swizzle, OPT_SCOPE_FUNCTION, false },
+   { "noop_swizzle", run_noop_swizzle, OPT_SCOPE_FUNCTION, false },
+   { "split_arrays", run_split_arrays, OPT_SCOPE_PROGRAM, false },
+   { "redundant_jumps", run_redundant_jumps, OPT_SCOPE_FUNCTION, false },
+   { "loops", run_loops, OPT_SCOPE_FUNCTION, false },
+};
+
+static opt_pass_stats stats[Elements(passes)];
+
+/** Shaders may be optimized on several threads at once */
+_glthread_DECLARE_STATIC_MUTEX(stats_mutex);
+
+
+static bool
+stats_enabled()
+{
+   static int enabled = -1;
+
+   if (enabled < 0)
+      enabled = getenv("MESA_GLSL_OPT_STATS") != NULL;
+
+   return enabled != 0;
+}
+
+
+static bool
+run_pass(unsigned p, exec_list *ir, const opt_params *params)
+{
+   if (!stats_enabled())
+      return passes[p].run(ir, params);
+
+   const clock_t start = clock();
+   const bool progress = passes[p].run(ir, params);
+
+   const clock_t end = clock();
+
+   _glthread_LOCK_MUTEX(stats_mutex);
+   stats[p].time += end - start;
+   stats[p].runs++;
+   if (progress)
+      stats[p].progress++;
+   _glthread_UNLOCK_MUTEX(stats_mutex);
+
+   return progress;
+}
+
+
+/**
+ * Run a pass on a single function, by moving it to a list of its own for
+ * the duration of the pass.
+ */
+static bool
+run_pass_on_function(unsigned p, ir_function *f, const opt_params *params)
+{
+   exec_node *const prev = f->get_prev();
+   exec_list list;
+
+   f->remove();
+   list.push_tail(f);
+
+   const bool progress = run_pass(p, &list, params);
+
+   assert(list.get_head() == f && f->get_next()->is_tail_sentinel());
+   f->remove();
+   prev->insert_after(f);
+
+   return progress;
+}
+
+
+namespace {
+
+/**
+ * A part of the program that function scope passes run on separately,
+ * along with the passes whose results are out of date there.
+ */
+struct opt_region {
+   /** NULL for the whole program */
+   ir_function *function;
+   unsigned dirty;
+};
+
+} /* anonymous namespace */
+
+
+/**
+ * Split the program into one region per function.  If there are
+ * instructions outside of functions, which is the case for global
+ * initializers before linking, the function scope passes have to see those
+ * too, and the whole program is a single region.
+ *
+ * \return the number of regions
+ */
+static unsigned
+find_regions(exec_list *ir, void *mem_ctx, opt_region **regions,
+             unsigned dirty)
+{
+   unsigned count = 0;
+
+   foreach_list(node, ir) {
+      ir_instruction *inst = (ir_instruction *) node;
+
+      if (inst->as_function()) {
+         count++;
+      } else if (!inst->as_variable()) {
+         count = 0;
+         break;
+      }
+   }
+
+   if (count == 0) {
+      *regions = ralloc_array(mem_ctx, opt_region, 1);
+      (*regions)[0].function = NULL;
+      (*regions)[0].dirty = dirty;
+      return 1;
+   }
+
+   *regions = ralloc_array(mem_ctx, opt_region, count);
+   count = 0;
+   foreach_list(node, ir) {
+      ir_function *f = ((ir_instruction *) node)->as_function();
+
+      if (f) {
+         (*regions)[count].function = f;
+         (*regions)[count].dirty = dirty;
+         count++;
+      }
+   }
+
+   return count;
+}
+
+
+/**
+ * Do the set of common optimizations passes, until none of them makes any
+ * more progress.
+ *
+ * \param ir                          List of instructions to be optimized
+ * \param linked                      Is the shader linked?  This enables
+ *                                    optimizations passes that remove code at
+ *                                    global scope and could cause linking to
+ *                                    fail.
+ * \param uniform_locations_assigned  Have locations already been assigned for
+ *                                    uniforms?  This prevents the declarations
+ *                                    of unused uniforms from being removed.
+ *                                    The setting of this flag only matters if
+ *                                    \c linked is \c true.
+ * \param max_unroll_iterations       Maximum number of loop iterations to be
+ *                                    unrolled.  Setting to 0 disables loop
+ *                                    unrolling.
+ *
+ * \return true if any pass made progress
+ */
+bool
+do_common_optimization(exec_list *ir, bool linked,
+		       bool uniform_locations_assigned,
+		       unsigned max_unroll_iterations)
+{
+   const opt_params params = {
+      linked, uniform_locations_assigned, max_unroll_iterations
+   };
+   unsigned function_passes = 0, program_passes = 0;
+   bool progress = false;
+
+   STATIC_ASSERT(Elements(passes) <= sizeof(unsigned) * 8);
+
+   for (unsigned p = 0; p < Elements(passes); p++) {
+      if (passes[p].linked_only && !linked)
+         continue;
+
+      if (passes[p].scope == OPT_SCOPE_FUNCTION)
+         function_passes |= 1u << p;
+      else
+         program_passes |= 1u << p;
+   }
+
+   void *mem_ctx = ralloc_context(NULL);
+   opt_region *regions;
+   unsigned num_regions = find_regions(ir, mem_ctx, &regions, function_passes);
+   unsigned dirty_program = program_passes;
+   bool dirty;
+
+   do {
+      for (unsigned p = 0; p < Elements(passes); p++) {
+         const unsigned bit = 1u << p;
+
+         if (program_passes & bit) {
+            if (!(dirty_program & bit))
+               continue;
+
+            dirty_program &= ~bit;
+            if (run_pass(p, ir, &params)) {
+               /* Anything may have changed, including the set of functions */
+               progress = true;
+               dirty_program = program_passes;
+               ralloc_free(regions);
+               num_regions = find_regions(ir, mem_ctx, &regions,
+                                          function_passes);
+            }
+         } else if (function_passes & bit) {
+            for (unsigned r = 0; r < num_regions; r++) {
+               if (!(regions[r].dirty & bit))
+                  continue;
+
+               regions[r].dirty &= ~bit;
+
+               const bool region_progress = regions[r].function
+                  ? run_pass_on_function(p, regions[r].function, &params)
+                  : run_pass(p, ir, &params);
+
+               if (region_progress) {
+                  progress = true;
+                  regions[r].dirty = function_passes;
+                  dirty_program = program_passes;
+               }
+            }
+         }
+      }
+
+      dirty = dirty_program != 0;
+      for (unsigned r = 0; r < num_regions; r++)
+         dirty = dirty || regions[r].dirty != 0;
+   } while (dirty);
+
+   ralloc_free(mem_ctx);
+
+   return progress;
+}
+
+
+/**
+ * Print the statistics gathered when MESA_GLSL_OPT_STATS is set.
+ */
+void
+print_optimization_stats(void)
+{
+   if (!stats_enabled())
+      return;
+
+   printf("GLSL optimization passes:\n");
+   printf("  %-28s %10s %10s %10s\n", "pass", "runs", "progress", "ms");
+   for (unsigned p = 0; p < Elements(passes); p++) {
+      printf("  %-28s %10u %10u %10.1f\n", passes[p].name,
+             stats[p].runs, stats[p].progress,
+             stats[p].time * 1000.0 / CLOCKS_PER_SEC);
+   }
+}
@@ -50,6 +50,7 @@ _CRTIMP int _vscprintf(const char *format, va_list argptr);
 #endif
 
 #define CANARY 0x5A1106
+#define ARENA_CANARY 0x5A1107
 
 struct ralloc_header
 {
@@ -70,6 +71,82 @@ struct ralloc_header
 
 typedef struct ralloc_header ralloc_header;
 
+/*
+ * Arenas
+ *
+ * Blocks allocated under an arena context are carved out of slabs of
+ * ARENA_SLAB_SIZE bytes instead of being malloc'd one by one.  They keep
+ * their ralloc_header, so the tree works exactly as for other blocks, and
+ * are preceded by an arena_prefix pointing back to their slab.
+ *
+ * Each slab counts the blocks in it which haven't been freed, and is
+ * released as soon as that drops to zero, unless it's the slab currently
+ * being allocated from.  Blocks stolen out of the arena keep their slab
+ * alive after the arena context is freed.
+ *
+ * Once the arena context itself has been freed, the arena is closed: the
+ * remaining blocks are still valid, but their new children are malloc'd.
+ *
+ * When freeing the context, its subtree only has to be walked if it may
+ * contain blocks with destructors or blocks that don't belong to the arena,
+ * or if blocks of the arena live outside of it.  Otherwise all the slabs
+ * are released at once.
+ */
+
+#define ARENA_SLAB_SIZE (32 * 1024)
+#define ARENA_ALIGN 16
+
+#define ALIGN_ARENA(size) (((size) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1))
+
+struct ralloc_arena;
+
+struct ralloc_slab
+{
+   struct ralloc_arena *arena;
+
+   struct ralloc_slab *prev;
+   struct ralloc_slab *next;
+
+   /* Bytes available for blocks, and bytes used so far */
+   size_t size;
+   size_t used;
+
+   /* Number of blocks not freed yet */
+   unsigned live;
+};
+
+struct ralloc_arena
+{
+   /* The arena context, NULL once it has been freed */
+   ralloc_header *root;
+
+   /* The slab blocks are allocated from, NULL if there is none yet */
+   struct ralloc_slab *current;
+
+   /* All slabs, including the current one */
+   struct ralloc_slab *slabs;
+
+   /* Blocks of this arena whose parent is not, except the root */
+   unsigned escaped;
+
+   /* Blocks of other arenas, or malloc'd, whose parent belongs to this one */
+   unsigned foreign;
+
+   /* Blocks of this arena with a destructor */
+   unsigned destructors;
+};
+
+struct arena_prefix
+{
+   struct ralloc_slab *slab;
+
+   /* Size requested for the block, not counting the header */
+   size_t size;
+};
+
+#define SLAB_DATA(slab) \
+   (((char *) slab) + ALIGN_ARENA(sizeof(struct ralloc_slab)))
+
 static void unlink_block(ralloc_header *info);
 static void unsafe_free(ralloc_header *info);
 
@@ -78,12 +155,229 @@ get_header(const void *ptr)
 {
    ralloc_header *info = (ralloc_header *) (((char *) ptr) -
 					    sizeof(ralloc_header));
-   assert(info->canary == CANARY);
+   assert(info->canary == CANARY || info->canary == ARENA_CANARY);
    return info;
 }
 
 #define PTR_FROM_HEADER(info) (((char *) info) + sizeof(ralloc_header))
 
+static inline struct arena_prefix *
+get_prefix(ralloc_header *info)
+{
+   assert(info->canary == ARENA_CANARY);
+   return ((struct arena_prefix *) info) - 1;
+}
+
+/* The arena a block was allocated from, or NULL for a malloc'd block */
+static inline struct ralloc_arena *
+get_arena(ralloc_header *info)
+{
+   if (info == NULL || info->canary != ARENA_CANARY)
+      return NULL;
+   return get_prefix(info)->slab->arena;
+}
+
+static inline size_t
+arena_block_size(size_t size)
+{
+   return ALIGN_ARENA(sizeof(struct arena_prefix) +
+                      sizeof(ralloc_header) + size);
+}
+
+static bool
+arenas_disabled(void)
+{
+   static int disabled = -1;
+
+   if (disabled < 0)
+      disabled = getenv("RALLOC_NO_ARENA") != NULL;
+
+   return disabled != 0;
+}
+
+static void
+free_slab(struct ralloc_slab *slab)
+{
+   struct ralloc_arena *arena = slab->arena;
+
+   if (slab->prev != NULL)
+      slab->prev->next = slab->next;
+   else
+      arena->slabs = slab->next;
+
+   if (slab->next != NULL)
+      slab->next->prev = slab->prev;
+
+   if (arena->current == slab)
+      arena->current = NULL;
+
+   free(slab);
+
+   if (arena->root == NULL && arena->slabs == NULL)
+      free(arena);
+}
+
+static struct ralloc_slab *
+new_slab(struct ralloc_arena *arena, size_t size)
+{
+   struct ralloc_slab *slab =
+      malloc(ALIGN_ARENA(sizeof(struct ralloc_slab)) + size);
+
+   if (unlikely(slab == NULL))
+      return NULL;
+
+   slab->arena = arena;
+   slab->prev = NULL;
+   slab->next = arena->slabs;
+   slab->size = size;
+   slab->used = 0;
+   slab->live = 0;
+
+   if (arena->slabs != NULL)
+      arena->slabs->prev = slab;
+   arena->slabs = slab;
+
+   return slab;
+}
+
+/* Drop a block from its slab, releasing the slab if it was the last one */
+static void
+slab_release(struct ralloc_slab *slab)
+{
+   assert(slab->live > 0);
+
+   if (--slab->live == 0) {
+      if (slab == slab->arena->current && slab->arena->root != NULL)
+	 slab->used = 0;
+      else
+	 free_slab(slab);
+   }
+}
+
+/* Allocate a zeroed block from an arena, header included */
+static ralloc_header *
+arena_alloc(struct ralloc_arena *arena, size_t size)
+{
+   const size_t block_size = arena_block_size(size);
+   struct ralloc_slab *slab = arena->current;
+   struct arena_prefix *prefix;
+   ralloc_header *info;
+
+   if (unlikely(block_size < size))
+      return NULL;
+
+   if (block_size > ARENA_SLAB_SIZE / 4) {
+      /* Big blocks get a slab of their own */
+      slab = new_slab(arena, block_size);
+      if (unlikely(slab == NULL))
+	 return NULL;
+   } else if (slab == NULL || slab->used + block_size > slab->size) {
+      struct ralloc_slab *old = slab;
+
+      slab = new_slab(arena, ARENA_SLAB_SIZE);
+      if (unlikely(slab == NULL))
+	 return NULL;
+
+      arena->current = slab;
+      if (old != NULL && old->live == 0)
+	 free_slab(old);
+   }
+
+   prefix = (struct arena_prefix *) (SLAB_DATA(slab) + slab->used);
+   slab->used += block_size;
+   slab->live++;
+
+   info = (ralloc_header *) (prefix + 1);
+   memset(info, 0, sizeof(ralloc_header) + size);
+   info->canary = ARENA_CANARY;
+
+   prefix->slab = slab;
+   prefix->size = size;
+
+   return info;
+}
+
+/* Resize an arena block, moving it if it can't be resized in place */
+static ralloc_header *
+arena_resize(ralloc_header *old, size_t size)
+{
+   struct arena_prefix *prefix = get_prefix(old);
+   struct ralloc_slab *slab = prefix->slab;
+   struct ralloc_arena *arena = slab->arena;
+   const size_t old_size = arena_block_size(prefix->size);
+   const size_t new_size = arena_block_size(size);
+   ralloc_header *info;
+
+   if (unlikely(new_size < size))
+      return NULL;
+
+   if (new_size <= old_size) {
+      prefix->size = size;
+      return old;
+   }
+
+   /* Grow the last block of the current slab in place */
+   if (slab == arena->current &&
+       (char *) prefix + old_size == SLAB_DATA(slab) + slab->used &&
+       slab->used - old_size + new_size <= slab->size) {
+      slab->used += new_size - old_size;
+      prefix->size = size;
+      return old;
+   }
+
+   if (arena->root != NULL) {
+      info = arena_alloc(arena, size);
+   } else {
+      /* No new blocks in a closed arena */
+      info = calloc(1, size + sizeof(ralloc_header));
+   }
+
+   if (unlikely(info == NULL))
+      return NULL;
+
+   memcpy(info, old, sizeof(ralloc_header) +
+          (prefix->size < size ? prefix->size : size));
+   if (arena->root == NULL)
+      info->canary = CANARY;
+   else if (arena->root == old)
+      arena->root = info;
+
+   slab_release(slab);
+
+   return info;
+}
+
+/* Release all of an arena at once, without walking its blocks */
+static void
+arena_destroy(struct ralloc_arena *arena)
+{
+   struct ralloc_slab *slab, *next;
+
+   for (slab = arena->slabs; slab != NULL; slab = next) {
+      next = slab->next;
+      free(slab);
+   }
+
+   free(arena);
+}
+
+/* Keep count of the links between an arena and the rest of the tree */
+static inline void
+account_link(ralloc_header *parent, ralloc_header *info, int delta)
+{
+   struct ralloc_arena *parent_arena = get_arena(parent);
+   struct ralloc_arena *arena = get_arena(info);
+
+   if (likely(parent_arena == arena))
+      return;
+
+   if (arena != NULL && info != arena->root)
+      arena->escaped += delta;
+
+   if (parent_arena != NULL)
+      parent_arena->foreign += delta;
+}
+
 static void
 add_child(ralloc_header *parent, ralloc_header *info)
 {
@@ -94,6 +388,8 @@ add_child(ralloc_header *parent, ralloc_header *info)
 
       if (info->next != NULL)
 	 info->next->prev = info;
+
+      account_link(parent, info, 1);
    }
 }
 
@@ -103,22 +399,56 @@ ralloc_context(const void *ctx)
    return ralloc_size(ctx, 0);
 }
 
+void *
+ralloc_arena_context(const void *ctx)
+{
+   struct ralloc_arena *arena;
+   ralloc_header *info;
+
+   if (arenas_disabled())
+      return ralloc_context(ctx);
+
+   arena = calloc(1, sizeof(struct ralloc_arena));
+   if (unlikely(arena == NULL))
+      return NULL;
+
+   info = arena_alloc(arena, 0);
+   if (unlikely(info == NULL)) {
+      free(arena);
+      return NULL;
+   }
+
+   arena->root = info;
+   add_child(ctx != NULL ? get_header(ctx) : NULL, info);
+
+   return PTR_FROM_HEADER(info);
+}
+
 void *
 ralloc_size(const void *ctx, size_t size)
 {
-   void *block = calloc(1, size + sizeof(ralloc_header));
    ralloc_header *info;
    ralloc_header *parent;
+   struct ralloc_arena *arena;
 
-   if (unlikely(block == NULL))
-      return NULL;
-   info = (ralloc_header *) block;
    parent = ctx != NULL ? get_header(ctx) : NULL;
+   arena = get_arena(parent);
+
+   if (arena != NULL && arena->root != NULL) {
+      info = arena_alloc(arena, size);
+      if (unlikely(info == NULL))
+	 return NULL;
+   } else {
+      void *block = calloc(1, size + sizeof(ralloc_header));
+
+      if (unlikely(block == NULL))
+	 return NULL;
+      info = (ralloc_header *) block;
+      info->canary = CANARY;
+   }
 
    add_child(parent, info);
 
-   info->canary = CANARY;
-
    return PTR_FROM_HEADER(info);
 }
 
@@ -138,7 +468,10 @@ resize(void *ptr, size_t size)
    ralloc_header *child, *old, *info;
 
    old = get_header(ptr);
-   info = realloc(old, size + sizeof(ralloc_header));
+   if (old->canary == ARENA_CANARY)
+      info = arena_resize(old, size);
+   else
+      info = realloc(old, size + sizeof(ralloc_header));
 
    if (info == NULL)
       return NULL;
@@ -217,6 +550,8 @@ unlink_block(ralloc_header *info)
 {
    /* Unlink from parent & siblings */
    if (info->parent != NULL) {
+      account_link(info->parent, info, -1);
+
       if (info->parent->child == info)
 	 info->parent->child = info->next;
 
@@ -234,11 +569,22 @@ unlink_block(ralloc_header *info)
 static void
 unsafe_free(ralloc_header *info)
 {
+   struct ralloc_arena *arena = get_arena(info);
+
+   /* An arena context with nothing to do for any block: drop it all at once.
+    */
+   if (arena != NULL && info == arena->root && arena->escaped == 0 &&
+       arena->foreign == 0 && arena->destructors == 0) {
+      arena_destroy(arena);
+      return;
+   }
+
    /* Recursively free any children...don't waste time unlinking them. */
    ralloc_header *temp;
    while (info->child != NULL) {
       temp = info->child;
       info->child = temp->next;
+      account_link(info, temp, -1);
       unsafe_free(temp);
    }
 
@@ -246,7 +592,25 @@ unsafe_free(ralloc_header *info)
    if (info->destructor != NULL)
       info->destructor(PTR_FROM_HEADER(info));
 
-   free(info);
+   if (arena != NULL) {
+      struct ralloc_slab *slab = get_prefix(info)->slab;
+
+      if (info->destructor != NULL)
+	 arena->destructors--;
+
+      if (info == arena->root) {
+	 /* Close the arena.  The current slab is no longer kept around. */
+	 arena->root = NULL;
+	 if (arena->current != NULL && arena->current != slab &&
+	     arena->current->live == 0)
+	    free_slab(arena->current);
+	 arena->current = NULL;
+      }
+
+      slab_release(slab);
+   } else {
+      free(info);
+   }
 }
 
 void
@@ -299,6 +663,15 @@ void
 ralloc_set_destructor(const void *ptr, void(*destructor)(void *))
 {
    ralloc_header *info = get_header(ptr);
+   struct ralloc_arena *arena = get_arena(info);
+
+   if (arena != NULL) {
+      if (info->destructor == NULL && destructor != NULL)
+	 arena->destructors++;
+      else if (info->destructor != NULL && destructor == NULL)
+	 arena->destructors--;
+   }
+
    info->destructor = destructor;
 }
 
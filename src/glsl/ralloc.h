@@ -91,6 +91,27 @@ extern "C" {
  */
 void *ralloc_context(const void *ctx);
 
+/**
+ * Allocate a new ralloc context backed by an arena.
+ *
+ * Everything allocated under the new context, directly or not, is carved
+ * out of large slabs instead of being malloc'd one block at a time, and
+ * freeing the context releases the slabs in bulk.  This suits short lived
+ * contexts that collect many small allocations and are freed as a whole,
+ * such as the instructions a backend builds while translating the IR.
+ *
+ * Apart from that, the returned context behaves like any other: blocks may
+ * be freed, resized or stolen individually.  Memory of freed blocks is only
+ * reclaimed once the rest of their slab is freed too, though.  Blocks stolen
+ * out of the arena remain valid after the context is freed, and keep their
+ * whole slab alive until they are freed themselves.  So don't use arenas for
+ * contexts that live long, or whose children are meant to outlive them.
+ *
+ * Arenas can be disabled by setting the RALLOC_NO_ARENA environment
+ * variable, in which case this is the same as ralloc_context().
+ */
+void *ralloc_arena_context(const void *ctx);
+
 /**
  * Allocate memory chained off of the given context.
  *
@@ -0,0 +1,127 @@
+/*
+ * Copyright © 2014 VMware, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include "ralloc.h"
+#include "blob.h"
+
+TEST(blob_test, round_trip)
+{
+   struct blob *blob = blob_create(NULL);
+   struct blob_reader reader;
+
+   blob_write_uint32(blob, 0xdeadbeef);
+   blob_write_string(blob, "hello");
+   blob_write_string(blob, NULL);
+   blob_write_uint64(blob, 0x0123456789abcdefull);
+   blob_write_string(blob, "");
+
+   EXPECT_FALSE(blob->out_of_memory);
+
+   blob_reader_init(&reader, blob->data, blob->size);
+   EXPECT_EQ(0xdeadbeefu, blob_read_uint32(&reader));
+   EXPECT_STREQ("hello", blob_read_string(&reader));
+   EXPECT_EQ(NULL, blob_read_string(&reader));
+   EXPECT_EQ(0x0123456789abcdefull, blob_read_uint64(&reader));
+   EXPECT_STREQ("", blob_read_string(&reader));
+   EXPECT_FALSE(reader.overrun);
+   EXPECT_EQ(reader.end, reader.current);
+
+   ralloc_free(blob);
+}
+
+TEST(blob_test, grows)
+{
+   struct blob *blob = blob_create(NULL);
+   struct blob_reader reader;
+
+   for (uint32_t i = 0; i < 10000; i++)
+      blob_write_uint32(blob, i);
+
+   EXPECT_FALSE(blob->out_of_memory);
+   EXPECT_EQ(10000 * sizeof(uint32_t), blob->size);
+
+   blob_reader_init(&reader, blob->data, blob->size);
+   for (uint32_t i = 0; i < 10000; i++)
+      EXPECT_EQ(i, blob_read_uint32(&reader));
+   EXPECT_FALSE(reader.overrun);
+
+   ralloc_free(blob);
+}
+
+TEST(blob_test, overwrite)
+{
+   struct blob *blob = blob_create(NULL);
+   struct blob_reader reader;
+
+   blob_write_uint32(blob, 1);
+   blob_write_uint32(blob, 2);
+   EXPECT_TRUE(blob_overwrite_uint32(blob, 0, 3));
+   EXPECT_FALSE(blob_overwrite_uint32(blob, 6, 4));
+
+   blob_reader_init(&reader, blob->data, blob->size);
+   EXPECT_EQ(3u, blob_read_uint32(&reader));
+   EXPECT_EQ(2u, blob_read_uint32(&reader));
+
+   ralloc_free(blob);
+}
+
+TEST(blob_test, overrun)
+{
+   struct blob *blob = blob_create(NULL);
+   struct blob_reader reader;
+
+   blob_write_uint32(blob, 5);
+   blob_write_bytes(blob, "abc", 3);
+
+   /* A string whose length runs past the end */
+   blob_reader_init(&reader, blob->data, blob->size);
+   EXPECT_EQ(NULL, blob_read_string(&reader));
+   EXPECT_TRUE(reader.overrun);
+
+   /* Reads after an overrun keep failing */
+   EXPECT_EQ(0u, blob_read_uint32(&reader));
+   EXPECT_TRUE(reader.overrun);
+
+   blob_reader_init(&reader, blob->data, 2);
+   EXPECT_EQ(0u, blob_read_uint32(&reader));
+   EXPECT_TRUE(reader.overrun);
+
+   ralloc_free(blob);
+}
+
+TEST(blob_test, missing_terminator)
+{
+   struct blob *blob = blob_create(NULL);
+   struct blob_reader reader;
+
+   blob_write_uint32(blob, 3);
+   blob_write_bytes(blob, "abc", 3);
+
+   blob_reader_init(&reader, blob->data, blob->size);
+   EXPECT_EQ(NULL, blob_read_string(&reader));
+   EXPECT_TRUE(reader.overrun);
+
+   ralloc_free(blob);
+}
@@ -0,0 +1,315 @@
+/*
+ * Copyright © 2014 VMware, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <string.h>
+#include "main/compiler.h"
+#include "main/mtypes.h"
+#include "main/macros.h"
+#include "ralloc.h"
+#include "ir.h"
+#include "ir_serialize.h"
+
+class ir_serialize_test : public ::testing::Test {
+public:
+   virtual void SetUp();
+   virtual void TearDown();
+
+   void build_shader();
+   ir_rvalue *nested_expression(ir_variable *var, unsigned depth);
+   bool round_trip(exec_list *in, exec_list *out);
+
+   void *mem_ctx;
+   exec_list ir;
+};
+
+void
+ir_serialize_test::SetUp()
+{
+   this->mem_ctx = ralloc_context(NULL);
+   this->ir.make_empty();
+}
+
+void
+ir_serialize_test::TearDown()
+{
+   ralloc_free(this->mem_ctx);
+   this->mem_ctx = NULL;
+}
+
+/**
+ * Build the IR of a small shader, using most kinds of instruction:
+ *
+ *    uniform vec4 u;
+ *    uniform sampler2D s;
+ *    out vec4 color;
+ *
+ *    float twice(float a) { return a * 2.0; }
+ *
+ *    void main() {
+ *       float t;
+ *       t = twice(u.x);
+ *       if (t > 1.0)
+ *          discard;
+ *       loop { t = t + 1.0; break; }
+ *       color = texture2D(s, u.xy) * t;
+ *    }
+ */
+void
+ir_serialize_test::build_shader()
+{
+   ir_variable *u =
+      new(mem_ctx) ir_variable(glsl_type::vec4_type, "u", ir_var_uniform);
+   ir_variable *s =
+      new(mem_ctx) ir_variable(glsl_type::get_builtin_instance("sampler2D"),
+                               "s", ir_var_uniform);
+   ir_variable *color =
+      new(mem_ctx) ir_variable(glsl_type::vec4_type, "color",
+                               ir_var_shader_out);
+   ir.push_tail(u);
+   ir.push_tail(s);
+   ir.push_tail(color);
+
+   /* float twice(float a) */
+   ir_function *twice = new(mem_ctx) ir_function("twice");
+   ir_function_signature *twice_sig =
+      new(mem_ctx) ir_function_signature(glsl_type::float_type);
+   ir_variable *a =
+      new(mem_ctx) ir_variable(glsl_type::float_type, "a",
+                               ir_var_function_in);
+   twice_sig->parameters.push_tail(a);
+   twice_sig->body.push_tail(
+      new(mem_ctx) ir_return(
+         new(mem_ctx) ir_expression(ir_binop_mul,
+                                    new(mem_ctx) ir_dereference_variable(a),
+                                    new(mem_ctx) ir_constant(2.0f))));
+   twice_sig->is_defined = true;
+   twice->add_signature(twice_sig);
+   ir.push_tail(twice);
+
+   /* void main() */
+   ir_function *main_func = new(mem_ctx) ir_function("main");
+   ir_function_signature *main_sig =
+      new(mem_ctx) ir_function_signature(glsl_type::void_type);
+   main_sig->is_defined = true;
+   main_func->add_signature(main_sig);
+   ir.push_tail(main_func);
+
+   exec_list *body = &main_sig->body;
+   ir_variable *t =
+      new(mem_ctx) ir_variable(glsl_type::float_type, "t", ir_var_temporary);
+   body->push_tail(t);
+
+   exec_list params;
+   params.push_tail(new(mem_ctx) ir_swizzle(
+                       new(mem_ctx) ir_dereference_variable(u),
+                       0, 0, 0, 0, 1));
+   body->push_tail(new(mem_ctx) ir_call(twice_sig,
+                                        new(mem_ctx) ir_dereference_variable(t),
+                                        &params));
+
+   ir_if *iff = new(mem_ctx) ir_if(
+      new(mem_ctx) ir_expression(ir_binop_greater,
+                                 new(mem_ctx) ir_dereference_variable(t),
+                                 new(mem_ctx) ir_constant(1.0f)));
+   iff->then_instructions.push_tail(new(mem_ctx) ir_discard());
+   body->push_tail(iff);
+
+   ir_loop *loop = new(mem_ctx) ir_loop();
+   loop->body_instructions.push_tail(
+      new(mem_ctx) ir_assignment(
+         new(mem_ctx) ir_dereference_variable(t),
+         new(mem_ctx) ir_expression(ir_binop_add,
+                                    new(mem_ctx) ir_dereference_variable(t),
+                                    new(mem_ctx) ir_constant(1.0f))));
+   loop->body_instructions.push_tail(
+      new(mem_ctx) ir_loop_jump(ir_loop_jump::jump_break));
+   body->push_tail(loop);
+
+   ir_texture *tex = new(mem_ctx) ir_texture(ir_tex);
+   tex->set_sampler(new(mem_ctx) ir_dereference_variable(s),
+                    glsl_type::vec4_type);
+   tex->coordinate = new(mem_ctx) ir_swizzle(
+      new(mem_ctx) ir_dereference_variable(u), 0, 1, 0, 0, 2);
+   body->push_tail(
+      new(mem_ctx) ir_assignment(
+         new(mem_ctx) ir_dereference_variable(color),
+         new(mem_ctx) ir_expression(ir_binop_mul, tex,
+                                    new(mem_ctx) ir_dereference_variable(t))));
+}
+
+/**
+ * Build -(-(-(... var))) with \c depth negations.
+ */
+ir_rvalue *
+ir_serialize_test::nested_expression(ir_variable *var, unsigned depth)
+{
+   ir_rvalue *value = new(mem_ctx) ir_dereference_variable(var);
+
+   for (unsigned i = 0; i < depth; i++)
+      value = new(mem_ctx) ir_expression(ir_unop_neg, value);
+
+   return value;
+}
+
+/**
+ * Serialize \c in, read it back into \c out, and check that serializing
+ * \c out again gives the same bytes.
+ */
+bool
+ir_serialize_test::round_trip(exec_list *in, exec_list *out)
+{
+   struct blob *first = blob_create(mem_ctx);
+   struct blob *second = blob_create(mem_ctx);
+   struct blob_reader reader;
+
+   EXPECT_TRUE(serialize_ir(first, in));
+
+   blob_reader_init(&reader, first->data, first->size);
+   if (!deserialize_ir(&reader, mem_ctx, out))
+      return false;
+   EXPECT_EQ(reader.end, reader.current);
+
+   EXPECT_TRUE(serialize_ir(second, out));
+   EXPECT_EQ(first->size, second->size);
+   if (first->size == second->size) {
+      EXPECT_EQ(0, memcmp(first->data, second->data, first->size));
+   }
+
+   return true;
+}
+
+TEST_F(ir_serialize_test, round_trip)
+{
+   exec_list out;
+
+   build_shader();
+   ASSERT_TRUE(round_trip(&ir, &out));
+
+   /* u, s, color, twice, main */
+   ir_instruction *nodes[5];
+   unsigned count = 0;
+   foreach_list(node, &out) {
+      if (count < Elements(nodes))
+         nodes[count] = (ir_instruction *) node;
+      count++;
+   }
+   ASSERT_EQ(5u, count);
+
+   ir_variable *u = nodes[0]->as_variable();
+   ASSERT_TRUE(u != NULL);
+   EXPECT_STREQ("u", u->name);
+   EXPECT_EQ(glsl_type::vec4_type, u->type);
+   EXPECT_EQ(ir_var_uniform, (ir_variable_mode) u->mode);
+
+   ir_function *twice = nodes[3]->as_function();
+   ASSERT_TRUE(twice != NULL);
+   EXPECT_STREQ("twice", twice->name);
+
+   ir_function *main_func = nodes[4]->as_function();
+   ASSERT_TRUE(main_func != NULL);
+   ir_function_signature *main_sig =
+      (ir_function_signature *) main_func->signatures.get_head();
+   EXPECT_TRUE(main_sig->is_defined);
+
+   /* The call refers to the signature read back, not the original one. */
+   ir_call *call = NULL;
+   foreach_list(node, &main_sig->body) {
+      if (call == NULL)
+         call = ((ir_instruction *) node)->as_call();
+   }
+   ASSERT_TRUE(call != NULL);
+   EXPECT_EQ(twice->signatures.get_head(), call->callee);
+}
+
+TEST_F(ir_serialize_test, truncated)
+{
+   struct blob *blob = blob_create(mem_ctx);
+
+   build_shader();
+   ASSERT_TRUE(serialize_ir(blob, &ir));
+
+   /* Every prefix of the data must be rejected, without crashing. */
+   for (size_t size = 0; size < blob->size; size += 4) {
+      struct blob_reader reader;
+      exec_list out;
+
+      blob_reader_init(&reader, blob->data, size);
+      EXPECT_FALSE(deserialize_ir(&reader, mem_ctx, &out) &&
+                   reader.current == reader.end);
+   }
+}
+
+TEST_F(ir_serialize_test, nested_types)
+{
+   struct blob *array = blob_create(mem_ctx);
+   struct blob *blob = blob_create(mem_ctx);
+   struct blob_reader reader;
+
+   /* Pick the array tag out of a real array type. */
+   serialize_glsl_type(array, glsl_type::get_array_instance(
+                                 glsl_type::float_type, 3));
+   blob_reader_init(&reader, array->data, array->size);
+   const uint32_t array_tag = blob_read_uint32(&reader);
+
+   for (unsigned i = 0; i < 100000; i++) {
+      blob_write_uint32(blob, array_tag);
+      blob_write_uint32(blob, 1);
+   }
+   serialize_glsl_type(blob, glsl_type::float_type);
+
+   blob_reader_init(&reader, blob->data, blob->size);
+   EXPECT_EQ(NULL, deserialize_glsl_type(&reader));
+   EXPECT_TRUE(reader.overrun);
+}
+
+TEST_F(ir_serialize_test, nested_expressions)
+{
+   ir_variable *x =
+      new(mem_ctx) ir_variable(glsl_type::float_type, "x", ir_var_auto);
+   ir_variable *y =
+      new(mem_ctx) ir_variable(glsl_type::float_type, "y", ir_var_auto);
+   exec_list out;
+
+   ir.push_tail(x);
+   ir.push_tail(y);
+   ir.push_tail(new(mem_ctx) ir_assignment(
+                   new(mem_ctx) ir_dereference_variable(y),
+                   nested_expression(x, 100)));
+   EXPECT_TRUE(round_trip(&ir, &out));
+
+   /* Far deeper than any real shader: the reader must give up. */
+   struct blob *blob = blob_create(mem_ctx);
+   struct blob_reader reader;
+   exec_list deep, deep_out;
+
+   ir_variable *z =
+      new(mem_ctx) ir_variable(glsl_type::float_type, "z", ir_var_auto);
+   deep.push_tail(z);
+   deep.push_tail(new(mem_ctx) ir_assignment(
+                     new(mem_ctx) ir_dereference_variable(z),
+                     nested_expression(z, 5000)));
+   ASSERT_TRUE(serialize_ir(blob, &deep));
+
+   blob_reader_init(&reader, blob->data, blob->size);
+   EXPECT_FALSE(deserialize_ir(&reader, mem_ctx, &deep_out));
+}
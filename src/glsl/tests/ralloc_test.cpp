@@ -36,3 +36,105 @@ TEST(ralloc_test, null_parent)
    EXPECT_EQ(NULL, ralloc_parent(mem_ctx));
 }
 /*@}*/
+
+/**
+ * \name Arena contexts
+ */
+/*@{*/
+TEST(ralloc_test, arena_tree)
+{
+   void *mem_ctx = ralloc_context(NULL);
+   void *arena = ralloc_arena_context(mem_ctx);
+   int *a = ralloc_array(arena, int, 16);
+   char *s = ralloc_strdup(a, "arena");
+
+   EXPECT_EQ(mem_ctx, ralloc_parent(arena));
+   EXPECT_EQ(arena, ralloc_parent(a));
+   EXPECT_EQ(a, ralloc_parent(s));
+   EXPECT_STREQ("arena", s);
+
+   for (unsigned i = 0; i < 10000; i++)
+      ralloc_asprintf(arena, "string %u", i);
+
+   ralloc_free(mem_ctx);
+}
+
+TEST(ralloc_test, arena_resize)
+{
+   void *arena = ralloc_arena_context(NULL);
+   char *s = ralloc_strdup(arena, "");
+   char *t = ralloc_strdup(arena, "");
+
+   for (unsigned i = 0; i < 1000; i++) {
+      ralloc_strcat(&s, "ab");
+      ralloc_strcat(&t, "c");
+   }
+
+   EXPECT_EQ(2000u, strlen(s));
+   EXPECT_EQ(1000u, strlen(t));
+   EXPECT_EQ(arena, ralloc_parent(s));
+   EXPECT_EQ('a', s[1998]);
+   EXPECT_EQ('b', s[1999]);
+
+   ralloc_free(arena);
+}
+
+static unsigned destructor_calls;
+
+static void
+count_destructor(void *)
+{
+   destructor_calls++;
+}
+
+TEST(ralloc_test, arena_destructor)
+{
+   void *arena = ralloc_arena_context(NULL);
+   void *a = ralloc_context(arena);
+
+   destructor_calls = 0;
+   ralloc_set_destructor(a, count_destructor);
+   ralloc_set_destructor(ralloc_context(a), count_destructor);
+
+   ralloc_free(arena);
+
+   EXPECT_EQ(2u, destructor_calls);
+}
+
+TEST(ralloc_test, arena_steal_out)
+{
+   void *mem_ctx = ralloc_context(NULL);
+   void *arena = ralloc_arena_context(NULL);
+   char *s = ralloc_strdup(arena, "survivor");
+   char *child = ralloc_strdup(s, "child");
+
+   ralloc_steal(mem_ctx, s);
+   ralloc_free(arena);
+
+   EXPECT_STREQ("survivor", s);
+   EXPECT_STREQ("child", child);
+
+   /* Blocks of a freed arena still work as contexts */
+   char *late = ralloc_strdup(s, "late");
+   EXPECT_EQ(s, ralloc_parent(late));
+   EXPECT_TRUE(ralloc_strcat(&s, ", resized"));
+   EXPECT_STREQ("survivor, resized", s);
+   EXPECT_EQ(s, ralloc_parent(child));
+
+   ralloc_free(mem_ctx);
+}
+
+TEST(ralloc_test, arena_steal_in)
+{
+   void *mem_ctx = ralloc_context(NULL);
+   void *arena = ralloc_arena_context(NULL);
+   void *nested = ralloc_arena_context(arena);
+   char *s = ralloc_strdup(mem_ctx, "malloced");
+
+   ralloc_strdup(nested, "nested");
+   ralloc_steal(arena, s);
+
+   ralloc_free(mem_ctx);
+   ralloc_free(arena);
+}
+/*@}*/
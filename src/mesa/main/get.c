@@ -712,6 +712,18 @@ find_custom_value(struct gl_context *ctx, const struct value_desc *d, union valu
       ASSERT(v->value_int_n.n <= 100);
       break;
 
+   case GL_NUM_PROGRAM_BINARY_FORMATS:
+      v->value_int = 1;
+      break;
+   case GL_MAX_SHADER_COMPILER_THREADS_ARB:
+      /* The default of 0xffffffff doesn't fit */
+      v->value_int = MIN2(ctx->Shader.MaxCompilerThreads, (GLuint) INT_MAX);
+      break;
+   case GL_PROGRAM_BINARY_FORMATS:
+      v->value_int_n.n = 1;
+      v->value_int_n.ints[0] = GL_PROGRAM_BINARY_FORMAT_MESA;
+      break;
+
    case GL_MAX_VARYING_FLOATS_ARB:
       v->value_int = ctx->Const.MaxVarying * 4;
       break;
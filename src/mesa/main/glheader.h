@@ -98,6 +98,16 @@ typedef void *GLeglImageOES;
 #define GL_PROGRAM_BINARY_LENGTH_OES 0x8741
 #endif
 
+/** The only format accepted by glProgramBinary */
+#ifndef GL_PROGRAM_BINARY_FORMAT_MESA
+#define GL_PROGRAM_BINARY_FORMAT_MESA 0x875F
+#endif
+
+#ifndef GL_ARB_parallel_shader_compile
+#define GL_MAX_SHADER_COMPILER_THREADS_ARB 0x91B0
+#define GL_COMPLETION_STATUS_ARB 0x91B1
+#endif
+
 /* GLES 2.0 tokens */
 #ifndef GL_RGB565
 #define GL_RGB565 0x8D62
@@ -79,6 +79,7 @@ struct st_context;
 struct gl_uniform_storage;
 struct prog_instruction;
 struct gl_program_parameter_list;
+struct shader_job;
 struct set;
 struct set_entry;
 /*@}*/
@@ -2156,6 +2157,24 @@ struct gl_shader
    /** Shaders containing built-in functions that are used for linking. */
    struct gl_shader *builtins_to_link[16];
    unsigned num_builtins_to_link;
+
+   /**
+    * \name Shader cache state
+    */
+   /*@{*/
+   GLchar *CachedSource;        /**< Copy of Source as last compiled */
+   /*@}*/
+
+   /**
+    * \name Parallel compile state, see shader_queue.c
+    */
+   /*@{*/
+   struct shader_job *CompileJob; /**< Last compile, or NULL if it was sync,
+                                     under the shader queue's lock */
+   GLuint PendingLinks;         /**< Queued links of programs using this
+                                     shader, under the shader queue's lock */
+   GLboolean Linking;           /**< One of them is running, likewise */
+   /*@}*/
 };
 
 
@@ -2354,6 +2373,21 @@ struct gl_shader_program
    GLboolean _Used;        /**< Ever used for drawing? */
    GLchar *InfoLog;
 
+   /**
+    * Serialized result of the last successful link, as returned by
+    * glGetProgramBinary, or NULL.
+    */
+   GLubyte *Binary;
+   GLuint BinarySize;
+
+   /**
+    * Queued link, or NULL.  ctx->Driver.LinkShader is called once it's
+    * done, by _mesa_wait_shader_program().  Both fields are only accessed
+    * with the shader queue's lock held.
+    */
+   struct shader_job *LinkJob;
+   GLboolean LinkFinishing;  /**< LinkShader is being called for LinkJob */
+
    unsigned Version;       /**< GLSL version used for linking */
    GLboolean IsES;         /**< True if this program uses GLSL ES */
 
@@ -2405,6 +2439,18 @@ struct gl_shader_state
    struct gl_shader_program *ActiveProgram;
 
    GLbitfield Flags;                    /**< Mask of GLSL_x flags */
+
+   /**
+    * GL_ARB_parallel_shader_compile hint.  Zero compiles and links on the
+    * calling thread.
+    */
+   GLuint MaxCompilerThreads;
+
+   /**
+    * Compile and link jobs queued and not done yet.  Protected by the
+    * shader queue's lock.
+    */
+   GLuint PendingJobs;
 };
 
 
@@ -0,0 +1,617 @@
+/*
+ * Mesa 3-D graphics library
+ *
+ * Copyright (C) 2014  VMware, Inc.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * \file shader_cache.c
+ * Cache of compiled and linked GLSL programs, and program binaries.
+ *
+ * A program binary is the output of link_shaders(), serialized by
+ * serialize_glsl_program() behind a small header that identifies the
+ * context it was made for.  Restoring it takes the place of compiling and
+ * linking the GLSL source, though the driver's LinkShader hook still runs
+ * on the result.
+ *
+ * The same binaries are stored on disk, keyed on everything that goes into
+ * linking: the source of the attached shaders, the attribute and fragment
+ * data bindings, the transform feedback varyings, and the context state
+ * the compiler looks at.  Shaders are always compiled, so that their
+ * compile status and info log are exactly those of the source, and a warm
+ * start only skips linking.
+ *
+ * Entries are files named after a hash of their key, which also contain
+ * the full key to rule out collisions.  The cache lives in
+ * $MESA_GLSL_CACHE_DIR, or in "mesa" under the XDG cache directory, and is
+ * disabled by setting MESA_GLSL_CACHE_DISABLE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include "main/glheader.h"
+#include "main/imports.h"
+#include "main/mtypes.h"
+#include "main/shader_cache.h"
+#include "glapi/glthread.h"
+#include "program/hash_table.h"
+#include "ralloc.h"
+#include "../glsl/blob.h"
+#include "../glsl/ir_serialize.h"
+
+
+/** Bump whenever the format of the cache entries changes */
+#define SHADER_CACHE_VERSION 1
+
+#define PROGRAM_BINARY_MAGIC 0x4153454d /* "MESA" */
+
+
+enum cache_entry_kind {
+   /* 1 was compiled shaders, which aren't cached anymore */
+   CACHE_ENTRY_PROGRAM = 2
+};
+
+
+/** 64-bit FNV-1a */
+static uint64_t
+hash_data(const void *data, size_t size)
+{
+   const uint8_t *bytes = (const uint8_t *) data;
+   uint64_t hash = 0xcbf29ce484222325ull;
+   size_t i;
+
+   for (i = 0; i < size; i++) {
+      hash ^= bytes[i];
+      hash *= 0x100000001b3ull;
+   }
+
+   return hash;
+}
+
+
+/**
+ * Write the context state that compiling and linking depend on.
+ */
+static void
+write_context_key(struct blob *key, struct gl_context *ctx)
+{
+   blob_write_string(key, PACKAGE_VERSION);
+   blob_write_uint32(key, SHADER_CACHE_VERSION);
+   blob_write_uint32(key, IR_SERIALIZE_VERSION);
+   blob_write_uint32(key, ctx->API);
+   blob_write_uint32(key, ctx->Version);
+   blob_write_bytes(key, &ctx->Const, sizeof(ctx->Const));
+   blob_write_bytes(key, &ctx->Extensions,
+                    offsetof(struct gl_extensions, String));
+   blob_write_bytes(key, ctx->ShaderCompilerOptions,
+                    sizeof(ctx->ShaderCompilerOptions));
+   blob_write_uint32(key, ctx->Shader.Flags);
+}
+
+
+static uint64_t
+context_hash(struct gl_context *ctx)
+{
+   struct blob *key = blob_create(NULL);
+   uint64_t hash;
+
+   write_context_key(key, ctx);
+   hash = hash_data(key->data, key->size);
+   ralloc_free(key);
+
+   return hash;
+}
+
+
+struct binding {
+   const char *name;
+   unsigned value;
+};
+
+struct binding_list {
+   struct binding *bindings;
+   unsigned count;
+};
+
+
+static void
+add_binding(const char *name, unsigned value, void *closure)
+{
+   struct binding_list *list = (struct binding_list *) closure;
+
+   list->bindings = reralloc(NULL, list->bindings, struct binding,
+                             list->count + 1);
+   if (list->bindings) {
+      list->bindings[list->count].name = name;
+      list->bindings[list->count].value = value;
+      list->count++;
+   }
+   else {
+      list->count = 0;
+   }
+}
+
+
+static int
+compare_bindings(const void *a, const void *b)
+{
+   return strcmp(((const struct binding *) a)->name,
+                 ((const struct binding *) b)->name);
+}
+
+
+/**
+ * Write the contents of a string_to_uint_map, sorted since the map itself
+ * has no particular order.
+ */
+static void
+write_bindings(struct blob *key, struct string_to_uint_map *map)
+{
+   struct binding_list list = { NULL, 0 };
+   unsigned i;
+
+   if (map)
+      string_to_uint_map_iterate(map, add_binding, &list);
+
+   qsort(list.bindings, list.count, sizeof(list.bindings[0]),
+         compare_bindings);
+
+   blob_write_uint32(key, list.count);
+   for (i = 0; i < list.count; i++) {
+      blob_write_string(key, list.bindings[i].name);
+      blob_write_uint32(key, list.bindings[i].value);
+   }
+
+   ralloc_free(list.bindings);
+}
+
+
+/**
+ * \return the key, or NULL if the program can't be cached
+ */
+static struct blob *
+create_program_key(struct gl_context *ctx, struct gl_shader_program *prog)
+{
+   struct blob *key = blob_create(NULL);
+   unsigned i;
+
+   blob_write_uint32(key, CACHE_ENTRY_PROGRAM);
+   write_context_key(key, ctx);
+
+   blob_write_uint32(key, prog->NumShaders);
+   for (i = 0; i < prog->NumShaders; i++) {
+      const struct gl_shader *sh = prog->Shaders[i];
+
+      /* Compiled before the cache was enabled */
+      if (!sh->CachedSource) {
+         ralloc_free(key);
+         return NULL;
+      }
+
+      blob_write_uint32(key, sh->Type);
+      blob_write_string(key, sh->CachedSource);
+   }
+
+   write_bindings(key, prog->AttributeBindings);
+   write_bindings(key, prog->FragDataBindings);
+   write_bindings(key, prog->FragDataIndexBindings);
+
+   blob_write_uint32(key, prog->TransformFeedback.BufferMode);
+   blob_write_uint32(key, prog->TransformFeedback.NumVarying);
+   for (i = 0; i < prog->TransformFeedback.NumVarying; i++)
+      blob_write_string(key, prog->TransformFeedback.VaryingNames[i]);
+
+   blob_write_uint32(key, prog->Geom.VerticesOut);
+   blob_write_uint32(key, prog->Geom.InputType);
+   blob_write_uint32(key, prog->Geom.OutputType);
+   blob_write_uint32(key, prog->InternalSeparateShader);
+
+   if (key->out_of_memory) {
+      ralloc_free(key);
+      return NULL;
+   }
+
+   return key;
+}
+
+
+#ifndef _WIN32
+
+/** Shaders are compiled on several threads, see shader_queue.c */
+_glthread_DECLARE_STATIC_MUTEX(cache_mutex);
+
+
+/** Create a directory and its parents, like "mkdir -p" */
+static GLboolean
+make_dirs(char *path)
+{
+   struct stat st;
+   char *p;
+
+   for (p = path + 1; *p; p++) {
+      if (*p == '/') {
+         *p = '\0';
+         if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+            *p = '/';
+            return GL_FALSE;
+         }
+         *p = '/';
+      }
+   }
+
+   if (mkdir(path, 0755) != 0 && errno != EEXIST)
+      return GL_FALSE;
+
+   return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+
+static char *
+find_cache_dir(void)
+{
+   const char *dir = _mesa_getenv("MESA_GLSL_CACHE_DIR");
+   const char *base, *subdir;
+   char *path;
+
+   if (dir) {
+      path = strdup(dir);
+   }
+   else {
+      base = _mesa_getenv("XDG_CACHE_HOME");
+      subdir = "/mesa";
+      if (!base || !base[0]) {
+         base = _mesa_getenv("HOME");
+         subdir = "/.cache/mesa";
+      }
+      if (!base || !base[0])
+         return NULL;
+
+      path = malloc(strlen(base) + strlen(subdir) + 1);
+      if (path) {
+         strcpy(path, base);
+         strcat(path, subdir);
+      }
+   }
+
+   if (path && (!path[0] || !make_dirs(path))) {
+      free(path);
+      path = NULL;
+   }
+
+   return path;
+}
+
+
+/**
+ * \return the cache directory, or NULL if the disk cache is disabled
+ */
+static const char *
+get_cache_dir(void)
+{
+   static GLboolean initialized = GL_FALSE;
+   static char *dir = NULL;
+
+   _glthread_LOCK_MUTEX(cache_mutex);
+   if (!initialized) {
+      if (!_mesa_getenv("MESA_GLSL_CACHE_DISABLE"))
+         dir = find_cache_dir();
+      initialized = GL_TRUE;
+   }
+   _glthread_UNLOCK_MUTEX(cache_mutex);
+
+   return dir;
+}
+
+
+static char *
+entry_path(const struct blob *key, const char *suffix)
+{
+   const char *dir = get_cache_dir();
+   size_t size = strlen(dir) + strlen(suffix) + 18;
+   char *path = malloc(size);
+
+   if (path) {
+      snprintf(path, size, "%s/%016llx%s", dir,
+               (unsigned long long) hash_data(key->data, key->size), suffix);
+   }
+
+   return path;
+}
+
+
+/**
+ * Look up an entry on disk.
+ * \return the contents of the entry, to be freed by the caller, with
+ *         \c reader positioned after the key; or NULL on a miss
+ */
+static uint8_t *
+cache_read(const struct blob *key, struct blob_reader *reader)
+{
+   char *path = entry_path(key, "");
+   uint8_t *data = NULL;
+   const void *stored_key;
+   FILE *f;
+   long size;
+
+   if (!path)
+      return NULL;
+
+   f = fopen(path, "rb");
+   free(path);
+   if (!f)
+      return NULL;
+
+   if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) > 0 &&
+       fseek(f, 0, SEEK_SET) == 0) {
+      data = malloc(size);
+      if (data && fread(data, 1, size, f) != (size_t) size) {
+         free(data);
+         data = NULL;
+      }
+   }
+   fclose(f);
+
+   if (!data)
+      return NULL;
+
+   blob_reader_init(reader, data, size);
+   if (blob_read_uint32(reader) != key->size ||
+       !(stored_key = blob_read_bytes(reader, key->size)) ||
+       memcmp(stored_key, key->data, key->size) != 0) {
+      free(data);
+      return NULL;
+   }
+
+   return data;
+}
+
+
+/**
+ * Store an entry on disk.  It's written to a temporary file first, so that
+ * other processes never see a partial entry.  The name of the temporary
+ * file is unique to the process and the write.
+ */
+static void
+cache_write(const struct blob *key, const void *data, size_t size)
+{
+   static unsigned counter = 0;
+   unsigned n;
+   char suffix[48];
+   char *path, *tmp_path;
+   uint32_t key_size = key->size;
+   GLboolean ok;
+   FILE *f;
+
+   _glthread_LOCK_MUTEX(cache_mutex);
+   n = counter++;
+   _glthread_UNLOCK_MUTEX(cache_mutex);
+
+   snprintf(suffix, sizeof(suffix), ".tmp%ld.%u", (long) getpid(), n);
+   path = entry_path(key, "");
+   tmp_path = entry_path(key, suffix);
+   if (!path || !tmp_path)
+      goto out;
+
+   f = fopen(tmp_path, "wb");
+   if (!f)
+      goto out;
+
+   ok = fwrite(&key_size, sizeof(key_size), 1, f) == 1 &&
+        fwrite(key->data, 1, key->size, f) == key->size &&
+        fwrite(data, 1, size, f) == size;
+
+   if (fclose(f) != 0)
+      ok = GL_FALSE;
+
+   if (!ok || rename(tmp_path, path) != 0)
+      unlink(tmp_path);
+
+out:
+   free(path);
+   free(tmp_path);
+}
+
+#else
+
+static const char *
+get_cache_dir(void)
+{
+   return NULL;
+}
+
+static uint8_t *
+cache_read(const struct blob *key, struct blob_reader *reader)
+{
+   return NULL;
+}
+
+static void
+cache_write(const struct blob *key, const void *data, size_t size)
+{
+}
+
+#endif /* _WIN32 */
+
+
+GLboolean
+_mesa_shader_cache_enabled(struct gl_context *ctx)
+{
+   /* Dumping and logging shaders needs them to be compiled */
+   if (ctx->Shader.Flags & (GLSL_DUMP | GLSL_LOG))
+      return GL_FALSE;
+
+   return get_cache_dir() != NULL;
+}
+
+
+/**
+ * Record the source a shader was just compiled from, which programs using
+ * it are keyed on: the shader's source may change before they are linked.
+ */
+void
+_mesa_shader_cache_record_shader(struct gl_context *ctx, struct gl_shader *sh)
+{
+   ralloc_free(sh->CachedSource);
+   sh->CachedSource = NULL;
+
+   if (sh->CompileStatus && sh->Source && _mesa_shader_cache_enabled(ctx))
+      sh->CachedSource = ralloc_strdup(sh, sh->Source);
+}
+
+
+/**
+ * Look up a program about to be linked, and restore it on a hit.
+ *
+ * \return GL_TRUE if the program was restored as by link_shaders(), in
+ *         which case only the driver's LinkShader hook has to be called
+ */
+GLboolean
+_mesa_shader_cache_find_program(struct gl_context *ctx,
+                                struct gl_shader_program *prog)
+{
+   struct blob_reader reader;
+   struct blob *key;
+   uint8_t *data;
+   GLboolean hit = GL_FALSE;
+
+   if (!_mesa_shader_cache_enabled(ctx))
+      return GL_FALSE;
+
+   key = create_program_key(ctx, prog);
+   if (!key)
+      return GL_FALSE;
+
+   data = cache_read(key, &reader);
+   if (data) {
+      hit = _mesa_program_binary_restore(ctx, prog, reader.current,
+                                         reader.end - reader.current);
+      free(data);
+   }
+
+   ralloc_free(key);
+   return hit;
+}
+
+
+/**
+ * Store the binary of a program that linked successfully.
+ */
+void
+_mesa_shader_cache_store_program(struct gl_context *ctx,
+                                 struct gl_shader_program *prog)
+{
+   struct blob *key;
+
+   if (!prog->LinkStatus || !prog->Binary ||
+       !_mesa_shader_cache_enabled(ctx))
+      return;
+
+   key = create_program_key(ctx, prog);
+   if (key) {
+      cache_write(key, prog->Binary, prog->BinarySize);
+      ralloc_free(key);
+   }
+}
+
+
+/**
+ * Serialize a program just linked by link_shaders() into prog->Binary.
+ *
+ * \return GL_FALSE if the program can't be serialized, in which case it
+ *         has no binary
+ */
+GLboolean
+_mesa_program_binary_create(struct gl_context *ctx,
+                            struct gl_shader_program *prog)
+{
+   struct blob *blob = blob_create(NULL);
+   GLboolean ok;
+
+   ralloc_free(prog->Binary);
+   prog->Binary = NULL;
+   prog->BinarySize = 0;
+
+   blob_write_uint32(blob, PROGRAM_BINARY_MAGIC);
+   blob_write_uint64(blob, context_hash(ctx));
+
+   ok = serialize_glsl_program(blob, prog) && !blob->out_of_memory;
+   if (ok) {
+      ralloc_steal(prog, blob->data);
+      prog->Binary = blob->data;
+      prog->BinarySize = blob->size;
+   }
+
+   ralloc_free(blob);
+   return ok;
+}
+
+
+/**
+ * Restore a program from a binary made by _mesa_program_binary_create()
+ * for the same context state, as by link_shaders().
+ *
+ * \return GL_FALSE if the binary is invalid or was made for another
+ *         context, in which case the program isn't linked
+ */
+GLboolean
+_mesa_program_binary_restore(struct gl_context *ctx,
+                             struct gl_shader_program *prog,
+                             const GLvoid *binary, GLsizei length)
+{
+   struct blob_reader reader;
+
+   ralloc_free(prog->Binary);
+   prog->Binary = NULL;
+   prog->BinarySize = 0;
+
+   if (length < 0)
+      return GL_FALSE;
+
+   blob_reader_init(&reader, binary, length);
+   if (blob_read_uint32(&reader) != PROGRAM_BINARY_MAGIC ||
+       blob_read_uint64(&reader) != context_hash(ctx) ||
+       reader.overrun)
+      return GL_FALSE;
+
+   if (!deserialize_glsl_program(&reader, ctx, prog)) {
+      prog->LinkStatus = GL_FALSE;
+      return GL_FALSE;
+   }
+
+   prog->Binary = ralloc_size(prog, length);
+   if (prog->Binary) {
+      memcpy(prog->Binary, binary, length);
+      prog->BinarySize = length;
+   }
+
+   return GL_TRUE;
+}
@@ -0,0 +1,529 @@
+/*
+ * Mesa 3-D graphics library
+ *
+ * Copyright (C) 2014  VMware, Inc.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * \file shader_queue.c
+ * Worker threads for compiling and linking GLSL shaders.
+ *
+ * glCompileShader and glLinkProgram queue a job and return.  The jobs of
+ * all contexts share one pool of worker threads, which is started with
+ * the first job and stopped with the last context.  Anything that needs
+ * the result waits for the job, running it on the calling thread if no
+ * worker has picked it up yet, so the caller never waits on an idle
+ * queue.
+ *
+ * The number of workers defaults to the number of CPUs and can be set with
+ * MESA_GLSL_COMPILER_THREADS.  Zero workers, or a build without pthreads,
+ * means every job runs synchronously, which the callers see as
+ * _mesa_shader_queue_submit() returning NULL.
+ */
+
+
+#include "main/glheader.h"
+#include "main/imports.h"
+#include "main/macros.h"
+#include "main/mtypes.h"
+#include "main/simple_list.h"
+#include "main/shader_queue.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+
+/** Upper bound on the number of worker threads */
+#define SHADER_QUEUE_MAX_THREADS 16
+
+
+struct shader_job
+{
+   /** Links in the queue, while the job isn't started */
+   struct shader_job *next, *prev;
+
+   struct gl_context *ctx;
+   shader_job_func func;
+   void *data;
+
+   /** One reference for the queue, until the job is done, one per holder */
+   GLuint refcount;
+   GLboolean started;
+   GLboolean done;
+};
+
+
+#ifdef HAVE_PTHREAD
+
+static struct {
+   /** Number of contexts alive */
+   GLuint users;
+
+   /** Number of workers wanted, or running once started is set */
+   GLuint num_threads;
+   GLboolean started;
+   GLboolean exit_flag;
+
+   /** Jobs no worker has picked up yet, oldest first */
+   struct shader_job jobs;
+
+   pthread_t threads[SHADER_QUEUE_MAX_THREADS];
+} queue;
+
+/** Protects the queue, the jobs and the counters of their owners */
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Serializes starting and stopping the pool, held across the joins */
+static pthread_mutex_t users_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Signalled when a job is queued, or the workers should exit */
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+
+/** Broadcast when a job is done, or a counter waited on changes */
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+
+static GLuint
+get_num_threads(void)
+{
+   const char *env = _mesa_getenv("MESA_GLSL_COMPILER_THREADS");
+   long n = 1;
+
+   if (env) {
+      n = strtol(env, NULL, 10);
+   }
+   else {
+#ifdef _SC_NPROCESSORS_ONLN
+      n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+   }
+
+   return CLAMP(n, 0, SHADER_QUEUE_MAX_THREADS);
+}
+
+
+static void
+job_unref_locked(struct shader_job *job)
+{
+   assert(job->refcount);
+   if (--job->refcount == 0)
+      free(job);
+}
+
+
+/**
+ * Run a job which was taken off the queue, then drop the queue's
+ * reference.  Called with the mutex held, which is released meanwhile.
+ */
+static void
+run_job_locked(struct shader_job *job)
+{
+   struct gl_context *ctx = job->ctx;
+
+   job->started = GL_TRUE;
+   pthread_mutex_unlock(&queue_mutex);
+
+   job->func(ctx, job->data);
+
+   pthread_mutex_lock(&queue_mutex);
+   job->done = GL_TRUE;
+   assert(ctx->Shader.PendingJobs);
+   ctx->Shader.PendingJobs--;
+   pthread_cond_broadcast(&done_cond);
+   job_unref_locked(job);
+}
+
+
+static void *
+worker_main(void *arg)
+{
+   (void) arg;
+
+   pthread_mutex_lock(&queue_mutex);
+
+   while (1) {
+      struct shader_job *job;
+
+      while (!queue.exit_flag && is_empty_list(&queue.jobs))
+         pthread_cond_wait(&work_cond, &queue_mutex);
+
+      if (queue.exit_flag)
+         break;
+
+      job = first_elem(&queue.jobs);
+      remove_from_list(job);
+      run_job_locked(job);
+   }
+
+   pthread_mutex_unlock(&queue_mutex);
+
+   return NULL;
+}
+
+
+/** Start the workers.  Called with the mutex held. */
+static void
+start_threads_locked(void)
+{
+   GLuint wanted = queue.num_threads, i;
+
+   queue.started = GL_TRUE;
+   queue.num_threads = 0;
+
+   for (i = 0; i < wanted; i++) {
+      if (pthread_create(&queue.threads[queue.num_threads], NULL,
+                         worker_main, NULL) == 0)
+         queue.num_threads++;
+   }
+}
+
+
+void
+_mesa_shader_queue_init(struct gl_context *ctx)
+{
+   ctx->Shader.PendingJobs = 0;
+
+   pthread_mutex_lock(&users_mutex);
+   pthread_mutex_lock(&queue_mutex);
+
+   if (queue.users++ == 0) {
+      queue.num_threads = get_num_threads();
+      queue.started = GL_FALSE;
+      queue.exit_flag = GL_FALSE;
+      make_empty_list(&queue.jobs);
+   }
+
+   pthread_mutex_unlock(&queue_mutex);
+   pthread_mutex_unlock(&users_mutex);
+}
+
+
+/**
+ * Wait for all the jobs queued by a context to be done.  Those no worker
+ * has started yet are run on the calling thread.
+ */
+void
+_mesa_shader_queue_finish(struct gl_context *ctx)
+{
+   struct shader_job *job;
+
+   pthread_mutex_lock(&queue_mutex);
+
+   job = first_elem(&queue.jobs);
+   while (!at_end(&queue.jobs, job)) {
+      if (job->ctx != ctx) {
+         job = next_elem(job);
+         continue;
+      }
+
+      remove_from_list(job);
+      run_job_locked(job);
+
+      /* The queue may have changed while the lock was released */
+      job = first_elem(&queue.jobs);
+   }
+
+   while (ctx->Shader.PendingJobs)
+      pthread_cond_wait(&done_cond, &queue_mutex);
+
+   pthread_mutex_unlock(&queue_mutex);
+}
+
+
+/**
+ * Wait for the jobs of a context to be done, and stop the workers if it
+ * was the last context.
+ */
+void
+_mesa_shader_queue_fini(struct gl_context *ctx)
+{
+   GLuint num_threads = 0, i;
+
+   _mesa_shader_queue_finish(ctx);
+
+   pthread_mutex_lock(&users_mutex);
+   pthread_mutex_lock(&queue_mutex);
+
+   assert(!ctx->Shader.PendingJobs);
+
+   assert(queue.users);
+   if (--queue.users == 0 && queue.started) {
+      assert(is_empty_list(&queue.jobs));
+      num_threads = queue.num_threads;
+      queue.exit_flag = GL_TRUE;
+      queue.started = GL_FALSE;
+      pthread_cond_broadcast(&work_cond);
+   }
+
+   pthread_mutex_unlock(&queue_mutex);
+
+   for (i = 0; i < num_threads; i++)
+      pthread_join(queue.threads[i], NULL);
+
+   pthread_mutex_unlock(&users_mutex);
+}
+
+
+/**
+ * Queue a call to func(ctx, data) on a worker thread.
+ * \return a reference to the job, to be waited on before using its
+ *         results, or NULL if the caller should call func itself
+ */
+struct shader_job *
+_mesa_shader_queue_submit(struct gl_context *ctx,
+                          shader_job_func func, void *data)
+{
+   struct shader_job *job;
+
+   if (!ctx->Shader.MaxCompilerThreads)
+      return NULL;
+
+   pthread_mutex_lock(&queue_mutex);
+
+   if (!queue.started)
+      start_threads_locked();
+
+   job = queue.num_threads ? calloc(1, sizeof *job) : NULL;
+   if (job) {
+      job->ctx = ctx;
+      job->func = func;
+      job->data = data;
+      job->refcount = 2;
+      insert_at_tail(&queue.jobs, job);
+      ctx->Shader.PendingJobs++;
+      pthread_cond_signal(&work_cond);
+   }
+
+   pthread_mutex_unlock(&queue_mutex);
+
+   return job;
+}
+
+
+/**
+ * Wait for a job to be done.  A job no worker has started yet is run on
+ * the calling thread instead.
+ */
+void
+_mesa_shader_job_wait(struct shader_job *job)
+{
+   if (!job)
+      return;
+
+   pthread_mutex_lock(&queue_mutex);
+
+   if (!job->started) {
+      remove_from_list(job);
+      run_job_locked(job);
+   }
+
+   while (!job->done)
+      pthread_cond_wait(&done_cond, &queue_mutex);
+
+   pthread_mutex_unlock(&queue_mutex);
+}
+
+
+GLboolean
+_mesa_shader_job_is_done(struct shader_job *job)
+{
+   GLboolean done;
+
+   pthread_mutex_lock(&queue_mutex);
+   done = _mesa_shader_job_is_done_locked(job);
+   pthread_mutex_unlock(&queue_mutex);
+
+   return done;
+}
+
+
+GLboolean
+_mesa_shader_job_is_done_locked(struct shader_job *job)
+{
+   return !job || job->done;
+}
+
+
+void
+_mesa_shader_job_reference(struct shader_job **ptr, struct shader_job *job)
+{
+   if (*ptr == job)
+      return;
+
+   pthread_mutex_lock(&queue_mutex);
+   _mesa_shader_job_reference_locked(ptr, job);
+   pthread_mutex_unlock(&queue_mutex);
+}
+
+
+/**
+ * Like _mesa_shader_job_reference(), for pointers which are shared
+ * between threads and so only read or written with the lock held.
+ */
+void
+_mesa_shader_job_reference_locked(struct shader_job **ptr,
+                                  struct shader_job *job)
+{
+   if (job)
+      job->refcount++;
+   if (*ptr)
+      job_unref_locked(*ptr);
+
+   *ptr = job;
+}
+
+
+/**
+ * The queue's mutex also protects counters shared between the jobs and
+ * the application thread, such as gl_shader::PendingLinks.  Waiters sleep
+ * in _mesa_shader_queue_wait_locked() until someone calls
+ * _mesa_shader_queue_notify_locked() or a job is done.
+ */
+void
+_mesa_shader_queue_lock(void)
+{
+   pthread_mutex_lock(&queue_mutex);
+}
+
+
+void
+_mesa_shader_queue_unlock(void)
+{
+   pthread_mutex_unlock(&queue_mutex);
+}
+
+
+void
+_mesa_shader_queue_wait_locked(void)
+{
+   pthread_cond_wait(&done_cond, &queue_mutex);
+}
+
+
+void
+_mesa_shader_queue_notify_locked(void)
+{
+   pthread_cond_broadcast(&done_cond);
+}
+
+#else /* HAVE_PTHREAD */
+
+void
+_mesa_shader_queue_init(struct gl_context *ctx)
+{
+   ctx->Shader.PendingJobs = 0;
+}
+
+
+void
+_mesa_shader_queue_finish(struct gl_context *ctx)
+{
+   (void) ctx;
+}
+
+
+void
+_mesa_shader_queue_fini(struct gl_context *ctx)
+{
+   (void) ctx;
+}
+
+
+struct shader_job *
+_mesa_shader_queue_submit(struct gl_context *ctx,
+                          shader_job_func func, void *data)
+{
+   (void) ctx;
+   (void) func;
+   (void) data;
+   return NULL;
+}
+
+
+void
+_mesa_shader_job_wait(struct shader_job *job)
+{
+   assert(!job);
+}
+
+
+GLboolean
+_mesa_shader_job_is_done(struct shader_job *job)
+{
+   assert(!job);
+   return GL_TRUE;
+}
+
+
+GLboolean
+_mesa_shader_job_is_done_locked(struct shader_job *job)
+{
+   assert(!job);
+   return GL_TRUE;
+}
+
+
+void
+_mesa_shader_job_reference(struct shader_job **ptr, struct shader_job *job)
+{
+   assert(!job);
+   *ptr = job;
+}
+
+
+void
+_mesa_shader_job_reference_locked(struct shader_job **ptr,
+                                  struct shader_job *job)
+{
+   assert(!job);
+   *ptr = job;
+}
+
+
+void
+_mesa_shader_queue_lock(void)
+{
+}
+
+
+void
+_mesa_shader_queue_unlock(void)
+{
+}
+
+
+void
+_mesa_shader_queue_wait_locked(void)
+{
+   /* Nothing runs concurrently, so whatever is waited on can't change */
+   assert(!"waiting without worker threads");
+}
+
+
+void
+_mesa_shader_queue_notify_locked(void)
+{
+}
+
+#endif /* HAVE_PTHREAD */
@@ -0,0 +1,96 @@
+/*
+ * Mesa 3-D graphics library
+ *
+ * Copyright (C) 2014  VMware, Inc.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * \file shader_queue.h
+ * Worker threads for compiling and linking GLSL shaders.
+ */
+
+
+#ifndef SHADER_QUEUE_H
+#define SHADER_QUEUE_H
+
+
+#include "main/glheader.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct gl_context;
+struct shader_job;
+
+typedef void (*shader_job_func)(struct gl_context *ctx, void *data);
+
+
+extern void
+_mesa_shader_queue_init(struct gl_context *ctx);
+
+extern void
+_mesa_shader_queue_finish(struct gl_context *ctx);
+
+extern void
+_mesa_shader_queue_fini(struct gl_context *ctx);
+
+extern struct shader_job *
+_mesa_shader_queue_submit(struct gl_context *ctx,
+                          shader_job_func func, void *data);
+
+extern void
+_mesa_shader_job_wait(struct shader_job *job);
+
+extern GLboolean
+_mesa_shader_job_is_done(struct shader_job *job);
+
+extern GLboolean
+_mesa_shader_job_is_done_locked(struct shader_job *job);
+
+extern void
+_mesa_shader_job_reference(struct shader_job **ptr, struct shader_job *job);
+
+extern void
+_mesa_shader_job_reference_locked(struct shader_job **ptr,
+                                  struct shader_job *job);
+
+extern void
+_mesa_shader_queue_lock(void);
+
+extern void
+_mesa_shader_queue_unlock(void);
+
+extern void
+_mesa_shader_queue_wait_locked(void);
+
+extern void
+_mesa_shader_queue_notify_locked(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SHADER_QUEUE_H */
@@ -45,6 +45,8 @@
 #include "main/mtypes.h"
 #include "main/shaderapi.h"
 #include "main/shaderobj.h"
+#include "main/shader_cache.h"
+#include "main/shader_queue.h"
 #include "main/transformfeedback.h"
 #include "main/uniforms.h"
 #include "program/program.h"
@@ -115,6 +117,9 @@ _mesa_init_shader_state(struct gl_context *ctx)
       memcpy(&ctx->ShaderCompilerOptions[sh], &options, sizeof(options));
 
    ctx->Shader.Flags = get_shader_flags();
+
+   ctx->Shader.MaxCompilerThreads = 0xffffffff;
+   _mesa_shader_queue_init(ctx);
 }
 
 
@@ -124,6 +129,8 @@ _mesa_init_shader_state(struct gl_context *ctx)
 void
 _mesa_free_shader_state(struct gl_context *ctx)
 {
+   _mesa_shader_queue_fini(ctx);
+
    _mesa_reference_shader_program(ctx, &ctx->Shader.CurrentVertexProgram, NULL);
    _mesa_reference_shader_program(ctx, &ctx->Shader.CurrentGeometryProgram,
 				  NULL);
@@ -461,8 +468,7 @@ get_handle(struct gl_context *ctx, GLenum pname)
 static void
 get_programiv(struct gl_context *ctx, GLuint program, GLenum pname, GLint *params)
 {
-   struct gl_shader_program *shProg
-      = _mesa_lookup_shader_program(ctx, program);
+   struct gl_shader_program *shProg;
 
    /* Is transform feedback available in this context?
     */
@@ -483,6 +489,19 @@ get_programiv(struct gl_context *ctx, GLuint program, GLenum pname, GLint *param
       || ctx->API == API_OPENGL_CORE
       || _mesa_is_gles3(ctx);
 
+   if (pname == GL_COMPLETION_STATUS_ARB && _mesa_is_desktop_gl(ctx)) {
+      /* Polling mustn't wait for the link, which the usual lookup does */
+      shProg = program ? (struct gl_shader_program *)
+         _mesa_HashLookup(ctx->Shared->ShaderObjects, program) : NULL;
+      if (!shProg || shProg->Type != GL_SHADER_PROGRAM_MESA) {
+         _mesa_error(ctx, GL_INVALID_VALUE, "glGetProgramiv(program)");
+         return;
+      }
+      *params = _mesa_shader_program_link_done(shProg);
+      return;
+   }
+
+   shProg = _mesa_lookup_shader_program(ctx, program);
    if (!shProg) {
       _mesa_error(ctx, GL_INVALID_VALUE, "glGetProgramiv(program)");
       return;
@@ -612,7 +631,7 @@ get_programiv(struct gl_context *ctx, GLuint program, GLenum pname, GLint *param
       *params = shProg->BinaryRetreivableHint;
       return;
    case GL_PROGRAM_BINARY_LENGTH:
-      *params = 0;
+      *params = shProg->LinkStatus ? shProg->BinarySize : 0;
       return;
    default:
       break;
@@ -636,6 +655,13 @@ get_shaderiv(struct gl_context *ctx, GLuint name, GLenum pname, GLint *params)
       return;
    }
 
+   if (pname == GL_COMPLETION_STATUS_ARB && _mesa_is_desktop_gl(ctx)) {
+      *params = _mesa_shader_compile_done(shader);
+      return;
+   }
+
+   _mesa_wait_shader(shader);
+
    switch (pname) {
    case GL_SHADER_TYPE:
       *params = shader->Type;
@@ -682,6 +708,7 @@ get_shader_info_log(struct gl_context *ctx, GLuint shader, GLsizei bufSize,
       _mesa_error(ctx, GL_INVALID_VALUE, "glGetShaderInfoLog(shader)");
       return;
    }
+   _mesa_wait_shader(sh);
    _mesa_copy_string(infoLog, bufSize, length, sh->InfoLog);
 }
 
@@ -715,6 +742,9 @@ shader_source(struct gl_context *ctx, GLuint shader, const GLchar *source)
    if (!sh)
       return;
 
+   /* A queued compile or link may still be reading the old source */
+   _mesa_wait_shader(sh);
+
    /* free old shader source string and install new one */
    free((void *)sh->Source);
    sh->Source = source;
@@ -725,6 +755,24 @@ shader_source(struct gl_context *ctx, GLuint shader, const GLchar *source)
 }
 
 
+/**
+ * Whether glCompileShader and glLinkProgram may leave the work to the
+ * shader queue.  The MESA_GLSL debug flags expect it done in order.
+ */
+static GLboolean
+shader_jobs_enabled(const struct gl_context *ctx)
+{
+   return ctx->Shader.MaxCompilerThreads != 0 && ctx->Shader.Flags == 0;
+}
+
+
+static void
+compile_shader_job(struct gl_context *ctx, void *data)
+{
+   _mesa_glsl_compile_shader(ctx, (struct gl_shader *) data);
+}
+
+
 /**
  * Compile a shader.
  */
@@ -738,11 +786,27 @@ compile_shader(struct gl_context *ctx, GLuint shaderObj)
    if (!sh)
       return;
 
+   _mesa_wait_shader(sh);
+
    options = &ctx->ShaderCompilerOptions[_mesa_shader_type_to_index(sh->Type)];
 
    /* set default pragma state for shader */
    sh->Pragmas = options->DefaultPragmas;
 
+   if (shader_jobs_enabled(ctx)) {
+      struct shader_job *job =
+         _mesa_shader_queue_submit(ctx, compile_shader_job, sh);
+
+      if (job) {
+         /* Hand our reference over to the shader */
+         _mesa_shader_queue_lock();
+         assert(!sh->CompileJob);
+         sh->CompileJob = job;
+         _mesa_shader_queue_unlock();
+         return;
+      }
+   }
+
    /* this call will set the sh->CompileStatus field to indicate if
     * compilation was successful.
     */
@@ -756,6 +820,158 @@ compile_shader(struct gl_context *ctx, GLuint shaderObj)
 }
 
 
+/**
+ * A queued link of a program.  It holds references to the queued compiles
+ * of the attached shaders, and counts in their PendingLinks.
+ */
+struct link_job
+{
+   struct gl_shader_program *prog;
+   struct shader_job **compiles;
+};
+
+
+static void
+link_job_destroy(struct link_job *job)
+{
+   struct gl_shader_program *shProg = job->prog;
+   GLuint i;
+
+   _mesa_shader_queue_lock();
+   for (i = 0; i < shProg->NumShaders; i++) {
+      assert(shProg->Shaders[i]->PendingLinks);
+      shProg->Shaders[i]->PendingLinks--;
+   }
+   _mesa_shader_queue_notify_locked();
+   _mesa_shader_queue_unlock();
+
+   for (i = 0; i < shProg->NumShaders; i++)
+      _mesa_shader_job_reference(&job->compiles[i], NULL);
+
+   free(job->compiles);
+   free(job);
+}
+
+
+static GLboolean
+shaders_linking_locked(const struct gl_shader_program *shProg)
+{
+   GLuint i;
+
+   for (i = 0; i < shProg->NumShaders; i++) {
+      if (shProg->Shaders[i]->Linking)
+         return GL_TRUE;
+   }
+
+   return GL_FALSE;
+}
+
+
+static void
+set_shaders_linking_locked(struct gl_shader_program *shProg, GLboolean linking)
+{
+   GLuint i;
+
+   for (i = 0; i < shProg->NumShaders; i++)
+      shProg->Shaders[i]->Linking = linking;
+}
+
+
+static void
+link_program_job(struct gl_context *ctx, void *data)
+{
+   struct link_job *job = (struct link_job *) data;
+   struct gl_shader_program *shProg = job->prog;
+   GLuint i;
+
+   for (i = 0; i < shProg->NumShaders; i++)
+      _mesa_shader_job_wait(job->compiles[i]);
+
+   /* The linker reads the shaders' IR and symbol tables, which aren't made
+    * for concurrent access, so programs sharing a shader are linked one at
+    * a time.
+    */
+   _mesa_shader_queue_lock();
+   while (shaders_linking_locked(shProg))
+      _mesa_shader_queue_wait_locked();
+   set_shaders_linking_locked(shProg, GL_TRUE);
+   _mesa_shader_queue_unlock();
+
+   _mesa_glsl_link_shader_run(ctx, shProg);
+
+   _mesa_shader_queue_lock();
+   set_shaders_linking_locked(shProg, GL_FALSE);
+   _mesa_shader_queue_unlock();
+
+   link_job_destroy(job);
+}
+
+
+/**
+ * Queue the GLSL part of linking a program.  The rest is done by
+ * _mesa_wait_shader_program() the next time the program is looked up.
+ * \return GL_FALSE if the caller should link the program itself
+ */
+static GLboolean
+queue_link_program(struct gl_context *ctx, struct gl_shader_program *shProg)
+{
+   struct link_job *job;
+   struct shader_job *link;
+   GLuint i;
+
+   job = calloc(1, sizeof *job);
+   if (!job)
+      return GL_FALSE;
+
+   job->prog = shProg;
+   /* + 1 so that a program without shaders doesn't look like a failure */
+   job->compiles = calloc(shProg->NumShaders + 1, sizeof job->compiles[0]);
+   if (!job->compiles) {
+      free(job);
+      return GL_FALSE;
+   }
+
+   _mesa_shader_queue_lock();
+   for (i = 0; i < shProg->NumShaders; i++) {
+      _mesa_shader_job_reference_locked(&job->compiles[i],
+                                        shProg->Shaders[i]->CompileJob);
+      shProg->Shaders[i]->PendingLinks++;
+   }
+   _mesa_shader_queue_unlock();
+
+   _mesa_glsl_link_shader_begin(ctx, shProg);
+
+   link = _mesa_shader_queue_submit(ctx, link_program_job, job);
+   if (!link) {
+      link_job_destroy(job);
+      return GL_FALSE;
+   }
+
+   /* Hand our reference over to the program */
+   _mesa_shader_queue_lock();
+   assert(!shProg->LinkJob && !shProg->LinkFinishing);
+   shProg->LinkJob = link;
+   _mesa_shader_queue_unlock();
+
+   return GL_TRUE;
+}
+
+
+/**
+ * Whether rendering or glUniform may be using the program's current link,
+ * in which case it's replaced right away.
+ */
+static GLboolean
+program_is_current(const struct gl_context *ctx,
+                   const struct gl_shader_program *shProg)
+{
+   return shProg == ctx->Shader.CurrentVertexProgram ||
+          shProg == ctx->Shader.CurrentGeometryProgram ||
+          shProg == ctx->Shader.CurrentFragmentProgram ||
+          shProg == ctx->Shader.ActiveProgram;
+}
+
+
 /**
  * Link a program's shaders.
  */
@@ -765,6 +981,7 @@ link_program(struct gl_context *ctx, GLuint program)
    struct gl_shader_program *shProg;
    struct gl_transform_feedback_object *obj =
       ctx->TransformFeedback.CurrentObject;
+   GLuint i;
 
    shProg = _mesa_lookup_shader_program_err(ctx, program, "glLinkProgram");
    if (!shProg)
@@ -781,6 +998,13 @@ link_program(struct gl_context *ctx, GLuint program)
 
    FLUSH_VERTICES(ctx, _NEW_PROGRAM);
 
+   if (shader_jobs_enabled(ctx) && !program_is_current(ctx, shProg) &&
+       queue_link_program(ctx, shProg))
+      return;
+
+   for (i = 0; i < shProg->NumShaders; i++)
+      _mesa_wait_shader(shProg->Shaders[i]);
+
    _mesa_glsl_link_shader(ctx, shProg);
 
    if (shProg->LinkStatus == GL_FALSE && 
@@ -1566,8 +1790,28 @@ _mesa_GetProgramBinary(GLuint program, GLsizei bufSize, GLsizei *length,
    if (length != NULL)
       *length = 0;
 
-   (void) binaryFormat;
-   (void) binary;
+   /* Programs that couldn't be serialized have no binary */
+   if (!shProg->Binary) {
+      _mesa_error(ctx, GL_INVALID_OPERATION,
+                  "glGetProgramBinary(no binary available)");
+      return;
+   }
+
+   /* The ARB_get_program_binary spec says:
+    *
+    *     "If <bufSize> is less than the number of bytes in the binary, then
+    *     an INVALID_OPERATION error is thrown."
+    */
+   if ((GLuint) bufSize < shProg->BinarySize) {
+      _mesa_error(ctx, GL_INVALID_OPERATION,
+                  "glGetProgramBinary(bufSize too small)");
+      return;
+   }
+
+   memcpy(binary, shProg->Binary, shProg->BinarySize);
+   *binaryFormat = GL_PROGRAM_BINARY_FORMAT_MESA;
+   if (length != NULL)
+      *length = shProg->BinarySize;
 }
 
 void GLAPIENTRY
@@ -1581,10 +1825,37 @@ _mesa_ProgramBinary(GLuint program, GLenum binaryFormat,
    if (!shProg)
       return;
 
-   (void) binaryFormat;
-   (void) binary;
-   (void) length;
-   _mesa_error(ctx, GL_INVALID_OPERATION, __FUNCTION__);
+   if (binaryFormat != GL_PROGRAM_BINARY_FORMAT_MESA) {
+      _mesa_error(ctx, GL_INVALID_ENUM, "glProgramBinary(binaryFormat)");
+      return;
+   }
+
+   FLUSH_VERTICES(ctx, _NEW_PROGRAM);
+
+   _mesa_clear_shader_program_data(ctx, shProg);
+
+   /* The ARB_get_program_binary spec says:
+    *
+    *     "If ProgramBinary fails to load a binary, no error is generated,
+    *     but any information about a previous link or load of that program
+    *     object is lost. Thus, a failed load does not restore the old state
+    *     of <program>."
+    *
+    * A binary from another Mesa build or context configuration is rejected
+    * this way, and the application falls back to compiling from source.
+    */
+   if (_mesa_program_binary_restore(ctx, shProg, binary, length) &&
+       ctx->Driver.LinkShader(ctx, shProg)) {
+      shProg->LinkStatus = GL_TRUE;
+   }
+   else {
+      shProg->LinkStatus = GL_FALSE;
+      ralloc_free(shProg->InfoLog);
+      shProg->InfoLog = ralloc_strdup(shProg,
+                                      "program binary is invalid or was "
+                                      "made for a different Mesa build "
+                                      "or context\n");
+   }
 }
 
 
@@ -1702,6 +1973,20 @@ _mesa_ProgramParameteri(GLuint program, GLenum pname, GLint value)
                _mesa_lookup_enum_by_nr(pname));
 }
 
+
+/**
+ * GL_ARB_parallel_shader_compile.  The worker threads are shared by all
+ * contexts, so the count is only a hint: zero makes this context compile
+ * and link on its own thread, anything else lets it use the shader queue.
+ */
+void GLAPIENTRY
+_mesa_MaxShaderCompilerThreadsARB(GLuint count)
+{
+   GET_CURRENT_CONTEXT(ctx);
+
+   ctx->Shader.MaxCompilerThreads = count;
+}
+
 void
 _mesa_use_shader_program(struct gl_context *ctx, GLenum type,
 			 struct gl_shader_program *shProg)
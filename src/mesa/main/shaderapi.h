@@ -197,6 +197,9 @@ _mesa_ProgramBinary(GLuint program, GLenum binaryFormat,
 extern void GLAPIENTRY
 _mesa_ProgramParameteri(GLuint program, GLenum pname, GLint value);
 
+extern void GLAPIENTRY
+_mesa_MaxShaderCompilerThreadsARB(GLuint count);
+
 void
 _mesa_use_shader_program(struct gl_context *ctx, GLenum type,
 			 struct gl_shader_program *shProg);
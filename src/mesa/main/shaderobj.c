@@ -35,7 +35,9 @@
 #include "main/hash.h"
 #include "main/mtypes.h"
 #include "main/shaderobj.h"
+#include "main/shader_queue.h"
 #include "main/uniforms.h"
+#include "program/ir_to_mesa.h"
 #include "program/program.h"
 #include "program/prog_parameter.h"
 #include "program/hash_table.h"
@@ -124,6 +126,8 @@ _mesa_new_shader(struct gl_context *ctx, GLuint name, GLenum type)
 static void
 _mesa_delete_shader(struct gl_context *ctx, struct gl_shader *sh)
 {
+   _mesa_wait_shader(sh);
+
    free((void *)sh->Source);
    _mesa_reference_program(ctx, &sh->Program, NULL);
    ralloc_free(sh);
@@ -290,6 +294,10 @@ _mesa_clear_shader_program_data(struct gl_context *ctx,
       shProg->UniformHash = NULL;
    }
 
+   ralloc_free(shProg->Binary);
+   shProg->Binary = NULL;
+   shProg->BinarySize = 0;
+
    assert(shProg->InfoLog != NULL);
    ralloc_free(shProg->InfoLog);
    shProg->InfoLog = ralloc_strdup(shProg, "");
@@ -309,6 +317,13 @@ _mesa_free_shader_program_data(struct gl_context *ctx,
 
    assert(shProg->Type == GL_SHADER_PROGRAM_MESA);
 
+   /* The result of a queued link is thrown away without generating code.
+    * Nothing else can be waiting for it, as the program is being deleted.
+    */
+   assert(!shProg->LinkFinishing);
+   _mesa_shader_job_wait(shProg->LinkJob);
+   _mesa_shader_job_reference(&shProg->LinkJob, NULL);
+
    _mesa_clear_shader_program_data(ctx, shProg);
 
    if (shProg->AttributeBindings) {
@@ -383,6 +398,8 @@ _mesa_lookup_shader_program(struct gl_context *ctx, GLuint name)
       if (shProg && shProg->Type != GL_SHADER_PROGRAM_MESA) {
          return NULL;
       }
+      if (shProg)
+         _mesa_wait_shader_program(ctx, shProg);
       return shProg;
    }
    return NULL;
@@ -411,11 +428,117 @@ _mesa_lookup_shader_program_err(struct gl_context *ctx, GLuint name,
          _mesa_error(ctx, GL_INVALID_OPERATION, "%s", caller);
          return NULL;
       }
+      _mesa_wait_shader_program(ctx, shProg);
       return shProg;
    }
 }
 
 
+/**
+ * Wait for the queued compile of a shader, and for the queued links of
+ * the programs it's attached to, which read it.  Called before anything
+ * looks at or changes the result of compiling the shader.
+ *
+ * Contexts sharing the shader may call this concurrently, so the job is
+ * only accessed through a reference of our own, taken with the lock held.
+ */
+void
+_mesa_wait_shader(struct gl_shader *sh)
+{
+   struct shader_job *job = NULL;
+
+   _mesa_shader_queue_lock();
+   _mesa_shader_job_reference_locked(&job, sh->CompileJob);
+   _mesa_shader_queue_unlock();
+
+   if (job) {
+      _mesa_shader_job_wait(job);
+
+      _mesa_shader_queue_lock();
+      if (sh->CompileJob == job)
+         _mesa_shader_job_reference_locked(&sh->CompileJob, NULL);
+      _mesa_shader_job_reference_locked(&job, NULL);
+      _mesa_shader_queue_unlock();
+   }
+
+   _mesa_shader_queue_lock();
+   while (sh->PendingLinks)
+      _mesa_shader_queue_wait_locked();
+   _mesa_shader_queue_unlock();
+}
+
+
+/**
+ * Wait for the queued link of a program, if any, and finish it on this
+ * thread.  The lookup functions above do this, so that a program is
+ * always completely linked by the time anything uses it.
+ *
+ * Contexts sharing the program may call this concurrently.  The first
+ * one takes the job and finishes the link, the others wait for it.
+ */
+void
+_mesa_wait_shader_program(struct gl_context *ctx,
+                          struct gl_shader_program *shProg)
+{
+   struct shader_job *job;
+
+   _mesa_shader_queue_lock();
+   while (shProg->LinkFinishing)
+      _mesa_shader_queue_wait_locked();
+
+   /* Take over the program's reference */
+   job = shProg->LinkJob;
+   shProg->LinkJob = NULL;
+   shProg->LinkFinishing = job != NULL;
+   _mesa_shader_queue_unlock();
+
+   if (!job)
+      return;
+
+   _mesa_shader_job_wait(job);
+   _mesa_shader_job_reference(&job, NULL);
+   _mesa_glsl_link_shader_end(ctx, shProg);
+
+   _mesa_shader_queue_lock();
+   shProg->LinkFinishing = GL_FALSE;
+   _mesa_shader_queue_notify_locked();
+   _mesa_shader_queue_unlock();
+}
+
+
+/**
+ * Whether a program's queued link is done, without waiting for it.
+ */
+GLboolean
+_mesa_shader_program_link_done(struct gl_shader_program *shProg)
+{
+   GLboolean done;
+
+   _mesa_shader_queue_lock();
+   done = _mesa_shader_job_is_done_locked(shProg->LinkJob) &&
+          !shProg->LinkFinishing;
+   _mesa_shader_queue_unlock();
+
+   return done;
+}
+
+
+/**
+ * Whether a shader's queued compile is done, without waiting for it.
+ */
+GLboolean
+_mesa_shader_compile_done(struct gl_shader *sh)
+{
+   GLboolean done;
+
+   _mesa_shader_queue_lock();
+   done = _mesa_shader_job_is_done_locked(sh->CompileJob);
+   _mesa_shader_queue_unlock();
+
+   return done;
+}
+
+
 void
 _mesa_init_shader_object_functions(struct dd_function_table *driver)
 {
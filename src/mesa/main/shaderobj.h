@@ -90,6 +90,19 @@ extern void
 _mesa_free_shader_program_data(struct gl_context *ctx,
                                struct gl_shader_program *shProg);
 
+extern void
+_mesa_wait_shader(struct gl_shader *sh);
+
+extern void
+_mesa_wait_shader_program(struct gl_context *ctx,
+                          struct gl_shader_program *shProg);
+
+extern GLboolean
+_mesa_shader_compile_done(struct gl_shader *sh);
+
+extern GLboolean
+_mesa_shader_program_link_done(struct gl_shader_program *shProg);
+
 
 
 extern void
@@ -899,6 +899,9 @@ const struct function gl_core_functions_possible[] = {
    /* GL_ARB_internalformat_query */
    { "glGetInternalformativ", 30, -1 },
 
+   /* GL_ARB_parallel_shader_compile */
+   { "glMaxShaderCompilerThreadsARB", 31, -1 },
+
    { NULL, 0, -1 }
 };
 
@@ -0,0 +1,334 @@
+/*
+ * Copyright © 2014 VMware, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+
+#include "main/glheader.h"
+#include "main/macros.h"
+#include "main/mtypes.h"
+#include "main/shader_queue.h"
+
+#ifdef HAVE_PTHREAD
+
+#include <pthread.h>
+#include <unistd.h>
+
+#define NUM_THREADS 4
+
+/**
+ * A job counting how often it ran, and on which thread.  The fields are
+ * protected by the shader queue's lock.
+ */
+struct count_job {
+   unsigned runs;
+   unsigned delay_us;
+   struct gl_context *ctx;
+   pthread_t thread;
+};
+
+static void
+count_job_func(struct gl_context *ctx, void *data)
+{
+   struct count_job *job = (struct count_job *) data;
+
+   if (job->delay_us)
+      usleep(job->delay_us);
+
+   _mesa_shader_queue_lock();
+   job->runs++;
+   job->ctx = ctx;
+   job->thread = pthread_self();
+   _mesa_shader_queue_unlock();
+}
+
+static unsigned
+count_job_runs(struct count_job *job)
+{
+   unsigned runs;
+
+   _mesa_shader_queue_lock();
+   runs = job->runs;
+   _mesa_shader_queue_unlock();
+
+   return runs;
+}
+
+/**
+ * A job which keeps a worker busy until the gate is opened.
+ */
+struct gate {
+   unsigned entered;
+   GLboolean open;
+};
+
+static void
+gate_job_func(struct gl_context *ctx, void *data)
+{
+   struct gate *gate = (struct gate *) data;
+
+   (void) ctx;
+
+   _mesa_shader_queue_lock();
+   gate->entered++;
+   _mesa_shader_queue_notify_locked();
+   while (!gate->open)
+      _mesa_shader_queue_wait_locked();
+   _mesa_shader_queue_unlock();
+}
+
+
+class shader_queue : public ::testing::Test {
+public:
+   virtual void SetUp();
+   virtual void TearDown();
+
+   void block_workers();
+   void unblock_workers();
+
+   struct gl_context *ctx;
+   struct gate gate;
+   struct shader_job *gate_jobs[NUM_THREADS];
+};
+
+void
+shader_queue::SetUp()
+{
+   setenv("MESA_GLSL_COMPILER_THREADS", "4", 1);
+
+   ctx = (struct gl_context *) calloc(1, sizeof *ctx);
+   ctx->Shader.MaxCompilerThreads = ~0u;
+   _mesa_shader_queue_init(ctx);
+
+   memset(&gate, 0, sizeof gate);
+   memset(gate_jobs, 0, sizeof gate_jobs);
+}
+
+void
+shader_queue::TearDown()
+{
+   unblock_workers();
+   _mesa_shader_queue_fini(ctx);
+   EXPECT_EQ(0u, ctx->Shader.PendingJobs);
+   free(ctx);
+}
+
+/**
+ * Occupy every worker, so that jobs submitted next stay queued.
+ */
+void
+shader_queue::block_workers()
+{
+   for (unsigned i = 0; i < NUM_THREADS; i++) {
+      gate_jobs[i] = _mesa_shader_queue_submit(ctx, gate_job_func, &gate);
+      ASSERT_TRUE(gate_jobs[i] != NULL);
+   }
+
+   _mesa_shader_queue_lock();
+   while (gate.entered < NUM_THREADS)
+      _mesa_shader_queue_wait_locked();
+   _mesa_shader_queue_unlock();
+}
+
+void
+shader_queue::unblock_workers()
+{
+   _mesa_shader_queue_lock();
+   gate.open = GL_TRUE;
+   _mesa_shader_queue_notify_locked();
+   _mesa_shader_queue_unlock();
+
+   for (unsigned i = 0; i < NUM_THREADS; i++) {
+      _mesa_shader_job_wait(gate_jobs[i]);
+      _mesa_shader_job_reference(&gate_jobs[i], NULL);
+   }
+}
+
+
+TEST_F(shader_queue, submit_and_wait)
+{
+   struct count_job data = { 0, 1000, NULL, 0 };
+   struct shader_job *job;
+
+   job = _mesa_shader_queue_submit(ctx, count_job_func, &data);
+   ASSERT_TRUE(job != NULL);
+
+   _mesa_shader_job_wait(job);
+   EXPECT_TRUE(_mesa_shader_job_is_done(job));
+   EXPECT_EQ(1u, count_job_runs(&data));
+   EXPECT_EQ(ctx, data.ctx);
+
+   _mesa_shader_job_reference(&job, NULL);
+   EXPECT_TRUE(job == NULL);
+}
+
+TEST_F(shader_queue, wait_after_finish)
+{
+   struct count_job data = { 0, 0, NULL, 0 };
+   struct shader_job *job;
+
+   job = _mesa_shader_queue_submit(ctx, count_job_func, &data);
+   ASSERT_TRUE(job != NULL);
+
+   while (!_mesa_shader_job_is_done(job))
+      usleep(100);
+
+   /* Must neither block nor run the job again */
+   _mesa_shader_job_wait(job);
+   _mesa_shader_job_wait(job);
+   EXPECT_EQ(1u, count_job_runs(&data));
+   EXPECT_TRUE(_mesa_shader_job_is_done(job));
+
+   _mesa_shader_job_reference(&job, NULL);
+}
+
+TEST_F(shader_queue, reference)
+{
+   struct count_job data = { 0, 1000, NULL, 0 };
+   struct shader_job *job, *other = NULL;
+
+   job = _mesa_shader_queue_submit(ctx, count_job_func, &data);
+   ASSERT_TRUE(job != NULL);
+
+   _mesa_shader_job_reference(&other, job);
+   EXPECT_EQ(job, other);
+   _mesa_shader_job_reference(&other, job);
+   EXPECT_EQ(job, other);
+
+   /* The job outlives the submitter's reference */
+   _mesa_shader_job_reference(&job, NULL);
+   _mesa_shader_job_wait(other);
+   EXPECT_TRUE(_mesa_shader_job_is_done(other));
+   EXPECT_EQ(1u, count_job_runs(&data));
+
+   _mesa_shader_job_reference(&other, NULL);
+   EXPECT_TRUE(other == NULL);
+
+   /* Dropping every reference before the job ran */
+   job = _mesa_shader_queue_submit(ctx, count_job_func, &data);
+   ASSERT_TRUE(job != NULL);
+   _mesa_shader_job_reference(&job, NULL);
+   _mesa_shader_queue_finish(ctx);
+   EXPECT_EQ(2u, count_job_runs(&data));
+}
+
+TEST_F(shader_queue, wait_runs_queued_job)
+{
+   struct count_job data = { 0, 0, NULL, 0 };
+   struct shader_job *job;
+
+   block_workers();
+
+   job = _mesa_shader_queue_submit(ctx, count_job_func, &data);
+   ASSERT_TRUE(job != NULL);
+   EXPECT_FALSE(_mesa_shader_job_is_done(job));
+
+   /* No worker is free, so the job runs here */
+   _mesa_shader_job_wait(job);
+   EXPECT_EQ(1u, count_job_runs(&data));
+   EXPECT_TRUE(pthread_equal(pthread_self(), data.thread));
+
+   _mesa_shader_job_reference(&job, NULL);
+}
+
+struct waiter {
+   struct shader_job *job;
+   pthread_t thread;
+};
+
+static void *
+waiter_main(void *data)
+{
+   struct waiter *waiter = (struct waiter *) data;
+
+   _mesa_shader_job_wait(waiter->job);
+   return NULL;
+}
+
+TEST_F(shader_queue, concurrent_waits)
+{
+   struct count_job data = { 0, 1000, NULL, 0 };
+   struct waiter waiters[8];
+   struct shader_job *job;
+
+   block_workers();
+
+   job = _mesa_shader_queue_submit(ctx, count_job_func, &data);
+   ASSERT_TRUE(job != NULL);
+
+   for (unsigned i = 0; i < Elements(waiters); i++) {
+      waiters[i].job = job;
+      ASSERT_EQ(0, pthread_create(&waiters[i].thread, NULL,
+                                  waiter_main, &waiters[i]));
+   }
+   for (unsigned i = 0; i < Elements(waiters); i++)
+      pthread_join(waiters[i].thread, NULL);
+
+   EXPECT_TRUE(_mesa_shader_job_is_done(job));
+   EXPECT_EQ(1u, count_job_runs(&data));
+
+   _mesa_shader_job_reference(&job, NULL);
+}
+
+TEST_F(shader_queue, fini_with_queued_jobs)
+{
+   struct gl_context *other =
+      (struct gl_context *) calloc(1, sizeof *other);
+   struct count_job data[64];
+   struct shader_job *jobs[64];
+
+   other->Shader.MaxCompilerThreads = ~0u;
+   _mesa_shader_queue_init(other);
+
+   memset(data, 0, sizeof data);
+   for (unsigned i = 0; i < Elements(jobs); i++) {
+      data[i].delay_us = 200;
+      jobs[i] = _mesa_shader_queue_submit(other, count_job_func, &data[i]);
+      ASSERT_TRUE(jobs[i] != NULL);
+   }
+
+   /* Most of the jobs haven't started yet */
+   _mesa_shader_queue_fini(other);
+   EXPECT_EQ(0u, other->Shader.PendingJobs);
+
+   for (unsigned i = 0; i < Elements(jobs); i++) {
+      EXPECT_TRUE(_mesa_shader_job_is_done(jobs[i]));
+      EXPECT_EQ(1u, count_job_runs(&data[i]));
+      EXPECT_EQ(other, data[i].ctx);
+      _mesa_shader_job_reference(&jobs[i], NULL);
+   }
+
+   free(other);
+}
+
+TEST_F(shader_queue, disabled)
+{
+   struct count_job data = { 0, 0, NULL, 0 };
+
+   ctx->Shader.MaxCompilerThreads = 0;
+   EXPECT_TRUE(_mesa_shader_queue_submit(ctx, count_job_func, &data) == NULL);
+   EXPECT_EQ(0u, count_job_runs(&data));
+   EXPECT_EQ(0u, ctx->Shader.PendingJobs);
+}
+
+#endif /* HAVE_PTHREAD */
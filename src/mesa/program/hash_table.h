@@ -194,6 +194,12 @@ string_to_uint_map_ctor();
 void
 string_to_uint_map_dtor(struct string_to_uint_map *);
 
+void
+string_to_uint_map_iterate(struct string_to_uint_map *map,
+                           void (*func)(const char *key, unsigned value,
+                                        void *closure),
+                           void *closure);
+
 
 #ifdef __cplusplus
 }
@@ -272,7 +278,31 @@ public:
 	 free(dup_key);
    }
 
+   /**
+    * Call \c func for every mapping, in no particular order
+    */
+   void iterate(void (*func)(const char *key, unsigned value, void *closure),
+                void *closure)
+   {
+      struct iterate_closure c = { func, closure };
+
+      hash_table_call_foreach(this->ht, iterate_callback, &c);
+   }
+
 private:
+   struct iterate_closure {
+      void (*func)(const char *key, unsigned value, void *closure);
+      void *closure;
+   };
+
+   static void iterate_callback(const void *key, void *data, void *closure)
+   {
+      struct iterate_closure *c = (struct iterate_closure *) closure;
+
+      c->func((const char *) key, (unsigned) ((intptr_t) data - 1),
+              c->closure);
+   }
+
    static void delete_key(const void *key, void *data, void *closure)
    {
       (void) data;
@@ -45,6 +45,7 @@
 
 #include "main/mtypes.h"
 #include "main/shaderobj.h"
+#include "main/shader_cache.h"
 #include "program/hash_table.h"
 
 extern "C" {
@@ -2257,7 +2258,8 @@ ir_to_mesa_visitor::ir_to_mesa_visitor()
    next_temp = 1;
    next_signature_id = 1;
    current_function = NULL;
-   mem_ctx = ralloc_context(NULL);
+   /* Nothing allocated here outlives the visitor */
+   mem_ctx = ralloc_arena_context(NULL);
 }
 
 ir_to_mesa_visitor::~ir_to_mesa_visitor()
@@ -3090,22 +3092,15 @@ _mesa_ir_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
 
 
 /**
- * Compile a GLSL shader.  Called via glCompileShader().
+ * Run the GLSL compiler on the shader's source.
  */
-void
-_mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader)
+static void
+compile_shader(struct gl_context *ctx, struct gl_shader *shader)
 {
    struct _mesa_glsl_parse_state *state =
       new(shader) _mesa_glsl_parse_state(ctx, shader->Type, shader);
 
    const char *source = shader->Source;
-   /* Check if the user called glCompileShader without first calling
-    * glShaderSource.  This should fail to compile, but not raise a GL_ERROR.
-    */
-   if (source == NULL) {
-      shader->CompileStatus = GL_FALSE;
-      return;
-   }
 
    state->error = glcpp_preprocess(state, &source, &state->info_log,
 			     &ctx->Extensions, ctx);
@@ -3133,8 +3128,7 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader)
       /* Do some optimization at compile time to reduce shader IR size
        * and reduce later work if the same shader is linked multiple times
        */
-      while (do_common_optimization(shader->ir, false, false, 32))
-	 ;
+      do_common_optimization(shader->ir, false, false, 32);
 
       validate_ir_tree(shader->ir);
    }
@@ -3180,15 +3174,59 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader)
 
 
 /**
- * Link a GLSL shader program.  Called via glLinkProgram().
+ * Compile a GLSL shader.  Called via glCompileShader().
  */
 void
-_mesa_glsl_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
+_mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader)
+{
+   /* Check if the user called glCompileShader without first calling
+    * glShaderSource.  This should fail to compile, but not raise a GL_ERROR.
+    */
+   if (shader->Source == NULL) {
+      shader->CompileStatus = GL_FALSE;
+      return;
+   }
+
+   compile_shader(ctx, shader);
+
+   _mesa_shader_cache_record_shader(ctx, shader);
+}
+
+
+/**
+ * First part of linking, on the thread calling glLinkProgram(): drop the
+ * results of any earlier link, including the linked shaders and with them
+ * the driver's programs.
+ */
+void
+_mesa_glsl_link_shader_begin(struct gl_context *ctx,
+                             struct gl_shader_program *prog)
 {
    unsigned int i;
 
    _mesa_clear_shader_program_data(ctx, prog);
 
+   for (i = 0; i < MESA_SHADER_TYPES; i++) {
+      if (prog->_LinkedShaders[i] != NULL) {
+         ctx->Driver.DeleteShader(ctx, prog->_LinkedShaders[i]);
+         prog->_LinkedShaders[i] = NULL;
+      }
+   }
+}
+
+
+/**
+ * Second part of linking: link the GLSL IR, or restore it from the shader
+ * cache.  This doesn't
+ * touch any state outside the program and its shaders, so it may run on a
+ * worker thread.
+ */
+void
+_mesa_glsl_link_shader_run(struct gl_context *ctx,
+                           struct gl_shader_program *prog)
+{
+   unsigned int i;
+
    prog->LinkStatus = GL_TRUE;
 
    for (i = 0; i < prog->NumShaders; i++) {
@@ -3198,10 +3236,28 @@ _mesa_glsl_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
       }
    }
 
-   if (prog->LinkStatus) {
+   if (prog->LinkStatus && !_mesa_shader_cache_find_program(ctx, prog)) {
+      /* A failed restore may have left some state behind */
+      _mesa_clear_shader_program_data(ctx, prog);
+
       link_shaders(ctx, prog);
+
+      if (prog->LinkStatus) {
+         _mesa_program_binary_create(ctx, prog);
+         _mesa_shader_cache_store_program(ctx, prog);
+      }
    }
+}
 
+
+/**
+ * Last part of linking, back on the context's thread: generate the
+ * driver's code for the linked shaders.
+ */
+void
+_mesa_glsl_link_shader_end(struct gl_context *ctx,
+                           struct gl_shader_program *prog)
+{
    if (prog->LinkStatus) {
       if (!ctx->Driver.LinkShader(ctx, prog)) {
 	 prog->LinkStatus = GL_FALSE;
@@ -3220,4 +3276,16 @@ _mesa_glsl_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
    }
 }
 
+
+/**
+ * Link a GLSL shader program.  Called via glLinkProgram().
+ */
+void
+_mesa_glsl_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
+{
+   _mesa_glsl_link_shader_begin(ctx, prog);
+   _mesa_glsl_link_shader_run(ctx, prog);
+   _mesa_glsl_link_shader_end(ctx, prog);
+}
+
 } /* extern "C" */
@@ -40,3 +40,12 @@ string_to_uint_map_dtor(struct string_to_uint_map *map)
 {
    delete map;
 }
+
+extern "C" void
+string_to_uint_map_iterate(struct string_to_uint_map *map,
+                           void (*func)(const char *key, unsigned value,
+                                        void *closure),
+                           void *closure)
+{
+   map->iterate(func, closure);
+}
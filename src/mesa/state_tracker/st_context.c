@@ -30,6 +30,7 @@
 #include "main/api_exec.h"
 #include "main/context.h"
 #include "main/samplerobj.h"
+#include "main/shader_queue.h"
 #include "main/shaderobj.h"
 #include "main/version.h"
 #include "main/vtxfmt.h"
@@ -309,6 +310,11 @@ void st_destroy_context( struct st_context *st )
 
    _vbo_DestroyContext(st->ctx);
 
+   /* Links queued by this context may still be writing the linked shaders
+    * the variant walk below reads.
+    */
+   _mesa_shader_queue_finish(ctx);
+
    st_destroy_program_variants(st);
 
    _mesa_free_context_data(ctx);
@@ -34,6 +34,7 @@
 #include "main/imports.h"
 #include "main/hash.h"
 #include "main/mtypes.h"
+#include "main/shaderobj.h"
 #include "program/prog_parameter.h"
 #include "program/prog_print.h"
 #include "program/programopt.h"
@@ -1257,6 +1258,13 @@ destroy_shader_program_variants_cb(GLuint key, void *data, void *userData)
             destroy_program_variants(st, shProg->Shaders[i]->Program);
          }
 
+         /* A link queued by another context may still be writing the
+          * linked shaders.  They can't have variants yet, as those are only
+          * made once ctx->Driver.LinkShader has been called for them.
+          */
+         if (!_mesa_shader_program_link_done(shProg))
+            break;
+
 	 for (i = 0; i < Elements(shProg->_LinkedShaders); i++) {
 	    if (shProg->_LinkedShaders[i])
                destroy_program_variants(st, shProg->_LinkedShaders[i]->Program);